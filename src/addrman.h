@@ -16,6 +16,7 @@
 #include <map>
 #include <set>
 #include <stdint.h>
+#include <unordered_map>
 #include <vector>
 
 /**
@@ -169,6 +170,63 @@ public:
 //! the maximum time we'll spend trying to resolve a tried table collision, in seconds
 static const int64_t ADDRMAN_TEST_WINDOW = 40*60; // 40 minutes
 
+/**
+ * Salted hasher for CNetAddr, so entries can be looked up in a hash table
+ * without revealing the table layout to peers choosing the addresses.
+ */
+class CNetAddrHasher
+{
+private:
+    uint64_t m_k0, m_k1;
+
+public:
+    CNetAddrHasher();
+    size_t operator()(const CNetAddr& addr) const;
+};
+
+/**
+ * The occupied positions of a bucket table, kept densely so that a uniformly
+ * random occupied position can be picked in constant time, however sparse the
+ * table is.
+ */
+class CAddrTablePositions
+{
+private:
+    //! occupied positions (bucket * ADDRMAN_BUCKET_SIZE + position), unordered
+    std::vector<int> m_positions;
+    //! index of every position in m_positions, or -1 if unoccupied
+    std::vector<int> m_index;
+
+public:
+    explicit CAddrTablePositions(size_t count) : m_index(count, -1) {}
+
+    void Insert(int position)
+    {
+        if (m_index[position] != -1) return;
+        m_index[position] = m_positions.size();
+        m_positions.push_back(position);
+    }
+
+    void Erase(int position)
+    {
+        int index = m_index[position];
+        if (index == -1) return;
+        m_positions[index] = m_positions.back();
+        m_index[m_positions[index]] = index;
+        m_positions.pop_back();
+        m_index[position] = -1;
+    }
+
+    void Clear()
+    {
+        for (int position : m_positions) m_index[position] = -1;
+        m_positions.clear();
+    }
+
+    size_t size() const { return m_positions.size(); }
+    int operator[](size_t index) const { return m_positions[index]; }
+};
+
 /**
  * Stochastical (IP) address manager
  */
@@ -179,14 +237,14 @@ protected:
     mutable CCriticalSection cs;
 
 private:
-    //! last used nId
-    int nIdCount GUARDED_BY(cs);
+    //! table with information about all nIds, indexed by nId (unused slots have nRandomPos == -1)
+    std::vector<CAddrInfo> vInfo GUARDED_BY(cs);
 
-    //! table with information about all nIds
-    std::map<int, CAddrInfo> mapInfo GUARDED_BY(cs);
+    //! unused slots in vInfo, reused before vInfo grows
+    std::vector<int> vFreeIds GUARDED_BY(cs);
 
     //! find an nId based on its network address
-    std::map<CNetAddr, int> mapAddr GUARDED_BY(cs);
+    std::unordered_map<CNetAddr, int, CNetAddrHasher> mapAddr GUARDED_BY(cs);
 
     //! randomly-ordered vector of all nIds
     std::vector<int> vRandom GUARDED_BY(cs);
@@ -203,6 +261,10 @@ private:
     //! list of "new" buckets
     int vvNew[ADDRMAN_NEW_BUCKET_COUNT][ADDRMAN_BUCKET_SIZE] GUARDED_BY(cs);
 
+    //! occupied positions in vvTried and vvNew, for constant time selection
+    CAddrTablePositions m_tried_positions GUARDED_BY(cs){ADDRMAN_TRIED_BUCKET_COUNT * ADDRMAN_BUCKET_SIZE};
+    CAddrTablePositions m_new_positions GUARDED_BY(cs){ADDRMAN_NEW_BUCKET_COUNT * ADDRMAN_BUCKET_SIZE};
+
     //! last time Good was called (memory only)
     int64_t nLastGood GUARDED_BY(cs);
 
@@ -223,6 +285,13 @@ protected:
     //! nTime and nServices of the found node are updated, if necessary.
     CAddrInfo* Create(const CAddress &addr, const CNetAddr &addrSource, int *pnId = nullptr) EXCLUSIVE_LOCKS_REQUIRED(cs);
 
+    //! Whether nId refers to an entry in use.
+    bool IsInUse(int nId) const EXCLUSIVE_LOCKS_REQUIRED(cs) { return nId >= 0 && (size_t)nId < vInfo.size() && vInfo[nId].nRandomPos != -1; }
+
+    //! Set a position in the "tried" or "new" table to nId (or -1 to empty it).
+    void SetTried(int nKBucket, int nKBucketPos, int nId) EXCLUSIVE_LOCKS_REQUIRED(cs);
+    void SetNew(int nUBucket, int nUBucketPos, int nId) EXCLUSIVE_LOCKS_REQUIRED(cs);
+
     //! Swap two elements in vRandom.
     void SwapRandom(unsigned int nRandomPos1, unsigned int nRandomPos2) EXCLUSIVE_LOCKS_REQUIRED(cs);
 
@@ -311,11 +380,11 @@ public:
 
         int nUBuckets = ADDRMAN_NEW_BUCKET_COUNT ^ (1 << 30);
         s << nUBuckets;
-        std::map<int, int> mapUnkIds;
+        std::vector<int> vUnkIds(vInfo.size(), -1);
         int nIds = 0;
-        for (const auto& entry : mapInfo) {
-            mapUnkIds[entry.first] = nIds;
-            const CAddrInfo &info = entry.second;
+        for (size_t n = 0; n < vInfo.size(); n++) {
+            vUnkIds[n] = nIds;
+            const CAddrInfo &info = vInfo[n];
             if (info.nRefCount) {
                 assert(nIds != nNew); // this means nNew was wrong, oh ow
                 s << info;
@@ -323,8 +392,7 @@ public:
             }
         }
         nIds = 0;
-        for (const auto& entry : mapInfo) {
-            const CAddrInfo &info = entry.second;
+        for (const CAddrInfo& info : vInfo) {
             if (info.fInTried) {
                 assert(nIds != nTried); // this means nTried was wrong, oh ow
                 s << info;
@@ -340,7 +408,7 @@ public:
             s << nSize;
             for (int i = 0; i < ADDRMAN_BUCKET_SIZE; i++) {
                 if (vvNew[bucket][i] != -1) {
-                    int nIndex = mapUnkIds[vvNew[bucket][i]];
+                    int nIndex = vUnkIds[vvNew[bucket][i]];
                     s << nIndex;
                 }
             }
@@ -377,8 +445,9 @@ public:
         }
 
         // Deserialize entries from the new table.
+        vInfo.resize(nNew);
         for (int n = 0; n < nNew; n++) {
-            CAddrInfo &info = mapInfo[n];
+            CAddrInfo &info = vInfo[n];
             s >> info;
             mapAddr[info] = n;
             info.nRandomPos = vRandom.size();
@@ -389,12 +458,11 @@ public:
                 int nUBucket = info.GetNewBucket(nKey);
                 int nUBucketPos = info.GetBucketPosition(nKey, true, nUBucket);
                 if (vvNew[nUBucket][nUBucketPos] == -1) {
-                    vvNew[nUBucket][nUBucketPos] = n;
+                    SetNew(nUBucket, nUBucketPos, n);
                     info.nRefCount++;
                 }
             }
         }
-        nIdCount = nNew;
 
         // Deserialize entries from the tried table.
         int nLost = 0;
@@ -404,13 +472,13 @@ public:
             int nKBucket = info.GetTriedBucket(nKey);
             int nKBucketPos = info.GetBucketPosition(nKey, false, nKBucket);
             if (vvTried[nKBucket][nKBucketPos] == -1) {
+                int nId = vInfo.size();
                 info.nRandomPos = vRandom.size();
                 info.fInTried = true;
-                vRandom.push_back(nIdCount);
-                mapInfo[nIdCount] = info;
-                mapAddr[info] = nIdCount;
-                vvTried[nKBucket][nKBucketPos] = nIdCount;
-                nIdCount++;
+                vRandom.push_back(nId);
+                vInfo.push_back(info);
+                mapAddr[info] = nId;
+                SetTried(nKBucket, nKBucketPos, nId);
             } else {
                 nLost++;
             }
@@ -425,11 +493,11 @@ public:
                 int nIndex = 0;
                 s >> nIndex;
                 if (nIndex >= 0 && nIndex < nNew) {
-                    CAddrInfo &info = mapInfo[nIndex];
+                    CAddrInfo &info = vInfo[nIndex];
                     int nUBucketPos = info.GetBucketPosition(nKey, true, bucket);
                     if (nVersion == 1 && nUBuckets == ADDRMAN_NEW_BUCKET_COUNT && vvNew[bucket][nUBucketPos] == -1 && info.nRefCount < ADDRMAN_NEW_BUCKETS_PER_ADDRESS) {
                         info.nRefCount++;
-                        vvNew[bucket][nUBucketPos] = nIndex;
+                        SetNew(bucket, nUBucketPos, nIndex);
                     }
                 }
             }
@@ -437,13 +505,10 @@ public:
 
         // Prune new entries with refcount 0 (as a result of collisions).
         int nLostUnk = 0;
-        for (std::map<int, CAddrInfo>::const_iterator it = mapInfo.begin(); it != mapInfo.end(); ) {
-            if (it->second.fInTried == false && it->second.nRefCount == 0) {
-                std::map<int, CAddrInfo>::const_iterator itCopy = it++;
-                Delete(itCopy->first);
+        for (int n = 0; n < (int)vInfo.size(); n++) {
+            if (IsInUse(n) && vInfo[n].fInTried == false && vInfo[n].nRefCount == 0) {
+                Delete(n);
                 nLostUnk++;
-            } else {
-                it++;
             }
         }
         if (nLost + nLostUnk > 0) {
@@ -469,12 +534,16 @@ public:
             }
         }
 
-        nIdCount = 0;
+        m_tried_positions.Clear();
+        m_new_positions.Clear();
+
         nTried = 0;
         nNew = 0;
         nLastGood = 1; //Initially at 1 so that "never" is strictly worse.
-        mapInfo.clear();
+        vInfo.clear();
+        vFreeIds.clear();
         mapAddr.clear();
+        m_tried_collisions.clear();
     }
 
     CAddrMan()
@@ -13,7 +13,7 @@
 #include <list>
 #include <vector>
 
-static void AssembleBlock(benchmark::State& state)
+static CScript FillMempool()
 {
     const std::vector<unsigned char> op_true{OP_TRUE};
     CScriptWitness witness;
@@ -45,9 +45,30 @@ static void AssembleBlock(benchmark::State& state)
         }
     }
 
+    return SCRIPT_PUB;
+}
+
+static void AssembleBlock(benchmark::State& state)
+{
+    const CScript script_pub{FillMempool()};
+
+    // Templates on an unchanged tip are refreshed from the cached selection.
+    while (state.KeepRunning()) {
+        PrepareBlock(script_pub);
+    }
+}
+
+static void AssembleBlockFromScratch(benchmark::State& state)
+{
+    const CScript script_pub{FillMempool()};
+
     while (state.KeepRunning()) {
-        PrepareBlock(SCRIPT_PUB);
+        // Make the mempool look changed, so that every template runs package
+        // selection over the whole mempool.
+        ::mempool.AddTransactionsUpdated(1);
+        PrepareBlock(script_pub);
     }
 }
 
 BENCHMARK(AssembleBlock, 700);
+BENCHMARK(AssembleBlockFromScratch, 700);
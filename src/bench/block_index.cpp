@@ -0,0 +1,136 @@
+// Copyright (c) 2019 The Vccoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <blockmap.h>
+#include <chain.h>
+#include <random.h>
+#include <tinyformat.h>
+
+#include <algorithm>
+#include <iostream>
+#include <unordered_map>
+
+#ifdef __linux__
+#include <stdio.h>
+#include <unistd.h>
+#endif
+
+static const int NUM_HEADERS = 1000 * 1000;
+
+struct SyntheticHeader
+{
+    uint256 hash;
+    uint256 hash_prev;
+    int height;
+};
+
+/** A chain of NUM_HEADERS headers in random order, like the block index database returns them. */
+static std::vector<SyntheticHeader> BuildHeaders()
+{
+    FastRandomContext rng(true);
+    std::vector<SyntheticHeader> headers(NUM_HEADERS);
+    for (int i = 0; i < NUM_HEADERS; ++i) {
+        headers[i].hash = rng.rand256();
+        headers[i].hash_prev = i > 0 ? headers[i - 1].hash : uint256();
+        headers[i].height = i;
+    }
+    std::shuffle(headers.begin(), headers.end(), rng);
+    return headers;
+}
+
+/** Resident memory of the process in bytes, or 0 if unknown. */
+static size_t ResidentMemory()
+{
+#ifdef __linux__
+    FILE* file = fopen("/proc/self/statm", "r");
+    if (!file) return 0;
+    unsigned long size = 0, resident = 0;
+    const bool ok = fscanf(file, "%lu %lu", &size, &resident) == 2;
+    fclose(file);
+    return ok ? resident * sysconf(_SC_PAGESIZE) : 0;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * Load the headers the way CChainState::LoadBlockIndex does, with insert
+ * returning the block index of a hash and creating it if needed.
+ */
+template <typename Insert>
+static void LoadHeaders(const std::vector<SyntheticHeader>& headers, Insert insert)
+{
+    std::vector<CBlockIndex*> by_height(headers.size());
+    for (const SyntheticHeader& header : headers) {
+        CBlockIndex* pindex = insert(header.hash);
+        pindex->pprev = insert(header.hash_prev);
+        pindex->nHeight = header.height;
+        pindex->nStatus = BLOCK_VALID_TREE;
+        by_height[header.height] = pindex;
+    }
+    for (CBlockIndex* pindex : by_height) {
+        pindex->BuildSkip();
+    }
+}
+
+/**
+ * Startup time of loading a million headers. The resident memory of the loaded
+ * index is reported once on stderr, as the benchmark framework only reports
+ * times.
+ */
+static void LoadBlockIndexArena(benchmark::State& state)
+{
+    const std::vector<SyntheticHeader> headers = BuildHeaders();
+    bool reported = false;
+    while (state.KeepRunning()) {
+        const size_t resident_before = ResidentMemory();
+        BlockMap map;
+        LoadHeaders(headers, [&map](const uint256& hash) -> CBlockIndex* {
+            if (hash.IsNull()) return nullptr;
+            return map.emplace_index(hash).first->second;
+        });
+        if (!reported) {
+            tfm::format(std::cerr, "LoadBlockIndexArena: %u headers, %u MiB resident, %u MiB allocated\n",
+                        map.size(), (ResidentMemory() - resident_before) >> 20, map.DynamicMemoryUsage() >> 20);
+            reported = true;
+        }
+    }
+}
+
+struct BlockHasher
+{
+    size_t operator()(const uint256& hash) const { return ReadLE64(hash.begin()); }
+};
+
+/** The block index as it was kept before BlockMap, for comparison. */
+static void LoadBlockIndexHeap(benchmark::State& state)
+{
+    const std::vector<SyntheticHeader> headers = BuildHeaders();
+    bool reported = false;
+    while (state.KeepRunning()) {
+        const size_t resident_before = ResidentMemory();
+        std::unordered_map<uint256, CBlockIndex*, BlockHasher> map;
+        LoadHeaders(headers, [&map](const uint256& hash) -> CBlockIndex* {
+            if (hash.IsNull()) return nullptr;
+            auto it = map.find(hash);
+            if (it != map.end()) return it->second;
+            CBlockIndex* pindex = new CBlockIndex();
+            it = map.insert(std::make_pair(hash, pindex)).first;
+            pindex->phashBlock = &it->first;
+            return pindex;
+        });
+        if (!reported) {
+            tfm::format(std::cerr, "LoadBlockIndexHeap: %u headers, %u MiB resident\n",
+                        map.size(), (ResidentMemory() - resident_before) >> 20);
+            reported = true;
+        }
+        for (const auto& entry : map) {
+            delete entry.second;
+        }
+    }
+}
+
+BENCHMARK(LoadBlockIndexArena, 1);
+BENCHMARK(LoadBlockIndexHeap, 1);
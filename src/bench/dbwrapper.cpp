@@ -0,0 +1,139 @@
+// Copyright (c) 2019 The Vccoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <coins.h>
+#include <dbwrapper.h>
+#include <random.h>
+#include <streams.h>
+#include <txdb.h>
+#include <uint256.h>
+
+#include <vector>
+
+static constexpr size_t NUM_ENTRIES = 20000;
+static constexpr size_t CACHE_SIZE = 8 << 20;
+
+/** A chainstate-shaped key: prefix, txid and output index. */
+struct CoinKey
+{
+    uint256 txid;
+    uint32_t n;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        char prefix = 'C';
+        READWRITE(prefix);
+        READWRITE(txid);
+        READWRITE(VARINT(n));
+    }
+};
+
+static std::vector<uint256> CreateKeys()
+{
+    FastRandomContext rng(true);
+    std::vector<uint256> keys;
+    keys.reserve(NUM_ENTRIES);
+    for (size_t i = 0; i < NUM_ENTRIES; ++i) {
+        keys.push_back(rng.rand256());
+    }
+    return keys;
+}
+
+// Write coins in batches and read back a random half of them plus as many
+// missing ones, like block connection does.
+static void DBWrapperChainstate(benchmark::State& state)
+{
+    const std::vector<uint256> keys = CreateKeys();
+    const std::vector<unsigned char> value(40, 0x5a);
+    FastRandomContext rng(true);
+
+    while (state.KeepRunning()) {
+        CDBWrapper db("dbwrapper_bench", CACHE_SIZE, true, false, true, GetDBOptions("chainstate"));
+        for (size_t i = 0; i < keys.size(); i += 1000) {
+            CDBBatch batch(db);
+            for (size_t j = i; j < i + 1000; ++j) {
+                batch.Write(CoinKey{keys[j], 0}, value);
+            }
+            db.WriteBatch(batch);
+        }
+        std::vector<unsigned char> read;
+        for (size_t i = 0; i < keys.size() / 2; ++i) {
+            const uint256& txid = keys[rng.randrange(keys.size())];
+            bool found = db.Read(CoinKey{txid, 0}, read);
+            assert(found);
+            found = db.Read(CoinKey{txid, 1}, read);
+            assert(!found);
+        }
+    }
+}
+
+// Index transaction positions in bulk and look up existing ones, like
+// -txindex does.
+static void DBWrapperTxIndex(benchmark::State& state)
+{
+    const std::vector<uint256> keys = CreateKeys();
+    FastRandomContext rng(true);
+
+    while (state.KeepRunning()) {
+        CDBWrapper db("dbwrapper_bench", CACHE_SIZE, true, false, false, GetDBOptions("txindex"));
+        CDBBatch batch(db);
+        for (size_t i = 0; i < keys.size(); ++i) {
+            batch.Write(std::make_pair('t', keys[i]), std::make_pair((uint32_t)(i / 1000), (uint32_t)i));
+        }
+        db.WriteBatch(batch);
+        std::pair<uint32_t, uint32_t> pos;
+        for (size_t i = 0; i < keys.size() / 2; ++i) {
+            bool found = db.Read(std::make_pair('t', keys[rng.randrange(keys.size())]), pos);
+            assert(found);
+        }
+    }
+}
+
+// Look up coins in the chainstate database, half of which exist.
+static void CoinsViewDBGetCoin(benchmark::State& state)
+{
+    const std::vector<uint256> keys = CreateKeys();
+    CCoinsViewDB db("chainstate", CACHE_SIZE, true, false);
+    {
+        CCoinsViewCache cache(&db);
+        for (const uint256& txid : keys) {
+            cache.AddCoin(COutPoint(txid, 0), Coin(CTxOut(COIN, CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 1) << OP_EQUALVERIFY << OP_CHECKSIG), 1, false), false);
+        }
+        cache.SetBestBlock(keys[0]);
+        bool flushed = cache.Flush();
+        assert(flushed);
+    }
+
+    FastRandomContext rng(true);
+    Coin coin;
+    while (state.KeepRunning()) {
+        const uint256& txid = keys[rng.randrange(keys.size())];
+        bool found = db.GetCoin(COutPoint(txid, 0), coin);
+        assert(found);
+        found = db.GetCoin(COutPoint(txid, 1), coin);
+        assert(!found);
+    }
+}
+
+// Deobfuscate a typical block index or undo sized value.
+static void DBWrapperXor(benchmark::State& state)
+{
+    FastRandomContext rng(true);
+    const std::vector<unsigned char> key = rng.randbytes(8);
+    CDataStream stream(SER_DISK, CLIENT_VERSION);
+    stream << rng.randbytes(4096);
+
+    while (state.KeepRunning()) {
+        stream.Xor(key);
+    }
+}
+
+BENCHMARK(CoinsViewDBGetCoin, 200000);
+BENCHMARK(DBWrapperChainstate, 2);
+BENCHMARK(DBWrapperTxIndex, 2);
+BENCHMARK(DBWrapperXor, 100000);
@@ -5,15 +5,23 @@
 #include <bench/bench.h>
 #include <blockfilter.h>
 
-static void ConstructGCSFilter(benchmark::State& state)
+static GCSFilter::ElementSet BuildElements(int count, int salt)
 {
     GCSFilter::ElementSet elements;
-    for (int i = 0; i < 10000; ++i) {
+    for (int i = 0; i < count; ++i) {
         GCSFilter::Element element(32);
         element[0] = static_cast<unsigned char>(i);
         element[1] = static_cast<unsigned char>(i >> 8);
+        element[2] = static_cast<unsigned char>(salt);
+        element[3] = static_cast<unsigned char>(salt >> 8);
         elements.insert(std::move(element));
     }
+    return elements;
+}
+
+static void ConstructGCSFilter(benchmark::State& state)
+{
+    GCSFilter::ElementSet elements = BuildElements(10000, 0);
 
     uint64_t siphash_k0 = 0;
     while (state.KeepRunning()) {
@@ -23,15 +31,21 @@ static void ConstructGCSFilter(benchmark::State& state)
     }
 }
 
-static void MatchGCSFilter(benchmark::State& state)
+static void DecodeGCSFilter(benchmark::State& state)
 {
-    GCSFilter::ElementSet elements;
-    for (int i = 0; i < 10000; ++i) {
-        GCSFilter::Element element(32);
-        element[0] = static_cast<unsigned char>(i);
-        element[1] = static_cast<unsigned char>(i >> 8);
-        elements.insert(std::move(element));
+    GCSFilter::ElementSet elements = BuildElements(10000, 0);
+    GCSFilter filter({0, 0, 20, 1 << 20}, elements);
+    const std::vector<unsigned char>& encoded = filter.GetEncoded();
+
+    while (state.KeepRunning()) {
+        // Reconstructing a filter decodes every element to check the encoding.
+        GCSFilter decoded(filter.GetParams(), encoded);
     }
+}
+
+static void MatchGCSFilter(benchmark::State& state)
+{
+    GCSFilter::ElementSet elements = BuildElements(10000, 0);
     GCSFilter filter({0, 0, 20, 1 << 20}, elements);
 
     while (state.KeepRunning()) {
@@ -39,5 +53,25 @@ static void MatchGCSFilter(benchmark::State& state)
     }
 }
 
+static void MatchAnyGCSFilters(benchmark::State& state)
+{
+    // Filters of 1000 blocks, matched against the scripts of a wallet.
+    std::vector<GCSFilter> filters;
+    for (int i = 0; i < 1000; ++i) {
+        filters.emplace_back(GCSFilter::Params(i, 0, BASIC_FILTER_P, BASIC_FILTER_M), BuildElements(100, i));
+    }
+    std::vector<const GCSFilter*> ptrs;
+    for (const GCSFilter& filter : filters) {
+        ptrs.push_back(&filter);
+    }
+    GCSFilter::ElementSet query = BuildElements(100, 0xFFFF);
+
+    while (state.KeepRunning()) {
+        GCSFilter::MatchAny(ptrs, query);
+    }
+}
+
 BENCHMARK(ConstructGCSFilter, 1000);
+BENCHMARK(DecodeGCSFilter, 1000);
 BENCHMARK(MatchGCSFilter, 50 * 1000);
+BENCHMARK(MatchAnyGCSFilters, 10);
@@ -131,4 +131,75 @@ static void MempoolEviction(benchmark::State& state)
     }
 }
 
+static CMutableTransaction CreateSpendingTx(const std::vector<COutPoint>& prevouts, size_t num_outputs)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(prevouts.size());
+    for (size_t i = 0; i < prevouts.size(); ++i) {
+        tx.vin[i].prevout = prevouts[i];
+        tx.vin[i].scriptSig = CScript() << OP_1;
+    }
+    tx.vout.resize(num_outputs);
+    for (CTxOut& out : tx.vout) {
+        out.scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+        out.nValue = COIN;
+    }
+    return tx;
+}
+
+// A single chain of transactions, each spending the previous one. Every
+// addition walks all ancestors, removing the root walks all descendants.
+static void MempoolDeepChain(benchmark::State& state)
+{
+    constexpr size_t DEPTH = 500;
+
+    std::vector<CTransactionRef> chain;
+    COutPoint prevout(uint256S("01"), 0);
+    for (size_t i = 0; i < DEPTH; ++i) {
+        chain.push_back(MakeTransactionRef(CreateSpendingTx({prevout}, 1)));
+        prevout = COutPoint(chain.back()->GetHash(), 0);
+    }
+
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+
+    while (state.KeepRunning()) {
+        for (const auto& tx : chain) {
+            AddTx(tx, 1000LL, pool);
+        }
+        pool.removeRecursive(*chain.front());
+        assert(pool.size() == 0);
+    }
+}
+
+// One parent with many children, all of which are spent by a single
+// transaction, so that its ancestor walk meets every child.
+static void MempoolWideFanout(benchmark::State& state)
+{
+    constexpr size_t WIDTH = 500;
+
+    std::vector<CTransactionRef> txs;
+    txs.push_back(MakeTransactionRef(CreateSpendingTx({COutPoint(uint256S("01"), 0)}, WIDTH)));
+    const uint256 parent_hash = txs.front()->GetHash();
+    std::vector<COutPoint> child_outputs;
+    for (size_t i = 0; i < WIDTH; ++i) {
+        txs.push_back(MakeTransactionRef(CreateSpendingTx({COutPoint(parent_hash, i)}, 1)));
+        child_outputs.emplace_back(txs.back()->GetHash(), 0);
+    }
+    txs.push_back(MakeTransactionRef(CreateSpendingTx(child_outputs, 1)));
+
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+
+    while (state.KeepRunning()) {
+        for (const auto& tx : txs) {
+            AddTx(tx, 1000LL, pool);
+        }
+        pool.removeRecursive(*txs.front());
+        assert(pool.size() == 0);
+    }
+}
+
 BENCHMARK(MempoolEviction, 41000);
+BENCHMARK(MempoolDeepChain, 10);
+BENCHMARK(MempoolWideFanout, 50);
@@ -0,0 +1,91 @@
+// Copyright (c) 2019 The Vccoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <policy/rbf.h>
+#include <txmempool.h>
+
+#include <vector>
+
+static constexpr int NUM_CHAINS = 200;
+static constexpr int CHAIN_LENGTH = 10;
+
+static void AddTx(const CTransactionRef& tx, const CAmount& fee, CTxMemPool& pool) EXCLUSIVE_LOCKS_REQUIRED(cs_main, pool.cs)
+{
+    LockPoints lp;
+    pool.addUnchecked(CTxMemPoolEntry(tx, fee, /* time */ 0, /* height */ 1, /* spendsCoinbase */ false, /* sigOpCost */ 4, lp));
+}
+
+/** Chains of transactions, each spending the single output of the previous one. */
+static std::vector<std::vector<CTransactionRef>> CreateChains()
+{
+    std::vector<std::vector<CTransactionRef>> chains(NUM_CHAINS);
+    for (int i = 0; i < NUM_CHAINS; ++i) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].scriptSig = CScript() << i << OP_1;
+        tx.vout.resize(1);
+        tx.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+        tx.vout[0].nValue = 10 * COIN;
+        for (int j = 0; j < CHAIN_LENGTH; ++j) {
+            chains[i].push_back(MakeTransactionRef(tx));
+            tx.vin[0].prevout = COutPoint(chains[i].back()->GetHash(), 0);
+            tx.vin[0].scriptSig = CScript() << OP_1;
+        }
+    }
+    return chains;
+}
+
+// Evaluate a replacement of many childless transactions, as done for every
+// replacement that is then rejected for paying too little.
+static void RbfEvaluateConflicts(benchmark::State& state)
+{
+    const std::vector<std::vector<CTransactionRef>> chains = CreateChains();
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+
+    std::set<uint256> conflicts;
+    for (const auto& chain : chains) {
+        AddTx(chain[0], 1000, pool);
+        if (conflicts.size() < 100) conflicts.insert(chain[0]->GetHash());
+    }
+    const CTxMemPool::setEntries setIterConflicting = pool.GetIterSet(conflicts);
+
+    while (state.KeepRunning()) {
+        CTxMemPool::setEntries allConflicting;
+        const ReplacementCost cost = GetReplacementCost(pool, setIterConflicting, allConflicting);
+        assert(cost.nCount == setIterConflicting.size());
+    }
+}
+
+// Replace the root of a chain, evicting the chain, and add it back.
+static void RbfReplaceChain(benchmark::State& state)
+{
+    const std::vector<std::vector<CTransactionRef>> chains = CreateChains();
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+
+    for (const auto& chain : chains) {
+        for (const CTransactionRef& tx : chain) {
+            AddTx(tx, 1000, pool);
+        }
+    }
+
+    size_t i = 0;
+    while (state.KeepRunning()) {
+        const std::vector<CTransactionRef>& chain = chains[i++ % chains.size()];
+        const CTxMemPool::setEntries setIterConflicting = pool.GetIterSet({chain[0]->GetHash()});
+        CTxMemPool::setEntries allConflicting;
+        const ReplacementCost cost = GetReplacementCost(pool, setIterConflicting, allConflicting);
+        assert(cost.nCount == CHAIN_LENGTH);
+        pool.CalculateDescendants(*setIterConflicting.begin(), allConflicting);
+        pool.RemoveStaged(allConflicting, false, MemPoolRemovalReason::REPLACED);
+        for (const CTransactionRef& tx : chain) {
+            AddTx(tx, 1000, pool);
+        }
+    }
+}
+
+BENCHMARK(RbfEvaluateConflicts, 5000);
+BENCHMARK(RbfReplaceChain, 500);
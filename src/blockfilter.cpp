@@ -6,6 +6,7 @@
 #include <sstream>
 
 #include <blockfilter.h>
+#include <crypto/common.h>
 #include <crypto/siphash.h>
 #include <hash.h>
 #include <primitives/transaction.h>
@@ -22,35 +23,194 @@ static const std::map<BlockFilterType, std::string> g_filter_types = {
     {BlockFilterType::BASIC, "basic"},
 };
 
-template <typename OStream>
-static void GolombRiceEncode(BitStreamWriter<OStream>& VCwriter, uint8_t P, uint64_t x)
+/** Mask of the n least significant bits of a 64-bit word, for n in [0, 64]. */
+static inline uint64_t LowMask(int n)
 {
-    // Write quotient as unary-encoded: q 1's followed by one 0.
-    uint64_t q = x >> P;
-    while (q > 0) {
-        int nVCs = q <= 64 ? static_cast<int>(q) : 64;
-        VCwriter.Write(~0ULL, nVCs);
-        q -= nVCs;
+    return n >= 64 ? ~uint64_t{0} : (uint64_t{1} << n) - 1;
+}
+
+/**
+ * Golomb-Rice encodes values into a byte vector. Bits are collected in a
+ * 64-bit word and appended to the vector eight bytes at a time, rather than
+ * written to a stream one byte at a time.
+ */
+class GolombRiceWriter
+{
+private:
+    std::vector<unsigned char>& m_out;
+
+    /// Bits not yet appended to m_out, most significant first. Only the top
+    /// m_bits bits are in use.
+    uint64_t m_buffer{0};
+    int m_bits{0};
+
+    /** Write the nbits least significant bits of data. */
+    void Write(uint64_t data, int nbits)
+    {
+        while (nbits > 0) {
+            const int n = std::min(64 - m_bits, nbits);
+            m_buffer |= ((data >> (nbits - n)) & LowMask(n)) << (64 - m_bits - n);
+            m_bits += n;
+            nbits -= n;
+            if (m_bits == 64) {
+                unsigned char word[8];
+                WriteBE64(word, m_buffer);
+                m_out.insert(m_out.end(), word, word + 8);
+                m_buffer = 0;
+                m_bits = 0;
+            }
+        }
     }
-    VCwriter.Write(0, 1);
 
-    // Write the remainder in P VCs. Since the remainder is just the bottom
-    // P VCs of x, there is no need to mask first.
-    VCwriter.Write(x, P);
-}
+public:
+    explicit GolombRiceWriter(std::vector<unsigned char>& out) : m_out(out) {}
+
+    void Encode(uint8_t P, uint64_t x)
+    {
+        // Write quotient as unary-encoded: q 1's followed by one 0.
+        uint64_t q = x >> P;
+        while (q >= 64) {
+            Write(~uint64_t{0}, 64);
+            q -= 64;
+        }
+        Write(LowMask(q) << 1, static_cast<int>(q) + 1);
+
+        // Write the remainder in P bits. Since the remainder is just the
+        // bottom P bits of x, there is no need to mask first.
+        Write(x, P);
+    }
+
+    /** Append the remaining bits, padding with 0's to the next byte boundary. */
+    void Flush()
+    {
+        for (int shift = 56; m_bits > 0; shift -= 8, m_bits -= 8) {
+            m_out.push_back(static_cast<unsigned char>(m_buffer >> shift));
+        }
+        m_buffer = 0;
+        m_bits = 0;
+    }
+};
 
-template <typename IStream>
-static uint64_t GolombRiceDecode(BitStreamReader<IStream>& VCreader, uint8_t P)
+/**
+ * Decodes Golomb-Rice coded values from a byte range, reading it a 64-bit
+ * word at a time. Throws std::ios_base::failure when reading past the end.
+ */
+class GolombRiceReader
 {
-    // Read unary-encoded quotient: q 1's followed by one 0.
-    uint64_t q = 0;
-    while (VCreader.Read(1) == 1) {
-        ++q;
+private:
+    const unsigned char* const m_begin;
+    const unsigned char* const m_end;
+    const unsigned char* m_pos;
+
+    /// Bits read from the range but not decoded yet, most significant
+    /// first. Only the top m_bits bits are in use.
+    uint64_t m_buffer{0};
+    int m_bits{0};
+
+    void Refill()
+    {
+        if (m_bits == 0 && m_end - m_pos >= 8) {
+            m_buffer = ReadBE64(m_pos);
+            m_pos += 8;
+            m_bits = 64;
+            return;
+        }
+        while (m_bits <= 56 && m_pos != m_end) {
+            m_buffer |= static_cast<uint64_t>(*m_pos++) << (56 - m_bits);
+            m_bits += 8;
+        }
+        if (m_bits == 0) {
+            throw std::ios_base::failure("GolombRiceReader: end of data");
+        }
     }
 
-    uint64_t r = VCreader.Read(P);
+    /** Drop the n most significant buffered bits, for n in [1, m_bits]. */
+    void Skip(int n)
+    {
+        m_buffer = n >= 64 ? 0 : m_buffer << n;
+        m_bits -= n;
+    }
 
-    return (q << P) + r;
+    /** Read nbits bits, returned in the least significant bits. */
+    uint64_t Read(int nbits)
+    {
+        uint64_t data = 0;
+        while (nbits > 0) {
+            if (m_bits == 0) Refill();
+            const int n = std::min(m_bits, nbits);
+            data = (n >= 64 ? 0 : data << n) | (m_buffer >> (64 - n));
+            Skip(n);
+            nbits -= n;
+        }
+        return data;
+    }
+
+public:
+    GolombRiceReader(const unsigned char* begin, const unsigned char* end)
+        : m_begin(begin), m_end(end), m_pos(begin) {}
+
+    uint64_t Decode(uint8_t P)
+    {
+        // Read unary-encoded quotient: q 1's followed by one 0. The leading
+        // 1's of the buffer are counted at once; the unused low bits of the
+        // buffer are 0, so they are never counted.
+        uint64_t q = 0;
+        while (true) {
+            if (m_bits == 0) Refill();
+            const int ones = 64 - static_cast<int>(CountBits(~m_buffer));
+            if (ones < m_bits) {
+                q += ones;
+                Skip(ones + 1);
+                break;
+            }
+            q += m_bits;
+            Skip(m_bits);
+        }
+
+        uint64_t r = Read(P);
+
+        return (q << P) + r;
+    }
+
+    /** Number of bytes holding the bits decoded so far. */
+    size_t BytesConsumed() const
+    {
+        return static_cast<size_t>(m_pos - m_begin) - m_bits / 8;
+    }
+};
+
+/**
+ * Sort values that are all below max, a byte at a time starting from the
+ * least significant one. Only the bytes that can be non-zero in values below
+ * max are sorted on, so filter hashes take ceil(log2(N * M) / 8) passes.
+ */
+static void RadixSort(std::vector<uint64_t>& values, uint64_t max)
+{
+    if (values.size() < 64) {
+        std::sort(values.begin(), values.end());
+        return;
+    }
+
+    std::vector<uint64_t> sorted(values.size());
+    for (int shift = 0; shift < 64 && (max >> shift) != 0; shift += 8) {
+        size_t offsets[256] = {};
+        for (uint64_t value : values) {
+            ++offsets[(value >> shift) & 0xFF];
+        }
+        // Skip the pass if every value has the same byte here.
+        if (offsets[values[0] >> shift & 0xFF] == values.size()) continue;
+
+        size_t offset = 0;
+        for (size_t& count : offsets) {
+            const size_t next = offset + count;
+            count = offset;
+            offset = next;
+        }
+        for (uint64_t value : values) {
+            sorted[offsets[(value >> shift) & 0xFF]++] = value;
+        }
+        values.swap(sorted);
+    }
 }
 
 // Map a value x that is uniformly distributed in the range [0, 2^64) to a
@@ -99,7 +259,7 @@ std::vector<uint64_t> GCSFilter::BuildHashedSet(const ElementSet& elements) cons
     for (const Element& element : elements) {
         hashed_elements.push_back(HashToRange(element));
     }
-    std::sort(hashed_elements.begin(), hashed_elements.end());
+    RadixSort(hashed_elements, m_F);
     return hashed_elements;
 }
 
@@ -121,11 +281,12 @@ GCSFilter::GCSFilter(const Params& params, std::vector<unsigned char> encoded_fi
 
     // Verify that the encoded filter contains exactly N elements. If it has too much or too little
     // data, a std::ios_base::failure exception will be raised.
-    BitStreamReader<VectorReader> VCreader(stream);
+    const unsigned char* data = m_encoded.data() + (m_encoded.size() - stream.size());
+    GolombRiceReader reader(data, m_encoded.data() + m_encoded.size());
     for (uint64_t i = 0; i < m_N; ++i) {
-        GolombRiceDecode(VCreader, m_params.m_P);
+        reader.Decode(m_params.m_P);
     }
-    if (!stream.empty()) {
+    if (reader.BytesConsumed() != stream.size()) {
         throw std::ios_base::failure("encoded_filter contains excess data");
     }
 }
@@ -148,16 +309,16 @@ GCSFilter::GCSFilter(const Params& params, const ElementSet& elements)
         return;
     }
 
-    BitStreamWriter<CVectorWriter> VCwriter(stream);
+    GolombRiceWriter writer(m_encoded);
 
     uint64_t last_value = 0;
     for (uint64_t value : BuildHashedSet(elements)) {
         uint64_t delta = value - last_value;
-        GolombRiceEncode(VCwriter, m_params.m_P, delta);
+        writer.Encode(m_params.m_P, delta);
         last_value = value;
     }
 
-    VCwriter.Flush();
+    writer.Flush();
 }
 
 bool GCSFilter::MatchInternal(const uint64_t* element_hashes, size_t size) const
@@ -168,12 +329,13 @@ bool GCSFilter::MatchInternal(const uint64_t* element_hashes, size_t size) const
     uint64_t N = ReadCompactSize(stream);
     assert(N == m_N);
 
-    BitStreamReader<VectorReader> VCreader(stream);
+    const unsigned char* data = m_encoded.data() + (m_encoded.size() - stream.size());
+    GolombRiceReader reader(data, m_encoded.data() + m_encoded.size());
 
     uint64_t value = 0;
     size_t hashes_index = 0;
     for (uint32_t i = 0; i < m_N; ++i) {
-        uint64_t delta = GolombRiceDecode(VCreader, m_params.m_P);
+        uint64_t delta = reader.Decode(m_params.m_P);
         value += delta;
 
         while (true) {
@@ -204,6 +366,36 @@ bool GCSFilter::MatchAny(const ElementSet& elements) const
     return MatchInternal(queries.data(), queries.size());
 }
 
+std::vector<bool> GCSFilter::MatchAny(const std::vector<const GCSFilter*>& filters, const ElementSet& elements)
+{
+    std::vector<bool> results;
+    results.reserve(filters.size());
+
+    // The hashes depend on the keys of each filter, so only the iteration
+    // over the set and the buffer for the hashes are shared.
+    std::vector<const Element*> query;
+    query.reserve(elements.size());
+    for (const Element& element : elements) {
+        query.push_back(&element);
+    }
+
+    std::vector<uint64_t> hashes;
+    hashes.reserve(query.size());
+    for (const GCSFilter* filter : filters) {
+        if (filter->m_N == 0 || query.empty()) {
+            results.push_back(false);
+            continue;
+        }
+        hashes.clear();
+        for (const Element* element : query) {
+            hashes.push_back(filter->HashToRange(*element));
+        }
+        RadixSort(hashes, filter->m_F);
+        results.push_back(filter->MatchInternal(hashes.data(), hashes.size()));
+    }
+    return results;
+}
+
 const std::string& BlockFilterTypeName(BlockFilterType filter_type)
 {
     static std::string unknown_retval = "";
@@ -79,6 +79,13 @@ public:
      * efficient that checking Match on multiple elements separately.
      */
     bool MatchAny(const ElementSet& elements) const;
+
+    /**
+     * Checks for each of the given filters if any of the elements may be in
+     * its set, as MatchAny does. This is more efficient than calling MatchAny
+     * on every filter, e.g. when scanning the filters of many blocks.
+     */
+    static std::vector<bool> MatchAny(const std::vector<const GCSFilter*>& filters, const ElementSet& elements);
 };
 
 constexpr uint8_t BASIC_FILTER_P = 19;
@@ -0,0 +1,191 @@
+// Copyright (c) 2019 The Vccoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockindexfile.h>
+
+#include <chain.h>
+#include <compat.h>
+#include <crypto/common.h>
+#include <crypto/siphash.h>
+#include <util/system.h>
+
+#include <assert.h>
+#include <string.h>
+
+#ifndef WIN32
+#include <sys/stat.h>
+#endif
+
+/** Magic bytes and version at the start of the file. */
+static const unsigned char BLOCK_INDEX_FILE_MAGIC[4] = {'v', 'c', 'b', 'i'};
+static const uint32_t BLOCK_INDEX_FILE_VERSION = 2;
+
+/** Checksum of the fields of an encoded record. */
+static uint64_t RecordChecksum(const unsigned char* data)
+{
+    return CSipHasher(0, 0).Write(data, BlockIndexRecord::SIZE - 8).Finalize();
+}
+
+constexpr size_t BlockIndexRecord::SIZE;
+constexpr uint64_t BlockIndexFile::HEADER_SIZE;
+
+BlockIndexRecord::BlockIndexRecord(const CBlockIndex& index)
+    : hash(index.GetBlockHash()),
+      hashPrev(index.pprev ? index.pprev->GetBlockHash() : uint256()),
+      hashMerkleRoot(index.hashMerkleRoot),
+      nVersion(index.nVersion),
+      nTime(index.nTime),
+      nBits(index.nBits),
+      nNonce(index.nNonce),
+      nHeight(index.nHeight),
+      nStatus(index.nStatus),
+      nTx(index.nTx),
+      nFile(index.nFile),
+      nDataPos(index.nDataPos),
+      nUndoPos(index.nUndoPos)
+{
+}
+
+void BlockIndexRecord::Encode(unsigned char* out) const
+{
+    memcpy(out, hash.begin(), 32);
+    memcpy(out + 32, hashPrev.begin(), 32);
+    memcpy(out + 64, hashMerkleRoot.begin(), 32);
+    out += 96;
+    for (uint32_t field : {(uint32_t)nVersion, nTime, nBits, nNonce, (uint32_t)nHeight, nStatus, nTx,
+                           (uint32_t)nFile, nDataPos, nUndoPos}) {
+        WriteLE32(out, field);
+        out += 4;
+    }
+    WriteLE64(out, RecordChecksum(out - (SIZE - 8)));
+}
+
+bool BlockIndexRecord::Decode(const unsigned char* in)
+{
+    if (ReadLE64(in + SIZE - 8) != RecordChecksum(in)) {
+        return false;
+    }
+    memcpy(hash.begin(), in, 32);
+    memcpy(hashPrev.begin(), in + 32, 32);
+    memcpy(hashMerkleRoot.begin(), in + 64, 32);
+    in += 96;
+    nVersion = (int32_t)ReadLE32(in);
+    nTime = ReadLE32(in + 4);
+    nBits = ReadLE32(in + 8);
+    nNonce = ReadLE32(in + 12);
+    nHeight = (int32_t)ReadLE32(in + 16);
+    nStatus = ReadLE32(in + 20);
+    nTx = ReadLE32(in + 24);
+    nFile = (int32_t)ReadLE32(in + 28);
+    nDataPos = ReadLE32(in + 32);
+    nUndoPos = ReadLE32(in + 36);
+    return true;
+}
+
+bool BlockIndexFile::Create()
+{
+    m_size = 0;
+    FILE* file = fsbridge::fopen(m_path, "wb");
+    if (!file) {
+        return error("%s: failed to create %s", __func__, m_path.string());
+    }
+    unsigned char header[HEADER_SIZE];
+    memcpy(header, BLOCK_INDEX_FILE_MAGIC, 4);
+    WriteLE32(header + 4, BLOCK_INDEX_FILE_VERSION);
+    const bool ok = fwrite(header, 1, sizeof(header), file) == sizeof(header) && FileCommit(file);
+    fclose(file);
+    if (!ok) {
+        return error("%s: failed to write %s", __func__, m_path.string());
+    }
+    m_size = HEADER_SIZE;
+    return true;
+}
+
+/**
+ * Check the header and every record of the first size bytes of a file, then
+ * call fn on every record.
+ */
+static bool ParseBlockIndexFile(const unsigned char* data, uint64_t size, const std::function<bool(const BlockIndexRecord&)>& check, const std::function<void(const BlockIndexRecord&)>& fn)
+{
+    if (memcmp(data, BLOCK_INDEX_FILE_MAGIC, 4) != 0 || ReadLE32(data + 4) != BLOCK_INDEX_FILE_VERSION) {
+        return error("%s: unknown block index file format", __func__);
+    }
+    BlockIndexRecord record;
+    for (uint64_t pos = BlockIndexFile::HEADER_SIZE; pos < size; pos += BlockIndexRecord::SIZE) {
+        if (!record.Decode(data + pos)) {
+            return error("%s: checksum mismatch at offset %u", __func__, pos);
+        }
+        if (!check(record)) return false;
+    }
+    for (uint64_t pos = BlockIndexFile::HEADER_SIZE; pos < size; pos += BlockIndexRecord::SIZE) {
+        record.Decode(data + pos);
+        fn(record);
+    }
+    return true;
+}
+
+bool BlockIndexFile::Load(uint64_t size, const std::function<bool(const BlockIndexRecord&)>& check, const std::function<void(const BlockIndexRecord&)>& fn)
+{
+    m_size = 0;
+    if (size < HEADER_SIZE || (size - HEADER_SIZE) % BlockIndexRecord::SIZE != 0) {
+        return error("%s: invalid size %u of %s", __func__, size, m_path.string());
+    }
+    bool ok;
+#ifndef WIN32
+    int fd = open(m_path.string().c_str(), O_RDONLY);
+    if (fd == -1) {
+        return error("%s: failed to open %s", __func__, m_path.string());
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (uint64_t)st.st_size < size) {
+        close(fd);
+        return error("%s: %s is shorter than %u bytes", __func__, m_path.string(), size);
+    }
+    void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return error("%s: failed to map %s", __func__, m_path.string());
+    }
+    posix_madvise(data, size, POSIX_MADV_SEQUENTIAL);
+    ok = ParseBlockIndexFile(static_cast<const unsigned char*>(data), size, check, fn);
+    munmap(data, size);
+#else
+    FILE* file = fsbridge::fopen(m_path, "rb");
+    if (!file) {
+        return error("%s: failed to open %s", __func__, m_path.string());
+    }
+    std::vector<unsigned char> data(size);
+    const bool read = fread(data.data(), 1, size, file) == size;
+    fclose(file);
+    if (!read) {
+        return error("%s: %s is shorter than %u bytes", __func__, m_path.string(), size);
+    }
+    ok = ParseBlockIndexFile(data.data(), size, check, fn);
+#endif
+    if (ok) m_size = size;
+    return ok;
+}
+
+bool BlockIndexFile::Append(const std::vector<BlockIndexRecord>& records, uint64_t& new_size)
+{
+    assert(m_size >= HEADER_SIZE);
+    std::vector<unsigned char> data(records.size() * BlockIndexRecord::SIZE);
+    for (size_t i = 0; i < records.size(); ++i) {
+        records[i].Encode(data.data() + i * BlockIndexRecord::SIZE);
+    }
+
+    FILE* file = fsbridge::fopen(m_path, "rb+");
+    if (!file) {
+        return error("%s: failed to open %s", __func__, m_path.string());
+    }
+    const bool ok = fseek(file, m_size, SEEK_SET) == 0 &&
+                    fwrite(data.data(), 1, data.size(), file) == data.size() &&
+                    FileCommit(file);
+    fclose(file);
+    if (!ok) {
+        return error("%s: failed to write %s", __func__, m_path.string());
+    }
+    new_size = m_size + data.size();
+    return true;
+}
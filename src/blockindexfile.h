@@ -0,0 +1,97 @@
+// Copyright (c) 2019 The Vccoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef VCCOIN_BLOCKINDEXFILE_H
+#define VCCOIN_BLOCKINDEXFILE_H
+
+#include <fs.h>
+#include <uint256.h>
+
+#include <functional>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+class CBlockIndex;
+
+/**
+ * A block index entry as stored in the block index file. An encoded record
+ * ends with a checksum of its fields.
+ */
+struct BlockIndexRecord
+{
+    //! Size of an encoded record in bytes, including the 8 byte checksum
+    static constexpr size_t SIZE = 3 * 32 + 10 * 4 + 8;
+
+    uint256 hash;
+    uint256 hashPrev;
+    uint256 hashMerkleRoot;
+    int32_t nVersion{0};
+    uint32_t nTime{0};
+    uint32_t nBits{0};
+    uint32_t nNonce{0};
+    int32_t nHeight{0};
+    uint32_t nStatus{0};
+    uint32_t nTx{0};
+    int32_t nFile{0};
+    uint32_t nDataPos{0};
+    uint32_t nUndoPos{0};
+
+    BlockIndexRecord() {}
+    explicit BlockIndexRecord(const CBlockIndex& index);
+
+    void Encode(unsigned char* out) const;
+    //! Returns false if the checksum does not match the fields.
+    bool Decode(const unsigned char* in);
+};
+
+/**
+ * An append-only copy of the block index entries of CBlockTreeDB, in a flat
+ * file of fixed-size records after a short header. The file is memory-mapped
+ * and read front to back when loading the block index; later records of a
+ * block replace earlier ones. Unlike the database entries, the records hold
+ * the block hash, so loading does not hash any headers.
+ *
+ * Only the first GetSize() bytes are valid. CBlockTreeDB records that size
+ * in the same batch as the database entries, so records appended by a write
+ * that did not reach the database are ignored and overwritten.
+ */
+class BlockIndexFile
+{
+public:
+    //! Size of the file header in bytes
+    static constexpr uint64_t HEADER_SIZE = 8;
+
+    explicit BlockIndexFile(fs::path path) : m_path(std::move(path)) {}
+
+    const fs::path& GetPath() const { return m_path; }
+
+    //! Size of the valid part of the file, 0 until it was loaded or created.
+    uint64_t GetSize() const { return m_size; }
+    void SetSize(uint64_t size) { m_size = size; }
+
+    /** Replace the file with an empty one. */
+    bool Create();
+
+    /**
+     * Map the first size bytes of the file and call check on every record in
+     * order. Only if every record is intact and passes check, call fn on every
+     * record in order, so that a damaged file has no effect. Returns false if
+     * the file is invalid or check returns false.
+     */
+    bool Load(uint64_t size, const std::function<bool(const BlockIndexRecord&)>& check, const std::function<void(const BlockIndexRecord&)>& fn);
+
+    /**
+     * Write records after the valid part of the file and sync them to disk.
+     * Returns the size of the file including them, which only becomes valid
+     * through SetSize.
+     */
+    bool Append(const std::vector<BlockIndexRecord>& records, uint64_t& new_size);
+
+private:
+    const fs::path m_path;
+    uint64_t m_size{0};
+};
+
+#endif // VCCOIN_BLOCKINDEXFILE_H
@@ -0,0 +1,247 @@
+// Copyright (c) 2019 The Vccoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef VCCOIN_BLOCKMAP_H
+#define VCCOIN_BLOCKMAP_H
+
+#include <chain.h>
+#include <crypto/common.h>
+#include <uint256.h>
+
+#include <assert.h>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * Allocates objects in slabs of SLAB_SIZE objects. Objects are never freed
+ * individually and keep their address until Clear(), so allocating many small
+ * objects with the same lifetime needs neither a heap allocation nor the heap's
+ * bookkeeping per object.
+ */
+template <typename T, size_t SLAB_SIZE = 4096>
+class SlabArena
+{
+public:
+    SlabArena() {}
+    SlabArena(const SlabArena&) = delete;
+    SlabArena& operator=(const SlabArena&) = delete;
+    ~SlabArena() { Clear(); }
+
+    template <typename... Args>
+    T* Emplace(Args&&... args)
+    {
+        if (m_slabs.empty() || m_used == SLAB_SIZE) {
+            m_slabs.emplace_back(new Storage[SLAB_SIZE]);
+            m_used = 0;
+        }
+        T* obj = new (&m_slabs.back()[m_used]) T(std::forward<Args>(args)...);
+        ++m_used;
+        return obj;
+    }
+
+    /** Destroy all objects and free the slabs. */
+    void Clear()
+    {
+        for (size_t i = 0; i < m_slabs.size(); ++i) {
+            const size_t used = i + 1 == m_slabs.size() ? m_used : SLAB_SIZE;
+            for (size_t j = 0; j < used; ++j) {
+                reinterpret_cast<T*>(&m_slabs[i][j])->~T();
+            }
+        }
+        m_slabs.clear();
+        m_used = 0;
+    }
+
+    size_t Size() const { return m_slabs.empty() ? 0 : (m_slabs.size() - 1) * SLAB_SIZE + m_used; }
+    size_t DynamicMemoryUsage() const { return m_slabs.size() * SLAB_SIZE * sizeof(Storage) + m_slabs.capacity() * sizeof(void*); }
+
+private:
+    typedef typename std::aligned_storage<sizeof(T), alignof(T)>::type Storage;
+
+    std::vector<std::unique_ptr<Storage[]>> m_slabs;
+    //! Number of objects in the last slab
+    size_t m_used{0};
+};
+
+/**
+ * Map from block hash to block index, used for mapBlockIndex.
+ *
+ * Entries are kept in a SlabArena and found through an open addressing table
+ * of pointers to them, using the first 8 bytes of the hash, which are random,
+ * as the hash function. Block index objects created by emplace_index live in
+ * a second arena owned by the map, which destroys them in clear(). Entries
+ * cannot be erased; the address of the key and value of an entry never change.
+ *
+ * The interface is the subset of std::unordered_map that mapBlockIndex needs.
+ */
+class BlockMap
+{
+public:
+    typedef std::pair<const uint256, CBlockIndex*> value_type;
+    typedef size_t size_type;
+
+    template <typename V>
+    class iter_base
+    {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef V value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef V* pointer;
+        typedef V& reference;
+
+        iter_base() {}
+        //! Conversion from iterator to const_iterator
+        template <typename W>
+        iter_base(const iter_base<W>& other) : m_slot(other.m_slot), m_end(other.m_end) {}
+        V& operator*() const { return **m_slot; }
+        V* operator->() const { return *m_slot; }
+        iter_base& operator++() { ++m_slot; Skip(); return *this; }
+        iter_base operator++(int) { iter_base copy(*this); ++(*this); return copy; }
+        bool operator==(const iter_base& other) const { return m_slot == other.m_slot; }
+        bool operator!=(const iter_base& other) const { return m_slot != other.m_slot; }
+
+    private:
+        friend class BlockMap;
+        template <typename W>
+        friend class iter_base;
+        iter_base(BlockMap::value_type* const* slot, BlockMap::value_type* const* end) : m_slot(slot), m_end(end) { Skip(); }
+        void Skip() { while (m_slot != m_end && !*m_slot) ++m_slot; }
+
+        BlockMap::value_type* const* m_slot{nullptr};
+        BlockMap::value_type* const* m_end{nullptr};
+    };
+    typedef iter_base<value_type> iterator;
+    typedef iter_base<const value_type> const_iterator;
+
+    BlockMap() {}
+    BlockMap(const BlockMap&) = delete;
+    BlockMap& operator=(const BlockMap&) = delete;
+
+    iterator begin() { return iterator(m_table.data(), m_table.data() + m_table.size()); }
+    iterator end() { return iterator(m_table.data() + m_table.size(), m_table.data() + m_table.size()); }
+    const_iterator begin() const { return const_iterator(m_table.data(), m_table.data() + m_table.size()); }
+    const_iterator end() const { return const_iterator(m_table.data() + m_table.size(), m_table.data() + m_table.size()); }
+
+    bool empty() const { return m_size == 0; }
+    size_type size() const { return m_size; }
+
+    iterator find(const uint256& hash) { return At(FindSlot(hash)); }
+    const_iterator find(const uint256& hash) const
+    {
+        const size_t slot = FindSlot(hash);
+        return m_table.empty() || !m_table[slot] ? end() : const_iterator(m_table.data() + slot, m_table.data() + m_table.size());
+    }
+    size_type count(const uint256& hash) const { return find(hash) == end() ? 0 : 1; }
+
+    std::pair<iterator, bool> insert(const value_type& value) { return emplace(value.first, value.second); }
+    std::pair<iterator, bool> emplace(const uint256& hash, CBlockIndex* pindex)
+    {
+        size_t slot = FindSlot(hash);
+        if (!m_table.empty() && m_table[slot]) return std::make_pair(At(slot), false);
+        slot = Insert(slot, hash, pindex);
+        return std::make_pair(At(slot), true);
+    }
+    CBlockIndex*& operator[](const uint256& hash) { return emplace(hash, nullptr).first->second; }
+
+    /**
+     * Construct a block index from args in the map's arena and add it for
+     * hash, unless hash is in the map already. The block index of a new entry
+     * points to the key of the entry as its hash.
+     */
+    template <typename... Args>
+    std::pair<iterator, bool> emplace_index(const uint256& hash, Args&&... args)
+    {
+        size_t slot = FindSlot(hash);
+        if (!m_table.empty() && m_table[slot]) return std::make_pair(At(slot), false);
+        CBlockIndex* pindex = m_indexes.Emplace(std::forward<Args>(args)...);
+        slot = Insert(slot, hash, pindex);
+        pindex->phashBlock = &m_table[slot]->first;
+        return std::make_pair(At(slot), true);
+    }
+
+    /** Make room for n entries without growing the table. */
+    void reserve(size_type n)
+    {
+        size_t capacity = MIN_CAPACITY;
+        while (capacity / 4 * 3 < n) capacity *= 2;
+        if (capacity > m_table.size()) Rehash(capacity);
+    }
+
+    /** Remove all entries and destroy the block indexes created by emplace_index. */
+    void clear()
+    {
+        std::vector<value_type*>().swap(m_table);
+        m_size = 0;
+        m_entries.Clear();
+        m_indexes.Clear();
+    }
+
+    size_t DynamicMemoryUsage() const
+    {
+        return m_table.capacity() * sizeof(value_type*) + m_entries.DynamicMemoryUsage() + m_indexes.DynamicMemoryUsage();
+    }
+
+private:
+    static constexpr size_t MIN_CAPACITY = 1024;
+
+    static size_t Hash(const uint256& hash) { return ReadLE64(hash.begin()); }
+
+    /** The slot holding hash, or the empty slot where it would be inserted. */
+    size_t FindSlot(const uint256& hash) const
+    {
+        if (m_table.empty()) return 0;
+        const size_t mask = m_table.size() - 1;
+        size_t slot = Hash(hash) & mask;
+        while (m_table[slot] && m_table[slot]->first != hash) {
+            slot = (slot + 1) & mask;
+        }
+        return slot;
+    }
+
+    iterator At(size_t slot)
+    {
+        if (m_table.empty() || !m_table[slot]) return end();
+        return iterator(m_table.data() + slot, m_table.data() + m_table.size());
+    }
+
+    /** Add an entry at the empty slot found for hash. Returns its slot, which changes if the table grows. */
+    size_t Insert(size_t slot, const uint256& hash, CBlockIndex* pindex)
+    {
+        // Keep the table at most three quarters full.
+        if (m_table.empty() || (m_size + 1) > m_table.size() / 4 * 3) {
+            Rehash(m_table.empty() ? MIN_CAPACITY : m_table.size() * 2);
+            slot = FindSlot(hash);
+        }
+        assert(!m_table[slot]);
+        m_table[slot] = m_entries.Emplace(hash, pindex);
+        ++m_size;
+        return slot;
+    }
+
+    void Rehash(size_t capacity)
+    {
+        std::vector<value_type*> table(capacity, nullptr);
+        const size_t mask = capacity - 1;
+        for (value_type* entry : m_table) {
+            if (!entry) continue;
+            size_t slot = Hash(entry->first) & mask;
+            while (table[slot]) slot = (slot + 1) & mask;
+            table[slot] = entry;
+        }
+        m_table.swap(table);
+    }
+
+    //! Open addressing table with linear probing, its size is a power of two
+    std::vector<value_type*> m_table;
+    size_t m_size{0};
+    SlabArena<value_type> m_entries;
+    SlabArena<CBlockIndex> m_indexes;
+};
+
+#endif // VCCOIN_BLOCKMAP_H
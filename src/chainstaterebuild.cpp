@@ -0,0 +1,261 @@
+// Copyright (c) 2019 The Vccoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainstaterebuild.h>
+
+#include <chain.h>
+#include <chainparams.h>
+#include <coins.h>
+#include <logging.h>
+#include <primitives/block.h>
+#include <tinyformat.h>
+#include <txdb.h>
+#include <util/memory.h>
+#include <util/system.h>
+#include <util/time.h>
+#include <validation.h>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+
+Mutex g_chainstate_rebuild_mutex;
+std::unique_ptr<ChainstateRebuild> g_chainstate_rebuild;
+
+/** Suffix of the directory the new chainstate database is built in. */
+static const char* const REBUILD_SUFFIX = ".new";
+
+/** Number of blocks read ahead and applied at a time. */
+static const int REBUILD_BATCH_BLOCKS = 64;
+/** Maximum number of threads reading blocks. */
+static const int MAX_REBUILD_READERS = 4;
+/** Blocks below the tip that are left to the final catch-up with cs_main held,
+ *  so that a reorganization rarely touches blocks already applied. */
+static const int REBUILD_TIP_DISTANCE = 6;
+/** LevelDB cache of the new database, in bytes. */
+static const size_t REBUILD_DB_CACHE = 8 << 20;
+
+ChainstateRebuild::ChainstateRebuild(size_t cache_usage) :
+    m_cache_usage(cache_usage),
+    m_path(GetDataDir() / (std::string("chainstate") + REBUILD_SUFFIX))
+{
+}
+
+ChainstateRebuild::~ChainstateRebuild()
+{
+    Interrupt();
+    Stop();
+}
+
+bool ChainstateRebuild::Start(std::string& error)
+{
+    LOCK(m_control_mutex);
+    if (m_running) {
+        error = "A chainstate rebuild is already running";
+        return false;
+    }
+    if (fPruneMode) {
+        error = "Cannot rebuild the chainstate in prune mode";
+        return false;
+    }
+    // Join the thread of the previous rebuild, which has finished.
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+    {
+        LOCK(m_error_mutex);
+        m_error.clear();
+    }
+    m_interrupt.reset();
+    m_height = 0;
+    m_running = true;
+    m_thread = std::thread(&TraceThread<std::function<void()>>, "rebuild", std::bind(&ChainstateRebuild::ThreadRebuild, this));
+    return true;
+}
+
+void ChainstateRebuild::Interrupt()
+{
+    m_interrupt();
+}
+
+void ChainstateRebuild::Stop()
+{
+    LOCK(m_control_mutex);
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+std::string ChainstateRebuild::GetError() const
+{
+    LOCK(m_error_mutex);
+    return m_error;
+}
+
+bool ChainstateRebuild::Fail(const std::string& error)
+{
+    LogPrintf("Chainstate rebuild failed: %s\n", error);
+    LOCK(m_error_mutex);
+    m_error = error;
+    return false;
+}
+
+void ChainstateRebuild::ThreadRebuild()
+{
+    const int64_t start = GetTimeMillis();
+    if (Rebuild()) {
+        LogPrintf("Chainstate rebuild finished at height %d in %ds\n", m_height, (GetTimeMillis() - start) / 1000);
+    }
+    // Whatever was not moved into place is of no use anymore.
+    fs::remove_all(m_path);
+    m_running = false;
+}
+
+bool ChainstateRebuild::ApplyBlocks(const std::vector<const CBlockIndex*>& blocks, CCoinsViewCache& cache)
+{
+    const Consensus::Params& consensus = Params().GetConsensus();
+
+    // Blocks are read and deserialized in parallel, which is where most of
+    // the time goes; applying them to the cache is cheap but must be in order.
+    // The readers do not take cs_main, as the caller may be holding it.
+    std::vector<FlatFilePos> positions;
+    {
+        LOCK(cs_main);
+        for (const CBlockIndex* pindex : blocks) {
+            positions.push_back(pindex->GetBlockPos());
+        }
+    }
+    std::vector<CBlock> read(blocks.size());
+    std::vector<char> ok(blocks.size(), 0);
+    const int num_readers = std::max(1, std::min(GetNumCores() - 1, MAX_REBUILD_READERS));
+    std::vector<std::thread> readers;
+    for (int t = 0; t < num_readers; ++t) {
+        readers.emplace_back([&, t] {
+            for (size_t i = t; i < blocks.size(); i += num_readers) {
+                ok[i] = ReadBlockFromDisk(read[i], positions[i], consensus) && read[i].GetHash() == blocks[i]->GetBlockHash();
+            }
+        });
+    }
+    for (std::thread& reader : readers) {
+        reader.join();
+    }
+
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        const CBlockIndex* pindex = blocks[i];
+        if (!ok[i]) {
+            return Fail(strprintf("Failed to read block %s at height %d", pindex->GetBlockHash().ToString(), pindex->nHeight));
+        }
+        // The genesis block's coinbase is not added to the UTXO set, see ConnectBlock.
+        if (pindex->nHeight > 0) {
+            for (const CTransactionRef& tx : read[i].vtx) {
+                if (!tx->IsCoinBase()) {
+                    for (const CTxIn& txin : tx->vin) {
+                        if (!cache.SpendCoin(txin.prevout)) {
+                            return Fail(strprintf("Block %s spends missing output %s", pindex->GetBlockHash().ToString(), txin.prevout.ToString()));
+                        }
+                    }
+                }
+                AddCoins(cache, *tx, pindex->nHeight);
+            }
+        }
+        m_height = pindex->nHeight;
+    }
+    cache.SetBestBlock(blocks.back()->GetBlockHash());
+    return true;
+}
+
+bool ChainstateRebuild::Rebuild()
+{
+    LogPrintf("Rebuilding chainstate in %s\n", m_path.string());
+    std::unique_ptr<CCoinsViewDB> db = MakeUnique<CCoinsViewDB>(m_path, REBUILD_DB_CACHE, false, true);
+    std::unique_ptr<CCoinsViewCache> cache = MakeUnique<CCoinsViewCache>(db.get());
+    const CBlockIndex* pindex = nullptr; // Last block applied
+
+    // Bulk phase: the node keeps running on the old database.
+    while (true) {
+        if (m_interrupt) return Fail("Interrupted");
+
+        std::vector<const CBlockIndex*> blocks;
+        {
+            LOCK(cs_main);
+            if (pindex && !::ChainActive().Contains(pindex)) {
+                return Fail(strprintf("Block %s was reorganized away during the rebuild", pindex->GetBlockHash().ToString()));
+            }
+            const int next = pindex ? pindex->nHeight + 1 : 0;
+            const int last = std::min(::ChainActive().Height() - REBUILD_TIP_DISTANCE, next + REBUILD_BATCH_BLOCKS - 1);
+            for (int height = next; height <= last; ++height) {
+                blocks.push_back(::ChainActive()[height]);
+            }
+        }
+        if (blocks.empty()) break;
+
+        if (!ApplyBlocks(blocks, *cache)) return false;
+        pindex = blocks.back();
+
+        if (cache->DynamicMemoryUsage() > m_cache_usage) {
+            LogPrint(BCLog::COINDB, "Chainstate rebuild: flushing at height %d\n", pindex->nHeight);
+            if (!cache->Flush()) return Fail("Failed to write to the new chainstate database");
+        }
+    }
+
+    // Final phase: catch up with the tip and swap the databases, with
+    // cs_main held so that the chainstate does not change underneath.
+    // Cursors into the old database (used by RPCs that scan the UTXO set)
+    // must be closed first, so wait for them without holding cs_main.
+    while (true) {
+        if (m_interrupt) return Fail("Interrupted");
+        {
+            LOCK(cs_main);
+            if (!pcoinsdbview->HasOpenCursors()) break;
+        }
+        m_interrupt.sleep_for(std::chrono::milliseconds(100));
+    }
+
+    LOCK(cs_main);
+    if (pindex && !::ChainActive().Contains(pindex)) {
+        return Fail(strprintf("Block %s was reorganized away during the rebuild", pindex->GetBlockHash().ToString()));
+    }
+    std::vector<const CBlockIndex*> blocks;
+    for (int height = pindex ? pindex->nHeight + 1 : 0; height <= ::ChainActive().Height(); ++height) {
+        blocks.push_back(::ChainActive()[height]);
+    }
+    if (!blocks.empty() && !ApplyBlocks(blocks, *cache)) return false;
+    if (!cache->Flush()) return Fail("Failed to write to the new chainstate database");
+    cache.reset();
+    if (db->GetBestBlock() != ::ChainActive().Tip()->GetBlockHash()) {
+        return Fail("The new chainstate database is not at the tip");
+    }
+    db.reset();
+
+    // Leave nothing in the coins cache that belongs to the old database.
+    ::ChainstateActive().ForceFlushStateToDisk();
+    if (pcoinsTip->GetBestBlock() != ::ChainActive().Tip()->GetBlockHash()) {
+        return Fail("The chainstate is not at the tip");
+    }
+    // This only fails if a cursor was opened without cs_main since the
+    // check above; the old database is then kept.
+    if (!pcoinsdbview->SwapDirectory(m_path)) {
+        return Fail("Failed to move the new chainstate database into place");
+    }
+    return true;
+}
+
+void CleanupChainstateRebuild(const fs::path& path)
+{
+    const fs::path path_old = path.string() + SWAP_SUFFIX;
+    const fs::path path_new = path.string() + REBUILD_SUFFIX;
+    if (fs::exists(path_old)) {
+        if (fs::exists(path)) {
+            // The swap completed, only deleting the old database did not.
+            fs::remove_all(path_old);
+        } else {
+            LogPrintf("Restoring chainstate database from interrupted swap\n");
+            fs::rename(path_old, path);
+        }
+    }
+    if (fs::exists(path_new)) {
+        LogPrintf("Removing incomplete chainstate rebuild in %s\n", path_new.string());
+        fs::remove_all(path_new);
+    }
+}
@@ -0,0 +1,88 @@
+// Copyright (c) 2019 The Vccoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef VCCOIN_CHAINSTATEREBUILD_H
+#define VCCOIN_CHAINSTATEREBUILD_H
+
+#include <fs.h>
+#include <sync.h>
+#include <threadinterrupt.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+class CBlockIndex;
+class CCoinsViewCache;
+
+/** Suffix the old chainstate database is moved to while the new one is moved into place. */
+static const char* const SWAP_SUFFIX = ".old";
+
+/**
+ * Rebuilds the UTXO set from the blocks on disk into a new database, while
+ * the node keeps running on the current one.
+ *
+ * Blocks are read and deserialized by several threads and applied to the new
+ * database in chain order. Once the rebuild is close to the tip, the last
+ * blocks are applied with cs_main held, both databases are flushed and the
+ * new one is moved into place of the old one. This is the online equivalent
+ * of -reindex-chainstate.
+ */
+class ChainstateRebuild
+{
+public:
+    /** @param[in] cache_usage  Memory to use for the coins cache of the new database, in bytes. */
+    explicit ChainstateRebuild(size_t cache_usage);
+    ~ChainstateRebuild();
+
+    /** Start the rebuild in a background thread. Returns false if it could not be started. */
+    bool Start(std::string& error);
+
+    void Interrupt();
+
+    /** Wait for the background thread to finish. */
+    void Stop();
+
+    bool IsRunning() const { return m_running; }
+    /** Height of the last block applied to the new database. */
+    int GetHeight() const { return m_height; }
+    /** Why the last rebuild failed, or empty. */
+    std::string GetError() const;
+
+private:
+    void ThreadRebuild();
+    bool Rebuild();
+    /** Read the given consecutive blocks in parallel and apply them to cache in order. */
+    bool ApplyBlocks(const std::vector<const CBlockIndex*>& blocks, CCoinsViewCache& cache);
+    bool Fail(const std::string& error);
+
+    const size_t m_cache_usage;
+    const fs::path m_path;
+
+    //! Serializes Start and Stop, which may be called from several RPC threads
+    Mutex m_control_mutex;
+    std::thread m_thread GUARDED_BY(m_control_mutex);
+    CThreadInterrupt m_interrupt;
+    std::atomic<bool> m_running{false};
+    std::atomic<int> m_height{0};
+
+    mutable Mutex m_error_mutex;
+    std::string m_error GUARDED_BY(m_error_mutex);
+};
+
+/**
+ * Finish or roll back a swap of chainstate databases that was interrupted by a
+ * crash, and remove a partial rebuild. Must be called before the chainstate
+ * database at path is opened.
+ */
+void CleanupChainstateRebuild(const fs::path& path);
+
+/** Protects g_chainstate_rebuild, which is created on first use. */
+extern Mutex g_chainstate_rebuild_mutex;
+/** The running or last chainstate rebuild. May be null. */
+extern std::unique_ptr<ChainstateRebuild> g_chainstate_rebuild GUARDED_BY(g_chainstate_rebuild_mutex);
+
+#endif // VCCOIN_CHAINSTATEREBUILD_H
@@ -2,6 +2,10 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#if defined(HAVE_CONFIG_H)
+#include <config/VCcoin-config.h>
+#endif
+
 #include <dbwrapper.h>
 
 #include <memory>
@@ -97,12 +101,61 @@ static void SetMaxOpenFiles(leveldb::Options *options) {
              options->max_open_files, default_open_files);
 }
 
-static leveldb::Options GetOptions(size_t nCacheSize)
+DBOptions GetDBOptions(const std::string& profile)
+{
+    DBOptions db_options;
+    if (profile == "blockindex") {
+        // Read in full once at startup and then mostly written to.
+        db_options.block_size = 16 * 1024;
+    } else if (profile == "txindex") {
+        // Written in bulk while the index is built, then only point lookups
+        // of keys that mostly exist.
+        db_options.max_file_size = 8 * 1024 * 1024;
+    } else if (profile == "scriptindex") {
+        // Written in bulk while the index is built, looking up every spent
+        // output, then read in ranges of the entries of a script.
+        db_options.max_file_size = 8 * 1024 * 1024;
+    } else if (profile == "blockfilter") {
+        // Mostly read in height order, by keys that exist.
+        db_options.block_size = 16 * 1024;
+        db_options.bloom_bits = 0;
+        db_options.max_file_size = 8 * 1024 * 1024;
+    }
+
+    const std::string prefix = profile + ":";
+    for (const std::string& arg : gArgs.GetArgs("-dbprofile")) {
+        if (arg.compare(0, prefix.size(), prefix) != 0) continue;
+        const std::string setting = arg.substr(prefix.size());
+        const size_t eq = setting.find('=');
+        int64_t value;
+        if (eq == std::string::npos || !ParseInt64(setting.substr(eq + 1), &value) || value < 0) {
+            LogPrintf("Ignoring invalid -dbprofile=%s\n", arg);
+            continue;
+        }
+        const std::string name = setting.substr(0, eq);
+        if (name == "blocksize" && value > 0) {
+            db_options.block_size = value;
+        } else if (name == "bloombits") {
+            db_options.bloom_bits = value;
+        } else if (name == "writebuffer" && value > 0 && value <= 25) {
+            db_options.write_buffer_percent = value;
+        } else if (name == "maxfilesize" && value > 0) {
+            db_options.max_file_size = value;
+        } else {
+            LogPrintf("Ignoring invalid -dbprofile=%s\n", arg);
+        }
+    }
+    return db_options;
+}
+
+static leveldb::Options GetOptions(size_t nCacheSize, const DBOptions& db_options)
 {
     leveldb::Options options;
     options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
-    options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
-    options.filter_policy = leveldb::NewBloomFilterPolicy(10);
+    options.write_buffer_size = nCacheSize * db_options.write_buffer_percent / 100; // up to two write buffers may be held in memory simultaneously
+    options.block_size = db_options.block_size;
+    options.max_file_size = db_options.max_file_size;
+    options.filter_policy = db_options.bloom_bits > 0 ? leveldb::NewBloomFilterPolicy(db_options.bloom_bits) : nullptr;
     options.compression = leveldb::kNoCompression;
     options.info_log = new CVccoinLevelDBLogger();
     if (leveldb::kMajorVersion > 1 || (leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16)) {
@@ -114,7 +167,7 @@ static leveldb::Options GetOptions(size_t nCacheSize)
     return options;
 }
 
-CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate)
+CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate, const DBOptions& db_options)
     : m_name{path.stem().string()}
 {
     penv = nullptr;
@@ -122,7 +175,7 @@ CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bo
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize);
+    options = GetOptions(nCacheSize, db_options);
     options.create_if_missing = true;
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
@@ -255,4 +308,20 @@ const std::vector<unsigned char>& GetObfuscateKey(const CDBWrapper &w)
     return w.obfuscate_key;
 }
 
+/** Read buffers that grew beyond this size are released instead of reused. */
+static const size_t MAX_READ_BUFFER_CAPACITY = 64 * 1024;
+
+std::string& GetReadBuffer(std::string& fallback)
+{
+#if defined(HAVE_THREAD_LOCAL)
+    static thread_local std::string buffer;
+    if (buffer.capacity() > MAX_READ_BUFFER_CAPACITY) {
+        std::string().swap(buffer);
+    }
+    return buffer;
+#else
+    return fallback;
+#endif
+}
+
 } // namespace dbwrapper_private
@@ -7,6 +7,7 @@
 
 #include <clientversion.h>
 #include <fs.h>
+#include <prevector.h>
 #include <serialize.h>
 #include <streams.h>
 #include <util/system.h>
@@ -35,6 +36,12 @@ namespace dbwrapper_private {
  */
 void HandleError(const leveldb::Status& status);
 
+/** Buffer for values read from the database, reused by all reads on the
+ * calling thread where thread_local is available, or owned by the given
+ * fallback otherwise.
+ */
+std::string& GetReadBuffer(std::string& fallback);
+
 /** Work around circular dependency, as well as for testing in dbwrapper_tests.
  * Database obfuscation should be considered an implementation detail of the
  * specific database.
@@ -43,6 +50,39 @@ const std::vector<unsigned char>& GetObfuscateKey(const CDBWrapper &w);
 
 };
 
+/** Stream that serializes a database key on the stack. Only keys longer
+ * than DBWRAPPER_PREALLOC_KEY_SIZE bytes need a heap allocation.
+ */
+class DBKeyWriter
+{
+private:
+    prevector<DBWRAPPER_PREALLOC_KEY_SIZE, char> m_data;
+
+public:
+    template <typename K>
+    explicit DBKeyWriter(const K& key)
+    {
+        ::Serialize(*this, key);
+    }
+
+    int GetVersion() const { return CLIENT_VERSION; }
+    int GetType() const { return SER_DISK; }
+
+    void write(const char* pch, size_t size)
+    {
+        m_data.insert(m_data.end(), pch, pch + size);
+    }
+
+    template <typename T>
+    DBKeyWriter& operator<<(const T& obj)
+    {
+        ::Serialize(*this, obj);
+        return *this;
+    }
+
+    leveldb::Slice GetSlice() const { return leveldb::Slice(m_data.data(), m_data.size()); }
+};
+
 /** Batch of changes queued to be written to a CDBWrapper */
 class CDBBatch
 {
@@ -119,6 +159,8 @@ class CDBIterator
 private:
     const CDBWrapper &parent;
     leveldb::Iterator *piter;
+    //! buffer for deobfuscating values, reused across GetValue calls
+    std::string m_value;
 
 public:
 
@@ -135,11 +177,7 @@ public:
     void SeekToFirst();
 
     template<typename K> void Seek(const K& key) {
-        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
-        ssKey.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
-        ssKey << key;
-        leveldb::Slice slKey(ssKey.data(), ssKey.size());
-        piter->Seek(slKey);
+        piter->Seek(DBKeyWriter(key).GetSlice());
     }
 
     void Next();
@@ -147,7 +185,7 @@ public:
     template<typename K> bool GetKey(K& key) {
         leveldb::Slice slKey = piter->key();
         try {
-            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            SpanReader ssKey(SER_DISK, CLIENT_VERSION, slKey.data(), slKey.size());
             ssKey >> key;
         } catch (const std::exception&) {
             return false;
@@ -158,8 +196,9 @@ public:
     template<typename V> bool GetValue(V& value) {
         leveldb::Slice slValue = piter->value();
         try {
-            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
-            ssValue.Xor(dbwrapper_private::GetObfuscateKey(parent));
+            m_value.assign(slValue.data(), slValue.size());
+            XorWithKey(&m_value[0], m_value.size(), dbwrapper_private::GetObfuscateKey(parent));
+            SpanReader ssValue(SER_DISK, CLIENT_VERSION, m_value.data(), m_value.size());
             ssValue >> value;
         } catch (const std::exception&) {
             return false;
@@ -173,6 +212,28 @@ public:
 
 };
 
+/** LevelDB tuning for one kind of database. */
+struct DBOptions
+{
+    //! Approximate size of the user data packed into one table block, in bytes
+    size_t block_size{4 * 1024};
+    //! Bits per key of the bloom filter, or 0 for no filter
+    int bloom_bits{10};
+    //! Share of the cache size, in percent, used for each of the (up to two) write buffers
+    int write_buffer_percent{25};
+    //! Size at which a table file is closed and a new one started, in bytes.
+    //! Larger files mean fewer, larger compactions.
+    size_t max_file_size{2 * 1024 * 1024};
+};
+
+/**
+ * Return the options for the named database profile ("chainstate",
+ * "blockindex", "txindex" or "blockfilter"), with any overrides from
+ * -dbprofile=<profile>:<option>=<value> applied. Unknown profiles get the
+ * default options.
+ */
+DBOptions GetDBOptions(const std::string& profile);
+
 class CDBWrapper
 {
     friend const std::vector<unsigned char>& dbwrapper_private::GetObfuscateKey(const CDBWrapper &w);
@@ -220,8 +281,9 @@ public:
      * @param[in] fWipe       If true, remove all existing data.
      * @param[in] obfuscate   If true, store data obfuscated via simple XOR. If false, XOR
      *                        with a zero'd byte array.
+     * @param[in] db_options  LevelDB tuning for the access pattern of this database.
      */
-    CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false);
+    CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false, const DBOptions& db_options = DBOptions());
     ~CDBWrapper();
 
     CDBWrapper(const CDBWrapper&) = delete;
@@ -230,13 +292,9 @@ public:
     template <typename K, typename V>
     bool Read(const K& key, V& value) const
     {
-        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
-        ssKey.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
-        ssKey << key;
-        leveldb::Slice slKey(ssKey.data(), ssKey.size());
-
-        std::string strValue;
-        leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
+        std::string fallback;
+        std::string& strValue = dbwrapper_private::GetReadBuffer(fallback);
+        leveldb::Status status = pdb->Get(readoptions, DBKeyWriter(key).GetSlice(), &strValue);
         if (!status.ok()) {
             if (status.IsNotFound())
                 return false;
@@ -244,8 +302,8 @@ public:
             dbwrapper_private::HandleError(status);
         }
         try {
-            CDataStream ssValue(strValue.data(), strValue.data() + strValue.size(), SER_DISK, CLIENT_VERSION);
-            ssValue.Xor(obfuscate_key);
+            XorWithKey(&strValue[0], strValue.size(), obfuscate_key);
+            SpanReader ssValue(SER_DISK, CLIENT_VERSION, strValue.data(), strValue.size());
             ssValue >> value;
         } catch (const std::exception&) {
             return false;
@@ -264,13 +322,9 @@ public:
     template <typename K>
     bool Exists(const K& key) const
     {
-        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
-        ssKey.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
-        ssKey << key;
-        leveldb::Slice slKey(ssKey.data(), ssKey.size());
-
-        std::string strValue;
-        leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
+        std::string fallback;
+        std::string& strValue = dbwrapper_private::GetReadBuffer(fallback);
+        leveldb::Status status = pdb->Get(readoptions, DBKeyWriter(key).GetSlice(), &strValue);
         if (!status.ok()) {
             if (status.IsNotFound())
                 return false;
@@ -4,6 +4,7 @@
 
 #include <chainparams.h>
 #include <index/base.h>
+#include <index/blockreader.h>
 #include <shutdown.h>
 #include <tinyformat.h>
 #include <ui_interface.h>
@@ -28,8 +29,9 @@ static void FatalError(const char* fmt, const Args&... args)
     StartShutdown();
 }
 
-BaseIndex::DB::DB(const fs::path& path, size_t n_cache_size, bool f_memory, bool f_wipe, bool f_obfuscate) :
-    CDBWrapper(path, n_cache_size, f_memory, f_wipe, f_obfuscate)
+BaseIndex::DB::DB(const fs::path& path, size_t n_cache_size, bool f_memory, bool f_wipe, bool f_obfuscate,
+                  const DBOptions& db_options) :
+    CDBWrapper(path, n_cache_size, f_memory, f_wipe, f_obfuscate, db_options)
 {}
 
 bool BaseIndex::DB::ReadBestBlock(CBlockLocator& locator) const
@@ -85,11 +87,23 @@ static const CBlockIndex* NextSyncBlock(const CBlockIndex* pindex_prev) EXCLUSIV
     return ::ChainActive().Next(::ChainActive().FindFork(pindex_prev));
 }
 
+namespace {
+/** Keeps a syncing index registered with g_index_block_reader until it stops syncing. */
+class BlockReaderRegistration
+{
+public:
+    BlockReaderRegistration() : m_id(g_index_block_reader.Register()) {}
+    ~BlockReaderRegistration() { g_index_block_reader.Unregister(m_id); }
+
+    const int m_id;
+};
+} // namespace
+
 void BaseIndex::ThreadSync()
 {
     const CBlockIndex* pindex = m_best_block_index.load();
     if (!m_synced) {
-        auto& consensus_params = Params().GetConsensus();
+        const BlockReaderRegistration reader;
 
         int64_t last_log_time = 0;
         int64_t last_locator_write_time = 0;
@@ -135,13 +149,13 @@ void BaseIndex::ThreadSync()
                 Commit();
             }
 
-            CBlock block;
-            if (!ReadBlockFromDisk(block, pindex, consensus_params)) {
+            const std::shared_ptr<const CBlock> block = g_index_block_reader.Read(reader.m_id, pindex);
+            if (!block) {
                 FatalError("%s: Failed to read block %s from disk",
                            __func__, pindex->GetBlockHash().ToString());
                 return;
             }
-            if (!WriteBlock(block, pindex)) {
+            if (!WriteBlock(*block, pindex)) {
                 FatalError("%s: Failed to write block %s to index database",
                            __func__, pindex->GetBlockHash().ToString());
                 return;
@@ -0,0 +1,191 @@
+// Copyright (c) 2019 The Vccoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <index/blockreader.h>
+
+#include <chain.h>
+#include <chainparams.h>
+#include <util/system.h>
+#include <validation.h>
+
+#include <algorithm>
+#include <functional>
+
+/** Maximum number of threads reading blocks ahead of the syncing indexes. */
+static const int MAX_INDEX_READ_THREADS = 4;
+
+IndexBlockReader g_index_block_reader;
+
+IndexBlockReader::~IndexBlockReader()
+{
+    std::vector<std::thread> threads;
+    {
+        LOCK(m_mutex);
+        ++m_generation;
+        threads.swap(m_threads);
+    }
+    m_cv.notify_all();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+int IndexBlockReader::Register()
+{
+    LOCK(m_mutex);
+    const int id = m_next_id++;
+    m_consumers.emplace(id, -1);
+    if (m_threads.empty()) {
+        m_read_height = 0;
+        m_at_tip = false;
+        const int num_threads = std::max(1, std::min(GetNumCores() - 1, MAX_INDEX_READ_THREADS));
+        for (int i = 0; i < num_threads; ++i) {
+            m_threads.emplace_back(&TraceThread<std::function<void()>>, "idxread",
+                                   std::function<void()>(std::bind(&IndexBlockReader::ThreadRead, this, m_generation)));
+        }
+    }
+    return id;
+}
+
+void IndexBlockReader::Unregister(int id)
+{
+    std::vector<std::thread> threads;
+    {
+        LOCK(m_mutex);
+        m_consumers.erase(id);
+        if (m_consumers.empty()) {
+            // Threads of the previous generation exit even if an index
+            // registers before they are joined.
+            ++m_generation;
+            threads.swap(m_threads);
+            m_blocks.clear();
+        } else {
+            Prune();
+        }
+    }
+    m_cv.notify_all();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+std::shared_ptr<const CBlock> IndexBlockReader::Read(int id, const CBlockIndex* pindex)
+{
+    bool cache = false;
+    {
+        WAIT_LOCK(m_mutex, lock);
+        m_consumers[id] = pindex->nHeight;
+        m_at_tip = false;
+        Prune();
+        const int min_height = MinHeight();
+        // Skip the blocks every index has moved past.
+        m_read_height = std::max(m_read_height, min_height);
+
+        auto it = m_blocks.find(pindex);
+        if (it != m_blocks.end()) {
+            m_cv.notify_all();
+            // The entry is at or above the height of this index, so it is not
+            // pruned while waiting.
+            m_cv.wait(lock, [&] { return it->second.done; });
+            if (it->second.block) return it->second.block;
+            // Reading ahead failed, try again below.
+        } else if (pindex->nHeight <= min_height + INDEX_READ_AHEAD_BLOCKS) {
+            // Share the block with the other indexes, which are not far behind.
+            m_blocks.emplace(pindex, Entry());
+            cache = true;
+        }
+        m_cv.notify_all();
+    }
+
+    std::shared_ptr<const CBlock> block = ReadBlock(pindex);
+    if (cache) {
+        {
+            LOCK(m_mutex);
+            auto it = m_blocks.find(pindex);
+            if (it != m_blocks.end()) {
+                it->second.block = block;
+                it->second.done = true;
+            }
+        }
+        m_cv.notify_all();
+    }
+    return block;
+}
+
+void IndexBlockReader::ThreadRead(uint64_t generation)
+{
+    while (true) {
+        int height;
+        {
+            WAIT_LOCK(m_mutex, lock);
+            m_cv.wait(lock, [&] {
+                if (m_generation != generation) return true;
+                const int min_height = MinHeight();
+                return !m_at_tip && min_height >= 0 && m_read_height <= min_height + INDEX_READ_AHEAD_BLOCKS;
+            });
+            if (m_generation != generation) return;
+            height = m_read_height++;
+        }
+
+        const CBlockIndex* pindex;
+        {
+            LOCK(cs_main);
+            pindex = ::ChainActive()[height];
+        }
+        if (!pindex) {
+            // Wait for the indexes to request another block before trying again.
+            LOCK(m_mutex);
+            m_at_tip = true;
+            m_read_height = std::min(m_read_height, height);
+            continue;
+        }
+
+        {
+            LOCK(m_mutex);
+            if (!m_blocks.emplace(pindex, Entry()).second) continue;
+        }
+        std::shared_ptr<const CBlock> block = ReadBlock(pindex);
+        {
+            LOCK(m_mutex);
+            auto it = m_blocks.find(pindex);
+            if (it != m_blocks.end()) {
+                it->second.block = std::move(block);
+                it->second.done = true;
+            }
+        }
+        m_cv.notify_all();
+    }
+}
+
+void IndexBlockReader::Prune()
+{
+    const int min_height = MinHeight();
+    for (auto it = m_blocks.begin(); it != m_blocks.end();) {
+        if (it->first->nHeight < min_height) {
+            it = m_blocks.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+int IndexBlockReader::MinHeight() const
+{
+    int min_height = -1;
+    for (const auto& consumer : m_consumers) {
+        if (consumer.second >= 0 && (min_height < 0 || consumer.second < min_height)) {
+            min_height = consumer.second;
+        }
+    }
+    return min_height;
+}
+
+std::shared_ptr<const CBlock> IndexBlockReader::ReadBlock(const CBlockIndex* pindex)
+{
+    auto block = std::make_shared<CBlock>();
+    if (!ReadBlockFromDisk(*block, pindex, Params().GetConsensus())) {
+        return nullptr;
+    }
+    return block;
+}
@@ -0,0 +1,82 @@
+// Copyright (c) 2019 The Vccoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef VCCOIN_INDEX_BLOCKREADER_H
+#define VCCOIN_INDEX_BLOCKREADER_H
+
+#include <primitives/block.h>
+#include <sync.h>
+
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+class CBlockIndex;
+
+/** Number of blocks read ahead of the index that is furthest behind. */
+static const int INDEX_READ_AHEAD_BLOCKS = 32;
+
+/**
+ * Reads blocks for indexes that are catching up with the chain.
+ *
+ * Every index syncs in its own thread, but indexes that sync at the same time
+ * share the blocks read here, so each block is read from disk and
+ * deserialized once. A few threads read the blocks of the active chain ahead
+ * of the syncing indexes in parallel, which also computes the transaction
+ * hashes. A block is kept until every syncing index has moved past it.
+ */
+class IndexBlockReader
+{
+public:
+    ~IndexBlockReader();
+
+    /** Register an index that is about to sync. Returns the id to pass to Read() and Unregister(). */
+    int Register();
+
+    /** Unregister an index that finished syncing or was interrupted. */
+    void Unregister(int id);
+
+    /**
+     * Get the block of pindex for the index registered as id. Blocks read
+     * earlier are released once no registered index needs them anymore.
+     * Returns null if the block could not be read.
+     */
+    std::shared_ptr<const CBlock> Read(int id, const CBlockIndex* pindex);
+
+private:
+    struct Entry
+    {
+        std::shared_ptr<const CBlock> block; //!< Null while being read or if reading failed
+        bool done{false};
+    };
+
+    void ThreadRead(uint64_t generation);
+    /** Drop the blocks below the height of every registered index. */
+    void Prune() EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+    /** Height of the registered index furthest behind, or -1 if none requested a block yet. */
+    int MinHeight() const EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+    static std::shared_ptr<const CBlock> ReadBlock(const CBlockIndex* pindex);
+
+    Mutex m_mutex;
+    std::condition_variable m_cv;
+    //! Height of the last block requested by every registered index
+    std::map<int, int> m_consumers GUARDED_BY(m_mutex);
+    int m_next_id GUARDED_BY(m_mutex){0};
+    std::map<const CBlockIndex*, Entry> m_blocks GUARDED_BY(m_mutex);
+    //! Height of the next block to read ahead
+    int m_read_height GUARDED_BY(m_mutex){0};
+    //! Set when reading ahead reached the tip, until an index requests another block
+    bool m_at_tip GUARDED_BY(m_mutex){false};
+    //! Incremented to stop the threads reading ahead
+    uint64_t m_generation GUARDED_BY(m_mutex){0};
+    std::vector<std::thread> m_threads GUARDED_BY(m_mutex);
+};
+
+/** The reader shared by all indexes. */
+extern IndexBlockReader g_index_block_reader;
+
+#endif // VCCOIN_INDEX_BLOCKREADER_H
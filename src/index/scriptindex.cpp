@@ -0,0 +1,367 @@
+// Copyright (c) 2019 The Vccoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <crypto/sha256.h>
+#include <index/scriptindex.h>
+#include <util/system.h>
+#include <validation.h>
+
+#include <map>
+#include <set>
+#include <tuple>
+
+/* The index database stores three kinds of entries:
+ *
+ * - For every spendable output, its script hash, asset number, height,
+ *   position of its transaction in the block and value, keyed by outpoint:
+ *   [DB_OUTPOINT, COutPoint]. These are kept after the output is spent, so
+ *   that spending and disconnecting a spend can find the entries of the
+ *   script.
+ * - For every unspent output, its value, keyed by [DB_UNSPENT, script hash,
+ *   asset no (BE), height (BE), tx position (BE), txid, n (BE)].
+ * - For every transaction that paid to or spent from a script, the amounts
+ *   received and spent, keyed by [DB_HISTORY, script hash, asset no (BE),
+ *   height (BE), tx position (BE), txid].
+ *
+ * Integers in keys are big-endian, so that iterating over the entries of a
+ * script in an asset visits them in chain order.
+ */
+constexpr char DB_OUTPOINT = 'o';
+constexpr char DB_UNSPENT = 'u';
+constexpr char DB_HISTORY = 'h';
+
+std::unique_ptr<ScriptIndex> g_scriptindex;
+
+namespace {
+
+struct DBOutput {
+    uint256 script_hash;
+    uint32_t asset_no;
+    int height;
+    uint32_t tx_pos;
+    CAmount value;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(script_hash);
+        READWRITE(asset_no);
+        READWRITE(height);
+        READWRITE(tx_pos);
+        READWRITE(value);
+    }
+};
+
+struct DBOutpointKey {
+    COutPoint outpoint;
+
+    explicit DBOutpointKey(const COutPoint& outpoint_in) : outpoint(outpoint_in) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        char prefix = DB_OUTPOINT;
+        READWRITE(prefix);
+        if (prefix != DB_OUTPOINT) {
+            throw std::ios_base::failure("Invalid format for script index DB outpoint key");
+        }
+
+        READWRITE(outpoint);
+    }
+};
+
+struct DBUnspentKey {
+    uint256 script_hash;
+    uint32_t asset_no;
+    int height;
+    uint32_t tx_pos;
+    COutPoint outpoint;
+
+    DBUnspentKey() : asset_no(0), height(0), tx_pos(0) {}
+    DBUnspentKey(const uint256& script_hash_in, uint32_t asset_no_in, int height_in, uint32_t tx_pos_in, const COutPoint& outpoint_in) :
+        script_hash(script_hash_in), asset_no(asset_no_in), height(height_in), tx_pos(tx_pos_in), outpoint(outpoint_in) {}
+
+    template<typename Stream>
+    void Serialize(Stream& s) const
+    {
+        ser_writedata8(s, DB_UNSPENT);
+        s << script_hash;
+        ser_writedata32be(s, asset_no);
+        ser_writedata32be(s, height);
+        ser_writedata32be(s, tx_pos);
+        s << outpoint.hash;
+        ser_writedata32be(s, outpoint.n);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s)
+    {
+        char prefix = ser_readdata8(s);
+        if (prefix != DB_UNSPENT) {
+            throw std::ios_base::failure("Invalid format for script index DB unspent key");
+        }
+        s >> script_hash;
+        asset_no = ser_readdata32be(s);
+        height = ser_readdata32be(s);
+        tx_pos = ser_readdata32be(s);
+        s >> outpoint.hash;
+        outpoint.n = ser_readdata32be(s);
+    }
+};
+
+struct DBHistoryKey {
+    uint256 script_hash;
+    uint32_t asset_no;
+    int height;
+    uint32_t tx_pos;
+    uint256 txid;
+
+    DBHistoryKey() : asset_no(0), height(0), tx_pos(0) {}
+    DBHistoryKey(const uint256& script_hash_in, uint32_t asset_no_in, int height_in, uint32_t tx_pos_in, const uint256& txid_in) :
+        script_hash(script_hash_in), asset_no(asset_no_in), height(height_in), tx_pos(tx_pos_in), txid(txid_in) {}
+
+    template<typename Stream>
+    void Serialize(Stream& s) const
+    {
+        ser_writedata8(s, DB_HISTORY);
+        s << script_hash;
+        ser_writedata32be(s, asset_no);
+        ser_writedata32be(s, height);
+        ser_writedata32be(s, tx_pos);
+        s << txid;
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s)
+    {
+        char prefix = ser_readdata8(s);
+        if (prefix != DB_HISTORY) {
+            throw std::ios_base::failure("Invalid format for script index DB history key");
+        }
+        s >> script_hash;
+        asset_no = ser_readdata32be(s);
+        height = ser_readdata32be(s);
+        tx_pos = ser_readdata32be(s);
+        s >> txid;
+    }
+};
+
+struct DBHistoryValue {
+    CAmount received{0};
+    CAmount spent{0};
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(received);
+        READWRITE(spent);
+    }
+};
+
+/** Script hash and asset number of the entries of a script in an asset. */
+using ScriptAsset = std::pair<uint256, uint32_t>;
+
+}; // namespace
+
+/** The asset an output of tx belongs to, by the same rule as the wallet. See ScriptIndex. */
+static uint32_t GetOutputAssetNo(const CTransaction& tx, uint32_t n)
+{
+    if (tx.nAssetNo != 0 && tx.vout.size() > 1 && tx.vin.size() > 1 && n == tx.vout.size() - 1) {
+        return 0;
+    }
+    return tx.nAssetNo;
+}
+
+/**
+ * Access to the script index database (indexes/scriptindex/)
+ */
+class ScriptIndex::DB : public BaseIndex::DB
+{
+public:
+    explicit DB(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    /// Read the entry of an indexed output, spent or not.
+    bool ReadOutput(const COutPoint& outpoint, DBOutput& output) const;
+};
+
+ScriptIndex::DB::DB(size_t n_cache_size, bool f_memory, bool f_wipe) :
+    BaseIndex::DB(GetDataDir() / "indexes" / "scriptindex", n_cache_size, f_memory, f_wipe, false, GetDBOptions("scriptindex"))
+{}
+
+bool ScriptIndex::DB::ReadOutput(const COutPoint& outpoint, DBOutput& output) const
+{
+    return Read(DBOutpointKey(outpoint), output);
+}
+
+ScriptIndex::ScriptIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
+    : m_db(MakeUnique<ScriptIndex::DB>(n_cache_size, f_memory, f_wipe))
+{}
+
+ScriptIndex::~ScriptIndex() {}
+
+BaseIndex::DB& ScriptIndex::GetDB() const { return *m_db; }
+
+uint256 ScriptIndex::GetScriptHash(const CScript& script)
+{
+    uint256 hash;
+    CSHA256().Write(script.data(), script.size()).Finalize(hash.begin());
+    return hash;
+}
+
+bool ScriptIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    // Exclude genesis block transaction because outputs are not spendable.
+    if (pindex->nHeight == 0) return true;
+
+    CDBBatch batch(*m_db);
+    std::map<COutPoint, DBOutput> block_outputs;
+    for (uint32_t tx_pos = 0; tx_pos < block.vtx.size(); ++tx_pos) {
+        const CTransactionRef& tx = block.vtx[tx_pos];
+        const uint256& txid = tx->GetHash();
+        std::map<ScriptAsset, DBHistoryValue> history;
+
+        if (!tx->IsCoinBase()) {
+            for (const CTxIn& txin : tx->vin) {
+                DBOutput output;
+                auto it = block_outputs.find(txin.prevout);
+                if (it != block_outputs.end()) {
+                    output = it->second;
+                } else if (!m_db->ReadOutput(txin.prevout, output)) {
+                    return error("%s: output %s spent by %s is not indexed",
+                                 __func__, txin.prevout.ToString(), txid.ToString());
+                }
+                batch.Erase(DBUnspentKey(output.script_hash, output.asset_no, output.height, output.tx_pos, txin.prevout));
+                history[ScriptAsset(output.script_hash, output.asset_no)].spent += output.value;
+            }
+        }
+
+        for (uint32_t n = 0; n < tx->vout.size(); ++n) {
+            const CTxOut& txout = tx->vout[n];
+            if (txout.scriptPubKey.IsUnspendable()) continue;
+
+            const COutPoint outpoint(txid, n);
+            const DBOutput output{GetScriptHash(txout.scriptPubKey), GetOutputAssetNo(*tx, n), pindex->nHeight, tx_pos, txout.nValue};
+            batch.Write(DBOutpointKey(outpoint), output);
+            batch.Write(DBUnspentKey(output.script_hash, output.asset_no, output.height, output.tx_pos, outpoint), output.value);
+            block_outputs.emplace(outpoint, output);
+            history[ScriptAsset(output.script_hash, output.asset_no)].received += output.value;
+        }
+
+        for (const auto& entry : history) {
+            batch.Write(DBHistoryKey(entry.first.first, entry.first.second, pindex->nHeight, tx_pos, txid), entry.second);
+        }
+    }
+    return m_db->WriteBatch(batch);
+}
+
+bool ScriptIndex::Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip)
+{
+    assert(current_tip->GetAncestor(new_tip->nHeight) == new_tip);
+
+    const Consensus::Params& consensus_params = Params().GetConsensus();
+    for (const CBlockIndex* pindex = current_tip; pindex != new_tip; pindex = pindex->pprev) {
+        if (pindex->nHeight == 0) break;
+
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex, consensus_params)) {
+            return error("%s: Failed to read block %s from disk",
+                         __func__, pindex->GetBlockHash().ToString());
+        }
+
+        // Undo the transactions in reverse order, so that an output created
+        // and spent in this block is made unspent before it is erased.
+        CDBBatch batch(*m_db);
+        for (uint32_t tx_pos = block.vtx.size(); tx_pos-- > 0;) {
+            const CTransaction& tx = *block.vtx[tx_pos];
+            std::set<ScriptAsset> scripts;
+
+            for (uint32_t n = 0; n < tx.vout.size(); ++n) {
+                const CTxOut& txout = tx.vout[n];
+                if (txout.scriptPubKey.IsUnspendable()) continue;
+
+                const COutPoint outpoint(tx.GetHash(), n);
+                const uint256 script_hash = GetScriptHash(txout.scriptPubKey);
+                const uint32_t asset_no = GetOutputAssetNo(tx, n);
+                batch.Erase(DBOutpointKey(outpoint));
+                batch.Erase(DBUnspentKey(script_hash, asset_no, pindex->nHeight, tx_pos, outpoint));
+                scripts.emplace(script_hash, asset_no);
+            }
+
+            if (!tx.IsCoinBase()) {
+                for (const CTxIn& txin : tx.vin) {
+                    DBOutput output;
+                    if (!m_db->ReadOutput(txin.prevout, output)) {
+                        return error("%s: output %s spent by %s is not indexed",
+                                     __func__, txin.prevout.ToString(), tx.GetHash().ToString());
+                    }
+                    batch.Write(DBUnspentKey(output.script_hash, output.asset_no, output.height, output.tx_pos, txin.prevout), output.value);
+                    scripts.emplace(output.script_hash, output.asset_no);
+                }
+            }
+
+            for (const ScriptAsset& script : scripts) {
+                batch.Erase(DBHistoryKey(script.first, script.second, pindex->nHeight, tx_pos, tx.GetHash()));
+            }
+        }
+        if (!m_db->WriteBatch(batch)) {
+            return error("%s: Failed to write to %s database", __func__, GetName());
+        }
+    }
+
+    return BaseIndex::Rewind(current_tip, new_tip);
+}
+
+bool ScriptIndex::FindUnspent(const CScript& script, uint32_t asset_no, size_t skip, size_t count,
+                              std::vector<ScriptUnspent>& unspent) const
+{
+    const uint256 script_hash = GetScriptHash(script);
+    DBUnspentKey key;
+    CAmount value;
+
+    std::unique_ptr<CDBIterator> db_it(m_db->NewIterator());
+    for (db_it->Seek(DBUnspentKey(script_hash, asset_no, 0, 0, COutPoint(uint256(), 0))); db_it->Valid() && unspent.size() < count; db_it->Next()) {
+        if (!db_it->GetKey(key) || key.script_hash != script_hash || key.asset_no != asset_no) {
+            break;
+        }
+        if (skip > 0) {
+            --skip;
+            continue;
+        }
+        if (!db_it->GetValue(value)) {
+            return error("%s: unable to read value in %s at unspent output %s",
+                         __func__, GetName(), key.outpoint.ToString());
+        }
+        unspent.push_back(ScriptUnspent{key.outpoint, key.height, value});
+    }
+    return true;
+}
+
+bool ScriptIndex::FindHistory(const CScript& script, uint32_t asset_no, size_t skip, size_t count,
+                              std::vector<ScriptHistoryEntry>& history) const
+{
+    const uint256 script_hash = GetScriptHash(script);
+    DBHistoryKey key;
+    DBHistoryValue value;
+
+    std::unique_ptr<CDBIterator> db_it(m_db->NewIterator());
+    for (db_it->Seek(DBHistoryKey(script_hash, asset_no, 0, 0, uint256())); db_it->Valid() && history.size() < count; db_it->Next()) {
+        if (!db_it->GetKey(key) || key.script_hash != script_hash || key.asset_no != asset_no) {
+            break;
+        }
+        if (skip > 0) {
+            --skip;
+            continue;
+        }
+        if (!db_it->GetValue(value)) {
+            return error("%s: unable to read value in %s at transaction %s",
+                         __func__, GetName(), key.txid.ToString());
+        }
+        history.push_back(ScriptHistoryEntry{key.txid, key.height, value.received, value.spent});
+    }
+    return true;
+}
@@ -0,0 +1,102 @@
+// Copyright (c) 2019 The Vccoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef VCCOIN_INDEX_SCRIPTINDEX_H
+#define VCCOIN_INDEX_SCRIPTINDEX_H
+
+#include <amount.h>
+#include <index/base.h>
+#include <script/script.h>
+#include <uint256.h>
+
+#include <memory>
+#include <vector>
+
+/** Default for -scriptindex. */
+static const bool DEFAULT_SCRIPTINDEX = false;
+
+/** An unspent output paying to an indexed script. */
+struct ScriptUnspent
+{
+    COutPoint outpoint;
+    int height;
+    CAmount value;
+};
+
+/** A transaction that paid to or spent from an indexed script. */
+struct ScriptHistoryEntry
+{
+    uint256 txid;
+    int height;
+    CAmount received; //!< Sum of the outputs of txid paying to the script
+    CAmount spent;    //!< Sum of the outputs of the script spent by txid
+};
+
+/**
+ * ScriptIndex is used to look up the unspent outputs and the transaction
+ * history of a scriptPubKey in an asset. Entries are keyed by the SHA256 of
+ * the scriptPubKey, the asset number, the height and the position of the
+ * transaction in its block, so that the entries of a script in an asset are
+ * adjacent and in chain order.
+ *
+ * Outputs of asset transactions belong to the asset. When an asset transaction
+ * has more than one input and more than one output, its last output returns
+ * change of the fee in the main coin (asset 0) instead, as in the wallet. In
+ * particular every output of an asset creating coinbase belongs to the asset.
+ */
+class ScriptIndex final : public BaseIndex
+{
+protected:
+    class DB;
+
+private:
+    const std::unique_ptr<DB> m_db;
+
+protected:
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    bool Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip) override;
+
+    BaseIndex::DB& GetDB() const override;
+
+    const char* GetName() const override { return "scriptindex"; }
+
+public:
+    /// Constructs the index, which becomes available to be queried.
+    explicit ScriptIndex(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    // Destructor is declared because this class contains a unique_ptr to an incomplete type.
+    virtual ~ScriptIndex() override;
+
+    /// The hash scripts are indexed by.
+    static uint256 GetScriptHash(const CScript& script);
+
+    /// Get the unspent outputs paying to a script in an asset, in chain order.
+    ///
+    /// @param[in]   script  The scriptPubKey.
+    /// @param[in]   asset_no  The asset number, 0 for the main coin.
+    /// @param[in]   skip  The number of outputs to skip.
+    /// @param[in]   count  The maximum number of outputs to return.
+    /// @param[out]  unspent  The unspent outputs.
+    /// @return  false on database errors
+    bool FindUnspent(const CScript& script, uint32_t asset_no, size_t skip, size_t count,
+                     std::vector<ScriptUnspent>& unspent) const;
+
+    /// Get the transactions that paid to or spent from a script in an asset,
+    /// in chain order.
+    ///
+    /// @param[in]   script  The scriptPubKey.
+    /// @param[in]   asset_no  The asset number, 0 for the main coin.
+    /// @param[in]   skip  The number of transactions to skip.
+    /// @param[in]   count  The maximum number of transactions to return.
+    /// @param[out]  history  The transactions.
+    /// @return  false on database errors
+    bool FindHistory(const CScript& script, uint32_t asset_no, size_t skip, size_t count,
+                     std::vector<ScriptHistoryEntry>& history) const;
+};
+
+/// The global script index. May be null.
+extern std::unique_ptr<ScriptIndex> g_scriptindex;
+
+#endif // VCCOIN_INDEX_SCRIPTINDEX_H
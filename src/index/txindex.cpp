@@ -2,12 +2,20 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <core_memusage.h>
 #include <index/txindex.h>
 #include <shutdown.h>
+#include <streams.h>
+#include <txmempool.h>
 #include <ui_interface.h>
 #include <util/system.h>
 #include <validation.h>
 
+#include <algorithm>
+#include <list>
+#include <tuple>
+#include <unordered_map>
+
 #include <boost/thread.hpp>
 
 constexpr char DB_BEST_BLOCK = 'B';
@@ -19,16 +27,25 @@ std::unique_ptr<TxIndex> g_txindex;
 struct CDiskTxPos : public FlatFilePos
 {
     unsigned int nTxOffset; // after header
+    unsigned int nTxSize;   // 0 if written by a version that did not record it
 
-    ADD_SERIALIZE_METHODS;
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        s << static_cast<const FlatFilePos&>(*this) << VARINT(nTxOffset) << VARINT(nTxSize);
+    }
 
-    template <typename Stream, typename Operation>
-    inline void SerializationOp(Stream& s, Operation ser_action) {
-        READWRITEAS(FlatFilePos, *this);
-        READWRITE(VARINT(nTxOffset));
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        s >> static_cast<FlatFilePos&>(*this) >> VARINT(nTxOffset);
+        nTxSize = 0;
+        if (!s.empty()) {
+            s >> VARINT(nTxSize);
+        }
     }
 
-    CDiskTxPos(const FlatFilePos &blockIn, unsigned int nTxOffsetIn) : FlatFilePos(blockIn.nFile, blockIn.nPos), nTxOffset(nTxOffsetIn) {
+    CDiskTxPos(const FlatFilePos &blockIn, unsigned int nTxOffsetIn) : FlatFilePos(blockIn.nFile, blockIn.nPos), nTxOffset(nTxOffsetIn), nTxSize(0) {
     }
 
     CDiskTxPos() {
@@ -38,6 +55,7 @@ struct CDiskTxPos : public FlatFilePos
     void SetNull() {
         FlatFilePos::SetNull();
         nTxOffset = 0;
+        nTxSize = 0;
     }
 };
 
@@ -59,6 +77,10 @@ public:
     /// transaction hash is not indexed.
     bool ReadTxPos(const uint256& txid, CDiskTxPos& pos) const;
 
+    /// Read the disk locations of several transactions, in key order. positions receives the index
+    /// into txids and the location of every transaction that is indexed.
+    void ReadTxPos(const std::vector<uint256>& txids, std::vector<std::pair<size_t, CDiskTxPos>>& positions) const;
+
     /// Write a batch of transaction positions to the DB.
     bool WriteTxs(const std::vector<std::pair<uint256, CDiskTxPos>>& v_pos);
 
@@ -68,7 +90,7 @@ public:
 };
 
 TxIndex::DB::DB(size_t n_cache_size, bool f_memory, bool f_wipe) :
-    BaseIndex::DB(GetDataDir() / "indexes" / "txindex", n_cache_size, f_memory, f_wipe)
+    BaseIndex::DB(GetDataDir() / "indexes" / "txindex", n_cache_size, f_memory, f_wipe, false, GetDBOptions("txindex"))
 {}
 
 bool TxIndex::DB::ReadTxPos(const uint256 &txid, CDiskTxPos& pos) const
@@ -76,6 +98,22 @@ bool TxIndex::DB::ReadTxPos(const uint256 &txid, CDiskTxPos& pos) const
     return Read(std::make_pair(DB_TXINDEX, txid), pos);
 }
 
+void TxIndex::DB::ReadTxPos(const std::vector<uint256>& txids, std::vector<std::pair<size_t, CDiskTxPos>>& positions) const
+{
+    // Reading keys in order makes consecutive reads likely to hit the same
+    // table blocks.
+    std::vector<size_t> order(txids.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    std::sort(order.begin(), order.end(), [&txids](size_t a, size_t b) { return txids[a] < txids[b]; });
+
+    CDiskTxPos pos;
+    for (size_t i : order) {
+        if (Read(std::make_pair(DB_TXINDEX, txids[i]), pos)) {
+            positions.emplace_back(i, pos);
+        }
+    }
+}
+
 bool TxIndex::DB::WriteTxs(const std::vector<std::pair<uint256, CDiskTxPos>>& v_pos)
 {
     CDBBatch batch(*this);
@@ -223,8 +261,94 @@ bool TxIndex::DB::MigrateData(CBlockTreeDB& block_tree_db, const CBlockLocator&
     return true;
 }
 
+/**
+ * Memory-bounded cache of the transactions most recently looked up in the
+ * index, evicting the least recently used.
+ *
+ * Entries are removed when their transaction is written to the index again,
+ * which happens when it is included in a different block after a reorg. To
+ * keep a lookup that raced with such a write from adding a stale entry, a
+ * lookup only adds to the cache if no block was written since it started.
+ */
+class TxIndex::TxCache
+{
+public:
+    explicit TxCache(size_t max_usage) : m_max_usage(max_usage) {}
+
+    bool Get(const uint256& tx_hash, uint256& block_hash, CTransactionRef& tx)
+    {
+        LOCK(m_mutex);
+        auto it = m_map.find(tx_hash);
+        if (it == m_map.end()) return false;
+        m_entries.splice(m_entries.begin(), m_entries, it->second);
+        block_hash = it->second->block_hash;
+        tx = it->second->tx;
+        return true;
+    }
+
+    /** Returns the epoch to pass to Add(), to be taken before reading the index. */
+    uint64_t GetEpoch()
+    {
+        LOCK(m_mutex);
+        return m_epoch;
+    }
+
+    void Add(uint64_t epoch, const uint256& block_hash, const CTransactionRef& tx)
+    {
+        const size_t usage = RecursiveDynamicUsage(tx) + ENTRY_OVERHEAD;
+        LOCK(m_mutex);
+        if (epoch != m_epoch || usage > m_max_usage) return;
+        if (!m_map.emplace(tx->GetHash(), m_entries.end()).second) return;
+        m_entries.push_front(Entry{block_hash, tx, usage});
+        m_map[tx->GetHash()] = m_entries.begin();
+        m_usage += usage;
+        while (m_usage > m_max_usage) {
+            const Entry& last = m_entries.back();
+            m_usage -= last.usage;
+            m_map.erase(last.tx->GetHash());
+            m_entries.pop_back();
+        }
+    }
+
+    /** Called after the transactions of a block were written to the index. */
+    void Erase(const std::vector<CTransactionRef>& txs)
+    {
+        LOCK(m_mutex);
+        ++m_epoch;
+        if (m_map.empty()) return;
+        for (const CTransactionRef& tx : txs) {
+            auto it = m_map.find(tx->GetHash());
+            if (it != m_map.end()) {
+                m_usage -= it->second->usage;
+                m_entries.erase(it->second);
+                m_map.erase(it);
+            }
+        }
+    }
+
+private:
+    struct Entry
+    {
+        uint256 block_hash;
+        CTransactionRef tx;
+        size_t usage;
+    };
+
+    /** Approximate memory used by a list node and a map node, besides the transaction. */
+    static constexpr size_t ENTRY_OVERHEAD = sizeof(Entry) + sizeof(uint256) + 6 * sizeof(void*);
+
+    const size_t m_max_usage;
+
+    Mutex m_mutex;
+    std::list<Entry> m_entries GUARDED_BY(m_mutex); //!< Most recently used first
+    std::unordered_map<uint256, std::list<Entry>::iterator, SaltedTxidHasher> m_map GUARDED_BY(m_mutex);
+    size_t m_usage GUARDED_BY(m_mutex){0};
+    uint64_t m_epoch GUARDED_BY(m_mutex){0};
+};
+
 TxIndex::TxIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
-    : m_db(MakeUnique<TxIndex::DB>(n_cache_size, f_memory, f_wipe))
+    : m_db(MakeUnique<TxIndex::DB>(n_cache_size, f_memory, f_wipe)),
+      m_cache(MakeUnique<TxIndex::TxCache>(TXINDEX_LOOKUP_CACHE_SIZE))
 {}
 
 TxIndex::~TxIndex() {}
@@ -252,16 +376,61 @@ bool TxIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
     std::vector<std::pair<uint256, CDiskTxPos>> vPos;
     vPos.reserve(block.vtx.size());
     for (const auto& tx : block.vtx) {
+        pos.nTxSize = ::GetSerializeSize(*tx, CLIENT_VERSION);
         vPos.emplace_back(tx->GetHash(), pos);
-        pos.nTxOffset += ::GetSerializeSize(*tx, CLIENT_VERSION);
+        pos.nTxOffset += pos.nTxSize;
     }
-    return m_db->WriteTxs(vPos);
+    if (!m_db->WriteTxs(vPos)) {
+        return false;
+    }
+    m_cache->Erase(block.vtx);
+    return true;
 }
 
 BaseIndex::DB& TxIndex::GetDB() const { return *m_db; }
 
+/**
+ * Read the header of the block the transaction at pos is in, and position file
+ * at the start of the transaction. file must be open on the block file of pos.
+ * Throws on I/O and deserialization errors.
+ */
+static bool SeekToTx(CAutoFile& file, const CDiskTxPos& pos, uint256& block_hash)
+{
+    if (fseek(file.Get(), pos.nPos, SEEK_SET)) {
+        return error("%s: fseek(...) failed", __func__);
+    }
+    CBlockHeader header;
+    file >> header;
+    if (fseek(file.Get(), pos.nTxOffset, SEEK_CUR)) {
+        return error("%s: fseek(...) failed", __func__);
+    }
+    block_hash = header.GetHash();
+    return true;
+}
+
+static bool ReadTxFromFile(CAutoFile& file, const CDiskTxPos& pos, const uint256& tx_hash, uint256& block_hash, CTransactionRef& tx)
+{
+    try {
+        if (!SeekToTx(file, pos, block_hash)) {
+            return false;
+        }
+        file >> tx;
+    } catch (const std::exception& e) {
+        return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+    }
+    if (tx->GetHash() != tx_hash) {
+        return error("%s: txid mismatch", __func__);
+    }
+    return true;
+}
+
 bool TxIndex::FindTx(const uint256& tx_hash, uint256& block_hash, CTransactionRef& tx) const
 {
+    if (m_cache->Get(tx_hash, block_hash, tx)) {
+        return true;
+    }
+
+    const uint64_t epoch = m_cache->GetEpoch();
     CDiskTxPos postx;
     if (!m_db->ReadTxPos(tx_hash, postx)) {
         return false;
@@ -271,19 +440,101 @@ bool TxIndex::FindTx(const uint256& tx_hash, uint256& block_hash, CTransactionRe
     if (file.IsNull()) {
         return error("%s: OpenBlockFile failed", __func__);
     }
-    CBlockHeader header;
+    if (!ReadTxFromFile(file, postx, tx_hash, block_hash, tx)) {
+        return false;
+    }
+    m_cache->Add(epoch, block_hash, tx);
+    return true;
+}
+
+size_t TxIndex::FindTxs(const std::vector<uint256>& tx_hashes, std::vector<uint256>& block_hashes, std::vector<CTransactionRef>& txs) const
+{
+    block_hashes.assign(tx_hashes.size(), uint256());
+    txs.assign(tx_hashes.size(), nullptr);
+    size_t found = 0;
+
+    std::vector<uint256> missing_hashes;
+    std::vector<size_t> missing;
+    for (size_t i = 0; i < tx_hashes.size(); ++i) {
+        if (m_cache->Get(tx_hashes[i], block_hashes[i], txs[i])) {
+            ++found;
+        } else {
+            missing_hashes.push_back(tx_hashes[i]);
+            missing.push_back(i);
+        }
+    }
+    if (missing.empty()) {
+        return found;
+    }
+
+    const uint64_t epoch = m_cache->GetEpoch();
+    std::vector<std::pair<size_t, CDiskTxPos>> positions;
+    m_db->ReadTxPos(missing_hashes, positions);
+
+    // Read in disk order, opening every block file once.
+    std::sort(positions.begin(), positions.end(), [](const std::pair<size_t, CDiskTxPos>& a, const std::pair<size_t, CDiskTxPos>& b) {
+        return std::tie(a.second.nFile, a.second.nPos, a.second.nTxOffset) < std::tie(b.second.nFile, b.second.nPos, b.second.nTxOffset);
+    });
+    std::unique_ptr<CAutoFile> file;
+    int file_num = -1;
+    for (const auto& entry : positions) {
+        const size_t i = missing[entry.first];
+        const CDiskTxPos& pos = entry.second;
+        if (!file || pos.nFile != file_num) {
+            file = MakeUnique<CAutoFile>(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+            file_num = pos.nFile;
+        }
+        if (file->IsNull()) {
+            error("%s: OpenBlockFile failed", __func__);
+            continue;
+        }
+        if (!ReadTxFromFile(*file, pos, tx_hashes[i], block_hashes[i], txs[i])) {
+            txs[i] = nullptr;
+            block_hashes[i].SetNull();
+            continue;
+        }
+        m_cache->Add(epoch, block_hashes[i], txs[i]);
+        ++found;
+    }
+    return found;
+}
+
+bool TxIndex::FindRawTx(const uint256& tx_hash, uint256& block_hash, std::vector<unsigned char>& raw_tx) const
+{
+    CTransactionRef tx;
+    if (m_cache->Get(tx_hash, block_hash, tx)) {
+        raw_tx.clear();
+        CVectorWriter(SER_DISK, CLIENT_VERSION, raw_tx, 0, tx);
+        return true;
+    }
+
+    CDiskTxPos postx;
+    if (!m_db->ReadTxPos(tx_hash, postx)) {
+        return false;
+    }
+    if (postx.nTxSize == 0) {
+        // Indexed by an older version, so the size is only known after
+        // deserializing the transaction.
+        if (!FindTx(tx_hash, block_hash, tx)) {
+            return false;
+        }
+        raw_tx.clear();
+        CVectorWriter(SER_DISK, CLIENT_VERSION, raw_tx, 0, tx);
+        return true;
+    }
+
+    CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        return error("%s: OpenBlockFile failed", __func__);
+    }
     try {
-        file >> header;
-        if (fseek(file.Get(), postx.nTxOffset, SEEK_CUR)) {
-            return error("%s: fseek(...) failed", __func__);
+        if (!SeekToTx(file, postx, block_hash)) {
+            return false;
         }
-        file >> tx;
+        raw_tx.resize(postx.nTxSize);
+        file.read((char*)raw_tx.data(), raw_tx.size());
     } catch (const std::exception& e) {
-        return error("%s: Deserialize or I/O error - %s", __func__, e.what());
-    }
-    if (tx->GetHash() != tx_hash) {
-        return error("%s: txid mismatch", __func__);
+        return error("%s: I/O error - %s", __func__, e.what());
     }
-    block_hash = header.GetHash();
     return true;
 }
@@ -9,6 +9,9 @@
 #include <index/base.h>
 #include <txdb.h>
 
+/** Memory used by the cache of transactions looked up in the index, in bytes. */
+static const size_t TXINDEX_LOOKUP_CACHE_SIZE = 8 << 20;
+
 /**
  * TxIndex is used to look up transactions included in the blockchain by hash.
  * The index is written to a LevelDB database and records the filesystem
@@ -18,9 +21,11 @@ class TxIndex final : public BaseIndex
 {
 protected:
     class DB;
+    class TxCache;
 
 private:
     const std::unique_ptr<DB> m_db;
+    const std::unique_ptr<TxCache> m_cache;
 
 protected:
     /// Override base class init to migrate from old database.
@@ -36,7 +41,7 @@ public:
     /// Constructs the index, which becomes available to be queried.
     explicit TxIndex(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
 
-    // Destructor is declared because this class contains a unique_ptr to an incomplete type.
+    // Destructor is declared because this class contains unique_ptrs to incomplete types.
     virtual ~TxIndex() override;
 
     /// Look up a transaction by hash.
@@ -46,6 +51,25 @@ public:
     /// @param[out]  tx  The transaction itself.
     /// @return  true if transaction is found, false otherwise
     bool FindTx(const uint256& tx_hash, uint256& block_hash, CTransactionRef& tx) const;
+
+    /// Look up several transactions by hash. The positions are looked up in key
+    /// order and the transactions read in the order they are stored on disk.
+    ///
+    /// @param[in]   tx_hashes  The hashes of the transactions to be returned.
+    /// @param[out]  block_hashes  For each hash, the hash of the block the transaction is found in.
+    /// @param[out]  txs  For each hash, the transaction, or null if it was not found.
+    /// @return  the number of transactions found
+    size_t FindTxs(const std::vector<uint256>& tx_hashes, std::vector<uint256>& block_hashes, std::vector<CTransactionRef>& txs) const;
+
+    /// Look up a transaction by hash and return it as stored in the block file,
+    /// without deserializing it. Unlike FindTx, the data is not checked against
+    /// tx_hash.
+    ///
+    /// @param[in]   tx_hash  The hash of the transaction to be returned.
+    /// @param[out]  block_hash  The hash of the block the transaction is found in.
+    /// @param[out]  raw_tx  The serialized transaction, including witness data.
+    /// @return  true if transaction is found, false otherwise
+    bool FindRawTx(const uint256& tx_hash, uint256& block_hash, std::vector<unsigned char>& raw_tx) const;
 };
 
 /// The global transaction index, used in GetTransaction. May be null.
@@ -6,6 +6,7 @@
 
 #include <chain.h>
 #include <chainparams.h>
+#include <index/blockfilterindex.h>
 #include <interfaces/handler.h>
 #include <interfaces/wallet.h>
 #include <net.h>
@@ -278,6 +279,38 @@ public:
         }
         return true;
     }
+    bool findBlockFilterMatches(int start_height,
+        int stop_height,
+        const GCSFilter::ElementSet& elements,
+        std::vector<std::pair<uint256, bool>>& matches) override
+    {
+        const BlockFilterIndex* index = GetBlockFilterIndex(BlockFilterType::BASIC);
+        if (!index) {
+            return false;
+        }
+        const CBlockIndex* stop_index;
+        {
+            LOCK(cs_main);
+            stop_index = ::ChainActive()[stop_height];
+        }
+        std::vector<BlockFilter> filters;
+        if (!stop_index || start_height > stop_height ||
+            !index->LookupFilterRange(start_height, stop_index, filters)) {
+            return false;
+        }
+        std::vector<const GCSFilter*> gcs_filters;
+        gcs_filters.reserve(filters.size());
+        for (const BlockFilter& filter : filters) {
+            gcs_filters.push_back(&filter.GetFilter());
+        }
+        const std::vector<bool> results = GCSFilter::MatchAny(gcs_filters, elements);
+        matches.clear();
+        matches.reserve(filters.size());
+        for (size_t i = 0; i < filters.size(); ++i) {
+            matches.emplace_back(filters[i].GetBlockHash(), results[i]);
+        }
+        return true;
+    }
     void findCoins(std::map<COutPoint, Coin>& coins) override { return FindCoins(coins); }
     double guessVerificationProgress(const uint256& block_hash) override
     {
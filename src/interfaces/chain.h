@@ -6,6 +6,7 @@
 #define VCCOIN_INTERFACES_CHAIN_H
 
 #include "asset_coin.h"
+#include <blockfilter.h>            // For GCSFilter::ElementSet
 #include <optional.h>               // For Optional and nullopt
 #include <primitives/transaction.h> // For CTransactionRef
 
@@ -150,6 +151,15 @@ public:
         int64_t* time = nullptr,
         int64_t* max_time = nullptr) = 0;
 
+    //! Check which blocks of the active chain from start_height to
+    //! stop_height may contain any of the elements, using the basic block
+    //! filter index. Returns the hash of each block and whether it may match,
+    //! or false if the index is disabled or has not indexed the range yet.
+    virtual bool findBlockFilterMatches(int start_height,
+        int stop_height,
+        const GCSFilter::ElementSet& elements,
+        std::vector<std::pair<uint256, bool>>& matches) = 0;
+
     //! Look up unspent output information. Returns coins in the mempool and in
     //! the current chain UTXO set. Iterates through all the keys in the map and
     //! populates the values.
@@ -0,0 +1,301 @@
+// Copyright (c) 2019 The Vccoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <mempooljournal.h>
+
+#include <clientversion.h>
+#include <crypto/common.h>
+#include <hash.h>
+#include <logging.h>
+#include <serialize.h>
+#include <streams.h>
+#include <txmempool.h>
+#include <util/system.h>
+#include <util/time.h>
+
+#include <unordered_map>
+
+std::unique_ptr<MempoolJournal> g_mempool_journal;
+
+static const uint64_t MEMPOOL_JOURNAL_VERSION = 1;
+
+/** Rewrite the journal once it holds this many more records than twice the mempool size. */
+static const uint64_t JOURNAL_COMPACTION_SLACK = 1000;
+
+template <typename Iterator>
+static uint32_t RecordChecksum(Iterator begin, Iterator end)
+{
+    return ReadLE32(Hash(begin, end).begin());
+}
+
+MempoolJournal::MempoolJournal(CTxMemPool& pool, const fs::path& path) : m_pool(pool), m_path(path) {}
+
+MempoolJournal::~MempoolJournal()
+{
+    Stop();
+}
+
+bool MempoolJournal::Read(const fs::path& path, std::vector<PersistedMempoolTx>& txs, std::map<uint256, CAmount>& deltas)
+{
+    CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        return false;
+    }
+
+    try {
+        uint64_t version;
+        file >> version;
+        if (version != MEMPOOL_JOURNAL_VERSION) {
+            return false;
+        }
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to read mempool journal header: %s\n", e.what());
+        return false;
+    }
+
+    std::vector<PersistedMempoolTx> entries;
+    std::unordered_map<uint256, size_t, SaltedTxidHasher> index;
+    std::vector<unsigned char> record;
+    uint64_t num_records = 0;
+    while (true) {
+        // A missing, truncated or corrupt record ends the journal. This is
+        // expected after a crash, so it is not treated as an error.
+        try {
+            uint32_t size;
+            file >> size;
+            if (size > MAX_SIZE) break;
+            record.resize(size);
+            file.read((char*)record.data(), size);
+            uint32_t checksum;
+            file >> checksum;
+            if (checksum != RecordChecksum(record.begin(), record.end())) break;
+
+            CDataStream stream((const char*)record.data(), (const char*)record.data() + record.size(), SER_DISK, CLIENT_VERSION);
+            uint8_t type;
+            stream >> type;
+            if (type == RECORD_ADD) {
+                CTransactionRef tx;
+                int64_t nTime;
+                stream >> tx >> nTime;
+                if (index.emplace(tx->GetHash(), entries.size()).second) {
+                    entries.push_back(PersistedMempoolTx{tx, nTime, 0});
+                }
+            } else if (type == RECORD_REMOVE) {
+                uint256 txid;
+                stream >> txid;
+                auto it = index.find(txid);
+                if (it != index.end()) {
+                    entries[it->second].tx = nullptr;
+                    index.erase(it);
+                }
+            } else if (type == RECORD_DELTA) {
+                uint256 txid;
+                int64_t delta;
+                stream >> txid >> delta;
+                if (delta) {
+                    deltas[txid] = delta;
+                } else {
+                    deltas.erase(txid);
+                }
+            } else {
+                break;
+            }
+            ++num_records;
+        } catch (const std::exception&) {
+            break;
+        }
+    }
+
+    txs.reserve(index.size());
+    for (PersistedMempoolTx& entry : entries) {
+        if (!entry.tx) continue;
+        auto it = deltas.find(entry.tx->GetHash());
+        if (it != deltas.end()) {
+            entry.nFeeDelta = it->second;
+            deltas.erase(it);
+        }
+        txs.push_back(std::move(entry));
+    }
+
+    LogPrintf("Read mempool journal: %u records, %u transactions\n", num_records, txs.size());
+    return true;
+}
+
+bool MempoolJournal::Start()
+{
+    // Subscribe before taking the snapshot, so that no change is missed.
+    // Changes made before the snapshot are dropped by Compact().
+    m_conn_added = m_pool.NotifyEntryAdded.connect(std::bind(&MempoolJournal::TransactionAdded, this, std::placeholders::_1));
+    m_conn_removed = m_pool.NotifyEntryRemoved.connect(std::bind(&MempoolJournal::TransactionRemoved, this, std::placeholders::_1, std::placeholders::_2));
+
+    LOCK(m_file_mutex);
+    m_started = true;
+    return Compact();
+}
+
+void MempoolJournal::Stop()
+{
+    m_conn_added.disconnect();
+    m_conn_removed.disconnect();
+    Flush();
+
+    LOCK(m_file_mutex);
+    m_started = false;
+    if (m_file) {
+        fclose(m_file);
+        m_file = nullptr;
+    }
+}
+
+void MempoolJournal::TransactionAdded(const CTransactionRef& tx)
+{
+    LOCK(m_buffer_mutex);
+    m_buffer.push_back(Record{RECORD_ADD, tx, tx->GetHash(), GetTime()});
+}
+
+void MempoolJournal::TransactionRemoved(const CTransactionRef& tx, MemPoolRemovalReason reason)
+{
+    LOCK(m_buffer_mutex);
+    m_buffer.push_back(Record{RECORD_REMOVE, nullptr, tx->GetHash(), 0});
+}
+
+void MempoolJournal::AppendDeltas(const std::map<uint256, CAmount>& deltas, std::vector<Record>& records)
+{
+    for (const auto& delta : deltas) {
+        auto it = m_written_deltas.find(delta.first);
+        if (it == m_written_deltas.end() || it->second != delta.second) {
+            records.push_back(Record{RECORD_DELTA, nullptr, delta.first, delta.second});
+        }
+    }
+    for (const auto& delta : m_written_deltas) {
+        if (!deltas.count(delta.first)) {
+            records.push_back(Record{RECORD_DELTA, nullptr, delta.first, 0});
+        }
+    }
+    m_written_deltas = deltas;
+}
+
+void MempoolJournal::WriteRecords(CAutoFile& file, const std::vector<Record>& records)
+{
+    CDataStream stream(SER_DISK, CLIENT_VERSION);
+    for (const Record& record : records) {
+        stream.clear();
+        stream << (uint8_t)record.type;
+        switch (record.type) {
+        case RECORD_ADD:
+            stream << *record.tx << record.value;
+            break;
+        case RECORD_REMOVE:
+            stream << record.txid;
+            break;
+        case RECORD_DELTA:
+            stream << record.txid << record.value;
+            break;
+        }
+        file << (uint32_t)stream.size();
+        file.write(stream.data(), stream.size());
+        file << RecordChecksum(stream.begin(), stream.end());
+    }
+}
+
+bool MempoolJournal::Compact()
+{
+    AssertLockHeld(m_file_mutex);
+    int64_t start = GetTimeMicros();
+
+    std::vector<Record> records;
+    std::map<uint256, CAmount> deltas;
+    {
+        LOCK(m_pool.cs);
+        // infoAll() returns parents before their children.
+        for (const TxMempoolInfo& info : m_pool.infoAll()) {
+            records.push_back(Record{RECORD_ADD, info.tx, info.tx->GetHash(), info.nTime});
+        }
+        deltas = m_pool.mapDeltas;
+        // Everything recorded so far is part of the snapshot.
+        LOCK(m_buffer_mutex);
+        m_buffer.clear();
+    }
+    m_written_deltas.clear();
+    AppendDeltas(deltas, records);
+
+    if (m_file) {
+        fclose(m_file);
+        m_file = nullptr;
+    }
+
+    const fs::path path_new = m_path.string() + ".new";
+    try {
+        CAutoFile file(fsbridge::fopen(path_new, "wb"), SER_DISK, CLIENT_VERSION);
+        if (file.IsNull()) {
+            throw std::runtime_error("failed to open " + path_new.string());
+        }
+        file << MEMPOOL_JOURNAL_VERSION;
+        WriteRecords(file, records);
+        if (!FileCommit(file.Get())) {
+            throw std::runtime_error("FileCommit failed");
+        }
+        file.fclose();
+        if (!RenameOver(path_new, m_path)) {
+            throw std::runtime_error("rename failed");
+        }
+    } catch (const std::exception& e) {
+        // m_file stays null, so the next Flush() tries again.
+        LogPrintf("Failed to write mempool journal: %s\n", e.what());
+        return false;
+    }
+
+    m_file = fsbridge::fopen(m_path, "ab");
+    if (!m_file) {
+        LogPrintf("Failed to open mempool journal %s for appending\n", m_path.string());
+        return false;
+    }
+    m_records = records.size();
+    LogPrint(BCLog::MEMPOOL, "Rewrote mempool journal with %u records in %.2fms\n", m_records, (GetTimeMicros() - start) * 0.001);
+    return true;
+}
+
+void MempoolJournal::Flush()
+{
+    LOCK(m_file_mutex);
+    if (!m_started) return;
+    if (!m_file) {
+        Compact();
+        return;
+    }
+
+    std::vector<Record> records;
+    {
+        LOCK(m_buffer_mutex);
+        records.swap(m_buffer);
+    }
+    std::map<uint256, CAmount> deltas;
+    size_t pool_size;
+    {
+        LOCK(m_pool.cs);
+        deltas = m_pool.mapDeltas;
+        pool_size = m_pool.mapTx.size();
+    }
+    AppendDeltas(deltas, records);
+    if (records.empty()) return;
+
+    try {
+        CAutoFile file(m_file, SER_DISK, CLIENT_VERSION);
+        m_file = nullptr;
+        WriteRecords(file, records);
+        if (!FileCommit(file.Get())) {
+            throw std::runtime_error("FileCommit failed");
+        }
+        m_file = file.release();
+    } catch (const std::exception& e) {
+        // The file was closed; the next Flush() rewrites the journal.
+        LogPrintf("Failed to append to mempool journal: %s\n", e.what());
+        return;
+    }
+
+    m_records += records.size();
+    if (m_records > 2 * pool_size + JOURNAL_COMPACTION_SLACK) {
+        Compact();
+    }
+}
@@ -0,0 +1,117 @@
+// Copyright (c) 2019 The Vccoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef VCCOIN_MEMPOOLJOURNAL_H
+#define VCCOIN_MEMPOOLJOURNAL_H
+
+#include <amount.h>
+#include <fs.h>
+#include <primitives/transaction.h>
+#include <sync.h>
+#include <uint256.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include <boost/signals2/connection.hpp>
+
+class CAutoFile;
+class CTxMemPool;
+enum class MemPoolRemovalReason;
+
+/** File name of the mempool journal in the data directory. */
+static const char* const MEMPOOL_JOURNAL_FILENAME = "mempool.journal";
+/** Default for -mempooljournalinterval, in seconds. */
+static const int64_t DEFAULT_MEMPOOL_JOURNAL_INTERVAL = 10;
+
+/** A transaction restored from disk, to be added back to the mempool. */
+struct PersistedMempoolTx
+{
+    CTransactionRef tx;
+    int64_t nTime;
+    CAmount nFeeDelta;
+};
+
+/**
+ * Append-only journal of mempool changes, so that a node restarts with the
+ * mempool it had, even after a crash.
+ *
+ * Additions and removals are buffered in memory as the mempool signals them
+ * and appended to the journal by Flush(), which is run periodically in the
+ * background. Each record is length-prefixed and checksummed; a record that
+ * was only partially written before a crash ends the journal when it is read
+ * back. Once the journal holds many more records than the mempool has
+ * transactions, Flush() rewrites it from a snapshot of the mempool.
+ */
+class MempoolJournal
+{
+public:
+    MempoolJournal(CTxMemPool& pool, const fs::path& path);
+    ~MempoolJournal();
+
+    /**
+     * Read the journal at path. Returns false if there is no usable journal.
+     * txs receives the transactions that were in the mempool when the journal
+     * was last written, in the order they were added, with their fee deltas.
+     * deltas receives the fee deltas of transactions not in txs.
+     */
+    static bool Read(const fs::path& path, std::vector<PersistedMempoolTx>& txs, std::map<uint256, CAmount>& deltas);
+
+    /** Rewrite the journal from the current mempool and start recording changes. */
+    bool Start();
+
+    /** Write out all recorded changes and stop recording. */
+    void Stop();
+
+    /** Append recorded changes to the journal, rewriting it if it grew too large. */
+    void Flush();
+
+private:
+    enum RecordType : uint8_t {
+        RECORD_ADD = 1,
+        RECORD_REMOVE = 2,
+        RECORD_DELTA = 3,
+    };
+
+    struct Record
+    {
+        RecordType type;
+        CTransactionRef tx; //!< RECORD_ADD only
+        uint256 txid;
+        int64_t value;      //!< Entry time for RECORD_ADD, fee delta for RECORD_DELTA
+    };
+
+    void TransactionAdded(const CTransactionRef& tx);
+    void TransactionRemoved(const CTransactionRef& tx, MemPoolRemovalReason reason);
+
+    /** Rewrite the journal from a snapshot of the mempool. */
+    bool Compact() EXCLUSIVE_LOCKS_REQUIRED(m_file_mutex);
+    /** Append fee delta records for every delta that changed since the last write. */
+    void AppendDeltas(const std::map<uint256, CAmount>& deltas, std::vector<Record>& records) EXCLUSIVE_LOCKS_REQUIRED(m_file_mutex);
+    static void WriteRecords(CAutoFile& file, const std::vector<Record>& records);
+
+    CTxMemPool& m_pool;
+    const fs::path m_path;
+
+    Mutex m_buffer_mutex;
+    std::vector<Record> m_buffer GUARDED_BY(m_buffer_mutex);
+
+    Mutex m_file_mutex;
+    bool m_started GUARDED_BY(m_file_mutex){false};
+    //! Open for appending; null while the journal needs to be rewritten
+    FILE* m_file GUARDED_BY(m_file_mutex){nullptr};
+    uint64_t m_records GUARDED_BY(m_file_mutex){0};
+    std::map<uint256, CAmount> m_written_deltas GUARDED_BY(m_file_mutex);
+
+    boost::signals2::scoped_connection m_conn_added;
+    boost::signals2::scoped_connection m_conn_removed;
+};
+
+/** The global mempool journal. May be null. */
+extern std::unique_ptr<MempoolJournal> g_mempool_journal;
+
+#endif // VCCOIN_MEMPOOLJOURNAL_H
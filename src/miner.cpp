@@ -25,6 +25,8 @@
 #include <wallet/wallet.h>
 
 #include <algorithm>
+#include <functional>
+#include <numeric>
 #include <queue>
 #include <utility>
 
@@ -43,6 +45,85 @@ int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParam
     return nNewTime - nOldTime;
 }
 
+BlockTemplateCache::BlockTemplateCache(CTxMemPool& pool) : m_pool(pool)
+{
+    m_conn_added = pool.NotifyEntryAdded.connect(std::bind(&BlockTemplateCache::TransactionAdded, this, std::placeholders::_1));
+    m_conn_removed = pool.NotifyEntryRemoved.connect(std::bind(&BlockTemplateCache::TransactionRemoved, this, std::placeholders::_1, std::placeholders::_2));
+}
+
+void BlockTemplateCache::Invalidate()
+{
+    m_valid = false;
+    m_selected.clear();
+    m_selected_index.clear();
+    m_pending.clear();
+}
+
+void BlockTemplateCache::TransactionAdded(CTransactionRef tx)
+{
+    AssertLockHeld(m_pool.cs);
+    if (!m_valid) return;
+    if (m_transactions_updated != m_pool.GetTransactionsUpdated()) {
+        // Something untracked happened (such as a new tip), so the cache will
+        // not be used again. Drop it rather than queueing up more additions.
+        Invalidate();
+        return;
+    }
+    m_pending.push_back(tx->GetHash());
+    ++m_transactions_updated;
+}
+
+void BlockTemplateCache::TransactionRemoved(CTransactionRef tx, MemPoolRemovalReason reason)
+{
+    AssertLockHeld(m_pool.cs);
+    if (!m_valid) return;
+    if (m_transactions_updated != m_pool.GetTransactionsUpdated()) {
+        Invalidate();
+        return;
+    }
+    // Called before the entry is erased, so the selection never holds a
+    // dangling iterator. Descendants are removed (and notified) as well,
+    // which keeps the remaining selection valid.
+    auto it = m_selected_index.find(tx->GetHash());
+    if (it != m_selected_index.end()) {
+        m_selected.erase(it->second);
+        m_selected_index.erase(it);
+    }
+    ++m_transactions_updated;
+}
+
+bool BlockTemplateCache::IsValidFor(const uint256& tip, unsigned int max_weight, bool include_witness, int64_t locktime_cutoff) const
+{
+    return m_valid && m_tip == tip && m_max_weight == max_weight && m_include_witness == include_witness &&
+           m_locktime_cutoff == locktime_cutoff && m_transactions_updated == m_pool.GetTransactionsUpdated();
+}
+
+void BlockTemplateCache::Reset(const uint256& tip, unsigned int max_weight, bool include_witness, int64_t locktime_cutoff, const std::vector<CTxMemPool::txiter>& selected)
+{
+    Invalidate();
+    m_valid = true;
+    m_tip = tip;
+    m_max_weight = max_weight;
+    m_include_witness = include_witness;
+    m_locktime_cutoff = locktime_cutoff;
+    m_transactions_updated = m_pool.GetTransactionsUpdated();
+    for (CTxMemPool::txiter it : selected) {
+        Append(it);
+    }
+}
+
+void BlockTemplateCache::Append(CTxMemPool::txiter it)
+{
+    m_selected_index.emplace(it->GetTx().GetHash(), m_selected.insert(m_selected.end(), it));
+}
+
+static BlockTemplateCache& GetBlockTemplateCache()
+{
+    // Constructed on first use, after (and so destroyed before) the mempool.
+    static BlockTemplateCache cache(::mempool);
+    return cache;
+}
+
 BlockAssembler::Options::Options()
 {
     blockMinFeeRate = CFeeRate(DEFAULT_BLOCK_MIN_TX_FEE);
@@ -85,6 +166,8 @@ void BlockAssembler::resetBlock()
     // These counters do not include coinbase tx
     nBlockTx = 0;
     nFees = 0;
+
+    fSelectionComplete = true;
 }
 
 CAmount WorkoutFee(const CTransaction* tx);
@@ -92,15 +175,18 @@ Optional<int64_t> BlockAssembler::m_last_block_num_txs{nullopt};
 Optional<int64_t> BlockAssembler::m_last_block_weight{nullopt};
 
 std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn, const int AssetNo, const CAmount MaxMoney, bool DoAssetCreate, bool amounttoaddress)
+{
+    std::vector<std::unique_ptr<CBlockTemplate>> templates = CreateNewBlocks({CoinbaseVariant(scriptPubKeyIn, AssetNo, MaxMoney, DoAssetCreate, amounttoaddress)});
+    return std::move(templates[0]);
+}
+
+std::vector<std::unique_ptr<CBlockTemplate>> BlockAssembler::CreateNewBlocks(const std::vector<CoinbaseVariant>& variants)
 {
     int64_t nTimeStart = GetTimeMicros();
 
     resetBlock();
 
     pblocktemplate.reset(new CBlockTemplate());
-
-    if (!pblocktemplate.get())
-        return nullptr;
     pblock = &pblocktemplate->block; // pointer for convenience
 
     // Add dummy coinbase tx as first transaction
@@ -108,6 +194,16 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     pblocktemplate->vTxFees.push_back(-1);       // updated at end
     pblocktemplate->vTxSigOpsCost.push_back(-1); // updated at end
 
+    // Without a main wallet, as in unit tests, the fees go to the coinbase
+    // script. Its address is read before taking mempool.cs, as the wallet
+    // locks cs_wallet first.
+    Optional<CScript> main_asset_address;
+    std::shared_ptr<CWallet> main_wallet = ::GetMainWallet();
+    if (main_wallet) {
+        LOCK(main_wallet->cs_wallet);
+        main_asset_address = main_wallet->GetMainAssetAddress();
+    }
+
     LOCK2(cs_main, mempool.cs);
     CBlockIndex* pindexPrev = ::ChainActive().Tip();
     assert(pindexPrev != nullptr);
@@ -135,56 +231,95 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     // transaction (which in most cases can be a no-op).
     fIncludeWitness = IsWitnessEnabled(pindexPrev, chainparams.GetConsensus());
 
+    // Variants paying out to an address get a block without mempool
+    // transactions; all others share one transaction selection.
+    std::unique_ptr<CBlockTemplate> empty_template;
+    bool fSelectTxs = false;
+    for (const CoinbaseVariant& variant : variants) {
+        if (variant.amounttoaddress) {
+            if (!empty_template) empty_template.reset(new CBlockTemplate(*pblocktemplate));
+        } else {
+            fSelectTxs = true;
+        }
+    }
+
     int nPackagesSelected = 0;
     int nDescendantsUpdated = 0;
-    if (!amounttoaddress) {
-        addPackageTxs(nPackagesSelected, nDescendantsUpdated);
-    }
-    
-    CAmount curFee = nFees;
-    /*
-    for (auto tx : pblock->vtx) {
-        if (tx == nullptr) {
-            continue;
+    if (fSelectTxs) {
+        BlockTemplateCache& cache = GetBlockTemplateCache();
+        if (!addCachedTxs(cache, pindexPrev->GetBlockHash())) {
+            addPackageTxs(nPackagesSelected, nDescendantsUpdated);
+            if (fSelectionComplete) {
+                std::vector<CTxMemPool::txiter> selected;
+                selected.reserve(nBlockTx);
+                for (size_t i = 1; i < pblock->vtx.size(); ++i) {
+                    selected.push_back(mempool.mapTx.find(pblock->vtx[i]->GetHash()));
+                }
+                cache.Reset(pindexPrev->GetBlockHash(), nBlockMaxWeight, fIncludeWitness, nLockTimeCutoff, selected);
+            } else {
+                cache.Invalidate();
+            }
         }
-
-        curFee += WorkoutFee(&*tx);
     }
-    */
 
     int64_t nTime1 = GetTimeMicros();
 
     m_last_block_num_txs = nBlockTx;
     m_last_block_weight = nBlockWeight;
 
+    std::vector<std::unique_ptr<CBlockTemplate>> templates;
+    templates.reserve(variants.size());
+    for (const CoinbaseVariant& variant : variants) {
+        std::unique_ptr<CBlockTemplate> blocktemplate;
+        if (variant.amounttoaddress) {
+            blocktemplate.reset(new CBlockTemplate(*empty_template));
+            FinishBlock(*blocktemplate, pindexPrev, variant, 0, main_asset_address);
+        } else {
+            blocktemplate.reset(new CBlockTemplate(*pblocktemplate));
+            FinishBlock(*blocktemplate, pindexPrev, variant, nFees, main_asset_address);
+        }
+        templates.push_back(std::move(blocktemplate));
+    }
+
+    int64_t nTime2 = GetTimeMicros();
+
+    LogPrint(BCLog::BENCH, "CreateNewBlock() packages: %.2fms (%d packages, %d updated descendants), validity: %.2fms for %u templates (total %.2fms)\n", 0.001 * (nTime1 - nTimeStart), nPackagesSelected, nDescendantsUpdated, 0.001 * (nTime2 - nTime1), templates.size(), 0.001 * (nTime2 - nTimeStart));
+
+    return templates;
+}
+
+void BlockAssembler::FinishBlock(CBlockTemplate& blocktemplate, CBlockIndex* pindexPrev, const CoinbaseVariant& variant, CAmount curFee, const Optional<CScript>& main_asset_address) const
+{
+    CBlock& block = blocktemplate.block;
+
     // Create coinbase transaction.
     CMutableTransaction coinbaseTx;
 
     // fixed by luolin
     // always set main asset for coinbase
-    coinbaseTx.nAssetNo = AssetNo;
-    if (DoAssetCreate) {
+    coinbaseTx.nAssetNo = variant.AssetNo;
+    if (variant.DoAssetCreate) {
         coinbaseTx.AssetFlag |= ASSET_FLAG_CREATE_ASSET;
     }
-    if (amounttoaddress) {
+    if (variant.amounttoaddress) {
         coinbaseTx.AssetFlag |= AMOUNT_TO_ADDRESS;
     }
 
     coinbaseTx.vin.resize(1);
     coinbaseTx.vin[0].prevout.SetNull();
     coinbaseTx.vout.resize(1);
-    coinbaseTx.vout[0].scriptPubKey = scriptPubKeyIn;
+    coinbaseTx.vout[0].scriptPubKey = variant.scriptPubKey;
     // fixed by luolin
-    if (AssetNo == 0) {
+    if (variant.AssetNo == 0) {
         //coinbaseTx.vout[0].nValue = nFees + GetBlockSubsidy(nHeight, chainparams.GetConsensus());
         if (nHeight == GENERATE_ALLCOINS_BLOCK_HEIGHT) {
-            coinbaseTx.vout[0].nValue = MaxMoney;           //MAX_MONEY;
+            coinbaseTx.vout[0].nValue = variant.MaxMoney;           //MAX_MONEY;
         } else {
-            if (amounttoaddress) {
-                coinbaseTx.vout[0].scriptPubKey = scriptPubKeyIn;
-                coinbaseTx.vout[0].nValue = MaxMoney;
+            if (variant.amounttoaddress) {
+                coinbaseTx.vout[0].scriptPubKey = variant.scriptPubKey;
+                coinbaseTx.vout[0].nValue = variant.MaxMoney;
             } else {
-                CScript MainCoinAddress = ::GetMainWallet()->GetMainAssetAddress();
+                CScript MainCoinAddress = main_asset_address ? *main_asset_address : variant.scriptPubKey;
                 if (!MainCoinAddress.IsUnspendable() && curFee > 0) {
                     coinbaseTx.vout[0].scriptPubKey = MainCoinAddress;
                     coinbaseTx.vout[0].nValue = curFee;
@@ -194,38 +329,34 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
             }
         }
     } else {
-        if (DoAssetCreate || amounttoaddress) {
-            coinbaseTx.vout[0].nValue = MaxMoney;
+        if (variant.DoAssetCreate || variant.amounttoaddress) {
+            coinbaseTx.vout[0].nValue = variant.MaxMoney;
         } else{
             coinbaseTx.vout[0].nValue = 0;
         }
     }
     coinbaseTx.vin[0].scriptSig = CScript() << nHeight << OP_0;
-    pblock->vtx[0] = MakeTransactionRef(std::move(coinbaseTx));
-    pblocktemplate->vchCoinbaseCommitment = GenerateCoinbaseCommitment(*pblock, pindexPrev, chainparams.GetConsensus());
-    pblocktemplate->vTxFees[0] = -nFees;
+    block.vtx[0] = MakeTransactionRef(std::move(coinbaseTx));
+    blocktemplate.vchCoinbaseCommitment = GenerateCoinbaseCommitment(block, pindexPrev, chainparams.GetConsensus());
+    blocktemplate.vTxFees[0] = -curFee;
 
-    LogPrintf("CreateNewBlock(): block weight: %u txs: %u fees: %ld sigops %d\n", GetBlockWeight(*pblock), nBlockTx, nFees, nBlockSigOpsCost);
+    // Reserved coinbase sigops plus those of the selected transactions
+    int64_t nSigOpsCost = std::accumulate(blocktemplate.vTxSigOpsCost.begin() + 1, blocktemplate.vTxSigOpsCost.end(), int64_t{400});
+    LogPrintf("CreateNewBlock(): block weight: %u txs: %u fees: %ld sigops %d\n", GetBlockWeight(block), block.vtx.size() - 1, curFee, nSigOpsCost);
 
     // Fill in header
-    pblock->hashPrevBlock = pindexPrev->GetBlockHash();
-    UpdateTime(pblock, chainparams.GetConsensus(), pindexPrev);
-    pblock->nBits = GetNextWorkRequired(pindexPrev, pblock, chainparams.GetConsensus());
-    pblock->nNonce = 0;
-    pblocktemplate->vTxSigOpsCost[0] = WITNESS_SCALE_FACTOR * GetLegacySigOpCount(*pblock->vtx[0]);
+    block.hashPrevBlock = pindexPrev->GetBlockHash();
+    UpdateTime(&block, chainparams.GetConsensus(), pindexPrev);
+    block.nBits = GetNextWorkRequired(pindexPrev, &block, chainparams.GetConsensus());
+    block.nNonce = 0;
+    blocktemplate.vTxSigOpsCost[0] = WITNESS_SCALE_FACTOR * GetLegacySigOpCount(*block.vtx[0]);
 
     if (nHeight != GENERATE_ALLCOINS_BLOCK_HEIGHT) {
         CValidationState state;
-        if (!TestBlockValidity(state, chainparams, *pblock, pindexPrev, false, false)) {
+        if (!TestBlockValidity(state, chainparams, block, pindexPrev, false, false)) {
             throw std::runtime_error(strprintf("%s: TestBlockValidity failed: %s", __func__, FormatStateMessage(state)));
         }
     }
-
-    int64_t nTime2 = GetTimeMicros();
-
-    LogPrint(BCLog::BENCH, "CreateNewBlock() packages: %.2fms (%d packages, %d updated descendants), validity: %.2fms (total %.2fms)\n", 0.001 * (nTime1 - nTimeStart), nPackagesSelected, nDescendantsUpdated, 0.001 * (nTime2 - nTime1), 0.001 * (nTime2 - nTimeStart));
-
-    return std::move(pblocktemplate);
 }
 
 void BlockAssembler::onlyUnconfirmed(CTxMemPool::setEntries& testSet)
@@ -241,11 +372,16 @@ void BlockAssembler::onlyUnconfirmed(CTxMemPool::setEntries& testSet)
 }
 
 bool BlockAssembler::TestPackage(uint64_t packageSize, int64_t packageSigOpsCost) const
+{
+    return TestPackage(nBlockWeight, nBlockSigOpsCost, packageSize, packageSigOpsCost);
+}
+
+bool BlockAssembler::TestPackage(uint64_t blockWeight, int64_t blockSigOpsCost, uint64_t packageSize, int64_t packageSigOpsCost) const
 {
     // TODO: switch to weight-based accounting for packages instead of vsize-based accounting.
-    if (nBlockWeight + WITNESS_SCALE_FACTOR * packageSize >= nBlockMaxWeight)
+    if (blockWeight + WITNESS_SCALE_FACTOR * packageSize >= nBlockMaxWeight)
         return false;
-    if (nBlockSigOpsCost + packageSigOpsCost >= MAX_BLOCK_SIGOPS_COST)
+    if (blockSigOpsCost + packageSigOpsCost >= MAX_BLOCK_SIGOPS_COST)
         return false;
     return true;
 }
@@ -423,6 +559,7 @@ void BlockAssembler::addPackageTxs(int& nPackagesSelected, int& nDescendantsUpda
         */
 
         if (!TestPackage(packageSize, packageSigOpsCost)) {
+            fSelectionComplete = false;
             if (fUsingModified) {
                 // Since we always look at the best entry in mapModifiedTx,
                 // we must erase failed entries so that we can consider the
@@ -478,6 +615,51 @@ void BlockAssembler::addPackageTxs(int& nPackagesSelected, int& nDescendantsUpda
     }
 }
 
+bool BlockAssembler::addCachedTxs(BlockTemplateCache& cache, const uint256& hashPrevBlock)
+{
+    if (!cache.IsValidFor(hashPrevBlock, nBlockMaxWeight, fIncludeWitness, nLockTimeCutoff)) {
+        return false;
+    }
+
+    uint64_t nWeight = nBlockWeight;
+    int64_t nSigOpsCost = nBlockSigOpsCost;
+    for (CTxMemPool::txiter it : cache.m_selected) {
+        nWeight += it->GetTxWeight();
+        nSigOpsCost += it->GetSigOpCost();
+    }
+
+    // The cached selection holds every eligible transaction, so a new one is
+    // eligible exactly when all its in-mempool parents are selected, and is
+    // then a package on its own. All of them must fit, otherwise package
+    // selection has to choose between them; the block is only filled once
+    // that is known.
+    for (const uint256& hash : cache.m_pending) {
+        CTxMemPool::txiter it = mempool.mapTx.find(hash);
+        if (it == mempool.mapTx.end() || cache.m_selected_index.count(hash)) continue;
+        bool fParentsSelected = true;
+        for (CTxMemPool::txiter parent : mempool.GetMemPoolParents(it)) {
+            if (!cache.m_selected_index.count(parent->GetTx().GetHash())) {
+                fParentsSelected = false;
+                break;
+            }
+        }
+        if (!fParentsSelected || !TestPackageTransactions(CTxMemPool::setEntries{it})) continue;
+        if (!TestPackage(nWeight, nSigOpsCost, it->GetTxSize(), it->GetSigOpCost())) {
+            cache.Invalidate();
+            return false;
+        }
+        nWeight += it->GetTxWeight();
+        nSigOpsCost += it->GetSigOpCost();
+        cache.Append(it);
+    }
+    cache.m_pending.clear();
+
+    for (CTxMemPool::txiter it : cache.m_selected) {
+        AddToBlock(it);
+    }
+    return true;
+}
+
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce)
 {
     // Update nExtraNonce
@@ -11,8 +11,10 @@
 #include <txmempool.h>
 #include <validation.h>
 
+#include <list>
 #include <memory>
 #include <stdint.h>
+#include <unordered_map>
 
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/ordered_index.hpp>
@@ -122,6 +124,72 @@ struct update_for_parent_inclusion
     CTxMemPool::txiter iter;
 };
 
+/**
+ * Transaction selection of the most recent block template, kept in sync with
+ * the mempool so that templates on the same tip can be refreshed without
+ * rerunning package selection over the whole mempool.
+ *
+ * Removals from the mempool are applied as they happen; additions are queued
+ * and checked against the template when the next one is requested. Only a
+ * selection that included every eligible mempool transaction is cached: once
+ * something does not fit, ancestor fee rate order matters again and the next
+ * template is assembled from scratch. Any other change to the mempool (clear,
+ * prioritisation, a new tip) also drops the cache.
+ *
+ * All state is guarded by the mempool's lock.
+ */
+class BlockTemplateCache
+{
+public:
+    explicit BlockTemplateCache(CTxMemPool& pool);
+
+    /** Forget the cached selection. */
+    void Invalidate();
+
+private:
+    friend class BlockAssembler;
+
+    void TransactionAdded(CTransactionRef tx);
+    void TransactionRemoved(CTransactionRef tx, MemPoolRemovalReason reason);
+
+    /** Whether the cached selection was made under the same conditions and
+     *  nothing changed in the mempool that was not tracked. */
+    bool IsValidFor(const uint256& tip, unsigned int max_weight, bool include_witness, int64_t locktime_cutoff) const;
+    /** Replace the cached selection with a freshly assembled one. */
+    void Reset(const uint256& tip, unsigned int max_weight, bool include_witness, int64_t locktime_cutoff, const std::vector<CTxMemPool::txiter>& selected);
+    void Append(CTxMemPool::txiter it);
+
+    CTxMemPool& m_pool;
+    boost::signals2::scoped_connection m_conn_added;
+    boost::signals2::scoped_connection m_conn_removed;
+
+    bool m_valid{false};
+    uint256 m_tip;
+    unsigned int m_max_weight{0};
+    bool m_include_witness{false};
+    int64_t m_locktime_cutoff{0};
+    //! Expected value of the mempool's transactions updated counter
+    unsigned int m_transactions_updated{0};
+    //! Selected transactions, in an order valid for a block
+    std::list<CTxMemPool::txiter> m_selected;
+    std::unordered_map<uint256, std::list<CTxMemPool::txiter>::iterator, SaltedTxidHasher> m_selected_index;
+    //! Transactions added to the mempool since, in order of arrival
+    std::vector<uint256> m_pending;
+};
+
+/** The coinbase of a block template: who is paid, and in which asset */
+struct CoinbaseVariant
+{
+    CScript scriptPubKey;
+    int AssetNo;
+    CAmount MaxMoney;
+    bool DoAssetCreate;
+    bool amounttoaddress;
+
+    explicit CoinbaseVariant(const CScript& scriptPubKeyIn, int AssetNoIn = 0, CAmount MaxMoneyIn = 0, bool DoAssetCreateIn = false, bool amounttoaddressIn = false)
+        : scriptPubKey(scriptPubKeyIn), AssetNo(AssetNoIn), MaxMoney(MaxMoneyIn), DoAssetCreate(DoAssetCreateIn), amounttoaddress(amounttoaddressIn) {}
+};
+
 /** Generate a new block, without valid proof-of-work */
 class BlockAssembler
 {
@@ -142,6 +210,8 @@ private:
     uint64_t nBlockSigOpsCost;
     CAmount nFees;
     CTxMemPool::setEntries inBlock;
+    // Whether package selection included every eligible transaction
+    bool fSelectionComplete;
 
     // Chain context for the block
     int nHeight;
@@ -160,6 +230,10 @@ public:
 
     /** Construct a new block template with coinbase to scriptPubKeyIn */
     std::unique_ptr<CBlockTemplate> CreateNewBlock(const CScript& scriptPubKeyIn, const int AssetNo = 0, const CAmount MaxMoney = 0, bool DoAssetCreate=false, bool amounttoaddress=false);
+    /** Construct a block template for each coinbase variant. Mempool
+     *  transactions are selected once and shared by all templates, except
+     *  those of variants paying out to an address, which get none. */
+    std::vector<std::unique_ptr<CBlockTemplate>> CreateNewBlocks(const std::vector<CoinbaseVariant>& variants);
 
     static Optional<int64_t> m_last_block_num_txs;
     static Optional<int64_t> m_last_block_weight;
@@ -170,18 +244,27 @@ private:
     void resetBlock();
     /** Add a tx to the block */
     void AddToBlock(CTxMemPool::txiter iter);
+    /** Fill in the coinbase and header of a template holding the selected transactions,
+     *  paying the fees to the main wallet's asset address if there is one */
+    void FinishBlock(CBlockTemplate& blocktemplate, CBlockIndex* pindexPrev, const CoinbaseVariant& variant, CAmount curFee, const Optional<CScript>& main_asset_address) const EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
     // Methods for how to add transactions to a block.
     /** Add transactions based on feerate including unconfirmed ancestors
       * Increments nPackagesSelected / nDescendantsUpdated with corresponding
       * statistics from the package selection (for logging statistics). */
     void addPackageTxs(int &nPackagesSelected, int &nDescendantsUpdated) EXCLUSIVE_LOCKS_REQUIRED(mempool.cs);
+    /** Add the transactions of the cached template and those that entered the
+      * mempool since. Returns false, leaving the block empty, if the cache
+      * cannot be used and package selection has to be run instead. */
+    bool addCachedTxs(BlockTemplateCache& cache, const uint256& hashPrevBlock) EXCLUSIVE_LOCKS_REQUIRED(mempool.cs);
 
     // helper functions for addPackageTxs()
     /** Remove confirmed (inBlock) entries from given set */
     void onlyUnconfirmed(CTxMemPool::setEntries& testSet);
     /** Test if a new package would "fit" in the block */
     bool TestPackage(uint64_t packageSize, int64_t packageSigOpsCost) const;
+    /** Test if a new package would "fit" in a block of the given weight and sigops cost */
+    bool TestPackage(uint64_t blockWeight, int64_t blockSigOpsCost, uint64_t packageSize, int64_t packageSigOpsCost) const;
     /** Perform checks on each transaction in a package:
       * locktime, premature-witness, serialized size (if necessary)
       * These checks should always succeed, and they're here
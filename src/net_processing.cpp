@@ -23,6 +23,7 @@
 #include <random.h>
 #include <reverse_iterator.h>
 #include <scheduler.h>
+#include <timerwheel.h>
 #include <tinyformat.h>
 #include <txmempool.h>
 #include <ui_interface.h>
@@ -33,6 +34,7 @@
 #include <wallet/wallet.h>
 
 #include <memory>
+#include <unordered_map>
 
 #if defined(NDEBUG)
 #error "Vccoin cannot be compiled without assertions."
@@ -109,6 +111,11 @@ static const unsigned int INVENTORY_BROADCAST_INTERVAL = 5;
 /** Maximum number of inventory items to send per transmission.
  *  Limits the impact of low-fee transaction floods. */
 static constexpr unsigned int INVENTORY_BROADCAST_MAX = 7 * INVENTORY_BROADCAST_INTERVAL;
+/** Tick length of the inventory trickle timer wheel in microseconds, and the
+ *  maximum age of the shared relay ordering data. */
+static constexpr int64_t INVENTORY_TRICKLE_TICK = 100 * 1000;
+/** Number of slots in the inventory trickle timer wheel (one minute per revolution). */
+static constexpr size_t INVENTORY_TRICKLE_WHEEL_SLOTS = 600;
 /** Average delay between feefilter broadcasts in seconds. */
 static constexpr unsigned int AVG_FEEFILTER_BROADCAST_INTERVAL = 10 * 60;
 /** Maximum feefilter broadcast delay after significant change. */
@@ -155,6 +162,7 @@ struct QueuedBlock {
     const CBlockIndex* pindex;                              //!< Optional.
     bool fValidatedHeaders;                                 //!< Whether this block has validated headers at the time of request.
     std::unique_ptr<PartiallyDownloadedBlock> partialBlock; //!< Optional, used for CMPCTBLOCK downloads
+    int64_t nTimeRequested;                                 //!< When the block was requested, in microseconds.
 };
 std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator>> mapBlocksInFlight GUARDED_BY(cs_main);
 
@@ -179,6 +187,15 @@ MapRelay mapRelay GUARDED_BY(cs_main);
 /** Expiration-time ordered list of (expire time, relay map entry) pairs. */
 std::deque<std::pair<int64_t, MapRelay::iterator>> vRelayExpiration GUARDED_BY(cs_main);
 
+/** Next inventory trickle of every peer, keyed by NodeId. */
+TimerWheel g_trickle_wheel GUARDED_BY(cs_main){INVENTORY_TRICKLE_TICK, INVENTORY_TRICKLE_WHEEL_SLOTS};
+/** Relay ordering data of the transactions announced in the current trickle
+ *  epoch. Peers trickling in the same epoch (e.g. all inbound peers, which
+ *  share one timer) look up each transaction in the mempool only once. */
+std::unordered_map<uint256, TxRelayInfo, SaltedTxidHasher> g_trickle_relay_info GUARDED_BY(cs_main);
+uint64_t g_trickle_relay_info_epoch GUARDED_BY(cs_main) = 0;
+int64_t g_trickle_relay_info_time GUARDED_BY(cs_main) = 0;
+
 struct IteratorComparator {
     template <typename I>
     bool operator()(const I& a, const I& b) const
@@ -241,6 +258,23 @@ struct CNodeState {
     int64_t nDownloadingSince;
     int nBlocksInFlight;
     int nBlocksInFlightValidHeaders;
+    /**
+     * Block download model of this peer, measured from the blocks, compact
+     * blocks and headers it delivered. Exponentially weighted moving averages,
+     * 0 until a sample was taken.
+     */
+    struct BlockDownloadStats {
+        //! Time the peer spends on one block at the head of its queue, in microseconds.
+        int64_t m_service_time;
+        //! Time between requesting a block and receiving it, in microseconds.
+        int64_t m_latency;
+        //! Time between requesting headers and receiving them, in microseconds.
+        //! Kept apart from m_latency, which decides when blocks are straggling.
+        int64_t m_headers_latency;
+    };
+    BlockDownloadStats m_block_download;
+    //! When headers were requested from this peer for headers sync, 0 once they arrived.
+    int64_t m_headers_requested;
     //! Whether we consider this a preferred download peer.
     bool fPreferredDownload;
     //! Whether this peer wants invs or headers (when possible) for block announcements.
@@ -379,6 +413,8 @@ struct CNodeState {
         nDownloadingSince = 0;
         nBlocksInFlight = 0;
         nBlocksInFlightValidHeaders = 0;
+        m_block_download = {0, 0, 0};
+        m_headers_requested = 0;
         fPreferredDownload = false;
         fPreferHeaders = false;
         fPreferHeaderAndIDs = false;
@@ -481,7 +517,7 @@ static bool MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const CBlock
     MarkBlockAsReceived(hash);
 
     std::list<QueuedBlock>::iterator it = state->vBlocksInFlight.insert(state->vBlocksInFlight.end(),
-        {hash, pindex, pindex != nullptr, std::unique_ptr<PartiallyDownloadedBlock>(pit ? new PartiallyDownloadedBlock(&mempool) : nullptr)});
+        {hash, pindex, pindex != nullptr, std::unique_ptr<PartiallyDownloadedBlock>(pit ? new PartiallyDownloadedBlock(&mempool) : nullptr), GetTimeMicros()});
     state->nBlocksInFlight++;
     state->nBlocksInFlightValidHeaders += it->fValidatedHeaders;
     if (state->nBlocksInFlight == 1) {
@@ -497,6 +533,92 @@ static bool MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const CBlock
     return true;
 }
 
+} // namespace
+
+/** Add a sample to an exponentially weighted moving average, which is 0 before the first sample. */
+int64_t UpdateMovingAverage(int64_t average, int64_t sample)
+{
+    return average == 0 ? sample : (3 * average + sample) / 4;
+}
+
+/** Number of blocks to keep in flight from a peer that takes service_time per
+ *  block (0 if unknown): enough to keep it busy for BLOCK_DOWNLOAD_LEAD_TIME,
+ *  so fast peers get larger windows. */
+int GetBlocksInFlightTarget(int64_t service_time)
+{
+    if (service_time == 0) return MAX_BLOCKS_IN_TRANSIT_PER_PEER;
+    const int64_t target = (BLOCK_DOWNLOAD_LEAD_TIME + service_time - 1) / service_time;
+    return std::max<int64_t>(MIN_BLOCKS_IN_TRANSIT_PER_PEER_ADAPTIVE, std::min<int64_t>(target, MAX_BLOCKS_IN_TRANSIT_PER_PEER_ADAPTIVE));
+}
+
+/**
+ * Whether a block that has been in flight for in_flight_time from a peer with
+ * the given download model should be requested from a peer taking
+ * our_service_time per block instead. Only a peer that is known to be faster
+ * takes over, and only once the block is late compared to the other peer's
+ * latency.
+ */
+bool ShouldReassignBlock(int64_t our_service_time, int64_t their_service_time, int64_t their_latency, int64_t in_flight_time)
+{
+    if (our_service_time == 0 || (their_service_time != 0 && our_service_time >= their_service_time)) return false;
+    return in_flight_time >= std::max(BLOCK_STRAGGLER_MIN_TIME, 2 * their_latency);
+}
+
+namespace {
+
+/** Add a sample to a latency average of a peer, for a request sent at nTimeRequested. */
+static void UpdateLatency(int64_t& latency, int64_t nTimeRequested, int64_t nNow)
+{
+    latency = UpdateMovingAverage(latency, std::max<int64_t>(nNow - nTimeRequested, 1));
+}
+
+/**
+ * Update the download model of the peer that had hash in flight, as it just
+ * delivered it. Only full blocks tell how long the peer takes per block;
+ * compact blocks and the transactions missing from them only tell the latency.
+ */
+static void UpdateBlockDownloadStats(NodeId nodeid, const uint256& hash, bool fFullBlock, int64_t nNow) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    auto itInFlight = mapBlocksInFlight.find(hash);
+    if (itInFlight == mapBlocksInFlight.end() || itInFlight->second.first != nodeid) return;
+    CNodeState* state = State(nodeid);
+    assert(state != nullptr);
+
+    const QueuedBlock& queued = *itInFlight->second.second;
+    UpdateLatency(state->m_block_download.m_latency, queued.nTimeRequested, nNow);
+    if (fFullBlock && state->vBlocksInFlight.begin() == itInFlight->second.second) {
+        // Only the block at the head of the queue tells how long the peer took
+        // for it; the others were partly downloaded in parallel.
+        const int64_t service_time = std::max<int64_t>(nNow - std::max(state->nDownloadingSince, queued.nTimeRequested), 1);
+        state->m_block_download.m_service_time = UpdateMovingAverage(state->m_block_download.m_service_time, service_time);
+    }
+}
+
+/**
+ * The download window of nodeid is blocked by hash, in flight from staller.
+ * If that block is taking unusually long and nodeid is faster than staller,
+ * move the request to nodeid. Returns whether the block was re-requested.
+ */
+static bool ReassignStraggler(NodeId nodeid, NodeId staller, const uint256& hash, int64_t nNow) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    CNodeState* state = State(nodeid);
+    CNodeState* state_staller = State(staller);
+    assert(state != nullptr && state_staller != nullptr);
+
+    auto itInFlight = mapBlocksInFlight.find(hash);
+    if (itInFlight == mapBlocksInFlight.end() || itInFlight->second.first != staller) return false;
+    const QueuedBlock& queued = *itInFlight->second.second;
+
+    if (!ShouldReassignBlock(state->m_block_download.m_service_time, state_staller->m_block_download.m_service_time,
+                             state_staller->m_block_download.m_latency, nNow - queued.nTimeRequested)) {
+        return false;
+    }
+
+    LogPrint(BCLog::NET, "Re-requesting straggling block %s from peer=%d (in flight from peer=%d for %dms)\n",
+        hash.ToString(), nodeid, staller, (nNow - queued.nTimeRequested) / 1000);
+    return MarkBlockAsInFlight(nodeid, hash, queued.pindex);
+}
+
 /** Check whether the last unknown block a peer advertised is not yet known. */
 static void ProcessBlockAvailability(NodeId nodeid) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
@@ -600,8 +722,9 @@ static bool PeerHasHeader(CNodeState* state, const CBlockIndex* pindex) EXCLUSIV
 }
 
 /** Update pindexLastCommonBlock and add not-in-flight missing successors to vBlocks, until it has
- *  at most count entries. */
-static void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<const CBlockIndex*>& vBlocks, NodeId& nodeStaller, const Consensus::Params& consensusParams) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+ *  at most count entries. If the download window is blocked, nodeStaller and pindexStalling are set
+ *  to the peer and the block it is waiting for. */
+static void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<const CBlockIndex*>& vBlocks, NodeId& nodeStaller, const CBlockIndex*& pindexStalling, const Consensus::Params& consensusParams) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
     if (count == 0)
         return;
@@ -638,6 +761,7 @@ static void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vec
     int nWindowEnd = state->pindexLastCommonBlock->nHeight + BLOCK_DOWNLOAD_WINDOW;
     int nMaxHeight = std::min<int>(state->pindexBestKnownBlock->nHeight, nWindowEnd + 1);
     NodeId waitingfor = -1;
+    const CBlockIndex* pindexWaitingFor = nullptr;
     while (pindexWalk->nHeight < nMaxHeight) {
         // Read up to 128 (or more, if more blocks than that are needed) successors of pindexWalk (towards
         // pindexBestKnownBlock) into vToFetch. We fetch 128, because CBlockIndex::GetAncestor may be as expensive
@@ -673,6 +797,7 @@ static void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vec
                     if (vBlocks.size() == 0 && waitingfor != nodeid) {
                         // We aren't able to fetch anything, but we would be if the download window was one larger.
                         nodeStaller = waitingfor;
+                        pindexStalling = pindexWaitingFor;
                     }
                     return;
                 }
@@ -683,6 +808,7 @@ static void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vec
             } else if (waitingfor == -1) {
                 // This is the first already-in-flight block.
                 waitingfor = mapBlocksInFlight[pindex->GetBlockHash()].first;
+                pindexWaitingFor = pindex;
             }
         }
     }
@@ -776,6 +902,8 @@ void PeerLogicValidation::InitializeNode(CNode* pnode)
     {
         LOCK(cs_main);
         mapNodeState.emplace_hint(mapNodeState.end(), std::piecewise_construct, std::forward_as_tuple(nodeid), std::forward_as_tuple(addr, std::move(addrName), pnode->fInbound, pnode->m_manual_connection));
+        // Trickle as soon as the handshake is complete.
+        g_trickle_wheel.Schedule(nodeid, 0);
     }
     if (!pnode->fInbound)
         PushNodeVersion(pnode, connman, GetTime());
@@ -806,6 +934,7 @@ void PeerLogicValidation::FinalizeNode(NodeId nodeid, bool& fUpdateConnectionTim
     assert(g_outbound_peers_with_protect_from_disconnect >= 0);
 
     mapNodeState.erase(nodeid);
+    g_trickle_wheel.Cancel(nodeid);
 
     if (mapNodeState.empty()) {
         // Do a consistency check after the last peer is removed.
@@ -1686,6 +1815,10 @@ bool static ProcessHeadersMessage(CNode* pfrom, CConnman* connman, const std::ve
     {
         LOCK(cs_main);
         CNodeState* nodestate = State(pfrom->GetId());
+        if (!via_compact_block && nodestate->m_headers_requested != 0) {
+            UpdateLatency(nodestate->m_block_download.m_headers_latency, nodestate->m_headers_requested, GetTimeMicros());
+            nodestate->m_headers_requested = 0;
+        }
 
         // If this looks like it could be a block announcement (nCount <
         // MAX_BLOCKS_TO_ANNOUNCE), use special logic for handling headers that
@@ -1764,6 +1897,7 @@ bool static ProcessHeadersMessage(CNode* pfrom, CConnman* connman, const std::ve
             // from there instead.
             LogPrint(BCLog::NET, "more getheaders (%d) to end to peer=%d (startheight:%d)\n", pindexLast->nHeight, pfrom->GetId(), pfrom->nStartingHeight);
             connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETHEADERS, ::ChainActive().GetLocator(pindexLast), uint256()));
+            nodestate->m_headers_requested = GetTimeMicros();
         }
 
         bool fCanDirectFetch = CanDirectFetch(chainparams.GetConsensus());
@@ -2737,6 +2871,10 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
 
             std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator>>::iterator blockInFlightIt = mapBlocksInFlight.find(pindex->GetBlockHash());
             bool fAlreadyInFlight = blockInFlightIt != mapBlocksInFlight.end();
+            if (fAlreadyInFlight && !blockInFlightIt->second.second->partialBlock) {
+                // We requested this block from the peer, which answered with a compact block.
+                UpdateBlockDownloadStats(pfrom->GetId(), pindex->GetBlockHash(), /* fFullBlock */ false, GetTimeMicros());
+            }
 
             if (pindex->nStatus & BLOCK_HAVE_DATA) // Nothing to do here
                 return true;
@@ -2947,6 +3085,9 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
                     }
                 }
 
+                if (!resp.txn.empty()) {
+                    UpdateBlockDownloadStats(pfrom->GetId(), resp.blockhash, /* fFullBlock */ false, GetTimeMicros());
+                }
                 MarkBlockAsReceived(resp.blockhash); // it is now an empty pointer
                 fBlockRead = true;
                 // mapBlockSource is only used for sending reject messages and DoS scores,
@@ -3023,6 +3164,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         const uint256 hash(pblock->GetHash());
         {
             LOCK(cs_main);
+            UpdateBlockDownloadStats(pfrom->GetId(), hash, /* fFullBlock */ true, GetTimeMicros());
             // Also always process if we requested the block explicitly, as we may
             // need it even though it is not a candidate for a new best tip.
             forceProcessing |= MarkBlockAsReceived(hash);
@@ -3625,23 +3767,41 @@ void PeerLogicValidation::CheckForStaleTipAndEvictPeers(const Consensus::Params&
 }
 
 namespace {
+typedef std::pair<const TxRelayInfo*, std::set<uint256>::iterator> InvTxCandidate;
+
 class CompareInvMempoolOrder
 {
-    CTxMemPool* mp;
-
 public:
-    explicit CompareInvMempoolOrder(CTxMemPool* _mempool)
-    {
-        mp = _mempool;
-    }
-
-    bool operator()(std::set<uint256>::iterator a, std::set<uint256>::iterator b)
+    bool operator()(const InvTxCandidate& a, const InvTxCandidate& b) const
     {
         /* As std::make_heap produces a max-heap, we want the entries with the
          * fewest ancestors/highest fee to sort later. */
-        return mp->CompareDepthAndScore(*b, *a);
+        return CompareTxRelayInfo()(*b.first, *a.first);
     }
 };
+
+/** Make sure g_trickle_relay_info has an entry for every hash, fetching the
+ *  missing ones from the mempool in one go. Entries are dropped when a new
+ *  trickle epoch starts or they are older than one trickle tick. */
+void FetchTrickleRelayInfo(const std::vector<uint256>& hashes, int64_t nNow) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    if (g_trickle_relay_info_epoch != g_trickle_wheel.GetEpoch() || nNow - g_trickle_relay_info_time > INVENTORY_TRICKLE_TICK) {
+        g_trickle_relay_info.clear();
+        g_trickle_relay_info_epoch = g_trickle_wheel.GetEpoch();
+        g_trickle_relay_info_time = nNow;
+    }
+
+    std::vector<uint256> missing;
+    for (const uint256& hash : hashes) {
+        if (!g_trickle_relay_info.count(hash)) missing.push_back(hash);
+    }
+    if (missing.empty()) return;
+
+    std::vector<TxRelayInfo> infos = mempool.relayInfo(missing);
+    for (size_t i = 0; i < missing.size(); ++i) {
+        g_trickle_relay_info.emplace(missing[i], std::move(infos[i]));
+    }
+}
 } // namespace
 
 bool PeerLogicValidation::SendMessagesFinished()
@@ -3796,6 +3956,7 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
                     pindexStart = pindexStart->pprev;
                 LogPrint(BCLog::NET, "initial getheaders (%d) to peer=%d (startheight:%d)\n", pindexStart->nHeight, pto->GetId(), pto->nStartingHeight);
                 connman->PushMessage(pto, msgMaker.Make(NetMsgType::GETHEADERS, ::ChainActive().GetLocator(pindexStart), uint256()));
+                state.m_headers_requested = GetTimeMicros();
             }
         }
 
@@ -3957,14 +4118,15 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
             pto->vInventoryBlockToSend.clear();
 
             // Check whether periodic sends should happen
+            g_trickle_wheel.Advance(nNow);
             bool fSendTrickle = pto->fWhitelisted;
-            if (pto->nNextInvSend < nNow) {
+            if (g_trickle_wheel.ConsumeFired(pto->GetId())) {
                 fSendTrickle = true;
                 if (pto->fInbound) {
-                    pto->nNextInvSend = connman->PoissonNextSendInbound(nNow, INVENTORY_BROADCAST_INTERVAL);
+                    g_trickle_wheel.Schedule(pto->GetId(), connman->PoissonNextSendInbound(nNow, INVENTORY_BROADCAST_INTERVAL));
                 } else {
                     // Use half the delay for outbound peers, as there is less privacy concern for them.
-                    pto->nNextInvSend = PoissonNextSend(nNow, INVENTORY_BROADCAST_INTERVAL >> 1);
+                    g_trickle_wheel.Schedule(pto->GetId(), PoissonNextSend(nNow, INVENTORY_BROADCAST_INTERVAL >> 1));
                 }
             }
 
@@ -4009,11 +4171,32 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
 
             // Determine transactions to relay
             if (fSendTrickle) {
-                // Produce a vector with all candidates for sending
-                std::vector<std::set<uint256>::iterator> vInvTx;
+                // Drop candidates the peer already knows about, and look up the
+                // rest in the ordering data shared by all peers of this epoch.
+                std::vector<uint256> vInvHashes;
+                vInvHashes.reserve(pto->setInventoryTxToSend.size());
+                for (std::set<uint256>::iterator it = pto->setInventoryTxToSend.begin(); it != pto->setInventoryTxToSend.end();) {
+                    if (pto->filterInventoryKnown.contains(*it)) {
+                        it = pto->setInventoryTxToSend.erase(it);
+                    } else {
+                        vInvHashes.push_back(*it);
+                        ++it;
+                    }
+                }
+                FetchTrickleRelayInfo(vInvHashes, nNow);
+
+                // Produce a vector with all candidates for sending. Not in the
+                // mempool anymore? don't bother sending it.
+                std::vector<InvTxCandidate> vInvTx;
                 vInvTx.reserve(pto->setInventoryTxToSend.size());
-                for (std::set<uint256>::iterator it = pto->setInventoryTxToSend.begin(); it != pto->setInventoryTxToSend.end(); it++) {
-                    vInvTx.push_back(it);
+                for (std::set<uint256>::iterator it = pto->setInventoryTxToSend.begin(); it != pto->setInventoryTxToSend.end();) {
+                    const TxRelayInfo& relayinfo = g_trickle_relay_info.at(*it);
+                    if (!relayinfo.info.tx) {
+                        it = pto->setInventoryTxToSend.erase(it);
+                    } else {
+                        vInvTx.emplace_back(&relayinfo, it);
+                        ++it;
+                    }
                 }
                 CAmount filterrate = 0;
                 {
@@ -4022,7 +4205,7 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
                 }
                 // Topologically and fee-rate sort the inventory we send for privacy and priority reasons.
                 // A heap is used so that not all items need sorting if only a few are being sent.
-                CompareInvMempoolOrder compareInvMempoolOrder(&mempool);
+                CompareInvMempoolOrder compareInvMempoolOrder;
                 std::make_heap(vInvTx.begin(), vInvTx.end(), compareInvMempoolOrder);
                 // No reason to drain out at many times the network's capacity,
                 // especially since we have many peers and some will draw much shorter delays.
@@ -4031,20 +4214,12 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
                 while (!vInvTx.empty() && nRelayedTransactions < INVENTORY_BROADCAST_MAX) {
                     // Fetch the top element from the heap
                     std::pop_heap(vInvTx.begin(), vInvTx.end(), compareInvMempoolOrder);
-                    std::set<uint256>::iterator it = vInvTx.back();
+                    TxMempoolInfo txinfo = vInvTx.back().first->info;
+                    std::set<uint256>::iterator it = vInvTx.back().second;
                     vInvTx.pop_back();
                     uint256 hash = *it;
                     // Remove it from the to-be-sent set
                     pto->setInventoryTxToSend.erase(it);
-                    // Check if not in the filter already
-                    if (pto->filterInventoryKnown.contains(hash)) {
-                        continue;
-                    }
-                    // Not in the mempool anymore? don't bother sending it.
-                    auto txinfo = mempool.info(hash);
-                    if (!txinfo.tx) {
-                        continue;
-                    }
                     if (filterrate && txinfo.feeRate.GetFeePerK() < filterrate) {
                         continue;
                     }
@@ -4140,10 +4315,12 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
         // Message: getdata (blocks)
         //
         std::vector<CInv> vGetData;
-        if (!pto->fClient && ((fFetch && !pto->m_limited_node) || !::ChainstateActive().IsInitialBlockDownload()) && state.nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+        const int nBlocksInFlightTarget = GetBlocksInFlightTarget(state.m_block_download.m_service_time);
+        if (!pto->fClient && ((fFetch && !pto->m_limited_node) || !::ChainstateActive().IsInitialBlockDownload()) && state.nBlocksInFlight < nBlocksInFlightTarget) {
             std::vector<const CBlockIndex*> vToDownload;
             NodeId staller = -1;
-            FindNextBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload, staller, consensusParams);
+            const CBlockIndex* pindexStalling = nullptr;
+            FindNextBlocksToDownload(pto->GetId(), nBlocksInFlightTarget - state.nBlocksInFlight, vToDownload, staller, pindexStalling, consensusParams);
             for (const CBlockIndex* pindex : vToDownload) {
                 uint32_t nFetchFlags = GetFetchFlags(pto);
                 vGetData.push_back(CInv(MSG_BLOCK | nFetchFlags, pindex->GetBlockHash()));
@@ -4151,7 +4328,10 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
                 LogPrint(BCLog::NET, "Requesting block %s (%d) peer=%d\n", pindex->GetBlockHash().ToString(),
                     pindex->nHeight, pto->GetId());
             }
-            if (state.nBlocksInFlight == 0 && staller != -1) {
+            if (state.nBlocksInFlight == 0 && staller != -1 && ReassignStraggler(pto->GetId(), staller, pindexStalling->GetBlockHash(), nNow)) {
+                // Rather than waiting for the staller, fetch the block holding up the window ourselves.
+                vGetData.push_back(CInv(MSG_BLOCK | GetFetchFlags(pto), pindexStalling->GetBlockHash()));
+            } else if (state.nBlocksInFlight == 0 && staller != -1) {
                 if (State(staller)->nStallingSince == 0) {
                     State(staller)->nStallingSince = nNow;
                     LogPrint(BCLog::NET, "Stall started peer=%d\n", staller);
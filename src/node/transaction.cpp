@@ -12,14 +12,18 @@
 #include <node/transaction.h>
 
 #include <future>
+#include <map>
 
-TransactionError BroadcastTransaction(const CTransactionRef tx, uint256& hashTx, std::string& err_string, const CAmount& highfee)
+/**
+ * Submit tx to the mempool unless it is already known.
+ * accepted is set if the transaction was newly added to the mempool.
+ */
+static TransactionError SubmitTransaction(const CTransactionRef& tx, std::string& err_string, const CAmount& highfee, bool& accepted) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
-    std::promise<void> promise;
-    hashTx = tx->GetHash();
+    AssertLockHeld(cs_main);
+    accepted = false;
+    const uint256& hashTx = tx->GetHash();
 
-    { // cs_main scope
-    LOCK(cs_main);
     CCoinsViewCache &view = *pcoinsTip;
     bool fHaveChain = false;
     for (size_t o = 0; !fHaveChain && o < tx->vout.size(); o++) {
@@ -31,7 +35,7 @@ TransactionError BroadcastTransaction(const CTransactionRef tx, uint256& hashTx,
         // push to local node and sync with wallets
         CValidationState state;
         bool fMissingInputs;
-        if (!AcceptToMemoryPool(mempool, state, std::move(tx), &fMissingInputs,
+        if (!AcceptToMemoryPool(mempool, state, tx, &fMissingInputs,
                                 nullptr /* plTxnReplaced */, false /* bypass_limits */, highfee)) {
             if (state.IsInvalid()) {
                 err_string = FormatStateMessage(state);
@@ -43,18 +47,35 @@ TransactionError BroadcastTransaction(const CTransactionRef tx, uint256& hashTx,
                 err_string = FormatStateMessage(state);
                 return TransactionError::MEMPOOL_ERROR;
             }
-        } else {
-            // If wallet is enabled, ensure that the wallet has been made aware
-            // of the new transaction prior to returning. This prevents a race
-            // where a user might call sendrawtransaction with a transaction
-            // to/from their wallet, immediately call some wallet RPC, and get
-            // a stale result because callbacks have not yet been processed.
-            CallFunctionInValidationInterfaceQueue([&promise] {
-                promise.set_value();
-            });
         }
+        accepted = true;
     } else if (fHaveChain) {
         return TransactionError::ALREADY_IN_CHAIN;
+    }
+    return TransactionError::OK;
+}
+
+TransactionError BroadcastTransaction(const CTransactionRef tx, uint256& hashTx, std::string& err_string, const CAmount& highfee)
+{
+    std::promise<void> promise;
+    hashTx = tx->GetHash();
+
+    { // cs_main scope
+    LOCK(cs_main);
+    bool accepted;
+    const TransactionError err = SubmitTransaction(tx, err_string, highfee, accepted);
+    if (err != TransactionError::OK) {
+        return err;
+    }
+    if (accepted) {
+        // If wallet is enabled, ensure that the wallet has been made aware
+        // of the new transaction prior to returning. This prevents a race
+        // where a user might call sendrawtransaction with a transaction
+        // to/from their wallet, immediately call some wallet RPC, and get
+        // a stale result because callbacks have not yet been processed.
+        CallFunctionInValidationInterfaceQueue([&promise] {
+            promise.set_value();
+        });
     } else {
         // Make sure we don't block forever if re-sending
         // a transaction already in mempool.
@@ -76,3 +97,100 @@ TransactionError BroadcastTransaction(const CTransactionRef tx, uint256& hashTx,
 
     return TransactionError::OK;
 }
+
+TransactionError BroadcastTransactions(const std::vector<CTransactionRef>& txs, const std::vector<CAmount>& highfees, std::vector<BroadcastResult>& results)
+{
+    assert(txs.size() == highfees.size());
+    const size_t count = txs.size();
+
+    results.assign(count, BroadcastResult());
+    std::map<uint256, size_t> index;
+    for (size_t i = 0; i < count; ++i) {
+        results[i].txid = txs[i]->GetHash();
+        index.emplace(results[i].txid, i);
+    }
+
+    // Order the batch so that every transaction comes after its in-batch parents.
+    std::vector<std::vector<size_t>> parents(count);
+    std::vector<std::vector<size_t>> children(count);
+    std::vector<size_t> pending_parents(count, 0);
+    for (size_t i = 0; i < count; ++i) {
+        for (const CTxIn& txin : txs[i]->vin) {
+            auto it = index.find(txin.prevout.hash);
+            if (it == index.end() || it->second == i) continue;
+            parents[i].push_back(it->second);
+            children[it->second].push_back(i);
+            ++pending_parents[i];
+        }
+    }
+    std::vector<size_t> order;
+    order.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        if (pending_parents[i] == 0) order.push_back(i);
+    }
+    for (size_t k = 0; k < order.size(); ++k) {
+        for (size_t child : children[order[k]]) {
+            if (--pending_parents[child] == 0) order.push_back(child);
+        }
+    }
+
+    std::promise<void> promise;
+    bool any_accepted = false;
+    std::vector<bool> failed(count, true);
+
+    { // cs_main scope
+    LOCK(cs_main);
+    for (size_t i : order) {
+        BroadcastResult& result = results[i];
+        bool parent_failed = false;
+        for (size_t parent : parents[i]) {
+            parent_failed |= failed[parent];
+        }
+        if (parent_failed) {
+            result.error = TransactionError::MISSING_INPUTS;
+            continue;
+        }
+        bool accepted;
+        result.error = SubmitTransaction(txs[i], result.err_string, highfees[i], accepted);
+        failed[i] = result.error != TransactionError::OK && result.error != TransactionError::ALREADY_IN_CHAIN;
+        any_accepted |= accepted;
+    }
+    if (any_accepted) {
+        // Wait for the wallet to catch up once for the whole batch, see
+        // BroadcastTransaction.
+        CallFunctionInValidationInterfaceQueue([&promise] {
+            promise.set_value();
+        });
+    } else {
+        promise.set_value();
+    }
+    } // cs_main
+
+    // Transactions that were never ordered are part of a dependency cycle.
+    for (size_t i = 0; i < count; ++i) {
+        if (pending_parents[i] != 0) results[i].error = TransactionError::MISSING_INPUTS;
+    }
+
+    promise.get_future().wait();
+
+    if (!g_connman) {
+        return TransactionError::P2P_DISABLED;
+    }
+
+    std::vector<CInv> invs;
+    invs.reserve(count);
+    for (size_t i : order) {
+        if (results[i].error == TransactionError::OK) {
+            invs.emplace_back(MSG_TX, results[i].txid);
+        }
+    }
+    if (!invs.empty()) {
+        g_connman->ForEachNode([&invs](CNode* pnode) {
+            for (const CInv& inv : invs) {
+                pnode->PushInventory(inv);
+            }
+        });
+    }
+
+    return TransactionError::OK;
+}
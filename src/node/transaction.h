@@ -10,6 +10,9 @@
 #include <uint256.h>
 #include <util/error.h>
 
+#include <string>
+#include <vector>
+
 /**
  * Broadcast a transaction
  *
@@ -21,4 +24,27 @@
  */
 NODISCARD TransactionError BroadcastTransaction(CTransactionRef tx, uint256& txid, std::string& err_string, const CAmount& highfee);
 
+/** Outcome of broadcasting one transaction of a batch. */
+struct BroadcastResult
+{
+    uint256 txid;
+    TransactionError error{TransactionError::OK};
+    std::string err_string;
+};
+
+/**
+ * Broadcast a batch of transactions, which may spend each other's outputs
+ *
+ * The batch is ordered so that parents are accepted before their children and
+ * validated under a single cs_main acquisition. A transaction whose in-batch
+ * parent was rejected is rejected with MISSING_INPUTS. All transactions that
+ * made it into the mempool are announced to every peer in one pass.
+ *
+ * @param[in]  txs the transactions to broadcast, in any order
+ * @param[in]  highfees per-transaction fee limits, parallel to txs (0 accepts any fee)
+ * @param[out] &results one result per transaction, in the order of txs
+ * return P2P_DISABLED if there is no connection manager, OK otherwise
+ */
+NODISCARD TransactionError BroadcastTransactions(const std::vector<CTransactionRef>& txs, const std::vector<CAmount>& highfees, std::vector<BroadcastResult>& results);
+
 #endif // VCCOIN_NODE_TRANSACTION_H
@@ -21,6 +21,7 @@ class CFeeRate;
 class CTxMemPoolEntry;
 class CTxMemPool;
 class TxConfirmStats;
+struct FeeEstimateSnapshot;
 
 /* Identifier for each of the 3 different TxConfirmStats which will track
  * history over different time horizons. */
@@ -127,6 +128,11 @@ struct FeeCalculation
  *  We want to be able to estimate feerates that are needed on tx's to be included in
  * a certain number of blocks.  Every time a block is added to the best chain, this class records
  * stats on the transactions included in that block
+ *
+ * Estimates are calculated from an immutable snapshot of the stats that is
+ * published after every block, so that estimating never waits for mempool
+ * updates. Transactions leaving the mempool between blocks are reflected in
+ * the estimates from the next block on.
  */
 class CBlockPolicyEstimator
 {
@@ -248,16 +254,23 @@ private:
     unsigned int trackedTxs GUARDED_BY(m_cs_fee_estimator);
     unsigned int untrackedTxs GUARDED_BY(m_cs_fee_estimator);
 
-    std::vector<double> buckets GUARDED_BY(m_cs_fee_estimator); // The upper-bound of the range for the bucket (inclusive)
-    std::map<double, unsigned int> bucketMap GUARDED_BY(m_cs_fee_estimator); // Map of bucket upper-bound to index into all vectors by bucket
+    std::vector<double> buckets GUARDED_BY(m_cs_fee_estimator); // The upper-bound of the range for the bucket (inclusive), sorted
+
+    mutable Mutex m_cs_snapshot;
+    std::shared_ptr<const FeeEstimateSnapshot> m_snapshot GUARDED_BY(m_cs_snapshot);
+
+    /** Make the current stats available to estimates */
+    void PublishSnapshot() EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
+    /** The stats as of the last published snapshot */
+    std::shared_ptr<const FeeEstimateSnapshot> GetSnapshot() const;
 
     /** Process a transaction confirmed in a block*/
     bool processBlockTx(unsigned int nBlockHeight, const CTxMemPoolEntry* entry) EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
 
     /** Helper for estimateSmartFee */
-    double estimateCombinedFee(unsigned int confTarget, double successThreshold, bool checkShorterHorizon, EstimationResult *result) const EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
+    double estimateCombinedFee(const FeeEstimateSnapshot& snapshot, unsigned int confTarget, double successThreshold, bool checkShorterHorizon, EstimationResult *result) const;
     /** Helper for estimateSmartFee */
-    double estimateConservativeFee(unsigned int doubleTarget, EstimationResult *result) const EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
+    double estimateConservativeFee(const FeeEstimateSnapshot& snapshot, unsigned int doubleTarget, EstimationResult *result) const;
     /** Number of blocks of data recorded while fee estimates have been running */
     unsigned int BlockSpan() const EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
     /** Number of blocks of recorded fee estimate data represented in saved data file */
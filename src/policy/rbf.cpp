@@ -36,3 +36,41 @@ RBFTransactionState IsRBFOptIn(const CTransaction& tx, const CTxMemPool& pool)
     }
     return RBFTransactionState::FINAL;
 }
+
+ReplacementCost GetReplacementCost(const CTxMemPool& pool, const CTxMemPool::setEntries& setIterConflicting, CTxMemPool::setEntries& allConflicting)
+{
+    AssertLockHeld(pool.cs);
+
+    ReplacementCost cost;
+
+    // A conflict can only be a descendant of another conflict, or share a
+    // descendant with it, if at least one of them has children.
+    bool overlap = false;
+    if (setIterConflicting.size() > 1) {
+        for (CTxMemPool::txiter it : setIterConflicting) {
+            if (it->GetCountWithDescendants() > 1) {
+                overlap = true;
+                break;
+            }
+        }
+    }
+
+    if (!overlap) {
+        for (CTxMemPool::txiter it : setIterConflicting) {
+            cost.nModFees += it->GetModFeesWithDescendants();
+            cost.nSize += it->GetSizeWithDescendants();
+            cost.nCount += it->GetCountWithDescendants();
+        }
+        return cost;
+    }
+
+    for (CTxMemPool::txiter it : setIterConflicting) {
+        pool.CalculateDescendants(it, allConflicting);
+    }
+    for (CTxMemPool::txiter it : allConflicting) {
+        cost.nModFees += it->GetModifiedFee();
+        cost.nSize += it->GetTxSize();
+    }
+    cost.nCount = allConflicting.size();
+    return cost;
+}
@@ -19,4 +19,20 @@ enum class RBFTransactionState {
 // as the sequence numbers of all in-mempool ancestors.
 RBFTransactionState IsRBFOptIn(const CTransaction& tx, const CTxMemPool& pool) EXCLUSIVE_LOCKS_REQUIRED(pool.cs);
 
+/** What a replacement would evict from the mempool. */
+struct ReplacementCost
+{
+    CAmount nModFees{0};
+    uint64_t nSize{0};
+    uint64_t nCount{0};
+};
+
+// Determine the combined modified fees, size and count of the conflicting
+// in-mempool transactions and all of their descendants.
+// When the descendant sets of the conflicts cannot overlap (a single conflict,
+// or no conflict has children) this only sums the cached descendant
+// aggregates. Otherwise the descendants are enumerated into allConflicting,
+// which the caller can reuse for removing them.
+ReplacementCost GetReplacementCost(const CTxMemPool& pool, const CTxMemPool::setEntries& setIterConflicting, CTxMemPool::setEntries& allConflicting) EXCLUSIVE_LOCKS_REQUIRED(pool.cs);
+
 #endif // VCCOIN_POLICY_RBF_H
@@ -8,12 +8,15 @@
 #include <amount.h>
 #include <blockfilter.h>
 #include <chain.h>
+#include <chainstaterebuild.h>
 #include <chainparams.h>
 #include <coins.h>
 #include <consensus/validation.h>
 #include <core_io.h>
 #include <hash.h>
 #include <index/blockfilterindex.h>
+#include <index/scriptindex.h>
+#include <key_io.h>
 #include <policy/feerate.h>
 #include <policy/policy.h>
 #include <policy/rbf.h>
@@ -21,11 +24,13 @@
 #include <rpc/server.h>
 #include <rpc/util.h>
 #include <script/descriptor.h>
+#include <script/standard.h>
 #include <streams.h>
 #include <sync.h>
 #include <txdb.h>
 #include <txmempool.h>
 #include <undo.h>
+#include <util/memory.h>
 #include <util/strencodings.h>
 #include <util/system.h>
 #include <util/validation.h>
@@ -417,7 +422,7 @@ static void entryToJSON(const CTxMemPool& pool, UniValue& info, const CTxMemPool
     info.pushKV("ancestorcount", e.GetCountWithAncestors());
     info.pushKV("ancestorsize", e.GetSizeWithAncestors());
     info.pushKV("ancestorfees", e.GetModFeesWithAncestors());
-    info.pushKV("wtxid", pool.vTxHashes[e.vTxHashesIdx].first.ToString());
+    info.pushKV("wtxid", e.GetTx().GetWitnessHash().ToString());
     const CTransaction& tx = e.GetTx();
     std::set<std::string> setDepends;
     for (const CTxIn& txin : tx.vin) {
@@ -434,8 +439,8 @@ static void entryToJSON(const CTxMemPool& pool, UniValue& info, const CTxMemPool
 
     UniValue spent(UniValue::VARR);
     const CTxMemPool::txiter& it = pool.mapTx.find(tx.GetHash());
-    const CTxMemPool::setEntries& setChildren = pool.GetMemPoolChildren(it);
-    for (CTxMemPool::txiter childiter : setChildren) {
+    const CTxMemPool::LinkRange children = pool.GetMemPoolChildren(it);
+    for (CTxMemPool::txiter childiter : CTxMemPool::setEntries(children.begin(), children.end())) {
         spent.push_back(childiter->GetTx().GetHash().ToString());
     }
 
@@ -1494,11 +1499,20 @@ UniValue MempoolInfoToJSON(const CTxMemPool& pool)
     ret.pushKV("loaded", pool.IsLoaded());
     ret.pushKV("size", (int64_t)pool.size());
     ret.pushKV("bytes", (int64_t)pool.GetTotalTxSize());
-    ret.pushKV("usage", (int64_t)pool.DynamicMemoryUsage());
+    const CTxMemPool::MemoryUsage usage = pool.GetMemoryUsage();
+    ret.pushKV("usage", (int64_t)usage.Total());
+    UniValue breakdown(UniValue::VOBJ);
+    breakdown.pushKV("entries", (int64_t)usage.entries);
+    breakdown.pushKV("transactions", (int64_t)usage.transactions);
+    breakdown.pushKV("links", (int64_t)usage.links);
+    breakdown.pushKV("spends", (int64_t)usage.spends);
+    breakdown.pushKV("deltas", (int64_t)usage.deltas);
+    ret.pushKV("usagebreakdown", breakdown);
     size_t maxmempool = gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
     ret.pushKV("maxmempool", (int64_t)maxmempool);
     ret.pushKV("mempoolminfee", ValueFromAmount(std::max(pool.GetMinFee(maxmempool), ::minRelayTxFee).GetFeePerK()));
     ret.pushKV("minrelaytxfee", ValueFromAmount(::minRelayTxFee.GetFeePerK()));
+    ret.pushKV("acceptrate", GetMempoolAcceptRate());
 
     return ret;
 }
@@ -1515,10 +1529,18 @@ static UniValue getmempoolinfo(const JSONRPCRequest& request)
             "  \"size\": xxxxx,               (numeric) Current tx count\n"
             "  \"bytes\": xxxxx,              (numeric) Sum of all virtual transaction sizes as defined in BIP 141. Differs from actual serialized size because witness data is discounted\n"
             "  \"usage\": xxxxx,              (numeric) Total memory usage for the mempool\n"
+            "  \"usagebreakdown\": {         (json object) Memory usage for the mempool by category\n"
+            "    \"entries\": xxxxx,            (numeric) Mempool entries and their index\n"
+            "    \"transactions\": xxxxx,       (numeric) Transaction data\n"
+            "    \"links\": xxxxx,              (numeric) Parent and child links and package state of entries with in-mempool relatives\n"
+            "    \"spends\": xxxxx,             (numeric) Index of spent outpoints\n"
+            "    \"deltas\": xxxxx              (numeric) Fee deltas set by prioritisetransaction\n"
+            "  },\n"
             "  \"maxmempool\": xxxxx,         (numeric) Maximum memory usage for the mempool\n"
             "  \"mempoolminfee\": xxxxx       (numeric) Minimum fee rate in " +
             CURRENCY_UNIT + "/kB for tx to be accepted. Is the maximum of minrelaytxfee and minimum mempool fee\n"
                             "  \"minrelaytxfee\": xxxxx       (numeric) Current minimum relay fee for transactions\n"
+                            "  \"acceptrate\": xxxxx          (numeric) Transactions accepted per second, smoothed over about a minute\n"
                             "}\n"},
         RPCExamples{
             HelpExampleCli("getmempoolinfo", "") + HelpExampleRpc("getmempoolinfo", "")},
@@ -2049,6 +2071,60 @@ static UniValue savemempool(const JSONRPCRequest& request)
     return NullUniValue;
 }
 
+static UniValue reindexchainstate(const JSONRPCRequest& request)
+{
+    RPCHelpMan{
+        "reindexchainstate",
+        "\nRebuilds the chainstate (UTXO set) from the blocks on disk into a new database, while the node keeps running on\n"
+        "the current one, and switches to the new database once it has caught up with the tip. This is the online equivalent\n"
+        "of -reindex-chainstate. Not available in prune mode.\n"
+        "The new database gets a coins cache of half the size of the -dbcache coins cache, in addition to it, so the\n"
+        "coins caches use up to 50% more memory while the rebuild runs.\n",
+        {
+            {"action", RPCArg::Type::STR, /* default */ "status", "The action to execute\n"
+                                                                "                                      \"start\" for starting a rebuild\n"
+                                                                "                                      \"abort\" for aborting the current rebuild\n"
+                                                                "                                      \"status\" for the progress of the current or last rebuild"},
+        },
+        RPCResult{
+            "{\n"
+            "  \"running\" : true|false,     (boolean) Whether a rebuild is running\n"
+            "  \"height\" : n,               (numeric) Height of the last block applied to the new chainstate\n"
+            "  \"error\" : \"message\",       (string, optional) Why the last rebuild failed\n"
+            "}\n"},
+        RPCExamples{
+            HelpExampleCli("reindexchainstate", "start") + HelpExampleRpc("reindexchainstate", "\"start\"")},
+    }
+        .Check(request);
+
+    const std::string action = request.params[0].isNull() ? "status" : request.params[0].get_str();
+    LOCK(g_chainstate_rebuild_mutex);
+    if (action == "start") {
+        if (!g_chainstate_rebuild) {
+            g_chainstate_rebuild = MakeUnique<ChainstateRebuild>(nCoinCacheUsage / 2);
+        }
+        std::string error;
+        if (!g_chainstate_rebuild->Start(error)) {
+            throw JSONRPCError(RPC_MISC_ERROR, error);
+        }
+    } else if (action == "abort") {
+        if (g_chainstate_rebuild) {
+            g_chainstate_rebuild->Interrupt();
+            g_chainstate_rebuild->Stop();
+        }
+    } else if (action != "status") {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid command");
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("running", g_chainstate_rebuild && g_chainstate_rebuild->IsRunning());
+    ret.pushKV("height", g_chainstate_rebuild ? g_chainstate_rebuild->GetHeight() : 0);
+    if (g_chainstate_rebuild && !g_chainstate_rebuild->GetError().empty()) {
+        ret.pushKV("error", g_chainstate_rebuild->GetError());
+    }
+    return ret;
+}
+
 //! Search for a given set of pubkey scripts
 bool FindScriptPubKey(std::atomic<int>& scan_progress, const std::atomic<bool>& should_abort, int64_t& count, CCoinsViewCursor* cursor, const std::set<CScript>& needles, std::map<COutPoint, Coin>& out_results)
 {
@@ -2328,6 +2404,193 @@ static UniValue getblockfilter(const JSONRPCRequest& request)
     return ret;
 }
 
+/** Parse an address or hex-encoded scriptPubKey argument. */
+static CScript ParseScriptArg(const UniValue& param)
+{
+    const std::string& str = param.get_str();
+    CTxDestination dest = DecodeDestination(str);
+    if (IsValidDestination(dest)) {
+        return GetScriptForDestination(dest);
+    }
+    if (!str.empty() && IsHex(str)) {
+        std::vector<unsigned char> data(ParseHex(str));
+        return CScript(data.begin(), data.end());
+    }
+    throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address or script: " + str);
+}
+
+/** Maximum number of entries returned by one listscriptunspent or getscripthistory call.
+ * The reply holds all of them at once.
+ */
+constexpr static unsigned int MAX_SCRIPT_INDEX_RESULTS{1000};
+
+/** Parse the skip and count arguments of a script index lookup. */
+static void ParseScriptIndexRange(const UniValue& skip_param, const UniValue& count_param, int default_count, int& skip, int& count)
+{
+    skip = skip_param.isNull() ? 0 : skip_param.get_int();
+    count = count_param.isNull() ? default_count : count_param.get_int();
+    if (skip < 0) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative skip");
+    }
+    if (count < 0) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative count");
+    }
+    if ((unsigned int)count > MAX_SCRIPT_INDEX_RESULTS) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Count %d exceeds the maximum of %u", count, MAX_SCRIPT_INDEX_RESULTS));
+    }
+}
+
+/** Wait for the script index to process the current chain, and return the asset of the assetno argument. */
+static CoinAsset GetScriptIndexAsset(const UniValue& param)
+{
+    if (!g_scriptindex) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Script index is not enabled. Use -scriptindex");
+    }
+    if (!g_scriptindex->BlockUntilSyncedToCurrentChain()) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Scripts are still in the process of being indexed");
+    }
+    CoinAsset ca;
+    if (!CoinAssetManager::Instance().GetAsset(param.isNull() ? 0 : param.get_int(), ca)) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Unknown asset");
+    }
+    return ca;
+}
+
+static UniValue getscriptbalance(const JSONRPCRequest& request)
+{
+    RPCHelpMan{"getscriptbalance",
+        "\nReturns the confirmed balance of an address or script in an asset. Requires -scriptindex.\n",
+        {
+            {"address", RPCArg::Type::STR, RPCArg::Optional::NO, "The address or hex-encoded scriptPubKey"},
+            {"assetno", RPCArg::Type::NUM, /* default */ "0", "The asset index"},
+        },
+        RPCResult{
+            "{\n"
+            "  \"balance\" : x.xxx,    (numeric) The sum of the unspent outputs\n"
+            "  \"unspent\" : n,        (numeric) The number of unspent outputs\n"
+            "}\n"},
+        RPCExamples{
+            HelpExampleCli("getscriptbalance", "\"myaddress\"")
+            + HelpExampleCli("getscriptbalance", "\"myaddress\" 1")
+            + HelpExampleRpc("getscriptbalance", "\"myaddress\", 1")},
+    }.Check(request);
+
+    const CScript script = ParseScriptArg(request.params[0]);
+    const CoinAsset ca = GetScriptIndexAsset(request.params[1]);
+
+    std::vector<ScriptUnspent> unspent;
+    if (!g_scriptindex->FindUnspent(script, ca.no, 0, std::numeric_limits<size_t>::max(), unspent)) {
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read script index");
+    }
+    CAmount balance = 0;
+    for (const ScriptUnspent& entry : unspent) {
+        balance += entry.value;
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("balance", ValueFromAmount(balance, ca.coin));
+    ret.pushKV("unspent", (uint64_t)unspent.size());
+    return ret;
+}
+
+static UniValue listscriptunspent(const JSONRPCRequest& request)
+{
+    RPCHelpMan{"listscriptunspent",
+        "\nReturns the confirmed unspent outputs of an address or script in an asset, in chain order. Requires -scriptindex.\n"
+        "At most " + std::to_string(MAX_SCRIPT_INDEX_RESULTS) + " outputs are returned at once.\n",
+        {
+            {"address", RPCArg::Type::STR, RPCArg::Optional::NO, "The address or hex-encoded scriptPubKey"},
+            {"assetno", RPCArg::Type::NUM, /* default */ "0", "The asset index"},
+            {"skip", RPCArg::Type::NUM, /* default */ "0", "The number of outputs to skip"},
+            {"count", RPCArg::Type::NUM, /* default */ std::to_string(MAX_SCRIPT_INDEX_RESULTS), "The maximum number of outputs to return"},
+        },
+        RPCResult{
+            "[\n"
+            "  {\n"
+            "    \"txid\" : \"txid\",      (string) The transaction id\n"
+            "    \"vout\" : n,           (numeric) The output number\n"
+            "    \"amount\" : x.xxx,     (numeric) The output value\n"
+            "    \"height\" : n,         (numeric) The height of the block the output was created in\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"},
+        RPCExamples{
+            HelpExampleCli("listscriptunspent", "\"myaddress\"")
+            + HelpExampleCli("listscriptunspent", "\"myaddress\" 1 1000 1000")
+            + HelpExampleRpc("listscriptunspent", "\"myaddress\", 1, 1000, 1000")},
+    }.Check(request);
+
+    const CScript script = ParseScriptArg(request.params[0]);
+    int skip, count;
+    ParseScriptIndexRange(request.params[2], request.params[3], MAX_SCRIPT_INDEX_RESULTS, skip, count);
+    const CoinAsset ca = GetScriptIndexAsset(request.params[1]);
+
+    std::vector<ScriptUnspent> unspent;
+    if (!g_scriptindex->FindUnspent(script, ca.no, skip, count, unspent)) {
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read script index");
+    }
+
+    UniValue ret(UniValue::VARR);
+    for (const ScriptUnspent& entry : unspent) {
+        UniValue o(UniValue::VOBJ);
+        o.pushKV("txid", entry.outpoint.hash.GetHex());
+        o.pushKV("vout", (int64_t)entry.outpoint.n);
+        o.pushKV("amount", ValueFromAmount(entry.value, ca.coin));
+        o.pushKV("height", entry.height);
+        ret.push_back(o);
+    }
+    return ret;
+}
+
+static UniValue getscripthistory(const JSONRPCRequest& request)
+{
+    RPCHelpMan{"getscripthistory",
+        "\nReturns the confirmed transactions that paid to or spent from an address or script in an asset, in chain order.\n"
+        "Requires -scriptindex. At most " + std::to_string(MAX_SCRIPT_INDEX_RESULTS) + " transactions are returned at once.\n",
+        {
+            {"address", RPCArg::Type::STR, RPCArg::Optional::NO, "The address or hex-encoded scriptPubKey"},
+            {"assetno", RPCArg::Type::NUM, /* default */ "0", "The asset index"},
+            {"skip", RPCArg::Type::NUM, /* default */ "0", "The number of transactions to skip"},
+            {"count", RPCArg::Type::NUM, /* default */ "100", "The maximum number of transactions to return"},
+        },
+        RPCResult{
+            "[\n"
+            "  {\n"
+            "    \"txid\" : \"txid\",      (string) The transaction id\n"
+            "    \"height\" : n,         (numeric) The height of the block the transaction is in\n"
+            "    \"received\" : x.xxx,   (numeric) The sum of the outputs paying to the script\n"
+            "    \"spent\" : x.xxx,      (numeric) The sum of the outputs of the script spent by the transaction\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"},
+        RPCExamples{
+            HelpExampleCli("getscripthistory", "\"myaddress\"")
+            + HelpExampleCli("getscripthistory", "\"myaddress\" 1 100 100")
+            + HelpExampleRpc("getscripthistory", "\"myaddress\", 1, 100, 100")},
+    }.Check(request);
+
+    const CScript script = ParseScriptArg(request.params[0]);
+    int skip, count;
+    ParseScriptIndexRange(request.params[2], request.params[3], 100, skip, count);
+    const CoinAsset ca = GetScriptIndexAsset(request.params[1]);
+
+    std::vector<ScriptHistoryEntry> history;
+    if (!g_scriptindex->FindHistory(script, ca.no, skip, count, history)) {
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read script index");
+    }
+
+    UniValue ret(UniValue::VARR);
+    for (const ScriptHistoryEntry& entry : history) {
+        UniValue o(UniValue::VOBJ);
+        o.pushKV("txid", entry.txid.GetHex());
+        o.pushKV("height", entry.height);
+        o.pushKV("received", ValueFromAmount(entry.received, ca.coin));
+        o.pushKV("spent", ValueFromAmount(entry.spent, ca.coin));
+        ret.push_back(o);
+    }
+    return ret;
+}
+
 // clang-format off
 static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         argNames
@@ -2350,12 +2613,16 @@ static const CRPCCommand commands[] =
     { "blockchain",         "gettxout",               &gettxout,               {"txid","n","include_mempool"} },            // ok
     { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {} },                                        // ok
     { "blockchain",         "pruneblockchain",        &pruneblockchain,        {"height"} },                                // ok
+    { "blockchain",         "reindexchainstate",      &reindexchainstate,      {"action"} },                                // ok
     { "blockchain",         "savemempool",            &savemempool,            {} },                                        // ok
     { "blockchain",         "verifychain",            &verifychain,            {"checklevel","nblocks"} },                  // ok
 
     { "blockchain",         "preciousblock",          &preciousblock,          {"blockhash"} },                             // ok
     { "blockchain",         "scantxoutset",           &scantxoutset,           {"action", "scanobjects"} },                 // fixed me
     { "blockchain",         "getblockfilter",         &getblockfilter,         {"blockhash", "filtertype"} },               
+    { "blockchain",         "getscriptbalance",       &getscriptbalance,       {"address", "assetno"} },                    // ok
+    { "blockchain",         "listscriptunspent",      &listscriptunspent,      {"address", "assetno", "skip", "count"} },   // ok
+    { "blockchain",         "getscripthistory",       &getscripthistory,       {"address", "assetno", "skip", "count"} },   // ok
 
     /* Not shown in help */
     { "hidden",             "invalidateblock",        &invalidateblock,        {"blockhash"} },                             // ok
@@ -42,6 +42,16 @@
  */
 constexpr static CAmount DEFAULT_MAX_RAW_TX_FEE{COIN / 10};
 
+/** Maximum number of transactions submitted by one sendrawtransactions call.
+ * The whole batch is validated under cs_main.
+ */
+constexpr static unsigned int MAX_SEND_RAW_TX_BATCH{1000};
+
+/** Maximum number of transactions looked up by one getrawtransactions call.
+ * The reply holds all of them at once.
+ */
+constexpr static unsigned int MAX_GET_RAW_TX_BATCH{1000};
+
 static void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry)
 {
     // Call into TxToUniv() in VCcoin-common to decode the transaction hex.
@@ -183,6 +193,13 @@ static UniValue getrawtransaction(const JSONRPCRequest& request)
 
     CTransactionRef tx;
     uint256 hash_block;
+    if (!fVerbose && f_txindex_ready && RPCSerializationFlags() == 0 && !mempool.exists(hash)) {
+        // Return the transaction as stored in the block file, without deserializing it.
+        std::vector<unsigned char> raw_tx;
+        if (g_txindex->FindRawTx(hash, hash_block, raw_tx)) {
+            return HexStr(raw_tx.begin(), raw_tx.end());
+        }
+    }
     if (!GetTransaction(hash, tx, Params().GetConsensus(), hash_block, blockindex)) {
         std::string errmsg;
         if (blockindex) {
@@ -210,6 +227,89 @@ static UniValue getrawtransaction(const JSONRPCRequest& request)
     return result;
 }
 
+static UniValue getrawtransactions(const JSONRPCRequest& request)
+{
+    RPCHelpMan{"getrawtransactions",
+                "\nReturn the raw transaction data of several transactions.\n"
+                "\nTransactions are looked up in the mempool and, if -txindex is enabled, in the blockchain, like\n"
+                "getrawtransaction without a blockhash argument. Looking up many transactions at once is faster\n"
+                "than calling getrawtransaction for each of them.\n"
+                "At most " + std::to_string(MAX_GET_RAW_TX_BATCH) + " transactions can be looked up at once.\n",
+                {
+                    {"txids", RPCArg::Type::ARR, RPCArg::Optional::NO, "A json array of transaction ids",
+                        {
+                            {"txid", RPCArg::Type::STR_HEX, RPCArg::Optional::OMITTED, "A transaction id"},
+                        },
+                        },
+                    {"verbose", RPCArg::Type::BOOL, /* default */ "false", "If false, return strings, otherwise return json objects"},
+                },
+                RPCResult{
+            "[                 (json array) One entry per txid, in the same order\n"
+            "  \"data\"|{...}    (string or json object) The transaction as returned by getrawtransaction, or null if it was not found\n"
+            "  ,...\n"
+            "]\n"
+                },
+                RPCExamples{
+                    HelpExampleCli("getrawtransactions", "'[\"mytxid\",...]'")
+            + HelpExampleCli("getrawtransactions", "'[\"mytxid\",...]' true")
+            + HelpExampleRpc("getrawtransactions", "[\"mytxid\",...], true")
+                },
+    }.Check(request);
+
+    const UniValue& txids = request.params[0].get_array();
+    if (txids.size() > MAX_GET_RAW_TX_BATCH) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Too many transactions: %u, at most %u can be looked up at once", txids.size(), MAX_GET_RAW_TX_BATCH));
+    }
+    std::vector<uint256> hashes;
+    hashes.reserve(txids.size());
+    for (unsigned int idx = 0; idx < txids.size(); idx++) {
+        hashes.push_back(ParseHashV(txids[idx], "txid"));
+    }
+
+    // Accept either a bool (true) or a num (>=1) to indicate verbose output.
+    bool fVerbose = false;
+    if (!request.params[1].isNull()) {
+        fVerbose = request.params[1].isNum() ? (request.params[1].get_int() != 0) : request.params[1].get_bool();
+    }
+
+    std::vector<CTransactionRef> txs(hashes.size());
+    std::vector<uint256> block_hashes(hashes.size());
+    std::vector<uint256> unconfirmed_hashes;
+    std::vector<size_t> unconfirmed;
+    for (size_t i = 0; i < hashes.size(); ++i) {
+        txs[i] = mempool.get(hashes[i]);
+        if (!txs[i]) {
+            unconfirmed_hashes.push_back(hashes[i]);
+            unconfirmed.push_back(i);
+        }
+    }
+
+    if (g_txindex && !unconfirmed.empty()) {
+        g_txindex->BlockUntilSyncedToCurrentChain();
+        std::vector<uint256> found_block_hashes;
+        std::vector<CTransactionRef> found_txs;
+        g_txindex->FindTxs(unconfirmed_hashes, found_block_hashes, found_txs);
+        for (size_t j = 0; j < unconfirmed.size(); ++j) {
+            txs[unconfirmed[j]] = found_txs[j];
+            block_hashes[unconfirmed[j]] = found_block_hashes[j];
+        }
+    }
+
+    UniValue result(UniValue::VARR);
+    for (size_t i = 0; i < hashes.size(); ++i) {
+        if (!txs[i]) {
+            result.push_back(NullUniValue);
+        } else if (!fVerbose) {
+            result.push_back(EncodeHexTx(*txs[i], RPCSerializationFlags()));
+        } else {
+            UniValue entry(UniValue::VOBJ);
+            TxToJSON(*txs[i], block_hashes[i], entry);
+            result.push_back(entry);
+        }
+    }
+    return result;
+}
+
 static UniValue gettxoutproof(const JSONRPCRequest& request)
 {
             RPCHelpMan{"gettxoutproof",
@@ -832,6 +932,94 @@ static UniValue sendrawtransaction(const JSONRPCRequest& request)
     return txid.GetHex();
 }
 
+static UniValue sendrawtransactions(const JSONRPCRequest& request)
+{
+    UniValue retobj(UniValue::VOBJ);
+    retobj.pushKV("warning", "Not supported.");
+    return retobj;
+
+    RPCHelpMan{"sendrawtransactions",
+                "\nSubmits a batch of raw transactions (serialized, hex-encoded) to local node and network.\n"
+                "\nTransactions may spend outputs of other transactions in the batch and can be given in any order.\n"
+                "They are validated together under a single lock and announced to peers in one batch.\n"
+                "A transaction whose parent in the batch is rejected is rejected as well.\n"
+                "At most " + std::to_string(MAX_SEND_RAW_TX_BATCH) + " transactions can be sent at once.\n"
+                "\nSee sendrawtransaction call.\n",
+                {
+                    {"rawtxs", RPCArg::Type::ARR, RPCArg::Optional::NO, "An array of hex strings of raw transactions.",
+                        {
+                            {"rawtx", RPCArg::Type::STR_HEX, RPCArg::Optional::OMITTED, ""},
+                        },
+                        },
+                    {"maxfeerate", RPCArg::Type::AMOUNT, /* default */ FormatMoney(DEFAULT_MAX_RAW_TX_FEE), "Reject transactions whose fee rate is higher than the specified value, expressed in " + CURRENCY_UNIT + "/kB\n"
+            "                                        Set to 0 to accept any fee rate.\n"},
+                },
+                RPCResult{
+            "[                   (array) The result for each raw transaction, in the order of the input array.\n"
+            " {\n"
+            "  \"txid\"           (string) The transaction hash in hex\n"
+            "  \"accepted\"       (boolean) If the transaction is in the mempool or the chain\n"
+            "  \"reject-reason\"  (string) Rejection string (only present when 'accepted' is false)\n"
+            " }\n"
+            "]\n"
+                },
+                RPCExamples{
+            HelpExampleCli("sendrawtransactions", "\"[\\\"signedparenthex\\\",\\\"signedchildhex\\\"]\"") +
+            "\nAs a JSON-RPC call\n"
+            + HelpExampleRpc("sendrawtransactions", "[\"signedparenthex\",\"signedchildhex\"]")
+                },
+    }.Check(request);
+
+    RPCTypeCheck(request.params, {
+        UniValue::VARR,
+        UniValue::VNUM,
+    }, true);
+
+    const UniValue& rawtxs = request.params[0].get_array();
+    if (rawtxs.size() > MAX_SEND_RAW_TX_BATCH) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Too many transactions: %u, at most %u can be sent at once", rawtxs.size(), MAX_SEND_RAW_TX_BATCH));
+    }
+    std::vector<CTransactionRef> txs;
+    std::vector<CAmount> max_raw_tx_fees;
+    txs.reserve(rawtxs.size());
+    max_raw_tx_fees.reserve(rawtxs.size());
+    for (size_t i = 0; i < rawtxs.size(); ++i) {
+        CMutableTransaction mtx;
+        if (!DecodeHexTx(mtx, rawtxs[i].get_str())) {
+            throw JSONRPCError(RPC_DESERIALIZATION_ERROR, strprintf("TX decode failed for transaction %u", i));
+        }
+        txs.push_back(MakeTransactionRef(std::move(mtx)));
+
+        CAmount max_raw_tx_fee = DEFAULT_MAX_RAW_TX_FEE;
+        if (!request.params[1].isNull()) {
+            size_t weight = GetTransactionWeight(*txs.back());
+            CFeeRate fr(AmountFromValue(request.params[1]));
+            // the +3/4 part rounds the value up, see sendrawtransaction
+            max_raw_tx_fee = fr.GetFee((weight+3)/4);
+        }
+        max_raw_tx_fees.push_back(max_raw_tx_fee);
+    }
+
+    std::vector<BroadcastResult> results;
+    const TransactionError err = BroadcastTransactions(txs, max_raw_tx_fees, results);
+    if (TransactionError::OK != err) {
+        throw JSONRPCTransactionError(err);
+    }
+
+    UniValue result(UniValue::VARR);
+    for (const BroadcastResult& res : results) {
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("txid", res.txid.GetHex());
+        const bool accepted = res.error == TransactionError::OK || res.error == TransactionError::ALREADY_IN_CHAIN;
+        entry.pushKV("accepted", accepted);
+        if (!accepted) {
+            entry.pushKV("reject-reason", res.err_string.empty() ? TransactionErrorString(res.error) : res.err_string);
+        }
+        result.push_back(std::move(entry));
+    }
+    return result;
+}
+
 static UniValue testmempoolaccept(const JSONRPCRequest& request)
 {
     UniValue retobj(UniValue::VOBJ);
@@ -1761,10 +1949,12 @@ static const CRPCCommand commands[] =
 { //  category              name                            actor (function)            argNames
   //  --------------------- ------------------------        -----------------------     ----------
     { "rawtransactions",    "getrawtransaction",            &getrawtransaction,         {"txid","verbose","blockhash"} },                       // ok
+    { "rawtransactions",    "getrawtransactions",           &getrawtransactions,        {"txids","verbose"} },                                  // ok
     { "rawtransactions",    "createrawtransaction",         &createrawtransaction,      {"inputs","outputs","locktime","replaceable"} },        // not yet supportted 
     { "rawtransactions",    "decoderawtransaction",         &decoderawtransaction,      {"hexstring","iswitness"} },                            // ok
     { "rawtransactions",    "decodescript",                 &decodescript,              {"hexstring"} },                                        // ok
     { "rawtransactions",    "sendrawtransaction",           &sendrawtransaction,        {"hexstring","allowhighfees|maxfeerate"} },             // not yet supportted
+    { "rawtransactions",    "sendrawtransactions",          &sendrawtransactions,       {"rawtxs","maxfeerate"} },                              // not yet supportted
     { "rawtransactions",    "combinerawtransaction",        &combinerawtransaction,     {"txs"} },                                              // not yet supportted
     { "rawtransactions",    "signrawtransactionwithkey",    &signrawtransactionwithkey, {"hexstring","privkeys","prevtxs","sighashtype"} },     // not yet supportted
     { "rawtransactions",    "testmempoolaccept",            &testmempoolaccept,         {"rawtxs","allowhighfees|maxfeerate"} },                // not yet supportted
@@ -195,6 +195,93 @@ public:
     }
 };
 
+/** Minimal stream for reading from an existing byte span, without copying it. */
+class SpanReader
+{
+private:
+    const int m_type;
+    const int m_version;
+    const char* m_data;
+    size_t m_size;
+
+public:
+    SpanReader(int type, int version, const char* data, size_t size)
+        : m_type(type), m_version(version), m_data(data), m_size(size) {}
+
+    template<typename T>
+    SpanReader& operator>>(T&& obj)
+    {
+        // Unserialize from this stream
+        ::Unserialize(*this, obj);
+        return (*this);
+    }
+
+    int GetVersion() const { return m_version; }
+    int GetType() const { return m_type; }
+
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+
+    void read(char* dst, size_t n)
+    {
+        if (n == 0) {
+            return;
+        }
+        if (n > m_size) {
+            throw std::ios_base::failure("SpanReader::read(): end of data");
+        }
+        memcpy(dst, m_data, n);
+        m_data += n;
+        m_size -= n;
+    }
+
+    void ignore(size_t n)
+    {
+        if (n > m_size) {
+            throw std::ios_base::failure("SpanReader::ignore(): end of data");
+        }
+        m_data += n;
+        m_size -= n;
+    }
+};
+
+/**
+ * XOR size bytes at data with key, repeating the key as needed.
+ *
+ * Keys of 8 bytes (the size of database obfuscation keys) are applied a word
+ * at a time, which compilers turn into vector instructions.
+ */
+inline void XorWithKey(char* data, size_t size, const std::vector<unsigned char>& key)
+{
+    if (key.size() == 0) {
+        return;
+    }
+
+    size_t i = 0;
+    if (key.size() == sizeof(uint64_t)) {
+        uint64_t word_key;
+        memcpy(&word_key, key.data(), sizeof(word_key));
+        for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+            uint64_t word;
+            memcpy(&word, data + i, sizeof(word));
+            word ^= word_key;
+            memcpy(data + i, &word, sizeof(word));
+        }
+    }
+
+    // The remainder starts at a multiple of the key size, so key index 0.
+    for (size_t j = 0; i != size; i++) {
+        data[i] ^= key[j++];
+
+        // This potentially acts on very many bytes of data, so it's
+        // important that we calculate `j`, i.e. the `key` index in this
+        // way instead of doing a %, which would effectively be a division
+        // for each byte Xor'd -- much slower than need be.
+        if (j == key.size())
+            j = 0;
+    }
+}
+
 /** Double ended buffer combining vector and stream-like interfaces.
  *
  * >> and << read and write unformatted data using the above serialization templates.
@@ -475,20 +562,7 @@ public:
      */
     void Xor(const std::vector<unsigned char>& key)
     {
-        if (key.size() == 0) {
-            return;
-        }
-
-        for (size_type i = 0, j = 0; i != size(); i++) {
-            vch[i] ^= key[j++];
-
-            // This potentially acts on very many bytes of data, so it's
-            // important that we calculate `j`, i.e. the `key` index in this
-            // way instead of doing a %, which would effectively be a division
-            // for each byte Xor'd -- much slower than need be.
-            if (j == key.size())
-                j = 0;
-        }
+        XorWithKey(vch.data(), size(), key);
     }
 };
 
@@ -0,0 +1,74 @@
+// Copyright (c) 2019 The Vccoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <test/setup_common.h>
+#include <validation.h>
+
+#include <boost/test/unit_test.hpp>
+
+// Tests these internal-to-net_processing.cpp methods:
+extern int64_t UpdateMovingAverage(int64_t average, int64_t sample);
+extern int GetBlocksInFlightTarget(int64_t service_time);
+extern bool ShouldReassignBlock(int64_t our_service_time, int64_t their_service_time, int64_t their_latency, int64_t in_flight_time);
+
+BOOST_FIXTURE_TEST_SUITE(blockdownload_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(moving_average)
+{
+    // The first sample is taken as is.
+    BOOST_CHECK_EQUAL(UpdateMovingAverage(0, 1000), 1000);
+    // Later samples have a weight of one quarter.
+    BOOST_CHECK_EQUAL(UpdateMovingAverage(1000, 2000), 1250);
+    BOOST_CHECK_EQUAL(UpdateMovingAverage(1000, 0), 750);
+
+    // The average converges to a steady sample.
+    int64_t average = 0;
+    for (int i = 0; i < 10; ++i) {
+        average = UpdateMovingAverage(average, 100000);
+    }
+    for (int i = 0; i < 50; ++i) {
+        average = UpdateMovingAverage(average, 20000);
+    }
+    BOOST_CHECK(average >= 20000 && average < 20010);
+}
+
+BOOST_AUTO_TEST_CASE(blocks_in_flight_target)
+{
+    // Unknown peers get the fixed window.
+    BOOST_CHECK_EQUAL(GetBlocksInFlightTarget(0), MAX_BLOCKS_IN_TRANSIT_PER_PEER);
+    // Enough blocks to keep the peer busy for the lead time.
+    BOOST_CHECK_EQUAL(GetBlocksInFlightTarget(BLOCK_DOWNLOAD_LEAD_TIME / 20), 20);
+    BOOST_CHECK_EQUAL(GetBlocksInFlightTarget(BLOCK_DOWNLOAD_LEAD_TIME / 20 + 1), 20);
+    // Within bounds for very fast and very slow peers.
+    BOOST_CHECK_EQUAL(GetBlocksInFlightTarget(1), MAX_BLOCKS_IN_TRANSIT_PER_PEER_ADAPTIVE);
+    BOOST_CHECK_EQUAL(GetBlocksInFlightTarget(BLOCK_DOWNLOAD_LEAD_TIME * 10), MIN_BLOCKS_IN_TRANSIT_PER_PEER_ADAPTIVE);
+    // Faster peers never get smaller windows.
+    int last = MAX_BLOCKS_IN_TRANSIT_PER_PEER_ADAPTIVE;
+    for (int64_t service_time = 1000; service_time < 10 * BLOCK_DOWNLOAD_LEAD_TIME; service_time *= 2) {
+        const int target = GetBlocksInFlightTarget(service_time);
+        BOOST_CHECK(target <= last);
+        last = target;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(reassign_straggling_block)
+{
+    const int64_t late = 10 * BLOCK_STRAGGLER_MIN_TIME;
+    // A peer without measurements never takes over.
+    BOOST_CHECK(!ShouldReassignBlock(0, 500000, 100000, late));
+    // Nor does a peer that is not faster.
+    BOOST_CHECK(!ShouldReassignBlock(500000, 500000, 100000, late));
+    BOOST_CHECK(!ShouldReassignBlock(600000, 500000, 100000, late));
+    // A faster peer takes over late blocks, also from unmeasured peers.
+    BOOST_CHECK(ShouldReassignBlock(100000, 500000, 100000, late));
+    BOOST_CHECK(ShouldReassignBlock(100000, 0, 0, late));
+    // But not before the block was in flight for the minimum time...
+    BOOST_CHECK(!ShouldReassignBlock(100000, 500000, 100000, BLOCK_STRAGGLER_MIN_TIME - 1));
+    BOOST_CHECK(ShouldReassignBlock(100000, 500000, 100000, BLOCK_STRAGGLER_MIN_TIME));
+    // ...or twice the usual latency of the peer it is in flight from.
+    BOOST_CHECK(!ShouldReassignBlock(100000, 500000, late, 2 * late - 1));
+    BOOST_CHECK(ShouldReassignBlock(100000, 500000, late, 2 * late));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -39,6 +39,88 @@ BOOST_AUTO_TEST_CASE(gcsfilter_test)
     }
 }
 
+BOOST_AUTO_TEST_CASE(gcsfilter_encoding_test)
+{
+    GCSFilter::ElementSet elements;
+    for (int i = 0; i < 300; ++i) {
+        GCSFilter::Element element(32);
+        element[0] = i;
+        element[1] = i >> 8;
+        elements.insert(std::move(element));
+    }
+
+    // Small values of P give long unary-coded quotients.
+    for (uint8_t P : {0, 1, 7, 19, 40}) {
+        GCSFilter::Params params(1, 2, P, 1 << 16);
+        GCSFilter filter(params, elements);
+
+        // Compare against decoding and encoding a bit at a time.
+        VectorReader reader_stream(SER_NETWORK, 0, filter.GetEncoded(), 0);
+        BOOST_CHECK_EQUAL(ReadCompactSize(reader_stream), elements.size());
+        BitStreamReader<VectorReader> reader(reader_stream);
+        std::vector<unsigned char> expected;
+        CVectorWriter stream(SER_NETWORK, 0, expected, 0);
+        WriteCompactSize(stream, elements.size());
+        {
+            BitStreamWriter<CVectorWriter> writer(stream);
+            for (size_t i = 0; i < elements.size(); ++i) {
+                uint64_t q = 0;
+                while (reader.Read(1) == 1) ++q;
+                const uint64_t r = reader.Read(P);
+                for (uint64_t j = 0; j < q; ++j) writer.Write(1, 1);
+                writer.Write(0, 1);
+                writer.Write(r, P);
+            }
+        }
+        BOOST_CHECK(reader_stream.empty());
+        BOOST_CHECK(filter.GetEncoded() == expected);
+
+        // Decoding validates the number of elements and the length.
+        GCSFilter decoded(params, filter.GetEncoded());
+        BOOST_CHECK_EQUAL(decoded.GetN(), elements.size());
+        for (const auto& element : elements) {
+            BOOST_CHECK(decoded.Match(element));
+        }
+
+        std::vector<unsigned char> truncated = filter.GetEncoded();
+        truncated.pop_back();
+        BOOST_CHECK_THROW(GCSFilter(params, truncated), std::ios_base::failure);
+        std::vector<unsigned char> extended = filter.GetEncoded();
+        extended.push_back(0);
+        BOOST_CHECK_THROW(GCSFilter(params, extended), std::ios_base::failure);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(gcsfilter_batch_match)
+{
+    std::vector<GCSFilter> filters;
+    GCSFilter::ElementSet query;
+    for (int i = 0; i < 20; ++i) {
+        GCSFilter::ElementSet elements;
+        for (int j = 0; j < 50; ++j) {
+            GCSFilter::Element element(32);
+            element[0] = i;
+            element[1] = j;
+            elements.insert(element);
+            // Query one element of every third filter.
+            if (i % 3 == 0 && j == 7) query.insert(element);
+        }
+        filters.emplace_back(GCSFilter::Params(i, 0, 10, 1 << 10), elements);
+    }
+    filters.emplace_back();
+
+    std::vector<const GCSFilter*> ptrs;
+    for (const GCSFilter& filter : filters) ptrs.push_back(&filter);
+    const std::vector<bool> results = GCSFilter::MatchAny(ptrs, query);
+    BOOST_REQUIRE_EQUAL(results.size(), filters.size());
+    for (size_t i = 0; i < filters.size(); ++i) {
+        BOOST_CHECK_EQUAL(results[i], filters[i].MatchAny(query));
+        if (i < 20 && i % 3 == 0) BOOST_CHECK(results[i]);
+    }
+    BOOST_CHECK(!results.back());
+    BOOST_CHECK(GCSFilter::MatchAny({}, query).empty());
+}
+
 BOOST_AUTO_TEST_CASE(gcsfilter_default_constructor)
 {
     GCSFilter filter;
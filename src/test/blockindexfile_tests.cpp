@@ -0,0 +1,281 @@
+// Copyright (c) 2019 The Vccoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <arith_uint256.h>
+#include <blockindexfile.h>
+#include <chain.h>
+#include <chainparams.h>
+#include <fs.h>
+#include <pow.h>
+#include <test/setup_common.h>
+#include <txdb.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockindexfile_tests, BasicTestingSetup)
+
+static BlockIndexRecord MakeRecord(int i)
+{
+    BlockIndexRecord record;
+    record.hash = ArithToUint256(arith_uint256(i + 1));
+    record.hashPrev = i > 0 ? ArithToUint256(arith_uint256(i)) : uint256();
+    record.hashMerkleRoot = InsecureRand256();
+    record.nVersion = -i;
+    record.nTime = 1000 + i;
+    record.nBits = 0x207fffff;
+    record.nNonce = InsecureRand32();
+    record.nHeight = i;
+    record.nStatus = BLOCK_VALID_TREE;
+    record.nTx = i * 2;
+    record.nFile = i / 10;
+    record.nDataPos = i * 100;
+    record.nUndoPos = i * 50;
+    return record;
+}
+
+static bool RecordsEqual(const BlockIndexRecord& a, const BlockIndexRecord& b)
+{
+    return a.hash == b.hash && a.hashPrev == b.hashPrev && a.hashMerkleRoot == b.hashMerkleRoot &&
+           a.nVersion == b.nVersion && a.nTime == b.nTime && a.nBits == b.nBits && a.nNonce == b.nNonce &&
+           a.nHeight == b.nHeight && a.nStatus == b.nStatus && a.nTx == b.nTx && a.nFile == b.nFile &&
+           a.nDataPos == b.nDataPos && a.nUndoPos == b.nUndoPos;
+}
+
+BOOST_AUTO_TEST_CASE(blockindexfile_append_load)
+{
+    BlockIndexFile file(GetDataDir() / "blockindex_test.dat");
+    BOOST_REQUIRE(file.Create());
+    BOOST_CHECK_EQUAL(file.GetSize(), BlockIndexFile::HEADER_SIZE);
+
+    std::vector<BlockIndexRecord> records;
+    for (int i = 0; i < 10; ++i) records.push_back(MakeRecord(i));
+    uint64_t size;
+    BOOST_REQUIRE(file.Append(records, size));
+    BOOST_CHECK_EQUAL(size, BlockIndexFile::HEADER_SIZE + 10 * BlockIndexRecord::SIZE);
+    file.SetSize(size);
+
+    // Records appended without updating the size are overwritten by the next append.
+    uint64_t discarded_size;
+    BOOST_REQUIRE(file.Append({MakeRecord(20)}, discarded_size));
+    records.push_back(MakeRecord(10));
+    BOOST_REQUIRE(file.Append({records.back()}, size));
+    file.SetSize(size);
+
+    std::vector<BlockIndexRecord> loaded;
+    const auto accept = [](const BlockIndexRecord&) { return true; };
+    const auto add = [&loaded](const BlockIndexRecord& record) { loaded.push_back(record); };
+    BlockIndexFile reopened(file.GetPath());
+    BOOST_CHECK(reopened.Load(size, accept, add));
+    BOOST_CHECK_EQUAL(reopened.GetSize(), size);
+    BOOST_REQUIRE_EQUAL(loaded.size(), records.size());
+    for (size_t i = 0; i < records.size(); ++i) {
+        BOOST_CHECK(RecordsEqual(loaded[i], records[i]));
+    }
+
+    // Only the given size is read, and it has to hold whole records.
+    loaded.clear();
+    BOOST_CHECK(reopened.Load(size - BlockIndexRecord::SIZE, accept, add));
+    BOOST_CHECK_EQUAL(loaded.size(), records.size() - 1);
+    loaded.clear();
+    BOOST_CHECK(!reopened.Load(size - 1, accept, add));
+    BOOST_CHECK(!reopened.Load(size + BlockIndexRecord::SIZE, accept, add));
+    BOOST_CHECK_EQUAL(reopened.GetSize(), 0U);
+
+    // No record is passed on unless all of them pass the check.
+    int checked = 0;
+    BOOST_CHECK(!reopened.Load(size, [&checked](const BlockIndexRecord&) { return ++checked < 5; }, add));
+    BOOST_CHECK_EQUAL(checked, 5);
+    BOOST_CHECK(loaded.empty());
+
+    // A changed byte anywhere in a record fails its checksum.
+    for (size_t offset : {size_t{0}, size_t{100}, BlockIndexRecord::SIZE - 1}) {
+        FILE* f = fsbridge::fopen(file.GetPath(), "rb+");
+        BOOST_REQUIRE(f);
+        const long pos = BlockIndexFile::HEADER_SIZE + 3 * BlockIndexRecord::SIZE + offset;
+        BOOST_REQUIRE(fseek(f, pos, SEEK_SET) == 0);
+        const int byte = fgetc(f);
+        BOOST_REQUIRE(byte != EOF);
+        BOOST_REQUIRE(fseek(f, pos, SEEK_SET) == 0);
+        fputc(byte ^ 1, f);
+        fclose(f);
+        BOOST_CHECK(!reopened.Load(size, accept, add));
+        BOOST_CHECK(loaded.empty());
+
+        f = fsbridge::fopen(file.GetPath(), "rb+");
+        BOOST_REQUIRE(f);
+        BOOST_REQUIRE(fseek(f, pos, SEEK_SET) == 0);
+        fputc(byte, f);
+        fclose(f);
+        BOOST_CHECK(reopened.Load(size, accept, add));
+        BOOST_CHECK_EQUAL(loaded.size(), records.size());
+        loaded.clear();
+    }
+}
+
+BOOST_AUTO_TEST_CASE(blockindexfile_blocktreedb)
+{
+    SelectParams(CBaseChainParams::REGTEST);
+    const Consensus::Params& params = Params().GetConsensus();
+    gArgs.ForceSetArg("-blockindexfile", "1");
+
+    // The database entries are keyed by the hash of the header, so build a
+    // chain of headers that pass the regtest proof of work check.
+    std::vector<uint256> hashes(20);
+    std::vector<CBlockIndex> blocks(20);
+    for (int i = 0; i < 20; ++i) {
+        CBlockHeader header;
+        header.hashPrevBlock = i > 0 ? hashes[i - 1] : uint256();
+        header.hashMerkleRoot = InsecureRand256();
+        header.nTime = 1000 + i;
+        header.nBits = 0x207fffff;
+        while (!CheckProofOfWork(header.GetHash(), header.nBits, params)) ++header.nNonce;
+        hashes[i] = header.GetHash();
+        blocks[i] = CBlockIndex(header);
+        blocks[i].phashBlock = &hashes[i];
+        blocks[i].pprev = i > 0 ? &blocks[i - 1] : nullptr;
+        blocks[i].nHeight = i;
+        blocks[i].nStatus = BLOCK_VALID_TREE;
+        blocks[i].nTx = i * 2;
+    }
+    std::vector<const CBlockIndex*> block_ptrs;
+    for (const CBlockIndex& block : blocks) block_ptrs.push_back(&block);
+
+    std::map<uint256, std::unique_ptr<CBlockIndex>> loaded;
+    const auto insert = [&loaded](const uint256& hash) -> CBlockIndex* {
+        if (hash.IsNull()) return nullptr;
+        std::unique_ptr<CBlockIndex>& pindex = loaded[hash];
+        if (!pindex) {
+            pindex = MakeUnique<CBlockIndex>();
+            pindex->phashBlock = &loaded.find(hash)->first;
+        }
+        return pindex.get();
+    };
+    const auto check_loaded = [&]() {
+        BOOST_REQUIRE_EQUAL(loaded.size(), blocks.size());
+        for (const CBlockIndex& block : blocks) {
+            const CBlockIndex& pindex = *loaded.at(block.GetBlockHash());
+            BOOST_CHECK_EQUAL(pindex.nHeight, block.nHeight);
+            BOOST_CHECK_EQUAL(pindex.nStatus, block.nStatus);
+            BOOST_CHECK_EQUAL(pindex.nTx, block.nTx);
+            BOOST_CHECK(pindex.pprev == (block.pprev ? loaded.at(block.pprev->GetBlockHash()).get() : nullptr));
+        }
+    };
+
+    {
+        // The file is only written after it was built when loading.
+        CBlockTreeDB db(1 << 20, false, true);
+        BOOST_CHECK(db.WriteBatchSync({}, 0, block_ptrs));
+    }
+    {
+        // Built from the database.
+        CBlockTreeDB db(1 << 20);
+        BOOST_CHECK(db.LoadBlockIndexGuts(params, insert));
+        check_loaded();
+
+        // Appended to from now on.
+        blocks[5].nStatus |= BLOCK_HAVE_DATA;
+        BOOST_CHECK(db.WriteBatchSync({}, 0, {&blocks[5]}));
+    }
+    {
+        // Loaded from the file.
+        loaded.clear();
+        CBlockTreeDB db(1 << 20);
+        BOOST_CHECK(db.LoadBlockIndexGuts(params, insert));
+        check_loaded();
+    }
+
+    // Writes without the file make it outdated, so it is rebuilt.
+    gArgs.ForceSetArg("-blockindexfile", "0");
+    {
+        CBlockTreeDB db(1 << 20);
+        blocks[6].nStatus |= BLOCK_HAVE_DATA;
+        BOOST_CHECK(db.WriteBatchSync({}, 0, {&blocks[6]}));
+    }
+    gArgs.ForceSetArg("-blockindexfile", "1");
+    {
+        loaded.clear();
+        CBlockTreeDB db(1 << 20);
+        BOOST_CHECK(db.LoadBlockIndexGuts(params, insert));
+        check_loaded();
+    }
+
+    // Versions without the file store blocks without updating it or the
+    // database entry of its size, as in CBlockTreeDB::WriteBatchSync before
+    // the file. The changed block file info shows the file is outdated.
+    {
+        CBlockTreeDB db(1 << 20);
+        blocks[7].nStatus |= BLOCK_HAVE_DATA;
+        CBlockFileInfo info;
+        info.AddBlock(blocks[7].nHeight, blocks[7].nTime);
+        CDBBatch batch(db);
+        batch.Write(std::make_pair('f', 0), info); // DB_BLOCK_FILES
+        batch.Write('l', 0); // DB_LAST_BLOCK
+        batch.Write(std::make_pair('b', blocks[7].GetBlockHash()), CDiskBlockIndex(&blocks[7])); // DB_BLOCK_INDEX
+        BOOST_REQUIRE(db.WriteBatch(batch, true));
+    }
+    {
+        loaded.clear();
+        CBlockTreeDB db(1 << 20);
+        BOOST_CHECK(db.LoadBlockIndexGuts(params, insert));
+        check_loaded();
+    }
+    {
+        // The rebuilt file matches the database again.
+        loaded.clear();
+        CBlockTreeDB db(1 << 20);
+        BOOST_CHECK(db.LoadBlockIndexGuts(params, insert));
+        check_loaded();
+    }
+
+    // A damaged file is ignored without changing the block index, which is
+    // loaded from the database, and the file is rebuilt.
+    const fs::path index_file_path = GetBlocksDir() / "index" / "blockindex.dat";
+    const auto check_damaged = [&](const std::function<void()>& damage) {
+        damage();
+        loaded.clear();
+        {
+            CBlockTreeDB db(1 << 20);
+            BOOST_CHECK(db.LoadBlockIndexGuts(params, insert));
+            check_loaded();
+        }
+        BlockIndexFileState state;
+        {
+            CBlockTreeDB db(1 << 20);
+            BOOST_CHECK(db.Read('L', state)); // DB_BLOCK_INDEX_FILE
+        }
+        BlockIndexFile file(index_file_path);
+        size_t num_records = 0;
+        BOOST_CHECK(file.Load(state.size, [](const BlockIndexRecord&) { return true; }, [&num_records](const BlockIndexRecord&) { ++num_records; }));
+        BOOST_CHECK_EQUAL(num_records, blocks.size());
+    };
+    // A changed byte
+    check_damaged([&]() {
+        FILE* f = fsbridge::fopen(index_file_path, "rb+");
+        BOOST_REQUIRE(f);
+        BOOST_REQUIRE(fseek(f, BlockIndexFile::HEADER_SIZE + 10 * BlockIndexRecord::SIZE, SEEK_SET) == 0);
+        fputc(0xff, f);
+        fclose(f);
+    });
+    // A truncated file
+    check_damaged([&]() { fs::resize_file(index_file_path, fs::file_size(index_file_path) - 1); });
+    // An intact record that fails the proof of work check, after records that pass it
+    check_damaged([&]() {
+        CBlockTreeDB db(1 << 20);
+        BlockIndexFileState state;
+        BOOST_REQUIRE(db.Read('L', state));
+        BlockIndexRecord record(blocks.back());
+        record.hash = uint256S("ffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff");
+        record.hashPrev = blocks.back().GetBlockHash();
+        record.nHeight = blocks.size();
+        BlockIndexFile file(index_file_path);
+        file.SetSize(state.size);
+        BOOST_REQUIRE(file.Append({record}, state.size));
+        BOOST_REQUIRE(db.Write('L', state, true));
+    });
+
+    gArgs.ForceSetArg("-blockindexfile", "0");
+    SelectParams(CBaseChainParams::MAIN);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
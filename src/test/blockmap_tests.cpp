@@ -0,0 +1,75 @@
+// Copyright (c) 2019 The Vccoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockmap.h>
+#include <chain.h>
+#include <test/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <map>
+
+BOOST_FIXTURE_TEST_SUITE(blockmap_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(blockmap_insert_find)
+{
+    BlockMap map;
+    BOOST_CHECK(map.empty());
+    BOOST_CHECK(map.find(InsecureRand256()) == map.end());
+
+    // Insert enough entries for the table to grow several times, and check
+    // that keys and block indexes never move.
+    std::map<uint256, const CBlockIndex*> expected;
+    for (int i = 0; i < 20000; ++i) {
+        const uint256 hash = InsecureRand256();
+        auto inserted = map.emplace_index(hash);
+        BOOST_REQUIRE(inserted.second);
+        CBlockIndex* pindex = inserted.first->second;
+        pindex->nHeight = i;
+        BOOST_CHECK(pindex->GetBlockHash() == hash);
+        BOOST_CHECK(pindex->phashBlock == &inserted.first->first);
+        expected.emplace(hash, pindex);
+    }
+    BOOST_CHECK_EQUAL(map.size(), expected.size());
+    for (const auto& entry : expected) {
+        const BlockMap& const_map = map;
+        BlockMap::const_iterator it = const_map.find(entry.first);
+        BOOST_REQUIRE(it != const_map.end());
+        BOOST_CHECK(it->second == entry.second);
+        BOOST_CHECK(&it->first == entry.second->phashBlock);
+        BOOST_CHECK_EQUAL(map.count(entry.first), 1U);
+    }
+
+    // Adding an existing hash returns the existing entry.
+    const uint256& first = expected.begin()->first;
+    auto existing = map.emplace_index(first);
+    BOOST_CHECK(!existing.second);
+    BOOST_CHECK(existing.first->second == expected.begin()->second);
+    BOOST_CHECK(!map.insert(std::make_pair(first, nullptr)).second);
+    BOOST_CHECK(map[first] == expected.begin()->second);
+
+    // Iteration visits every entry once.
+    size_t visited = 0;
+    for (const BlockMap::value_type& entry : map) {
+        BOOST_CHECK(expected.at(entry.first) == entry.second);
+        ++visited;
+    }
+    BOOST_CHECK_EQUAL(visited, expected.size());
+
+    // Entries not created by the map are kept as given.
+    CBlockIndex external;
+    const uint256 hash = InsecureRand256();
+    BOOST_CHECK(map.emplace(hash, &external).second);
+    BOOST_CHECK(map.find(hash)->second == &external);
+    BOOST_CHECK(map[InsecureRand256()] == nullptr);
+    BOOST_CHECK_EQUAL(map.size(), expected.size() + 2);
+
+    map.clear();
+    BOOST_CHECK(map.empty());
+    BOOST_CHECK(map.begin() == map.end());
+    BOOST_CHECK(map.find(first) == map.end());
+    BOOST_CHECK(map.emplace_index(first).second);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
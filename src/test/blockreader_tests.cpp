@@ -0,0 +1,47 @@
+// Copyright (c) 2019 The Vccoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <index/blockreader.h>
+#include <test/setup_common.h>
+#include <validation.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockreader_tests, TestingSetup)
+
+BOOST_AUTO_TEST_CASE(blockreader_shared_reads)
+{
+    const CBlockIndex* genesis;
+    {
+        LOCK(cs_main);
+        genesis = ::ChainActive().Genesis();
+    }
+    BOOST_REQUIRE(genesis);
+
+    IndexBlockReader reader;
+    const int id1 = reader.Register();
+    const int id2 = reader.Register();
+    BOOST_CHECK(id1 != id2);
+
+    // Both indexes get the same copy of the block.
+    const std::shared_ptr<const CBlock> block1 = reader.Read(id1, genesis);
+    const std::shared_ptr<const CBlock> block2 = reader.Read(id2, genesis);
+    BOOST_REQUIRE(block1);
+    BOOST_CHECK_EQUAL(block1.get(), block2.get());
+    BOOST_CHECK(block1->GetHash() == Params().GenesisBlock().GetHash());
+
+    reader.Unregister(id1);
+    reader.Unregister(id2);
+
+    // Reading again after every index unregistered starts over.
+    const int id3 = reader.Register();
+    const std::shared_ptr<const CBlock> block3 = reader.Read(id3, genesis);
+    BOOST_REQUIRE(block3);
+    BOOST_CHECK(block3 != block1);
+    BOOST_CHECK(block3->GetHash() == genesis->GetBlockHash());
+    reader.Unregister(id3);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
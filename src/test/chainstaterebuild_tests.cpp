@@ -0,0 +1,178 @@
+// Copyright (c) 2019 The Vccoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainstaterebuild.h>
+#include <coins.h>
+#include <hash.h>
+#include <key.h>
+#include <script/interpreter.h>
+#include <txdb.h>
+#include <util/system.h>
+#include <validation.h>
+
+#include <test/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(chainstaterebuild_tests, BasicTestingSetup)
+
+static void WriteCoin(CCoinsViewDB& db, const COutPoint& outpoint, const uint256& best_block)
+{
+    CCoinsViewCache cache(&db);
+    cache.AddCoin(outpoint, Coin(CTxOut(COIN, CScript() << OP_TRUE), 1, false), false);
+    cache.SetBestBlock(best_block);
+    BOOST_CHECK(cache.Flush());
+}
+
+BOOST_AUTO_TEST_CASE(swap_directory)
+{
+    const fs::path path = GetDataDir() / "chainstate";
+    const fs::path path_new = GetDataDir() / "chainstate.new";
+    const COutPoint old_coin(InsecureRand256(), 0);
+    const COutPoint new_coin(InsecureRand256(), 0);
+    const uint256 new_tip = InsecureRand256();
+
+    CCoinsViewDB db(path, 1 << 20, false, true);
+    WriteCoin(db, old_coin, InsecureRand256());
+    {
+        CCoinsViewDB db_new(path_new, 1 << 20, false, true);
+        WriteCoin(db_new, new_coin, new_tip);
+    }
+
+    // Not while a cursor is open
+    {
+        std::unique_ptr<CCoinsViewCursor> cursor(db.Cursor());
+        BOOST_CHECK(db.HasOpenCursors());
+        BOOST_CHECK(!db.SwapDirectory(path_new));
+        BOOST_CHECK(db.HaveCoin(old_coin));
+    }
+    BOOST_CHECK(!db.HasOpenCursors());
+
+    BOOST_CHECK(db.SwapDirectory(path_new));
+    BOOST_CHECK(!db.HaveCoin(old_coin));
+    BOOST_CHECK(db.HaveCoin(new_coin));
+    BOOST_CHECK(db.GetBestBlock() == new_tip);
+    BOOST_CHECK(!fs::exists(path_new));
+    BOOST_CHECK(!fs::exists(GetDataDir() / "chainstate.old"));
+}
+
+BOOST_AUTO_TEST_CASE(cleanup)
+{
+    const fs::path path = GetDataDir() / "chainstate";
+    const fs::path path_new = GetDataDir() / "chainstate.new";
+    const fs::path path_old = GetDataDir() / "chainstate.old";
+    const COutPoint coin(InsecureRand256(), 0);
+    {
+        CCoinsViewDB db(path, 1 << 20, false, true);
+        WriteCoin(db, coin, InsecureRand256());
+    }
+
+    // Interrupted between moving the old database away and the new one in:
+    // the old one is restored and the partial rebuild removed.
+    fs::rename(path, path_old);
+    TryCreateDirectories(path_new);
+    CleanupChainstateRebuild(path);
+    BOOST_CHECK(fs::exists(path));
+    BOOST_CHECK(!fs::exists(path_old));
+    BOOST_CHECK(!fs::exists(path_new));
+    {
+        CCoinsViewDB db(path, 1 << 20, false, false);
+        BOOST_CHECK(db.HaveCoin(coin));
+    }
+
+    // Interrupted before the old database was deleted
+    TryCreateDirectories(path_old);
+    CleanupChainstateRebuild(path);
+    BOOST_CHECK(fs::exists(path));
+    BOOST_CHECK(!fs::exists(path_old));
+}
+
+/** Hash of all coins and the best block of db, like gettxoutsetinfo's hash_serialized. */
+static uint256 UTXOHash(CCoinsViewDB& db)
+{
+    std::unique_ptr<CCoinsViewCursor> cursor(db.Cursor());
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << cursor->GetBestBlock();
+    for (; cursor->Valid(); cursor->Next()) {
+        COutPoint key;
+        Coin coin;
+        BOOST_REQUIRE(cursor->GetKey(key));
+        BOOST_REQUIRE(cursor->GetValue(coin));
+        ss << key << coin;
+    }
+    return ss.GetHash();
+}
+
+BOOST_FIXTURE_TEST_CASE(rebuild, TestChain100Setup)
+{
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CTransactionRef coins = IssueMainCoins();
+
+    // Spend some coins, so that the UTXO set is more than coinbases
+    CMutableTransaction split;
+    split.vin.resize(1);
+    split.vin[0].prevout = COutPoint(coins->GetHash(), 0);
+    split.vout.resize(3, CTxOut(COIN, CScript() << OP_TRUE));
+    split.vout.emplace_back(coins->vout[0].nValue - 3 * COIN, scriptPubKey);
+    std::vector<unsigned char> vchSig;
+    uint256 sighash = SignatureHash(coins->vout[0].scriptPubKey, split, 0, SIGHASH_ALL, 0, SigVersion::BASE);
+    BOOST_REQUIRE(coinbaseKey.Sign(sighash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    split.vin[0].scriptSig << vchSig;
+    CreateAndProcessBlock({split}, scriptPubKey);
+    CMutableTransaction spend;
+    spend.vin.resize(1);
+    spend.vin[0].prevout = COutPoint(split.GetHash(), 1);
+    spend.vout.resize(1, CTxOut(COIN / 2, CScript() << OP_TRUE));
+    CreateAndProcessBlock({spend}, scriptPubKey);
+
+    // The fixture keeps the chainstate in memory, the rebuild needs a
+    // database in the data directory to swap.
+    {
+        LOCK(cs_main);
+        ::ChainstateActive().ForceFlushStateToDisk();
+        std::unique_ptr<CCoinsViewDB> db = MakeUnique<CCoinsViewDB>(GetDataDir() / "chainstate", 1 << 23, false, true);
+        {
+            CCoinsViewCache cache(db.get());
+            std::unique_ptr<CCoinsViewCursor> cursor(pcoinsdbview->Cursor());
+            for (; cursor->Valid(); cursor->Next()) {
+                COutPoint key;
+                Coin coin;
+                BOOST_REQUIRE(cursor->GetKey(key) && cursor->GetValue(coin));
+                cache.AddCoin(key, std::move(coin), false);
+            }
+            cache.SetBestBlock(pcoinsdbview->GetBestBlock());
+            BOOST_REQUIRE(cache.Flush());
+        }
+        pcoinsTip.reset();
+        pcoinsdbview = std::move(db);
+        pcoinsTip.reset(new CCoinsViewCache(pcoinsdbview.get()));
+    }
+    const uint256 live_hash = WITH_LOCK(cs_main, return UTXOHash(*pcoinsdbview));
+
+    // A coin the blocks do not create, which the rebuilt database lacks
+    const COutPoint bogus(InsecureRand256(), 0);
+    WriteCoin(*pcoinsdbview, bogus, WITH_LOCK(cs_main, return ::ChainActive().Tip()->GetBlockHash()));
+    BOOST_CHECK(WITH_LOCK(cs_main, return UTXOHash(*pcoinsdbview)) != live_hash);
+
+    ChainstateRebuild rebuild(1 << 20);
+    std::string error;
+    BOOST_REQUIRE(rebuild.Start(error));
+    BOOST_CHECK(!rebuild.Start(error));
+    BOOST_CHECK_EQUAL(error, "A chainstate rebuild is already running");
+    rebuild.Stop();
+    BOOST_CHECK(!rebuild.IsRunning());
+    BOOST_CHECK_EQUAL(rebuild.GetError(), "");
+
+    LOCK(cs_main);
+    BOOST_CHECK_EQUAL(rebuild.GetHeight(), ::ChainActive().Height());
+    BOOST_CHECK(UTXOHash(*pcoinsdbview) == live_hash);
+    BOOST_CHECK(!pcoinsTip->HaveCoin(bogus));
+    BOOST_CHECK(pcoinsTip->HaveCoin(COutPoint(split.GetHash(), 0)));
+    BOOST_CHECK(!pcoinsTip->HaveCoin(COutPoint(split.GetHash(), 1)));
+    BOOST_CHECK(pcoinsTip->HaveCoin(COutPoint(spend.GetHash(), 0)));
+    BOOST_CHECK(!fs::exists(GetDataDir() / "chainstate.new"));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -21,6 +21,15 @@ static bool is_null_key(const std::vector<unsigned char>& key) {
     return isnull;
 }
 
+// A key written with DBKeyWriter must serialize exactly as with CDataStream
+template <typename K>
+static void CheckKeyWriter(const K& key)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << key;
+    BOOST_CHECK_EQUAL(DBKeyWriter(key).GetSlice().ToString(), ss.str());
+}
+
 BOOST_FIXTURE_TEST_SUITE(dbwrapper_tests, BasicTestingSetup)
 
 BOOST_AUTO_TEST_CASE(dbwrapper)
@@ -318,5 +327,100 @@ BOOST_AUTO_TEST_CASE(iterator_string_ordering)
 }
 
 
+BOOST_AUTO_TEST_CASE(dbwrapper_profiles)
+{
+    BOOST_CHECK_EQUAL(GetDBOptions("chainstate").bloom_bits, 10);
+    BOOST_CHECK_EQUAL(GetDBOptions("blockindex").block_size, 16U * 1024);
+    BOOST_CHECK_EQUAL(GetDBOptions("blockfilter").bloom_bits, 0);
+
+    gArgs.ForceSetArg("-dbprofile", "txindex:bloombits=0");
+    BOOST_CHECK_EQUAL(GetDBOptions("txindex").bloom_bits, 0);
+    BOOST_CHECK_EQUAL(GetDBOptions("chainstate").bloom_bits, 10);
+    gArgs.ForceSetArg("-dbprofile", "txindex:writebuffer=50");
+    BOOST_CHECK_EQUAL(GetDBOptions("txindex").write_buffer_percent, 25);
+    gArgs.ForceSetArg("-dbprofile", "");
+
+    // Every profile can be opened, written to and read from
+    for (const std::string profile : {"chainstate", "blockindex", "txindex", "blockfilter"}) {
+        fs::path ph = GetDataDir() / ("dbwrapper_profiles_" + profile);
+        CDBWrapper dbw(ph, (1 << 20), false, true, false, GetDBOptions(profile));
+        uint256 in = InsecureRand256();
+        uint256 res;
+        BOOST_CHECK(dbw.Write('k', in));
+        BOOST_CHECK(dbw.Read('k', res));
+        BOOST_CHECK_EQUAL(res.ToString(), in.ToString());
+        BOOST_CHECK(!dbw.Exists('m'));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(dbwrapper_key_writer)
+{
+    // Keys that fit in the preallocated space and keys that do not
+    const std::pair<char, uint256> short_key('c', InsecureRand256());
+    const std::pair<char, std::string> long_key('l', std::string(2 * DBWRAPPER_PREALLOC_KEY_SIZE, 'x'));
+    BOOST_CHECK_LT(DBKeyWriter(short_key).GetSlice().size(), DBWRAPPER_PREALLOC_KEY_SIZE);
+    BOOST_CHECK_GT(DBKeyWriter(long_key).GetSlice().size(), DBWRAPPER_PREALLOC_KEY_SIZE);
+    CheckKeyWriter('k');
+    CheckKeyWriter(short_key);
+    CheckKeyWriter(long_key);
+
+    // Appending grows the key past the preallocated space
+    DBKeyWriter writer(short_key);
+    writer << long_key.second << uint32_t{7};
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << short_key << long_key.second << uint32_t{7};
+    BOOST_CHECK_EQUAL(writer.GetSlice().ToString(), ss.str());
+
+    // Both kinds of keys can be written, found, read, iterated to and erased
+    fs::path ph = GetDataDir() / "dbwrapper_key_writer";
+    CDBWrapper dbw(ph, (1 << 20), true, false, true);
+    const uint256 in = InsecureRand256();
+    uint256 res;
+    BOOST_CHECK(dbw.Write(short_key, in));
+    BOOST_CHECK(dbw.Write(long_key, in));
+    BOOST_CHECK(dbw.Exists(long_key));
+    BOOST_CHECK(dbw.Read(long_key, res));
+    BOOST_CHECK_EQUAL(res.ToString(), in.ToString());
+    std::unique_ptr<CDBIterator> it(dbw.NewIterator());
+    it->Seek(long_key);
+    std::pair<char, std::string> key;
+    BOOST_REQUIRE(it->Valid());
+    BOOST_CHECK(it->GetKey(key));
+    BOOST_CHECK(key == long_key);
+    BOOST_CHECK(dbw.Erase(long_key));
+    BOOST_CHECK(!dbw.Exists(long_key));
+    BOOST_CHECK(dbw.Exists(short_key));
+}
+
+BOOST_AUTO_TEST_CASE(dbwrapper_span_reader)
+{
+    const uint256 hash = InsecureRand256();
+    const std::string str(2 * DBWRAPPER_PREALLOC_VALUE_SIZE, 'x');
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << 'c' << hash << str << uint32_t{7};
+
+    // Everything written to a CDataStream reads back the same
+    SpanReader reader(SER_DISK, CLIENT_VERSION, ss.data(), ss.size());
+    BOOST_CHECK_EQUAL(reader.size(), ss.size());
+    char c;
+    uint256 hash_read;
+    std::string str_read;
+    uint32_t n;
+    reader >> c >> hash_read >> str_read >> n;
+    BOOST_CHECK_EQUAL(c, 'c');
+    BOOST_CHECK(hash_read == hash);
+    BOOST_CHECK(str_read == str);
+    BOOST_CHECK_EQUAL(n, 7U);
+    BOOST_CHECK(reader.empty());
+
+    // Reading or skipping past the end throws without moving the reader
+    SpanReader short_reader(SER_DISK, CLIENT_VERSION, ss.data(), 1 + 16);
+    short_reader >> c;
+    BOOST_CHECK_THROW(short_reader >> hash_read, std::ios_base::failure);
+    BOOST_CHECK_THROW(short_reader.ignore(17), std::ios_base::failure);
+    BOOST_CHECK_EQUAL(short_reader.size(), 16U);
+    short_reader.ignore(16);
+    BOOST_CHECK(short_reader.empty());
+}
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -5,6 +5,7 @@
 #include <clientversion.h>
 #include <crypto/siphash.h>
 #include <hash.h>
+#include <streams.h>
 #include <util/strencodings.h>
 #include <test/setup_common.h>
 
@@ -147,4 +148,26 @@ BOOST_AUTO_TEST_CASE(siphash)
     }
 }
 
+BOOST_AUTO_TEST_CASE(hashed_source_writer)
+{
+    std::vector<uint256> data{InsecureRand256(), InsecureRand256(), InsecureRand256()};
+
+    CDataStream stream(SER_DISK, CLIENT_VERSION);
+    CHashedSourceWriter<CDataStream> hashwriter(&stream);
+    hashwriter << data;
+
+    // The stream receives exactly the serialization, and the hash covers it.
+    CDataStream expected(SER_DISK, CLIENT_VERSION);
+    expected << data;
+    BOOST_CHECK(stream.str() == expected.str());
+    BOOST_CHECK(hashwriter.GetHash() == Hash(expected.begin(), expected.end()));
+
+    // Reading it back through a CHashVerifier yields the same hash.
+    CHashVerifier<CDataStream> verifier(&stream);
+    std::vector<uint256> read;
+    verifier >> read;
+    BOOST_CHECK(read == data);
+    BOOST_CHECK(verifier.GetHash() == Hash(expected.begin(), expected.end()));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
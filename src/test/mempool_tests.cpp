@@ -3,6 +3,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <policy/policy.h>
+#include <policy/rbf.h>
 #include <txmempool.h>
 #include <util/system.h>
 #include <util/time.h>
@@ -106,6 +107,95 @@ BOOST_AUTO_TEST_CASE(MempoolRemoveTest)
     BOOST_CHECK_EQUAL(testPool.size(), 0U);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolLinksTest)
+{
+    TestMemPoolEntryHelper entry;
+    // Parent transaction with four children, the first of which has a child
+    CMutableTransaction txParent;
+    txParent.vin.resize(1);
+    txParent.vin[0].scriptSig = CScript() << OP_11;
+    txParent.vout.resize(4);
+    for (int i = 0; i < 4; i++)
+    {
+        txParent.vout[i].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        txParent.vout[i].nValue = 33000LL;
+    }
+    CMutableTransaction txChild[4];
+    for (int i = 0; i < 4; i++)
+    {
+        txChild[i].vin.resize(1);
+        txChild[i].vin[0].scriptSig = CScript() << OP_11;
+        txChild[i].vin[0].prevout.hash = txParent.GetHash();
+        txChild[i].vin[0].prevout.n = i;
+        txChild[i].vout.resize(1);
+        txChild[i].vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        txChild[i].vout[0].nValue = 11000LL;
+    }
+    CMutableTransaction txGrandChild;
+    txGrandChild.vin.resize(1);
+    txGrandChild.vin[0].scriptSig = CScript() << OP_11;
+    txGrandChild.vin[0].prevout.hash = txChild[0].GetHash();
+    txGrandChild.vin[0].prevout.n = 0;
+    txGrandChild.vout.resize(1);
+    txGrandChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txGrandChild.vout[0].nValue = 10000LL;
+
+    CTxMemPool testPool;
+    LOCK2(cs_main, testPool.cs);
+    const size_t relatives_usage = memusage::MallocUsage(sizeof(CTxMemPoolEntry::Relatives));
+
+    testPool.addUnchecked(entry.FromTx(txParent));
+    CTxMemPool::txiter parentIt = testPool.mapTx.find(txParent.GetHash());
+    // An entry without relatives carries no links or package state
+    BOOST_CHECK_EQUAL(testPool.GetMemoryUsage().links, 0U);
+    BOOST_CHECK(testPool.GetMemPoolChildren(parentIt).empty());
+    BOOST_CHECK_EQUAL(parentIt->GetCountWithDescendants(), 1U);
+    BOOST_CHECK_EQUAL(parentIt->GetSizeWithAncestors(), parentIt->GetTxSize());
+
+    for (int i = 0; i < 3; i++) {
+        testPool.addUnchecked(entry.FromTx(txChild[i]));
+    }
+    BOOST_CHECK_EQUAL(testPool.GetMemPoolChildren(parentIt).size(), 3U);
+    BOOST_CHECK(testPool.GetMemPoolParents(parentIt).empty());
+    BOOST_CHECK_EQUAL(parentIt->GetCountWithDescendants(), 4U);
+    // Three links fit inline
+    BOOST_CHECK_EQUAL(testPool.GetMemoryUsage().links, 4 * relatives_usage);
+
+    testPool.addUnchecked(entry.FromTx(txChild[3]));
+    testPool.addUnchecked(entry.FromTx(txGrandChild));
+    BOOST_CHECK(testPool.GetMemoryUsage().links > 6 * relatives_usage);
+    BOOST_CHECK_EQUAL(testPool.GetMemoryUsage().Total(), testPool.DynamicMemoryUsage());
+
+    CTxMemPool::setEntries children;
+    for (CTxMemPool::txiter child : testPool.GetMemPoolChildren(parentIt)) {
+        BOOST_CHECK_EQUAL(testPool.GetMemPoolParents(child).size(), 1U);
+        BOOST_CHECK(*testPool.GetMemPoolParents(child).begin() == parentIt);
+        children.insert(child);
+    }
+    BOOST_CHECK_EQUAL(children.size(), 4U);
+
+    // An entry in the middle of a chain keeps its parents and children apart
+    CTxMemPool::txiter childIt = testPool.mapTx.find(txChild[0].GetHash());
+    CTxMemPool::txiter grandChildIt = testPool.mapTx.find(txGrandChild.GetHash());
+    BOOST_CHECK_EQUAL(testPool.GetMemPoolParents(childIt).size(), 1U);
+    BOOST_CHECK(*testPool.GetMemPoolParents(childIt).begin() == parentIt);
+    BOOST_CHECK_EQUAL(testPool.GetMemPoolChildren(childIt).size(), 1U);
+    BOOST_CHECK(*testPool.GetMemPoolChildren(childIt).begin() == grandChildIt);
+    BOOST_CHECK_EQUAL(grandChildIt->GetCountWithAncestors(), 3U);
+    BOOST_CHECK_EQUAL(parentIt->GetCountWithDescendants(), 6U);
+
+    testPool.removeRecursive(CTransaction(txChild[1]));
+    BOOST_CHECK_EQUAL(testPool.GetMemPoolChildren(parentIt).size(), 3U);
+    BOOST_CHECK_EQUAL(parentIt->GetCountWithDescendants(), 5U);
+
+    testPool.removeRecursive(CTransaction(txParent));
+    BOOST_CHECK_EQUAL(testPool.size(), 0U);
+    const CTxMemPool::MemoryUsage usage = testPool.GetMemoryUsage();
+    BOOST_CHECK_EQUAL(usage.links, 0U);
+    BOOST_CHECK_EQUAL(usage.transactions, 0U);
+    BOOST_CHECK_EQUAL(usage.entries, 0U);
+}
+
 template<typename name>
 static void CheckSort(CTxMemPool &pool, std::vector<std::string> &sortedOrder) EXCLUSIVE_LOCKS_REQUIRED(pool.cs)
 {
@@ -117,6 +207,67 @@ static void CheckSort(CTxMemPool &pool, std::vector<std::string> &sortedOrder) E
     }
 }
 
+BOOST_AUTO_TEST_CASE(ReplacementCostTest)
+{
+    TestMemPoolEntryHelper entry;
+    // Parent with two children, and an unrelated transaction
+    CMutableTransaction txParent;
+    txParent.vin.resize(1);
+    txParent.vin[0].scriptSig = CScript() << OP_11;
+    txParent.vout.resize(2);
+    for (int i = 0; i < 2; i++) {
+        txParent.vout[i].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        txParent.vout[i].nValue = 33000LL;
+    }
+    CMutableTransaction txChild[2];
+    for (int i = 0; i < 2; i++) {
+        txChild[i].vin.resize(1);
+        txChild[i].vin[0].scriptSig = CScript() << OP_11;
+        txChild[i].vin[0].prevout = COutPoint(txParent.GetHash(), i);
+        txChild[i].vout.resize(1);
+        txChild[i].vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        txChild[i].vout[0].nValue = 11000LL;
+    }
+    CMutableTransaction txOther;
+    txOther.vin.resize(1);
+    txOther.vin[0].scriptSig = CScript() << OP_12;
+    txOther.vout.resize(1);
+    txOther.vout[0].scriptPubKey = CScript() << OP_12 << OP_EQUAL;
+    txOther.vout[0].nValue = 10000LL;
+
+    CTxMemPool testPool;
+    LOCK2(cs_main, testPool.cs);
+    testPool.addUnchecked(entry.Fee(1000LL).FromTx(txParent));
+    testPool.addUnchecked(entry.Fee(2000LL).FromTx(txChild[0]));
+    testPool.addUnchecked(entry.Fee(3000LL).FromTx(txChild[1]));
+    testPool.addUnchecked(entry.Fee(4000LL).FromTx(txOther));
+    const uint64_t parent_size = GetVirtualTransactionSize(CTransaction(txParent));
+    const uint64_t child_size = GetVirtualTransactionSize(CTransaction(txChild[0]));
+    const uint64_t other_size = GetVirtualTransactionSize(CTransaction(txOther));
+
+    // A single conflict only reads the cached aggregates
+    CTxMemPool::setEntries allConflicting;
+    ReplacementCost cost = GetReplacementCost(testPool, testPool.GetIterSet({txParent.GetHash()}), allConflicting);
+    BOOST_CHECK(allConflicting.empty());
+    BOOST_CHECK_EQUAL(cost.nModFees, 6000LL);
+    BOOST_CHECK_EQUAL(cost.nSize, parent_size + 2 * child_size);
+    BOOST_CHECK_EQUAL(cost.nCount, 3U);
+
+    // So do several conflicts without children
+    cost = GetReplacementCost(testPool, testPool.GetIterSet({txChild[0].GetHash(), txOther.GetHash()}), allConflicting);
+    BOOST_CHECK(allConflicting.empty());
+    BOOST_CHECK_EQUAL(cost.nModFees, 6000LL);
+    BOOST_CHECK_EQUAL(cost.nSize, child_size + other_size);
+    BOOST_CHECK_EQUAL(cost.nCount, 2U);
+
+    // A conflict that descends from another one is only counted once
+    cost = GetReplacementCost(testPool, testPool.GetIterSet({txParent.GetHash(), txChild[1].GetHash(), txOther.GetHash()}), allConflicting);
+    BOOST_CHECK_EQUAL(allConflicting.size(), 4U);
+    BOOST_CHECK_EQUAL(cost.nModFees, 10000LL);
+    BOOST_CHECK_EQUAL(cost.nSize, parent_size + 2 * child_size + other_size);
+    BOOST_CHECK_EQUAL(cost.nCount, 4U);
+}
+
 BOOST_AUTO_TEST_CASE(MempoolIndexingTest)
 {
     CTxMemPool pool;
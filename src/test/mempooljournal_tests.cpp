@@ -0,0 +1,141 @@
+// Copyright (c) 2019 The Vccoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <mempooljournal.h>
+#include <txmempool.h>
+#include <util/memory.h>
+#include <util/system.h>
+#include <validation.h>
+
+#include <test/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(mempooljournal_tests, TestingSetup)
+
+static CMutableTransaction MakeTx(const COutPoint& prevout)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = prevout;
+    tx.vin[0].scriptSig = CScript() << OP_11;
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx.vout[0].nValue = 10000LL;
+    return tx;
+}
+
+BOOST_AUTO_TEST_CASE(journal_replay)
+{
+    const fs::path path = GetDataDir() / MEMPOOL_JOURNAL_FILENAME;
+    TestMemPoolEntryHelper entry;
+    CTxMemPool pool;
+    MempoolJournal journal(pool, path);
+
+    const CMutableTransaction tx1 = MakeTx(COutPoint(uint256S("01"), 0));
+    const CMutableTransaction tx2 = MakeTx(COutPoint(tx1.GetHash(), 0));
+    const CMutableTransaction tx3 = MakeTx(COutPoint(uint256S("02"), 0));
+    const uint256 not_in_pool = uint256S("03");
+
+    {
+        LOCK2(cs_main, pool.cs);
+        pool.addUnchecked(entry.FromTx(tx1));
+    }
+    // The snapshot written on start contains tx1.
+    BOOST_CHECK(journal.Start());
+    {
+        LOCK2(cs_main, pool.cs);
+        pool.addUnchecked(entry.FromTx(tx2));
+        pool.addUnchecked(entry.FromTx(tx3));
+    }
+    pool.PrioritiseTransaction(tx2.GetHash(), 1000);
+    journal.Flush();
+    {
+        LOCK2(cs_main, pool.cs);
+        pool.removeRecursive(CTransaction(tx3));
+    }
+    pool.PrioritiseTransaction(not_in_pool, 500);
+    journal.Flush();
+
+    // Read back without stopping, as after a crash.
+    std::vector<PersistedMempoolTx> txs;
+    std::map<uint256, CAmount> deltas;
+    BOOST_CHECK(MempoolJournal::Read(path, txs, deltas));
+    BOOST_REQUIRE_EQUAL(txs.size(), 2U);
+    BOOST_CHECK(txs[0].tx->GetHash() == tx1.GetHash());
+    BOOST_CHECK_EQUAL(txs[0].nFeeDelta, 0);
+    BOOST_CHECK(txs[1].tx->GetHash() == tx2.GetHash());
+    BOOST_CHECK_EQUAL(txs[1].nFeeDelta, 1000);
+    BOOST_CHECK_EQUAL(deltas.size(), 1U);
+    BOOST_CHECK_EQUAL(deltas[not_in_pool], 500);
+
+    journal.Stop();
+
+    // A partially written record at the end of the journal is ignored.
+    FILE* file = fsbridge::fopen(path, "ab");
+    BOOST_REQUIRE(file);
+    const unsigned char partial[] = {0x40, 0x00, 0x00, 0x00, 0x01, 0x02};
+    BOOST_CHECK_EQUAL(fwrite(partial, 1, sizeof(partial), file), sizeof(partial));
+    fclose(file);
+
+    txs.clear();
+    deltas.clear();
+    BOOST_CHECK(MempoolJournal::Read(path, txs, deltas));
+    BOOST_CHECK_EQUAL(txs.size(), 2U);
+    BOOST_CHECK_EQUAL(deltas.size(), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(journal_stale_after_dump)
+{
+    const fs::path path = GetDataDir() / MEMPOOL_JOURNAL_FILENAME;
+    TestMemPoolEntryHelper entry;
+    CTxMemPool pool;
+
+    const CMutableTransaction tx1 = MakeTx(COutPoint(uint256S("01"), 0));
+    const CMutableTransaction tx2 = MakeTx(COutPoint(uint256S("02"), 0));
+    const CMutableTransaction tx3 = MakeTx(COutPoint(uint256S("03"), 0));
+
+    {
+        LOCK2(cs_main, pool.cs);
+        pool.addUnchecked(entry.FromTx(tx1));
+    }
+    {
+        MempoolJournal journal(pool, path);
+        BOOST_CHECK(journal.Start());
+        journal.Stop();
+    }
+    BOOST_CHECK(fs::exists(path));
+
+    // With journaling disabled, the mempool changes and is dumped. The old
+    // journal must not be loaded instead of mempool.dat once journaling is
+    // enabled again.
+    {
+        LOCK2(cs_main, pool.cs);
+        pool.removeRecursive(CTransaction(tx1));
+        pool.addUnchecked(entry.FromTx(tx2));
+    }
+    BOOST_REQUIRE(!g_mempool_journal);
+    BOOST_CHECK(DumpMempool(pool));
+    BOOST_CHECK(!fs::exists(path));
+    std::vector<PersistedMempoolTx> txs;
+    std::map<uint256, CAmount> deltas;
+    BOOST_CHECK(!MempoolJournal::Read(path, txs, deltas));
+
+    // A running journal is kept, and is as recent as mempool.dat.
+    g_mempool_journal = MakeUnique<MempoolJournal>(pool, path);
+    BOOST_CHECK(g_mempool_journal->Start());
+    {
+        LOCK2(cs_main, pool.cs);
+        pool.addUnchecked(entry.FromTx(tx3));
+    }
+    BOOST_CHECK(DumpMempool(pool));
+    BOOST_CHECK(MempoolJournal::Read(path, txs, deltas));
+    BOOST_REQUIRE_EQUAL(txs.size(), 2U);
+    BOOST_CHECK(txs[0].tx->GetHash() == tx2.GetHash());
+    BOOST_CHECK(txs[1].tx->GetHash() == tx3.GetHash());
+    g_mempool_journal->Stop();
+    g_mempool_journal.reset();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -2,6 +2,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <asset_coin.h>
 #include <chainparams.h>
 #include <coins.h>
 #include <consensus/consensus.h>
@@ -9,6 +10,7 @@
 #include <consensus/tx_verify.h>
 #include <miner.h>
 #include <policy/policy.h>
+#include <script/interpreter.h>
 #include <script/standard.h>
 #include <txmempool.h>
 #include <uint256.h>
@@ -20,6 +22,7 @@
 #include <test/setup_common.h>
 
 #include <memory>
+#include <set>
 
 #include <boost/test/unit_test.hpp>
 
@@ -95,6 +98,37 @@ static bool TestSequenceLocks(const CTransaction &tx, int flags) EXCLUSIVE_LOCKS
     return CheckSequenceLocks(::mempool, tx, flags);
 }
 
+// Templates for several coinbase variants share one transaction selection,
+// but each has its own coinbase.
+static void CheckCoinbaseVariants(const CChainParams& chainparams, const CScript& scriptPubKey, size_t num_txs)
+{
+    // A coinbase of another asset is valid only once the asset is known
+    CoinAsset asset = {0};
+    asset.no = 1;
+    asset.name = "TEST";
+    asset.coin = COIN;
+    asset.max = MAX_MONEY;
+    BOOST_REQUIRE(CoinAssetManager::Instance().AddCoinAsset(asset));
+    const std::vector<CoinbaseVariant> variants{CoinbaseVariant(scriptPubKey), CoinbaseVariant(CScript() << OP_TRUE), CoinbaseVariant(scriptPubKey, asset.no)};
+    std::vector<std::unique_ptr<CBlockTemplate>> templates = AssemblerForTest(chainparams).CreateNewBlocks(variants);
+    CoinAssetManager::Instance().RemoveCoinAsset(asset.no);
+    BOOST_REQUIRE_EQUAL(templates.size(), variants.size());
+    for (size_t v = 0; v < templates.size(); ++v) {
+        const CBlock& block = templates[v]->block;
+        BOOST_REQUIRE_EQUAL(block.vtx.size(), num_txs);
+        BOOST_CHECK(block.vtx[0]->vout[0].scriptPubKey == variants[v].scriptPubKey);
+        BOOST_CHECK_EQUAL(block.vtx[0]->nAssetNo, variants[v].AssetNo);
+        for (size_t w = 0; w < v; ++w) {
+            BOOST_CHECK(block.vtx[0]->GetHash() != templates[w]->block.vtx[0]->GetHash());
+            BOOST_CHECK(BlockMerkleRoot(block) != BlockMerkleRoot(templates[w]->block));
+        }
+        // The selected transactions are the same objects in every template
+        for (size_t i = 1; i < block.vtx.size(); ++i) {
+            BOOST_CHECK(block.vtx[i] == templates[0]->block.vtx[i]);
+        }
+    }
+}
+
 // Test suite for ancestor feerate transaction selection.
 // Implemented as an additional function, rather than a separate test case,
 // to allow reusing the blockchain created in CreateNewBlock_validity.
@@ -520,4 +554,99 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     fCheckpointsEnabled = true;
 }
 
+static std::set<uint256> TemplateTxs(const CBlockTemplate& blocktemplate)
+{
+    std::set<uint256> txs;
+    for (size_t i = 1; i < blocktemplate.block.vtx.size(); ++i) {
+        txs.insert(blocktemplate.block.vtx[i]->GetHash());
+    }
+    return txs;
+}
+
+// A template assembled from the cached transaction selection must hold the
+// same transactions as one assembled from scratch.
+static void CheckCachedTemplate(const CChainParams& chainparams, const CScript& scriptPubKey)
+{
+    std::unique_ptr<CBlockTemplate> cached = AssemblerForTest(chainparams).CreateNewBlock(scriptPubKey);
+    // An untracked mempool update invalidates the cache
+    mempool.AddTransactionsUpdated(1);
+    std::unique_ptr<CBlockTemplate> fresh = AssemblerForTest(chainparams).CreateNewBlock(scriptPubKey);
+    BOOST_CHECK_EQUAL(cached->block.vtx.size(), fresh->block.vtx.size());
+    BOOST_CHECK(TemplateTxs(*cached) == TemplateTxs(*fresh));
+    BOOST_CHECK_EQUAL(cached->vTxFees[0], fresh->vTxFees[0]);
+}
+
+BOOST_FIXTURE_TEST_CASE(block_template_cache, TestChain100Setup)
+{
+    const CChainParams& chainparams = Params();
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CTransactionRef coins = IssueMainCoins();
+
+    // Confirm a transaction with outputs that anyone can spend
+    CMutableTransaction split;
+    split.vin.resize(1);
+    split.vin[0].prevout = COutPoint(coins->GetHash(), 0);
+    split.vout.resize(10, CTxOut(COIN, CScript() << OP_TRUE));
+    split.vout.emplace_back(coins->vout[0].nValue - 10 * COIN, scriptPubKey);
+    std::vector<unsigned char> vchSig;
+    uint256 sighash = SignatureHash(coins->vout[0].scriptPubKey, split, 0, SIGHASH_ALL, 0, SigVersion::BASE);
+    BOOST_REQUIRE(coinbaseKey.Sign(sighash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    split.vin[0].scriptSig << vchSig;
+    CreateAndProcessBlock({split}, scriptPubKey);
+    BOOST_REQUIRE(WITH_LOCK(cs_main, return ::pcoinsTip->HaveCoin(COutPoint(split.GetHash(), 0))));
+
+    TestMemPoolEntryHelper entry;
+    std::vector<CTransactionRef> spends;
+    for (int i = 0; i < 10; ++i) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(split.GetHash(), i);
+        tx.vout.resize(2, CTxOut(COIN / 2 - (i + 1) * 1000, CScript() << OP_TRUE));
+        spends.push_back(MakeTransactionRef(tx));
+    }
+    CMutableTransaction child;
+    child.vin.resize(1);
+    child.vin[0].prevout = COutPoint(spends[0]->GetHash(), 0);
+    child.vout.resize(1, CTxOut(COIN / 4, CScript() << OP_TRUE));
+
+    {
+        LOCK2(cs_main, mempool.cs);
+        for (int i = 0; i < 5; ++i) {
+            mempool.addUnchecked(entry.Fee(2 * (i + 1) * 1000).FromTx(spends[i]));
+        }
+        BOOST_CHECK_EQUAL(AssemblerForTest(chainparams).CreateNewBlock(scriptPubKey)->block.vtx.size(), 6U);
+
+        // Additions, including a child of a selected transaction
+        mempool.addUnchecked(entry.Fee(2 * 6 * 1000).FromTx(spends[5]));
+        mempool.addUnchecked(entry.Fee(COIN / 4 - 1000).FromTx(child));
+        mempool.addUnchecked(entry.Fee(2 * 7 * 1000).FromTx(spends[6]));
+        CheckCachedTemplate(chainparams, scriptPubKey);
+
+        // Removals, of a transaction and of one with a descendant
+        mempool.removeRecursive(*spends[1], MemPoolRemovalReason::CONFLICT);
+        mempool.removeRecursive(*spends[0], MemPoolRemovalReason::CONFLICT);
+        BOOST_CHECK(!mempool.exists(child.GetHash()));
+        mempool.addUnchecked(entry.Fee(2 * 8 * 1000).FromTx(spends[7]));
+        CheckCachedTemplate(chainparams, scriptPubKey);
+    }
+
+    // A new tip invalidates the cache, even for a template on the old tip
+    std::unique_ptr<CBlockTemplate> old_tip = AssemblerForTest(chainparams).CreateNewBlock(scriptPubKey);
+    CreateAndProcessBlock({CMutableTransaction(*spends[2])}, scriptPubKey);
+    {
+        LOCK2(cs_main, mempool.cs);
+        BOOST_CHECK(!mempool.exists(spends[2]->GetHash()));
+        mempool.addUnchecked(entry.Fee(2 * 9 * 1000).FromTx(spends[8]));
+        std::unique_ptr<CBlockTemplate> new_tip = AssemblerForTest(chainparams).CreateNewBlock(scriptPubKey);
+        BOOST_CHECK(new_tip->block.hashPrevBlock == ::ChainActive().Tip()->GetBlockHash());
+        BOOST_CHECK(new_tip->block.hashPrevBlock != old_tip->block.hashPrevBlock);
+        BOOST_CHECK(!TemplateTxs(*new_tip).count(spends[2]->GetHash()));
+        BOOST_CHECK(TemplateTxs(*new_tip).count(spends[8]->GetHash()));
+        CheckCachedTemplate(chainparams, scriptPubKey);
+        CheckCoinbaseVariants(chainparams, scriptPubKey, 7);
+    }
+    mempool.clear();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -181,4 +181,41 @@ BOOST_AUTO_TEST_CASE(BlockPolicyEstimates)
     }
 }
 
+BOOST_AUTO_TEST_CASE(AssetTxsWithoutFee)
+{
+    CBlockPolicyEstimator feeEst;
+    CTxMemPool mpool(&feeEst);
+    LOCK2(cs_main, mpool.cs);
+    TestMemPoolEntryHelper entry;
+    // The estimator has not seen a block yet
+    entry.Height(0);
+
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << OP_1;
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    tx.vout[0].nValue = 0LL;
+
+    // Asset transactions that pay no main coin fee are not tracked
+    tx.nAssetNo = 1;
+    tx.vin[0].prevout.n = 1;
+    const uint256 no_fee = tx.GetHash();
+    mpool.addUnchecked(entry.Fee(0).FromTx(tx));
+    BOOST_CHECK(!feeEst.removeTx(no_fee, false));
+
+    // ... but those that do are
+    tx.vin[0].prevout.n = 2;
+    const uint256 with_fee = tx.GetHash();
+    mpool.addUnchecked(entry.Fee(2000).FromTx(tx));
+    BOOST_CHECK(feeEst.removeTx(with_fee, false));
+
+    // as are main coin transactions without a fee
+    tx.nAssetNo = 0;
+    tx.vin[0].prevout.n = 3;
+    const uint256 main_no_fee = tx.GetHash();
+    mpool.addUnchecked(entry.Fee(0).FromTx(tx));
+    BOOST_CHECK(feeEst.removeTx(main_no_fee, false));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
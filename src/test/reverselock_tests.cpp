@@ -3,6 +3,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <reverselock.h>
+#include <sync.h>
 #include <test/setup_common.h>
 
 #include <boost/test/unit_test.hpp>
@@ -57,4 +58,33 @@ BOOST_AUTO_TEST_CASE(reverselock_errors)
     BOOST_CHECK(lock.owns_lock());
 }
 
+BOOST_AUTO_TEST_CASE(reverselock_debuglock)
+{
+    Mutex mutex;
+    WAIT_LOCK(mutex, lock);
+
+    BOOST_CHECK(lock.owns_lock());
+    {
+        REVERSE_LOCK(lock);
+        BOOST_CHECK(!lock.owns_lock());
+
+        // The mutex is really free while the lock is reversed
+        TRY_LOCK(mutex, other);
+        BOOST_CHECK(other.owns_lock());
+    }
+    BOOST_CHECK(lock.owns_lock());
+
+    // Reversing a lock that is not held fails and leaves it unheld
+    lock.unlock();
+    bool failed = false;
+    try {
+        REVERSE_LOCK(lock);
+    } catch (...) {
+        failed = true;
+    }
+    BOOST_CHECK(failed);
+    BOOST_CHECK(!lock.owns_lock());
+    lock.lock();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
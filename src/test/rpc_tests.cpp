@@ -9,8 +9,13 @@
 #include <core_io.h>
 #include <init.h>
 #include <interfaces/chain.h>
+#include <key.h>
+#include <node/transaction.h>
+#include <script/interpreter.h>
+#include <txmempool.h>
 #include <test/setup_common.h>
 #include <util/time.h>
+#include <validation.h>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/test/unit_test.hpp>
@@ -75,6 +80,9 @@ BOOST_AUTO_TEST_CASE(rpc_rawparams)
     BOOST_CHECK_THROW(CallRPC("sendrawtransaction null"), std::runtime_error);
     BOOST_CHECK_THROW(CallRPC("sendrawtransaction DEADBEEF"), std::runtime_error);
     BOOST_CHECK_THROW(CallRPC(std::string("sendrawtransaction ")+rawtx+" extra"), std::runtime_error);
+    // Raw transaction submission is disabled, like sendrawtransaction
+    BOOST_CHECK_NO_THROW(r = CallRPC(std::string("sendrawtransactions [\"")+rawtx+"\"]"));
+    BOOST_CHECK_EQUAL(find_value(r.get_obj(), "warning").get_str(), "Not supported.");
 }
 
 BOOST_AUTO_TEST_CASE(rpc_togglenetwork)
@@ -417,4 +425,120 @@ BOOST_AUTO_TEST_CASE(rpc_getblockstats_calculate_percentiles_by_weight)
     }
 }
 
+static CMutableTransaction SpendToKey(const std::vector<COutPoint>& prevouts, CAmount value, const CKey& key, unsigned int outputs = 1)
+{
+    CScript scriptPubKey = CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG;
+    CMutableTransaction tx;
+    for (const COutPoint& prevout : prevouts) {
+        tx.vin.emplace_back(prevout);
+    }
+    tx.vout.resize(outputs, CTxOut(value, scriptPubKey));
+    for (unsigned int i = 0; i < tx.vin.size(); ++i) {
+        std::vector<unsigned char> vchSig;
+        uint256 hash = SignatureHash(scriptPubKey, tx, i, SIGHASH_ALL, 0, SigVersion::BASE);
+        BOOST_REQUIRE(key.Sign(hash, vchSig));
+        vchSig.push_back((unsigned char)SIGHASH_ALL);
+        tx.vin[i].scriptSig = CScript() << vchSig;
+    }
+    return tx;
+}
+
+static std::vector<BroadcastResult> Broadcast(const std::vector<CMutableTransaction>& txs)
+{
+    std::vector<CTransactionRef> tx_refs;
+    for (const CMutableTransaction& tx : txs) {
+        tx_refs.push_back(MakeTransactionRef(tx));
+    }
+    std::vector<BroadcastResult> results;
+    BOOST_CHECK(BroadcastTransactions(tx_refs, std::vector<CAmount>(txs.size(), 0), results) == TransactionError::OK);
+    return results;
+}
+
+// The batch broadcast behind the disabled sendrawtransactions RPC
+BOOST_FIXTURE_TEST_CASE(broadcast_transactions, TestChain100Setup)
+{
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CTransactionRef coins = IssueMainCoins();
+    CMutableTransaction split = SpendToKey({COutPoint(coins->GetHash(), 0)}, COIN, coinbaseKey, 3);
+    CreateAndProcessBlock({split}, scriptPubKey);
+
+    // A child given before its parent, and a transaction that is in the chain
+    // already; the results are in the order of the request
+    CMutableTransaction parent = SpendToKey({COutPoint(split.GetHash(), 0)}, COIN - 10000, coinbaseKey);
+    CMutableTransaction child = SpendToKey({COutPoint(parent.GetHash(), 0)}, COIN - 20000, coinbaseKey);
+    std::vector<BroadcastResult> r = Broadcast({child, split, parent});
+    BOOST_REQUIRE_EQUAL(r.size(), 3U);
+    BOOST_CHECK(r[0].txid == child.GetHash());
+    BOOST_CHECK(r[1].txid == split.GetHash());
+    BOOST_CHECK(r[2].txid == parent.GetHash());
+    BOOST_CHECK(r[0].error == TransactionError::OK);
+    BOOST_CHECK(r[1].error == TransactionError::ALREADY_IN_CHAIN);
+    BOOST_CHECK(r[2].error == TransactionError::OK);
+    BOOST_CHECK(WITH_LOCK(mempool.cs, return mempool.exists(parent.GetHash()) && mempool.exists(child.GetHash())));
+
+    // A failure only rejects the failing transaction and its descendants
+    CMutableTransaction good = SpendToKey({COutPoint(split.GetHash(), 1)}, COIN - 10000, coinbaseKey);
+    CMutableTransaction bad = SpendToKey({COutPoint(split.GetHash(), 2)}, COIN - 10000, coinbaseKey);
+    bad.vin[0].scriptSig = good.vin[0].scriptSig;
+    CMutableTransaction bad_child = SpendToKey({COutPoint(bad.GetHash(), 0)}, COIN - 20000, coinbaseKey);
+    CMutableTransaction missing = SpendToKey({COutPoint(uint256S("0x01"), 0)}, COIN, coinbaseKey);
+    r = Broadcast({bad_child, good, bad, missing});
+    BOOST_REQUIRE_EQUAL(r.size(), 4U);
+    BOOST_CHECK(r[0].error == TransactionError::MISSING_INPUTS);
+    BOOST_CHECK(r[1].error == TransactionError::OK);
+    BOOST_CHECK(r[2].error == TransactionError::MEMPOOL_REJECTED);
+    BOOST_CHECK_EQUAL(r[2].err_string.find("mandatory-script-verify-flag-failed"), 0U);
+    BOOST_CHECK(r[3].error == TransactionError::MISSING_INPUTS);
+    BOOST_CHECK(WITH_LOCK(mempool.cs, return mempool.exists(good.GetHash()) && !mempool.exists(bad.GetHash()) && !mempool.exists(bad_child.GetHash())));
+}
+
+BOOST_FIXTURE_TEST_CASE(rpc_getrawtransactions, TestChain100Setup)
+{
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CTransactionRef coins = IssueMainCoins();
+    CMutableTransaction split = SpendToKey({COutPoint(coins->GetHash(), 0)}, COIN, coinbaseKey);
+    CreateAndProcessBlock({split}, scriptPubKey);
+    CMutableTransaction tx = SpendToKey({COutPoint(split.GetHash(), 0)}, COIN - 10000, coinbaseKey);
+    Broadcast({tx});
+
+    // Without -txindex, only mempool transactions are found
+    UniValue txids(UniValue::VARR);
+    txids.push_back(split.GetHash().GetHex());
+    txids.push_back(tx.GetHash().GetHex());
+    UniValue r = CallRPC("getrawtransactions " + txids.write());
+    BOOST_REQUIRE_EQUAL(r.size(), 2U);
+    BOOST_CHECK(r[0].isNull());
+    BOOST_CHECK_EQUAL(r[1].get_str(), EncodeHexTx(CTransaction(tx)));
+
+    // The number of transactions is limited
+    UniValue many(UniValue::VARR);
+    for (int i = 0; i < 1000; ++i) {
+        many.push_back(tx.GetHash().GetHex());
+    }
+    BOOST_CHECK_EQUAL(CallRPC("getrawtransactions " + many.write()).size(), 1000U);
+    many.push_back(tx.GetHash().GetHex());
+    BOOST_CHECK_THROW(CallRPC("getrawtransactions " + many.write()), std::runtime_error);
+}
+
+static std::string CallRPCError(const std::string& args)
+{
+    try {
+        CallRPC(args);
+    } catch (const std::runtime_error& e) {
+        return e.what();
+    }
+    return "";
+}
+
+BOOST_AUTO_TEST_CASE(rpc_scriptindex_limits)
+{
+    // The number of entries is checked before the index is looked up
+    for (const std::string method : {"listscriptunspent", "getscripthistory"}) {
+        BOOST_CHECK_EQUAL(CallRPCError(method + " 51 0 0 1001"), "Count 1001 exceeds the maximum of 1000");
+        BOOST_CHECK_EQUAL(CallRPCError(method + " 51 0 0 -1"), "Negative count");
+        BOOST_CHECK_EQUAL(CallRPCError(method + " 51 0 -1"), "Negative skip");
+        BOOST_CHECK_EQUAL(CallRPCError(method + " 51 0 0 1000"), "Script index is not enabled. Use -scriptindex");
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
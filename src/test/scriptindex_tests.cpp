@@ -0,0 +1,309 @@
+// Copyright (c) 2019 The Vccoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <asset_coin.h>
+#include <chainparams.h>
+#include <consensus/consensus.h>
+#include <consensus/validation.h>
+#include <index/scriptindex.h>
+#include <key.h>
+#include <miner.h>
+#include <pow.h>
+#include <script/interpreter.h>
+#include <script/standard.h>
+#include <test/setup_common.h>
+#include <util/time.h>
+#include <validation.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(scriptindex_tests)
+
+static bool HasUnspent(const std::vector<ScriptUnspent>& unspent, const COutPoint& outpoint, CAmount value)
+{
+    for (const ScriptUnspent& entry : unspent) {
+        if (entry.outpoint == outpoint) return entry.value == value;
+    }
+    return false;
+}
+
+static void WaitForSync(ScriptIndex& scriptindex)
+{
+    constexpr int64_t timeout_ms = 10 * 1000;
+    int64_t time_start = GetTimeMillis();
+    while (!scriptindex.BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        MilliSleep(100);
+    }
+}
+
+/** Mine a block whose coinbase creates value of asset_no for script. */
+static CBlock MineAssetCoinbase(const CScript& script, int asset_no, CAmount value)
+{
+    const CChainParams& chainparams = Params();
+    std::vector<std::unique_ptr<CBlockTemplate>> templates = BlockAssembler(chainparams).CreateNewBlocks({CoinbaseVariant(script, asset_no, value, true)});
+    CBlock& block = templates[0]->block;
+    block.vtx.resize(1);
+    // Drop the witness commitment, which a block without witnesses does not
+    // need, so that the asset output is the last output of the coinbase.
+    CMutableTransaction coinbase(*block.vtx[0]);
+    coinbase.vout.resize(1);
+    block.vtx[0] = MakeTransactionRef(std::move(coinbase));
+    {
+        LOCK(cs_main);
+        unsigned int extraNonce = 0;
+        IncrementExtraNonce(&block, ::ChainActive().Tip(), extraNonce);
+    }
+    while (!CheckProofOfWork(block.GetHash(), block.nBits, chainparams.GetConsensus())) ++block.nNonce;
+    BOOST_REQUIRE(ProcessNewBlock(chainparams, std::make_shared<const CBlock>(block), true, nullptr));
+    BOOST_REQUIRE(WITH_LOCK(cs_main, return ::ChainActive().Tip()->GetBlockHash()) == block.GetHash());
+    return block;
+}
+
+static void SignInput(CMutableTransaction& tx, unsigned int n, const CKey& key, const CScript& script)
+{
+    std::vector<unsigned char> sig;
+    uint256 hash = SignatureHash(script, tx, n, SIGHASH_ALL, 0, SigVersion::BASE);
+    BOOST_REQUIRE(key.Sign(hash, sig));
+    sig.push_back((unsigned char)SIGHASH_ALL);
+    tx.vin[n].scriptSig = CScript() << sig;
+}
+
+BOOST_FIXTURE_TEST_CASE(scriptindex_initial_sync, TestChain100Setup)
+{
+    ScriptIndex scriptindex(1 << 20, true);
+    const CScript coinbase_script = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+    scriptindex.Start();
+
+    // Allow script index to catch up with the block index.
+    WaitForSync(scriptindex);
+
+    // Check that every coinbase output is unspent and in the history, in chain order.
+    std::vector<ScriptUnspent> unspent;
+    BOOST_CHECK(scriptindex.FindUnspent(coinbase_script, 0, 0, 1000, unspent));
+    for (const auto& txn : m_coinbase_txns) {
+        BOOST_CHECK(HasUnspent(unspent, COutPoint(txn->GetHash(), 0), txn->vout[0].nValue));
+    }
+    std::vector<ScriptHistoryEntry> history;
+    BOOST_CHECK(scriptindex.FindHistory(coinbase_script, 0, 0, m_coinbase_txns.size(), history));
+    BOOST_REQUIRE_EQUAL(history.size(), m_coinbase_txns.size());
+    for (size_t i = 0; i < history.size(); ++i) {
+        BOOST_CHECK(history[i].txid == m_coinbase_txns[i]->GetHash());
+        BOOST_CHECK_EQUAL(history[i].height, (int)i + 1);
+        BOOST_CHECK_EQUAL(history[i].spent, 0);
+    }
+
+    // Check paging through the history and the unspent outputs.
+    std::vector<ScriptHistoryEntry> page;
+    BOOST_CHECK(scriptindex.FindHistory(coinbase_script, 0, 2, 5, page));
+    BOOST_REQUIRE_EQUAL(page.size(), 5U);
+    BOOST_CHECK(page[0].txid == history[2].txid);
+    BOOST_CHECK(page[4].txid == history[6].txid);
+    std::vector<ScriptUnspent> unspent_page;
+    BOOST_CHECK(scriptindex.FindUnspent(coinbase_script, 0, 2, 5, unspent_page));
+    BOOST_REQUIRE_EQUAL(unspent_page.size(), 5U);
+    BOOST_CHECK(unspent_page[0].outpoint == COutPoint(m_coinbase_txns[2]->GetHash(), 0));
+    BOOST_CHECK(unspent_page[4].outpoint == COutPoint(m_coinbase_txns[6]->GetHash(), 0));
+
+    // Nothing is indexed for other assets.
+    unspent.clear();
+    history.clear();
+    BOOST_CHECK(scriptindex.FindUnspent(coinbase_script, 1, 0, 1000, unspent));
+    BOOST_CHECK(scriptindex.FindHistory(coinbase_script, 1, 0, 10, history));
+    BOOST_CHECK(unspent.empty());
+    BOOST_CHECK(history.empty());
+
+    // The block at GENERATE_ALLCOINS_BLOCK_HEIGHT holds only its coinbase.
+    IssueMainCoins();
+    BOOST_CHECK(scriptindex.BlockUntilSyncedToCurrentChain());
+
+    // Spend the first coinbase output to another script.
+    CKey key;
+    key.MakeNewKey(true);
+    const CScript dest_script = GetScriptForDestination(PKHash(key.GetPubKey()));
+    CMutableTransaction spend;
+    spend.nVersion = 1;
+    spend.vin.resize(1);
+    spend.vin[0].prevout = COutPoint(m_coinbase_txns[0]->GetHash(), 0);
+    spend.vout.resize(1);
+    spend.vout[0].nValue = m_coinbase_txns[0]->vout[0].nValue;
+    spend.vout[0].scriptPubKey = dest_script;
+    std::vector<unsigned char> sig;
+    uint256 hash = SignatureHash(coinbase_script, spend, 0, SIGHASH_ALL, 0, SigVersion::BASE);
+    BOOST_REQUIRE(coinbaseKey.Sign(hash, sig));
+    sig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << sig;
+
+    const CBlock block = CreateAndProcessBlock({spend}, coinbase_script);
+    BOOST_REQUIRE_EQUAL(block.vtx.size(), 2U);
+    const int spend_height = WITH_LOCK(cs_main, return ::ChainActive().Height());
+    BOOST_CHECK(scriptindex.BlockUntilSyncedToCurrentChain());
+
+    unspent.clear();
+    BOOST_CHECK(scriptindex.FindUnspent(coinbase_script, 0, 0, 1000, unspent));
+    BOOST_CHECK(!HasUnspent(unspent, spend.vin[0].prevout, m_coinbase_txns[0]->vout[0].nValue));
+    BOOST_CHECK(HasUnspent(unspent, COutPoint(block.vtx[0]->GetHash(), 0), block.vtx[0]->vout[0].nValue));
+
+    unspent.clear();
+    BOOST_CHECK(scriptindex.FindUnspent(dest_script, 0, 0, 1000, unspent));
+    BOOST_REQUIRE_EQUAL(unspent.size(), 1U);
+    BOOST_CHECK(unspent[0].outpoint == COutPoint(spend.GetHash(), 0));
+    BOOST_CHECK_EQUAL(unspent[0].height, spend_height);
+    BOOST_CHECK_EQUAL(unspent[0].value, spend.vout[0].nValue);
+
+    // The spend is in the history of both scripts, after the coinbase of its
+    // block.
+    history.clear();
+    BOOST_CHECK(scriptindex.FindHistory(coinbase_script, 0, 0, 1000, history));
+    BOOST_REQUIRE(history.size() >= 2);
+    BOOST_CHECK(history.end()[-2].txid == block.vtx[0]->GetHash());
+    BOOST_CHECK_EQUAL(history.end()[-2].height, spend_height);
+    BOOST_CHECK(history.back().txid == spend.GetHash());
+    BOOST_CHECK_EQUAL(history.back().height, spend_height);
+    BOOST_CHECK_EQUAL(history.back().received, 0);
+    BOOST_CHECK_EQUAL(history.back().spent, m_coinbase_txns[0]->vout[0].nValue);
+    history.clear();
+    BOOST_CHECK(scriptindex.FindHistory(dest_script, 0, 0, 1000, history));
+    BOOST_REQUIRE_EQUAL(history.size(), 1U);
+    BOOST_CHECK(history[0].txid == spend.GetHash());
+    BOOST_CHECK_EQUAL(history[0].received, spend.vout[0].nValue);
+    BOOST_CHECK_EQUAL(history[0].spent, 0);
+
+    // shutdown sequence (c.f. Shutdown() in init.cpp)
+    scriptindex.Stop();
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+
+    // Rest of shutdown sequence and destructors happen in ~TestingSetup()
+}
+
+BOOST_FIXTURE_TEST_CASE(scriptindex_assets, TestChain100Setup)
+{
+    const CScript coinbase_script = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    const CTransactionRef main_coinbase = IssueMainCoins();
+
+    CoinAsset asset = {0};
+    asset.no = 1;
+    asset.name = "TEST";
+    asset.coin = COIN;
+    asset.max = MAX_MONEY;
+    BOOST_REQUIRE(CoinAssetManager::Instance().AddCoinAsset(asset));
+
+    ScriptIndex scriptindex(1 << 20, true);
+    scriptindex.Start();
+    WaitForSync(scriptindex);
+
+    // Every output of an asset creating coinbase belongs to the asset.
+    const CTransactionRef asset_coinbase = MineAssetCoinbase(coinbase_script, asset.no, 1000 * COIN).vtx[0];
+    BOOST_REQUIRE_EQUAL(asset_coinbase->vout.size(), 1U);
+    BOOST_CHECK(scriptindex.BlockUntilSyncedToCurrentChain());
+    std::vector<ScriptUnspent> unspent;
+    BOOST_CHECK(scriptindex.FindUnspent(coinbase_script, asset.no, 0, 1000, unspent));
+    BOOST_CHECK(HasUnspent(unspent, COutPoint(asset_coinbase->GetHash(), 0), 1000 * COIN));
+    unspent.clear();
+    BOOST_CHECK(scriptindex.FindUnspent(coinbase_script, 0, 0, 1000, unspent));
+    BOOST_CHECK(!HasUnspent(unspent, COutPoint(asset_coinbase->GetHash(), 0), 1000 * COIN));
+    BOOST_CHECK(HasUnspent(unspent, COutPoint(main_coinbase->GetHash(), 0), MAX_MONEY));
+
+    for (int i = 0; i < COINBASE_MATURITY; i++) {
+        CreateAndProcessBlock({}, coinbase_script);
+    }
+
+    // Transfer part of the asset, paying the fee with the main coin. The last
+    // output returns change of the fee in the main coin.
+    CKey key;
+    key.MakeNewKey(true);
+    const CScript dest_script = GetScriptForDestination(PKHash(key.GetPubKey()));
+    CMutableTransaction transfer;
+    transfer.nVersion = 1;
+    transfer.nAssetNo = asset.no;
+    transfer.vin.resize(2);
+    transfer.vin[0].prevout = COutPoint(asset_coinbase->GetHash(), 0);
+    transfer.vin[1].prevout = COutPoint(main_coinbase->GetHash(), 0);
+    transfer.vout.resize(3);
+    transfer.vout[0].nValue = 600 * COIN;
+    transfer.vout[0].scriptPubKey = dest_script;
+    transfer.vout[1].nValue = 400 * COIN;
+    transfer.vout[1].scriptPubKey = coinbase_script;
+    transfer.vout[2].nValue = MAX_MONEY - COIN;
+    transfer.vout[2].scriptPubKey = coinbase_script;
+    SignInput(transfer, 0, coinbaseKey, coinbase_script);
+    SignInput(transfer, 1, coinbaseKey, coinbase_script);
+
+    const CBlock block = CreateAndProcessBlock({transfer}, coinbase_script);
+    BOOST_REQUIRE(WITH_LOCK(cs_main, return ::ChainActive().Tip()->GetBlockHash()) == block.GetHash());
+    BOOST_CHECK(scriptindex.BlockUntilSyncedToCurrentChain());
+
+    unspent.clear();
+    BOOST_CHECK(scriptindex.FindUnspent(dest_script, asset.no, 0, 1000, unspent));
+    BOOST_REQUIRE_EQUAL(unspent.size(), 1U);
+    BOOST_CHECK(unspent[0].outpoint == COutPoint(transfer.GetHash(), 0));
+    BOOST_CHECK_EQUAL(unspent[0].value, 600 * COIN);
+    unspent.clear();
+    BOOST_CHECK(scriptindex.FindUnspent(dest_script, 0, 0, 1000, unspent));
+    BOOST_CHECK(unspent.empty());
+
+    unspent.clear();
+    BOOST_CHECK(scriptindex.FindUnspent(coinbase_script, asset.no, 0, 1000, unspent));
+    BOOST_CHECK(!HasUnspent(unspent, transfer.vin[0].prevout, 1000 * COIN));
+    BOOST_CHECK(HasUnspent(unspent, COutPoint(transfer.GetHash(), 1), 400 * COIN));
+    BOOST_CHECK(!HasUnspent(unspent, COutPoint(transfer.GetHash(), 2), MAX_MONEY - COIN));
+    unspent.clear();
+    BOOST_CHECK(scriptindex.FindUnspent(coinbase_script, 0, 0, 1000, unspent));
+    BOOST_CHECK(!HasUnspent(unspent, transfer.vin[1].prevout, MAX_MONEY));
+    BOOST_CHECK(HasUnspent(unspent, COutPoint(transfer.GetHash(), 2), MAX_MONEY - COIN));
+
+    // The transfer spends and receives the asset and the main coin separately.
+    std::vector<ScriptHistoryEntry> history;
+    BOOST_CHECK(scriptindex.FindHistory(coinbase_script, asset.no, 0, 1000, history));
+    BOOST_REQUIRE(!history.empty());
+    BOOST_CHECK(history.back().txid == transfer.GetHash());
+    BOOST_CHECK_EQUAL(history.back().received, 400 * COIN);
+    BOOST_CHECK_EQUAL(history.back().spent, 1000 * COIN);
+    // The coinbase of the block also pays to the script, before the transfer.
+    history.clear();
+    BOOST_CHECK(scriptindex.FindHistory(coinbase_script, 0, 0, 1000, history));
+    BOOST_REQUIRE(history.size() >= 2);
+    BOOST_CHECK(history.end()[-2].txid == block.vtx[0]->GetHash());
+    BOOST_CHECK(history.back().txid == transfer.GetHash());
+    BOOST_CHECK_EQUAL(history.back().received, MAX_MONEY - COIN);
+    BOOST_CHECK_EQUAL(history.back().spent, MAX_MONEY);
+
+    // Replace the block of the transfer. Rewinding the index removes the
+    // outputs of the transfer and makes the outputs it spent unspent again.
+    CValidationState state;
+    BOOST_REQUIRE(InvalidateBlock(state, Params(), WITH_LOCK(cs_main, return LookupBlockIndex(block.GetHash()))));
+    CreateAndProcessBlock({}, coinbase_script);
+    WaitForSync(scriptindex);
+
+    unspent.clear();
+    BOOST_CHECK(scriptindex.FindUnspent(dest_script, asset.no, 0, 1000, unspent));
+    BOOST_CHECK(unspent.empty());
+    history.clear();
+    BOOST_CHECK(scriptindex.FindHistory(dest_script, asset.no, 0, 1000, history));
+    BOOST_CHECK(history.empty());
+
+    unspent.clear();
+    BOOST_CHECK(scriptindex.FindUnspent(coinbase_script, asset.no, 0, 1000, unspent));
+    BOOST_CHECK(HasUnspent(unspent, transfer.vin[0].prevout, 1000 * COIN));
+    BOOST_CHECK(!HasUnspent(unspent, COutPoint(transfer.GetHash(), 1), 400 * COIN));
+    unspent.clear();
+    BOOST_CHECK(scriptindex.FindUnspent(coinbase_script, 0, 0, 1000, unspent));
+    BOOST_CHECK(HasUnspent(unspent, transfer.vin[1].prevout, MAX_MONEY));
+    BOOST_CHECK(!HasUnspent(unspent, COutPoint(transfer.GetHash(), 2), MAX_MONEY - COIN));
+    history.clear();
+    BOOST_CHECK(scriptindex.FindHistory(coinbase_script, asset.no, 0, 1000, history));
+    BOOST_REQUIRE(!history.empty());
+    BOOST_CHECK(history.back().txid == asset_coinbase->GetHash());
+
+    scriptindex.Stop();
+    CoinAssetManager::Instance().RemoveCoinAsset(asset.no);
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -88,7 +88,11 @@ struct TestChain100Setup : public TestingSetup {
     // Create a new block with just given transactions, coinbase paying to
     // scriptPubKey, and try to add it to the current chain.
     CBlock CreateAndProcessBlock(const std::vector<CMutableTransaction>& txns,
-                                 const CScript& scriptPubKey);
+                                 const CScript& scriptPubKey, const CAmount MaxMoney = 0);
+
+    // Mine the block issuing all main coins, paying them to coinbaseKey, and
+    // enough blocks on top of it for them to mature. Returns its coinbase.
+    CTransactionRef IssueMainCoins();
 
     ~TestChain100Setup();
 
@@ -196,6 +196,25 @@ BOOST_AUTO_TEST_CASE(streams_serializedata_xor)
     key.push_back('\xff');
     key.push_back('\x0f');
 
+    ds.Xor(key);
+    BOOST_CHECK_EQUAL(
+            std::string(expected_xor.begin(), expected_xor.end()),
+            std::string(ds.begin(), ds.end()));
+
+    // Eight byte key over data that is not a multiple of its size, which
+    // takes the word-wise path followed by a byte-wise remainder
+
+    in.clear();
+    expected_xor.clear();
+    key = {0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08};
+    for (int i = 0; i < 21; ++i) {
+        in.push_back((char)(i * 13));
+        expected_xor.push_back((char)(i * 13) ^ key[i % key.size()]);
+    }
+
+    ds.clear();
+    ds.insert(ds.begin(), in.begin(), in.end());
+
     ds.Xor(key);
     BOOST_CHECK_EQUAL(
             std::string(expected_xor.begin(), expected_xor.end()),
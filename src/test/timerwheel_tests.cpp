@@ -0,0 +1,92 @@
+// Copyright (c) 2019 The Vccoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <timerwheel.h>
+
+#include <test/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(timerwheel_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(timerwheel_fire_and_consume)
+{
+    // 10 ticks of 100 units: one revolution is 1000 units
+    TimerWheel wheel(100, 10);
+
+    wheel.Schedule(1, 250);
+    wheel.Schedule(2, 250);
+    wheel.Schedule(3, 5250); // several revolutions away
+    BOOST_CHECK_EQUAL(wheel.size(), 3U);
+
+    // Timers fire at their exact expiry time, not at the start of their tick
+    BOOST_CHECK(!wheel.Advance(249));
+    BOOST_CHECK(!wheel.ConsumeFired(1));
+    BOOST_CHECK(wheel.Advance(250));
+    BOOST_CHECK_EQUAL(wheel.GetEpoch(), 1U);
+    BOOST_CHECK(wheel.ConsumeFired(1));
+    BOOST_CHECK(!wheel.ConsumeFired(1));
+    BOOST_CHECK(wheel.IsScheduled(2));
+    BOOST_CHECK(wheel.ConsumeFired(2));
+    BOOST_CHECK(!wheel.IsScheduled(2));
+
+    // Passing slot 2 again does not fire the far away timer
+    BOOST_CHECK(!wheel.Advance(1250));
+    BOOST_CHECK(!wheel.ConsumeFired(3));
+    BOOST_CHECK(wheel.IsScheduled(3));
+
+    // A large jump fires everything that expired
+    BOOST_CHECK(wheel.Advance(100000));
+    BOOST_CHECK(wheel.ConsumeFired(3));
+    BOOST_CHECK_EQUAL(wheel.size(), 0U);
+    BOOST_CHECK_EQUAL(wheel.GetEpoch(), 2U);
+}
+
+BOOST_AUTO_TEST_CASE(timerwheel_reschedule_and_cancel)
+{
+    TimerWheel wheel(100, 10);
+    wheel.Advance(1000);
+
+    // Rescheduling replaces the earlier expiry
+    wheel.Schedule(1, 1150);
+    wheel.Schedule(1, 1450);
+    BOOST_CHECK(!wheel.Advance(1200));
+    BOOST_CHECK(!wheel.ConsumeFired(1));
+    BOOST_CHECK(wheel.Advance(1450));
+    BOOST_CHECK(wheel.ConsumeFired(1));
+
+    // Cancelled timers never fire
+    wheel.Schedule(2, 1500);
+    wheel.Cancel(2);
+    BOOST_CHECK(!wheel.IsScheduled(2));
+    BOOST_CHECK(!wheel.Advance(2000));
+    BOOST_CHECK(!wheel.ConsumeFired(2));
+
+    // Timers in the past fire on the next advance
+    wheel.Schedule(3, 0);
+    BOOST_CHECK(wheel.Advance(2000));
+    BOOST_CHECK(wheel.ConsumeFired(3));
+}
+
+BOOST_AUTO_TEST_CASE(timerwheel_epochs)
+{
+    TimerWheel wheel(100, 10);
+
+    // Timers firing in the same tick share an epoch, even over several advances
+    wheel.Schedule(1, 110);
+    wheel.Schedule(2, 150);
+    wheel.Schedule(3, 250);
+    BOOST_CHECK(wheel.Advance(120));
+    BOOST_CHECK_EQUAL(wheel.GetEpoch(), 1U);
+    BOOST_CHECK(wheel.Advance(160));
+    BOOST_CHECK_EQUAL(wheel.GetEpoch(), 1U);
+    BOOST_CHECK(wheel.Advance(260));
+    BOOST_CHECK_EQUAL(wheel.GetEpoch(), 2U);
+
+    // Ticks without firing timers do not start an epoch
+    BOOST_CHECK(!wheel.Advance(900));
+    BOOST_CHECK_EQUAL(wheel.GetEpoch(), 2U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -3,11 +3,16 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <chainparams.h>
+#include <consensus/validation.h>
 #include <index/txindex.h>
+#include <key.h>
+#include <script/interpreter.h>
 #include <script/standard.h>
+#include <streams.h>
 #include <test/setup_common.h>
 #include <util/system.h>
 #include <util/time.h>
+#include <validation.h>
 
 #include <boost/test/unit_test.hpp>
 
@@ -53,6 +58,26 @@ BOOST_FIXTURE_TEST_CASE(txindex_initial_sync, TestChain100Setup)
         }
     }
 
+    // Check that several transactions can be looked up at once, and that
+    // unknown transactions are reported as missing. The known ones are
+    // answered from the lookup cache now.
+    std::vector<uint256> tx_hashes;
+    for (const auto& txn : m_coinbase_txns) {
+        tx_hashes.push_back(txn->GetHash());
+    }
+    tx_hashes.push_back(uint256S("0x01"));
+    std::vector<uint256> block_hashes;
+    std::vector<CTransactionRef> txs;
+    BOOST_CHECK_EQUAL(txindex.FindTxs(tx_hashes, block_hashes, txs), m_coinbase_txns.size());
+    for (size_t i = 0; i < m_coinbase_txns.size(); ++i) {
+        BOOST_REQUIRE(txs[i]);
+        BOOST_CHECK(txs[i]->GetHash() == tx_hashes[i]);
+        BOOST_CHECK(txindex.FindTx(tx_hashes[i], block_hash, tx_disk));
+        BOOST_CHECK(block_hashes[i] == block_hash);
+    }
+    BOOST_CHECK(!txs.back());
+    BOOST_CHECK(block_hashes.back().IsNull());
+
     // Check that new transactions in new blocks make it into the index.
     for (int i = 0; i < 10; i++) {
         CScript coinbase_script_pub_key = GetScriptForDestination(PKHash(coinbaseKey.GetPubKey()));
@@ -61,6 +86,15 @@ BOOST_FIXTURE_TEST_CASE(txindex_initial_sync, TestChain100Setup)
         const CTransaction& txn = *block.vtx[0];
 
         BOOST_CHECK(txindex.BlockUntilSyncedToCurrentChain());
+
+        // The transaction is not cached yet, so it is read from the block file.
+        std::vector<unsigned char> raw_tx;
+        BOOST_REQUIRE(txindex.FindRawTx(txn.GetHash(), block_hash, raw_tx));
+        BOOST_CHECK(block_hash == block.GetHash());
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << txn;
+        BOOST_CHECK(std::vector<unsigned char>(ss.begin(), ss.end()) == raw_tx);
+
         if (!txindex.FindTx(txn.GetHash(), block_hash, tx_disk)) {
             BOOST_ERROR("FindTx failed");
         } else if (tx_disk->GetHash() != txn.GetHash()) {
@@ -77,4 +111,54 @@ BOOST_FIXTURE_TEST_CASE(txindex_initial_sync, TestChain100Setup)
     // Rest of shutdown sequence and destructors happen in ~TestingSetup()
 }
 
+BOOST_FIXTURE_TEST_CASE(txindex_cache_reorg, TestChain100Setup)
+{
+    TxIndex txindex(1 << 20, true);
+    txindex.Start();
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CTransactionRef coins = IssueMainCoins();
+
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(coins->GetHash(), 0);
+    tx.vout.resize(1, CTxOut(COIN, scriptPubKey));
+    std::vector<unsigned char> vchSig;
+    uint256 sighash = SignatureHash(coins->vout[0].scriptPubKey, tx, 0, SIGHASH_ALL, 0, SigVersion::BASE);
+    BOOST_REQUIRE(coinbaseKey.Sign(sighash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    tx.vin[0].scriptSig << vchSig;
+    const uint256 block_a = CreateAndProcessBlock({tx}, scriptPubKey).GetHash();
+    BOOST_CHECK(txindex.BlockUntilSyncedToCurrentChain());
+
+    // Look the transaction up, which caches it with its block
+    CTransactionRef tx_disk;
+    uint256 block_hash;
+    BOOST_REQUIRE(txindex.FindTx(tx.GetHash(), block_hash, tx_disk));
+    BOOST_CHECK(block_hash == block_a);
+
+    // Mine the transaction again in a competing block, paying the coinbase
+    // elsewhere so that the block differs
+    CValidationState state;
+    BOOST_REQUIRE(InvalidateBlock(state, Params(), WITH_LOCK(cs_main, return LookupBlockIndex(block_a))));
+    const uint256 block_b = CreateAndProcessBlock({tx}, CScript() << OP_TRUE).GetHash();
+    BOOST_REQUIRE(block_b != block_a);
+    BOOST_REQUIRE(WITH_LOCK(cs_main, return ::ChainActive().Tip()->GetBlockHash()) == block_b);
+    BOOST_CHECK(txindex.BlockUntilSyncedToCurrentChain());
+
+    // Neither lookup is served the block of the stale cache entry
+    BOOST_REQUIRE(txindex.FindTx(tx.GetHash(), block_hash, tx_disk));
+    BOOST_CHECK(block_hash == block_b);
+    std::vector<uint256> block_hashes;
+    std::vector<CTransactionRef> txs;
+    BOOST_CHECK_EQUAL(txindex.FindTxs({tx.GetHash()}, block_hashes, txs), 1U);
+    BOOST_CHECK(block_hashes[0] == block_b);
+    std::vector<unsigned char> raw_tx;
+    BOOST_REQUIRE(txindex.FindRawTx(tx.GetHash(), block_hash, raw_tx));
+    BOOST_CHECK(block_hash == block_b);
+
+    txindex.Stop();
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -3,10 +3,17 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <validation.h>
+#include <chainparams.h>
 #include <consensus/validation.h>
 #include <primitives/transaction.h>
+#include <key.h>
+#include <miner.h>
+#include <pow.h>
+#include <script/interpreter.h>
 #include <script/script.h>
+#include <script/standard.h>
 #include <test/setup_common.h>
+#include <util/system.h>
 
 #include <boost/test/unit_test.hpp>
 
@@ -53,4 +60,261 @@ BOOST_FIXTURE_TEST_CASE(tx_mempool_reject_coinbase, TestChain100Setup)
     BOOST_CHECK(state.GetReason() == ValidationInvalidReason::CONSENSUS);
 }
 
+static void SignInput(CMutableTransaction& tx, unsigned int n, const CScript& scriptPubKey, const CKey& key)
+{
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, tx, n, SIGHASH_ALL, 0, SigVersion::BASE);
+    BOOST_REQUIRE(key.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    tx.vin[n].scriptSig = CScript() << vchSig;
+}
+
+/**
+ * Transactions with several inputs have their scripts verified on the script
+ * check threads. Check that invalid ones are rejected there with the same
+ * reasons as by a serial check, and that missing inputs are reported.
+ */
+BOOST_FIXTURE_TEST_CASE(tx_mempool_parallel_script_checks, TestChain100Setup)
+{
+    BOOST_REQUIRE(nScriptCheckThreads > 0);
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CTransactionRef coins = IssueMainCoins();
+
+    // Confirm some outputs to spend
+    CMutableTransaction split;
+    split.vin.resize(1);
+    split.vin[0].prevout = COutPoint(coins->GetHash(), 0);
+    split.vout.resize(8, CTxOut(COIN, scriptPubKey));
+    SignInput(split, 0, scriptPubKey, coinbaseKey);
+    CreateAndProcessBlock({split}, scriptPubKey);
+
+    auto spend = [&](std::vector<unsigned int> outputs) {
+        CMutableTransaction tx;
+        for (unsigned int n : outputs) {
+            tx.vin.emplace_back(COutPoint(split.GetHash(), n));
+        }
+        tx.vout.resize(1, CTxOut(outputs.size() * COIN - 10000, scriptPubKey));
+        for (unsigned int i = 0; i < tx.vin.size(); ++i) {
+            SignInput(tx, i, scriptPubKey, coinbaseKey);
+        }
+        return tx;
+    };
+    auto accept = [](const CMutableTransaction& tx, CValidationState& state, bool& missing_inputs) {
+        LOCK(cs_main);
+        return AcceptToMemoryPool(mempool, state, MakeTransactionRef(tx), &missing_inputs,
+                                  nullptr /* plTxnReplaced */, true /* bypass_limits */, 0 /* nAbsurdFee */);
+    };
+
+    const unsigned int initialPoolSize = WITH_LOCK(mempool.cs, return mempool.size());
+    CValidationState state;
+    bool missing_inputs = false;
+
+    // An invalid signature on the last of several inputs
+    CMutableTransaction bad_sig = spend({0, 1, 2, 3});
+    bad_sig.vin[3].scriptSig = bad_sig.vin[2].scriptSig;
+    BOOST_CHECK(!accept(bad_sig, state, missing_inputs));
+    BOOST_CHECK(!missing_inputs);
+    BOOST_CHECK(state.IsInvalid());
+    BOOST_CHECK(state.GetReason() == ValidationInvalidReason::CONSENSUS);
+    BOOST_CHECK_EQUAL(state.GetRejectReason().find("mandatory-script-verify-flag-failed"), 0U);
+
+    // The same failure is reported for a single input, which is checked serially
+    CValidationState serial_state;
+    CMutableTransaction bad_sig_single = spend({4});
+    bad_sig_single.vin[0].scriptSig = bad_sig.vin[0].scriptSig;
+    BOOST_CHECK(!accept(bad_sig_single, serial_state, missing_inputs));
+    BOOST_CHECK_EQUAL(serial_state.GetRejectReason(), state.GetRejectReason());
+
+    // A missing input among several valid ones
+    state = CValidationState();
+    CMutableTransaction missing = spend({0, 1});
+    missing.vin.emplace_back(COutPoint(uint256S("0x01"), 0));
+    BOOST_CHECK(!accept(missing, state, missing_inputs));
+    BOOST_CHECK(missing_inputs);
+    BOOST_CHECK_EQUAL(WITH_LOCK(mempool.cs, return mempool.size()), initialPoolSize);
+
+    // The valid transaction is accepted
+    state = CValidationState();
+    missing_inputs = false;
+    CMutableTransaction good = spend({0, 1, 2, 3});
+    BOOST_CHECK(accept(good, state, missing_inputs));
+    BOOST_CHECK(state.IsValid());
+    BOOST_CHECK(WITH_LOCK(mempool.cs, return mempool.exists(good.GetHash())));
+}
+
+/**
+ * Transactions of disconnected blocks are re-added to the mempool without
+ * verifying their scripts only if they were verified with the policy flags
+ * before, which is not the case for transactions that were not in the
+ * mempool, or for blocks connected without script checks.
+ */
+BOOST_FIXTURE_TEST_CASE(tx_mempool_reorg_script_checks, TestChain100Setup)
+{
+    const CChainParams& chainparams = Params();
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CScript redeem_script = CScript() << OP_TRUE;
+    CScript anyone = GetScriptForDestination(ScriptHash(redeem_script));
+    CTransactionRef coins = IssueMainCoins();
+
+    CMutableTransaction split;
+    split.vin.resize(1);
+    split.vin[0].prevout = COutPoint(coins->GetHash(), 0);
+    split.vout.resize(2, CTxOut(COIN, anyone));
+    split.vout.resize(3, CTxOut(COIN, scriptPubKey));
+    SignInput(split, 0, scriptPubKey, coinbaseKey);
+    CreateAndProcessBlock({split}, scriptPubKey);
+
+    auto spend = [&](unsigned int n, const CScript& scriptSig) {
+        CMutableTransaction tx;
+        tx.vin.emplace_back(COutPoint(split.GetHash(), n), scriptSig);
+        tx.vout.resize(1, CTxOut(COIN - 10000, scriptPubKey));
+        return tx;
+    };
+    auto in_mempool = [](const CMutableTransaction& tx) {
+        LOCK(mempool.cs);
+        return mempool.exists(tx.GetHash());
+    };
+    auto invalidate_tip = [&]() {
+        CValidationState state;
+        CBlockIndex* tip = WITH_LOCK(cs_main, return ::ChainActive().Tip());
+        BOOST_CHECK(InvalidateBlock(state, chainparams, tip));
+        BOOST_CHECK(WITH_LOCK(cs_main, return ::ChainActive().Tip()) == tip->pprev);
+    };
+
+    // A transaction from the mempool comes back after a reorg
+    CMutableTransaction standard = spend(0, CScript() << ToByteVector(redeem_script));
+    {
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_CHECK(AcceptToMemoryPool(mempool, state, MakeTransactionRef(standard), nullptr, nullptr, true, 0));
+    }
+    CreateAndProcessBlock({standard}, scriptPubKey);
+    BOOST_CHECK(!in_mempool(standard));
+    invalidate_tip();
+    BOOST_CHECK(in_mempool(standard));
+
+    // A transaction that is valid under the consensus rules but not the
+    // policy rules is not, though its block was verified. Pushing the redeem
+    // script with OP_PUSHDATA1 violates SCRIPT_VERIFY_MINIMALDATA.
+    CScript non_minimal_push;
+    non_minimal_push.insert(non_minimal_push.end(), OP_PUSHDATA1);
+    non_minimal_push.insert(non_minimal_push.end(), (unsigned char)redeem_script.size());
+    non_minimal_push.insert(non_minimal_push.end(), redeem_script.begin(), redeem_script.end());
+    CMutableTransaction nonstandard = spend(1, non_minimal_push);
+    {
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_CHECK(!AcceptToMemoryPool(mempool, state, MakeTransactionRef(nonstandard), nullptr, nullptr, true, 0));
+        BOOST_CHECK_EQUAL(state.GetRejectReason(), "non-mandatory-script-verify-flag (Data push larger than necessary)");
+    }
+    CreateAndProcessBlock({nonstandard}, scriptPubKey);
+    BOOST_CHECK(WITH_LOCK(cs_main, return ::pcoinsTip->HaveCoin(COutPoint(nonstandard.GetHash(), 0))));
+    invalidate_tip();
+    BOOST_CHECK(!in_mempool(nonstandard));
+    BOOST_CHECK(in_mempool(standard));
+
+    // A block under -assumevalid is connected without script checks, so an
+    // invalid signature goes unnoticed. Its transactions are verified when
+    // they are re-added to the mempool.
+    CMutableTransaction bad_sig = spend(2, CScript());
+    SignInput(bad_sig, 0, redeem_script, coinbaseKey);
+    std::unique_ptr<CBlockTemplate> pblocktemplate = BlockAssembler(chainparams).CreateNewBlock(scriptPubKey);
+    CBlock block = pblocktemplate->block;
+    block.vtx.resize(1);
+    block.vtx.push_back(MakeTransactionRef(bad_sig));
+    {
+        LOCK(cs_main);
+        unsigned int extraNonce = 0;
+        IncrementExtraNonce(&block, ::ChainActive().Tip(), extraNonce);
+    }
+    while (!CheckProofOfWork(block.GetHash(), block.nBits, chainparams.GetConsensus())) ++block.nNonce;
+
+    // The assumed valid block must be buried by two weeks' worth of work
+    std::vector<CBlockHeader> headers{block.GetBlockHeader()};
+    for (int i = 0; i < 2100; ++i) {
+        CBlockHeader header = headers.back();
+        header.hashPrevBlock = header.GetHash();
+        header.hashMerkleRoot = InsecureRand256();
+        ++header.nTime;
+        while (!CheckProofOfWork(header.GetHash(), header.nBits, chainparams.GetConsensus())) ++header.nNonce;
+        headers.push_back(header);
+    }
+    CValidationState state;
+    BOOST_REQUIRE(ProcessNewBlockHeaders(headers, state, chainparams));
+    hashAssumeValid = headers.back().GetHash();
+    BOOST_CHECK(ProcessNewBlock(chainparams, std::make_shared<const CBlock>(block), true, nullptr));
+    hashAssumeValid = uint256();
+    BOOST_REQUIRE(WITH_LOCK(cs_main, return ::ChainActive().Tip()->GetBlockHash()) == block.GetHash());
+    invalidate_tip();
+    BOOST_CHECK(!in_mempool(bad_sig));
+    BOOST_CHECK(in_mempool(standard));
+}
+
+/**
+ * The mempool is keyed by txid, so a block may carry a mempool transaction
+ * with a different witness. Its scripts were not verified with the policy
+ * flags, so the transaction is verified when it comes back after a reorg.
+ */
+BOOST_FIXTURE_TEST_CASE(tx_mempool_reorg_malleated_witness, TestChain100Setup)
+{
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    // Any true OP_IF argument is valid under the consensus rules, but
+    // SCRIPT_VERIFY_MINIMALIF only allows 1.
+    CScript witness_script = CScript() << OP_IF << OP_ENDIF << OP_TRUE;
+    CScript p2wsh = GetScriptForDestination(WitnessV0ScriptHash(witness_script));
+    CTransactionRef coins = IssueMainCoins();
+
+    CMutableTransaction split;
+    split.vin.resize(1);
+    split.vin[0].prevout = COutPoint(coins->GetHash(), 0);
+    split.vout.resize(1, CTxOut(COIN, p2wsh));
+    SignInput(split, 0, scriptPubKey, coinbaseKey);
+    CreateAndProcessBlock({split}, scriptPubKey);
+
+    // Activate segwit to mine witnesses, which TestChain100Setup does not
+    gArgs.ForceSetArg("-vbparams", strprintf("segwit:%d:%d", (int64_t)Consensus::BIP9Deployment::ALWAYS_ACTIVE, (int64_t)Consensus::BIP9Deployment::NO_TIMEOUT));
+    SelectParams(CBaseChainParams::REGTEST);
+    const CChainParams& chainparams = Params();
+
+    CMutableTransaction standard;
+    standard.vin.emplace_back(COutPoint(split.GetHash(), 0));
+    standard.vin[0].scriptWitness.stack = {{1}, ToByteVector(witness_script)};
+    standard.vout.resize(1, CTxOut(COIN - 10000, scriptPubKey));
+    CMutableTransaction malleated = standard;
+    malleated.vin[0].scriptWitness.stack[0] = {2};
+    BOOST_REQUIRE(malleated.GetHash() == standard.GetHash());
+    BOOST_REQUIRE(CTransaction(malleated).GetWitnessHash() != CTransaction(standard).GetWitnessHash());
+    {
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_CHECK(AcceptToMemoryPool(mempool, state, MakeTransactionRef(standard), nullptr, nullptr, true, 0));
+        BOOST_CHECK(!AcceptToMemoryPool(mempool, state, MakeTransactionRef(malleated), nullptr, nullptr, true, 0));
+    }
+
+    // Mine the malleated transaction, committing to its witness
+    std::unique_ptr<CBlockTemplate> pblocktemplate = BlockAssembler(chainparams).CreateNewBlock(scriptPubKey);
+    CBlock block = pblocktemplate->block;
+    CMutableTransaction coinbase(*block.vtx[0]);
+    BOOST_REQUIRE(coinbase.vout.back().scriptPubKey.IsUnspendable());
+    coinbase.vout.pop_back();
+    block.vtx = {MakeTransactionRef(coinbase), MakeTransactionRef(malleated)};
+    {
+        LOCK(cs_main);
+        GenerateCoinbaseCommitment(block, ::ChainActive().Tip(), chainparams.GetConsensus());
+        unsigned int extraNonce = 0;
+        IncrementExtraNonce(&block, ::ChainActive().Tip(), extraNonce);
+    }
+    while (!CheckProofOfWork(block.GetHash(), block.nBits, chainparams.GetConsensus())) ++block.nNonce;
+    BOOST_CHECK(ProcessNewBlock(chainparams, std::make_shared<const CBlock>(block), true, nullptr));
+    BOOST_REQUIRE(WITH_LOCK(cs_main, return ::ChainActive().Tip()->GetBlockHash()) == block.GetHash());
+    BOOST_CHECK(!WITH_LOCK(mempool.cs, return mempool.exists(standard.GetHash())));
+
+    CValidationState state;
+    BOOST_CHECK(InvalidateBlock(state, chainparams, WITH_LOCK(cs_main, return ::ChainActive().Tip())));
+    BOOST_CHECK(!WITH_LOCK(mempool.cs, return mempool.exists(malleated.GetHash())));
+
+    gArgs.ForceSetArg("-vbparams", strprintf("segwit:0:%d", (int64_t)Consensus::BIP9Deployment::NO_TIMEOUT));
+    SelectParams(CBaseChainParams::REGTEST);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -207,6 +207,36 @@ BOOST_AUTO_TEST_CASE(processnewblock_signals_ordering)
     BOOST_CHECK_EQUAL(sub.m_expected_tip, ::ChainActive().Tip()->GetBlockHash());
 }
 
+BOOST_AUTO_TEST_CASE(processnewblockheaders_bad_pow)
+{
+    // Headers are hashed and checked for proof of work in parallel before being
+    // connected. Everything up to the first bad header must still be accepted.
+    std::vector<CBlockHeader> headers;
+    uint256 prev_hash = Params().GenesisBlock().GetHash();
+    for (int i = 0; i < 10; ++i) {
+        headers.push_back(GoodBlock(prev_hash)->GetBlockHeader());
+        prev_hash = headers.back().GetHash();
+    }
+    CBlockHeader& bad = headers[6];
+    while (CheckProofOfWork(bad.GetHash(), bad.nBits, Params().GetConsensus())) {
+        ++bad.nNonce;
+    }
+
+    CValidationState state;
+    CBlockHeader first_invalid;
+    const CBlockIndex* pindex = nullptr;
+    BOOST_CHECK(!ProcessNewBlockHeaders(headers, state, Params(), &pindex, &first_invalid));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "high-hash");
+    BOOST_CHECK_EQUAL(first_invalid.GetHash(), bad.GetHash());
+    BOOST_CHECK_EQUAL(pindex->GetBlockHash(), headers[5].GetHash());
+
+    LOCK(cs_main);
+    for (int i = 0; i < 6; ++i) {
+        BOOST_CHECK(LookupBlockIndex(headers[i].GetHash()) != nullptr);
+    }
+    BOOST_CHECK(LookupBlockIndex(bad.GetHash()) == nullptr);
+}
+
 /**
  * Test that mempool updates happen atomically with reorgs.
  *
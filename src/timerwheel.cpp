@@ -0,0 +1,81 @@
+// Copyright (c) 2019 The Vccoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <timerwheel.h>
+
+#include <algorithm>
+#include <assert.h>
+
+TimerWheel::TimerWheel(int64_t tick_length, size_t num_slots) : m_tick_length(tick_length), m_slots(num_slots)
+{
+    assert(tick_length > 0);
+    assert(num_slots > 0);
+}
+
+int64_t TimerWheel::TickOf(int64_t when) const
+{
+    return std::max<int64_t>(when, 0) / m_tick_length;
+}
+
+void TimerWheel::Schedule(Id id, int64_t when)
+{
+    m_fired.erase(id);
+    m_expiry[id] = when;
+    // Timers that expire in a tick that was already processed go into the
+    // current slot, which is rescanned on the next Advance.
+    const int64_t tick = std::max(TickOf(when), m_cur_tick);
+    m_slots[tick % m_slots.size()].emplace_back(id, when);
+}
+
+void TimerWheel::Cancel(Id id)
+{
+    m_expiry.erase(id);
+    m_fired.erase(id);
+}
+
+bool TimerWheel::Advance(int64_t now)
+{
+    const int64_t now_tick = TickOf(now);
+    if (now_tick < m_cur_tick) return false;
+
+    // Each slot only needs to be visited once, however far the clock jumped.
+    int64_t first_tick = m_cur_tick;
+    if (now_tick - first_tick >= (int64_t)m_slots.size()) {
+        first_tick = now_tick - m_slots.size() + 1;
+    }
+
+    bool fired = false;
+    for (int64_t tick = first_tick; tick <= now_tick; ++tick) {
+        std::vector<std::pair<Id, int64_t>>& slot = m_slots[tick % m_slots.size()];
+        size_t i = 0;
+        while (i < slot.size()) {
+            auto it = m_expiry.find(slot[i].first);
+            const bool stale = it == m_expiry.end() || it->second != slot[i].second;
+            if (!stale && slot[i].second > now) {
+                // Expires in a later revolution, or later in the current tick.
+                ++i;
+                continue;
+            }
+            if (!stale) {
+                m_fired.insert(it->first);
+                m_expiry.erase(it);
+                fired = true;
+            }
+            slot[i] = slot.back();
+            slot.pop_back();
+        }
+    }
+    m_cur_tick = now_tick;
+
+    if (fired && now_tick != m_epoch_tick) {
+        m_epoch_tick = now_tick;
+        ++m_epoch;
+    }
+    return fired;
+}
+
+bool TimerWheel::ConsumeFired(Id id)
+{
+    return m_fired.erase(id) > 0;
+}
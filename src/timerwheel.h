@@ -0,0 +1,80 @@
+// Copyright (c) 2019 The Vccoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef VCCOIN_TIMERWHEEL_H
+#define VCCOIN_TIMERWHEEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <map>
+#include <set>
+#include <vector>
+
+/**
+ * Hashed timer wheel for a large number of coarse-grained, frequently
+ * rescheduled timers (such as per-peer inventory trickles).
+ *
+ * Time is divided into ticks of a fixed length. A timer is stored in the slot
+ * of the tick it expires in, so advancing the wheel only has to look at the
+ * slots of the ticks that passed instead of polling every timer. Timers still
+ * fire at their exact expiry time, the tick only determines the slot. Timers that
+ * are further away than one revolution of the wheel stay in their slot until
+ * the wheel has come around often enough.
+ *
+ * Every tick in which at least one timer fires starts a new epoch. All timers
+ * firing in the same epoch can share work that only needs to be done once per
+ * epoch.
+ *
+ * Not thread-safe; callers are expected to provide their own locking.
+ */
+class TimerWheel
+{
+public:
+    typedef int64_t Id;
+
+    /** @param[in] tick_length  Length of one tick, in the caller's time unit (must be > 0).
+     *  @param[in] num_slots    Number of slots, i.e. ticks per revolution (must be > 0). */
+    TimerWheel(int64_t tick_length, size_t num_slots);
+
+    /** (Re)schedule the timer for id to expire at time when. Any pending
+     *  expiry or unconsumed firing of the same id is replaced. */
+    void Schedule(Id id, int64_t when);
+
+    /** Remove any pending timer or unconsumed firing for id. */
+    void Cancel(Id id);
+
+    /** Move the wheel forward to time now, firing all timers that expired.
+     *  Returns true if any timer fired. */
+    bool Advance(int64_t now);
+
+    /** Returns true (once) if the timer for id fired since it was last
+     *  scheduled. The timer must be rescheduled to fire again. */
+    bool ConsumeFired(Id id);
+
+    /** Whether a timer for id is pending or has fired but was not consumed. */
+    bool IsScheduled(Id id) const { return m_expiry.count(id) || m_fired.count(id); }
+
+    /** Number of ticks in which timers fired so far. */
+    uint64_t GetEpoch() const { return m_epoch; }
+
+    size_t size() const { return m_expiry.size(); }
+
+private:
+    int64_t TickOf(int64_t when) const;
+
+    const int64_t m_tick_length;
+    std::vector<std::vector<std::pair<Id, int64_t>>> m_slots;
+    /** Authoritative expiry time of every pending timer. Slot entries that do
+     *  not match are stale and dropped lazily. */
+    std::map<Id, int64_t> m_expiry;
+    std::set<Id> m_fired;
+    /** Tick up to which slots have been processed. Its own slot is rescanned
+     *  on every Advance, as timers in it may not have expired yet. */
+    int64_t m_cur_tick{0};
+    /** Tick in which the current epoch started. */
+    int64_t m_epoch_tick{-1};
+    uint64_t m_epoch{0};
+};
+
+#endif // VCCOIN_TIMERWHEEL_H
@@ -5,13 +5,17 @@
 
 #include <txdb.h>
 
+#include <blockindexfile.h>
+#include <chainstaterebuild.h>
 #include <random.h>
+#include <util/memory.h>
 #include <pow.h>
 #include <shutdown.h>
 #include <uint256.h>
 #include <util/system.h>
 #include <ui_interface.h>
 
+#include <algorithm>
 #include <stdint.h>
 
 #include <boost/thread.hpp>
@@ -26,6 +30,7 @@ static const char DB_HEAD_BLOCKS = 'H';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
+static const char DB_BLOCK_INDEX_FILE = 'L';
 
 namespace {
 
@@ -51,35 +56,72 @@ struct CoinEntry {
 
 }
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true)
+CCoinsViewDB::CCoinsViewDB(fs::path ldb_path, size_t nCacheSize, bool fMemory, bool fWipe) :
+    m_ldb_path(std::move(ldb_path)),
+    m_cache_size(nCacheSize),
+    m_db(MakeUnique<CDBWrapper>(m_ldb_path, nCacheSize, fMemory, fWipe, true, GetDBOptions("chainstate")))
 {
 }
 
+bool CCoinsViewDB::HasOpenCursors() const
+{
+    LOCK(m_cursors_mutex);
+    return m_open_cursors > 0;
+}
+
+bool CCoinsViewDB::SwapDirectory(const fs::path& new_path)
+{
+    LOCK(m_cursors_mutex);
+    if (m_open_cursors > 0) {
+        LogPrintf("%s: Cannot replace the database while cursors are open\n", __func__);
+        return false;
+    }
+
+    const fs::path old_path = m_ldb_path.string() + SWAP_SUFFIX;
+    m_db.reset();
+    try {
+        // A crash between the two renames is recovered from at startup, see
+        // CleanupChainstateRebuild().
+        fs::rename(m_ldb_path, old_path);
+        fs::rename(new_path, m_ldb_path);
+    } catch (const fs::filesystem_error& e) {
+        LogPrintf("%s: Failed to move %s into place: %s\n", __func__, new_path.string(), e.what());
+        if (!fs::exists(m_ldb_path) && fs::exists(old_path)) {
+            fs::rename(old_path, m_ldb_path);
+        }
+        m_db = MakeUnique<CDBWrapper>(m_ldb_path, m_cache_size, false, false, true, GetDBOptions("chainstate"));
+        return false;
+    }
+    m_db = MakeUnique<CDBWrapper>(m_ldb_path, m_cache_size, false, false, true, GetDBOptions("chainstate"));
+    fs::remove_all(old_path);
+    return true;
+}
+
 bool CCoinsViewDB::GetCoin(const COutPoint &outpoint, Coin &coin) const {
-    return db.Read(CoinEntry(&outpoint), coin);
+    return m_db->Read(CoinEntry(&outpoint), coin);
 }
 
 bool CCoinsViewDB::HaveCoin(const COutPoint &outpoint) const {
-    return db.Exists(CoinEntry(&outpoint));
+    return m_db->Exists(CoinEntry(&outpoint));
 }
 
 uint256 CCoinsViewDB::GetBestBlock() const {
     uint256 hashBestChain;
-    if (!db.Read(DB_BEST_BLOCK, hashBestChain))
+    if (!m_db->Read(DB_BEST_BLOCK, hashBestChain))
         return uint256();
     return hashBestChain;
 }
 
 std::vector<uint256> CCoinsViewDB::GetHeadBlocks() const {
     std::vector<uint256> vhashHeadBlocks;
-    if (!db.Read(DB_HEAD_BLOCKS, vhashHeadBlocks)) {
+    if (!m_db->Read(DB_HEAD_BLOCKS, vhashHeadBlocks)) {
         return std::vector<uint256>();
     }
     return vhashHeadBlocks;
 }
 
 bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
-    CDBBatch batch(db);
+    CDBBatch batch(*m_db);
     size_t count = 0;
     size_t changed = 0;
     size_t batch_size = (size_t)gArgs.GetArg("-dbbatchsize", nDefaultDbBatchSize);
@@ -117,7 +159,7 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
         mapCoins.erase(itOld);
         if (batch.SizeEstimate() > batch_size) {
             LogPrint(BCLog::COINDB, "Writing partial batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
-            db.WriteBatch(batch);
+            m_db->WriteBatch(batch);
             batch.Clear();
             if (crash_simulate) {
                 static FastRandomContext rng;
@@ -134,17 +176,48 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     batch.Write(DB_BEST_BLOCK, hashBlock);
 
     LogPrint(BCLog::COINDB, "Writing final batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
-    bool ret = db.WriteBatch(batch);
+    bool ret = m_db->WriteBatch(batch);
     LogPrint(BCLog::COINDB, "Committed %u changed transaction outputs (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
     return ret;
 }
 
 size_t CCoinsViewDB::EstimateSize() const
 {
-    return db.EstimateSize(DB_COIN, (char)(DB_COIN+1));
+    return m_db->EstimateSize(DB_COIN, (char)(DB_COIN+1));
 }
 
-CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(gArgs.IsArgSet("-blocksdir") ? GetDataDir() / "blocks" / "index" : GetBlocksDir() / "index", nCacheSize, fMemory, fWipe) {
+/** Number of records written to the block index file at once when rewriting it. */
+static const size_t BLOCK_INDEX_FILE_BATCH = 10000;
+
+CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(gArgs.IsArgSet("-blocksdir") ? GetDataDir() / "blocks" / "index" : GetBlocksDir() / "index", nCacheSize, fMemory, fWipe, false, GetDBOptions("blockindex")) {
+    if (fMemory) return;
+    const fs::path index_file_path = (gArgs.IsArgSet("-blocksdir") ? GetDataDir() / "blocks" / "index" : GetBlocksDir() / "index") / "blockindex.dat";
+    if (fWipe) {
+        fs::remove(index_file_path);
+    }
+    if (gArgs.GetBoolArg("-blockindexfile", DEFAULT_BLOCKINDEXFILE)) {
+        m_index_file = MakeUnique<BlockIndexFile>(index_file_path);
+    }
+}
+
+CBlockTreeDB::~CBlockTreeDB() {}
+
+bool BlockIndexFileState::SameBlockFiles(const BlockIndexFileState& other) const
+{
+    const CBlockFileInfo& a = last_file_info;
+    const CBlockFileInfo& b = other.last_file_info;
+    return last_file == other.last_file && a.nBlocks == b.nBlocks && a.nSize == b.nSize && a.nUndoSize == b.nUndoSize &&
+           a.nHeightFirst == b.nHeightFirst && a.nHeightLast == b.nHeightLast && a.nTimeFirst == b.nTimeFirst && a.nTimeLast == b.nTimeLast;
+}
+
+BlockIndexFileState CBlockTreeDB::ReadBlockIndexFileState(uint64_t size)
+{
+    BlockIndexFileState state;
+    state.size = size;
+    if (ReadLastBlockFile(state.last_file)) {
+        ReadBlockFileInfo(state.last_file, state.last_file_info);
+    }
+    return state;
 }
 
 bool CBlockTreeDB::ReadBlockFileInfo(int nFile, CBlockFileInfo &info) {
@@ -168,7 +241,9 @@ bool CBlockTreeDB::ReadLastBlockFile(int &nFile) {
 
 CCoinsViewCursor *CCoinsViewDB::Cursor() const
 {
-    CCoinsViewDBCursor *i = new CCoinsViewDBCursor(const_cast<CDBWrapper&>(db).NewIterator(), GetBestBlock());
+    LOCK(m_cursors_mutex);
+    ++m_open_cursors;
+    CCoinsViewDBCursor *i = new CCoinsViewDBCursor(*this, m_db->NewIterator(), GetBestBlock());
     /* It seems that there are no "const iterators" for LevelDB.  Since we
        only need read operations on it, use a const-cast to get around
        that restriction.  */
@@ -184,6 +259,13 @@ CCoinsViewCursor *CCoinsViewDB::Cursor() const
     return i;
 }
 
+CCoinsViewDBCursor::~CCoinsViewDBCursor()
+{
+    pcursor.reset();
+    LOCK(m_parent.m_cursors_mutex);
+    --m_parent.m_open_cursors;
+}
+
 bool CCoinsViewDBCursor::GetKey(COutPoint &key) const
 {
     // Return cached key
@@ -229,7 +311,38 @@ bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockF
     for (std::vector<const CBlockIndex*>::const_iterator it=blockinfo.begin(); it != blockinfo.end(); it++) {
         batch.Write(std::make_pair(DB_BLOCK_INDEX, (*it)->GetBlockHash()), CDiskBlockIndex(*it));
     }
-    return WriteBatch(batch, true);
+    // Append the entries to the block index file first; it only becomes
+    // valid up to its new size with this batch.
+    uint64_t index_file_size = 0;
+    if (m_index_file && m_index_file->GetSize() > 0) {
+        std::vector<BlockIndexRecord> records;
+        records.reserve(blockinfo.size());
+        for (const CBlockIndex* pindex : blockinfo) {
+            records.emplace_back(*pindex);
+        }
+        if (!m_index_file->Append(records, index_file_size)) {
+            return false;
+        }
+        BlockIndexFileState state;
+        state.size = index_file_size;
+        state.last_file = nLastFile;
+        const auto last_info = std::find_if(fileInfo.begin(), fileInfo.end(), [nLastFile](const std::pair<int, const CBlockFileInfo*>& info) { return info.first == nLastFile; });
+        if (last_info != fileInfo.end()) {
+            state.last_file_info = *last_info->second;
+        } else {
+            ReadBlockFileInfo(nLastFile, state.last_file_info);
+        }
+        batch.Write(DB_BLOCK_INDEX_FILE, state);
+    } else {
+        batch.Erase(DB_BLOCK_INDEX_FILE);
+    }
+    if (!WriteBatch(batch, true)) {
+        return false;
+    }
+    if (index_file_size > 0) {
+        m_index_file->SetSize(index_file_size);
+    }
+    return true;
 }
 
 bool CBlockTreeDB::WriteFlag(const std::string &name, bool fValue) {
@@ -244,13 +357,100 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) {
     return true;
 }
 
+bool CBlockTreeDB::WriteBlockIndexFile(const std::vector<const CBlockIndex*>& blocks)
+{
+    // Invalidate the file before rewriting it in place.
+    if (!Erase(DB_BLOCK_INDEX_FILE, true) || !m_index_file->Create()) {
+        return false;
+    }
+    uint64_t size = m_index_file->GetSize();
+    std::vector<BlockIndexRecord> records;
+    for (size_t i = 0; i < blocks.size(); i += BLOCK_INDEX_FILE_BATCH) {
+        records.clear();
+        for (size_t j = i; j < std::min(blocks.size(), i + BLOCK_INDEX_FILE_BATCH); ++j) {
+            records.emplace_back(*blocks[j]);
+        }
+        if (!m_index_file->Append(records, size)) {
+            return false;
+        }
+        m_index_file->SetSize(size);
+    }
+    return Write(DB_BLOCK_INDEX_FILE, ReadBlockIndexFileState(size), true);
+}
+
+bool CBlockTreeDB::LoadBlockIndexFile(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex)
+{
+    BlockIndexFileState state;
+    if (!Read(DB_BLOCK_INDEX_FILE, state)) {
+        return false;
+    }
+    // Blocks were stored since, by a version that does not update the file.
+    if (!state.SameBlockFiles(ReadBlockIndexFileState(state.size))) {
+        return false;
+    }
+
+    // Check every record before inserting any, so that a damaged file leaves
+    // the block index untouched for loading it from the database.
+    size_t num_records = 0;
+    const auto check = [&](const BlockIndexRecord& record) {
+        if ((++num_records & 0xFFFF) == 0 && ShutdownRequested()) return false;
+        if (!CheckProofOfWork(record.hash, record.nBits, consensusParams))
+            return error("%s: CheckProofOfWork failed: %s", __func__, record.hash.ToString());
+        return true;
+    };
+    std::vector<const CBlockIndex*> blocks;
+    const auto insert = [&](const BlockIndexRecord& record) {
+        CBlockIndex* pindexNew = insertBlockIndex(record.hash);
+        pindexNew->pprev          = insertBlockIndex(record.hashPrev);
+        pindexNew->nHeight        = record.nHeight;
+        pindexNew->nFile          = record.nFile;
+        pindexNew->nDataPos       = record.nDataPos;
+        pindexNew->nUndoPos       = record.nUndoPos;
+        pindexNew->nVersion       = record.nVersion;
+        pindexNew->hashMerkleRoot = record.hashMerkleRoot;
+        pindexNew->nTime          = record.nTime;
+        pindexNew->nBits          = record.nBits;
+        pindexNew->nNonce         = record.nNonce;
+        pindexNew->nStatus        = record.nStatus;
+        pindexNew->nTx            = record.nTx;
+        blocks.push_back(pindexNew);
+    };
+    if (!m_index_file->Load(state.size, check, insert)) {
+        return false;
+    }
+    // Later records of a block replace earlier ones.
+    std::sort(blocks.begin(), blocks.end());
+    blocks.erase(std::unique(blocks.begin(), blocks.end()), blocks.end());
+    LogPrintf("Loaded %u block index entries from %s\n", blocks.size(), m_index_file->GetPath().string());
+
+    // Every block is appended again when its status changes. Drop the
+    // replaced records once they make up most of the file.
+    if (num_records > 2 * blocks.size() + BLOCK_INDEX_FILE_BATCH) {
+        std::sort(blocks.begin(), blocks.end(), [](const CBlockIndex* a, const CBlockIndex* b) { return a->nHeight < b->nHeight; });
+        if (!WriteBlockIndexFile(blocks)) {
+            LogPrintf("%s: failed to compact %s, it will be rebuilt at the next start\n", __func__, m_index_file->GetPath().string());
+            m_index_file->SetSize(0);
+        }
+    }
+    return true;
+}
+
 bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex)
 {
+    if (m_index_file) {
+        if (LoadBlockIndexFile(consensusParams, insertBlockIndex)) {
+            return true;
+        }
+        if (ShutdownRequested()) return false;
+        LogPrintf("Block index file %s is missing, damaged or outdated, loading the block index from the database\n", m_index_file->GetPath().string());
+    }
+
     std::unique_ptr<CDBIterator> pcursor(NewIterator());
 
     pcursor->Seek(std::make_pair(DB_BLOCK_INDEX, uint256()));
 
     // Load mapBlockIndex
+    std::vector<const CBlockIndex*> blocks;
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
         if (ShutdownRequested()) return false;
@@ -275,6 +475,7 @@ bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams,
 
                 if (!CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits, consensusParams))
                     return error("%s: CheckProofOfWork failed: %s", __func__, pindexNew->ToString());
+                if (m_index_file) blocks.push_back(pindexNew);
 
                 pcursor->Next();
             } else {
@@ -285,6 +486,15 @@ bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams,
         }
     }
 
+    if (m_index_file) {
+        std::sort(blocks.begin(), blocks.end(), [](const CBlockIndex* a, const CBlockIndex* b) { return a->nHeight < b->nHeight; });
+        if (!WriteBlockIndexFile(blocks)) {
+            // Keep running without the file; it is rebuilt at the next start.
+            LogPrintf("%s: failed to write %s\n", __func__, m_index_file->GetPath().string());
+            m_index_file->SetSize(0);
+        }
+    }
+
     return true;
 }
 
@@ -348,7 +558,7 @@ public:
  * Currently implemented: from the per-tx utxo model (0.8..0.14.x) to per-txout.
  */
 bool CCoinsViewDB::Upgrade() {
-    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+    std::unique_ptr<CDBIterator> pcursor(m_db->NewIterator());
     pcursor->Seek(std::make_pair(DB_COINS, uint256()));
     if (!pcursor->Valid()) {
         return true;
@@ -359,7 +569,7 @@ bool CCoinsViewDB::Upgrade() {
     LogPrintf("[0%%]..."); /* Continued */
     uiInterface.ShowProgress(_("Upgrading UTXO database"), 0, true);
     size_t batch_size = 1 << 24;
-    CDBBatch batch(db);
+    CDBBatch batch(*m_db);
     int reportDone = 0;
     std::pair<unsigned char, uint256> key;
     std::pair<unsigned char, uint256> prev_key = {DB_COINS, uint256()};
@@ -394,9 +604,9 @@ bool CCoinsViewDB::Upgrade() {
             }
             batch.Erase(key);
             if (batch.SizeEstimate() > batch_size) {
-                db.WriteBatch(batch);
+                m_db->WriteBatch(batch);
                 batch.Clear();
-                db.CompactRange(prev_key, key);
+                m_db->CompactRange(prev_key, key);
                 prev_key = key;
             }
             pcursor->Next();
@@ -404,8 +614,8 @@ bool CCoinsViewDB::Upgrade() {
             break;
         }
     }
-    db.WriteBatch(batch);
-    db.CompactRange({DB_COINS, uint256()}, key);
+    m_db->WriteBatch(batch);
+    m_db->CompactRange({DB_COINS, uint256()}, key);
     uiInterface.ShowProgress("", 100, false);
     LogPrintf("[%s].\n", ShutdownRequested() ? "CANCELLED" : "DONE");
     return !ShutdownRequested();
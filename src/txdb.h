@@ -17,6 +17,7 @@
 #include <utility>
 #include <vector>
 
+class BlockIndexFile;
 class CBlockIndex;
 class CCoinsViewDBCursor;
 class uint256;
@@ -37,18 +38,33 @@ static const int64_t nMaxBlockDBCache = 2;
 // Unlike for the UTXO database, for the txindex scenario the leveldb cache make
 // a meaningful difference: https://github.com/VCcoin/VCcoin/pull/8273#issuecomment-229601991
 static const int64_t nMaxTxIndexCache = 1024;
+//! Max memory allocated to script index DB specific cache (MiB)
+static const int64_t max_script_index_cache = 1024;
 //! Max memory allocated to all block filter index caches combined in MiB.
 static const int64_t max_filter_index_cache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
+//! -blockindexfile default
+static const bool DEFAULT_BLOCKINDEXFILE = false;
 
 /** CCoinsView backed by the coin database (chainstate/) */
 class CCoinsViewDB final : public CCoinsView
 {
 protected:
-    CDBWrapper db;
+    const fs::path m_ldb_path;
+    const size_t m_cache_size;
+    std::unique_ptr<CDBWrapper> m_db;
+
+    //! The database cannot be replaced while cursors into it are open
+    mutable Mutex m_cursors_mutex;
+    mutable int m_open_cursors GUARDED_BY(m_cursors_mutex){0};
+
+    friend class CCoinsViewDBCursor;
 public:
-    explicit CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    /**
+     * @param[in] ldb_path    Location in the filesystem where leveldb data will be stored.
+     */
+    explicit CCoinsViewDB(fs::path ldb_path, size_t nCacheSize, bool fMemory = false, bool fWipe = false);
 
     bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
     bool HaveCoin(const COutPoint &outpoint) const override;
@@ -60,13 +76,21 @@ public:
     //! Attempt to update from an older database format. Returns whether an error occurred.
     bool Upgrade();
     size_t EstimateSize() const override;
+
+    //! Whether cursors returned by Cursor() are still open.
+    bool HasOpenCursors() const;
+
+    //! Replace the database by the (closed) one at new_path, which is moved
+    //! into the location of this one. The old database is deleted. Fails
+    //! without changing anything if cursors are open.
+    bool SwapDirectory(const fs::path& new_path);
 };
 
 /** Specialization of CCoinsViewCursor to iterate over a CCoinsViewDB */
 class CCoinsViewDBCursor: public CCoinsViewCursor
 {
 public:
-    ~CCoinsViewDBCursor() {}
+    ~CCoinsViewDBCursor();
 
     bool GetKey(COutPoint &key) const override;
     bool GetValue(Coin &coin) const override;
@@ -76,19 +100,57 @@ public:
     void Next() override;
 
 private:
-    CCoinsViewDBCursor(CDBIterator* pcursorIn, const uint256 &hashBlockIn):
-        CCoinsViewCursor(hashBlockIn), pcursor(pcursorIn) {}
+    CCoinsViewDBCursor(const CCoinsViewDB& parent, CDBIterator* pcursorIn, const uint256 &hashBlockIn):
+        CCoinsViewCursor(hashBlockIn), m_parent(parent), pcursor(pcursorIn) {}
+    const CCoinsViewDB& m_parent;
     std::unique_ptr<CDBIterator> pcursor;
     std::pair<char, COutPoint> keyTmp;
 
     friend class CCoinsViewDB;
 };
 
+/**
+ * What the block database records about the block index file: the size of
+ * its valid part, and the last block file and its info when it was written.
+ * Versions without -blockindexfile write block index entries without
+ * updating it, but they change the info of the last block file whenever they
+ * store a block or undo data, which marks the block index file as outdated.
+ */
+struct BlockIndexFileState
+{
+    uint64_t size{0};
+    int last_file{0};
+    CBlockFileInfo last_file_info;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(size);
+        READWRITE(last_file);
+        READWRITE(last_file_info);
+    }
+
+    //! Whether both were written with the same block files.
+    bool SameBlockFiles(const BlockIndexFileState& other) const;
+};
+
 /** Access to the block database (blocks/index/) */
 class CBlockTreeDB : public CDBWrapper
 {
+private:
+    //! Copy of the block index entries loaded at startup, with -blockindexfile
+    std::unique_ptr<BlockIndexFile> m_index_file;
+
+    //! The state of the block files in the database, for a block index file of the given size
+    BlockIndexFileState ReadBlockIndexFileState(uint64_t size);
+    bool LoadBlockIndexFile(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex);
+    bool WriteBlockIndexFile(const std::vector<const CBlockIndex*>& blocks);
+
 public:
     explicit CBlockTreeDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    // Destructor is declared because this class contains a unique_ptr to an incomplete type.
+    ~CBlockTreeDB();
 
     bool WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo);
     bool ReadBlockFileInfo(int nFile, CBlockFileInfo &info);
@@ -6,6 +6,7 @@
 #ifndef VCCOIN_TXMEMPOOL_H
 #define VCCOIN_TXMEMPOOL_H
 
+#include <algorithm>
 #include <atomic>
 #include <map>
 #include <memory>
@@ -19,6 +20,7 @@
 #include <crypto/siphash.h>
 #include <indirectmap.h>
 #include <policy/feerate.h>
+#include <prevector.h>
 #include <primitives/transaction.h>
 #include <sync.h>
 #include <random.h>
@@ -66,36 +68,67 @@ class CTxMemPool;
 
 class CTxMemPoolEntry
 {
+public:
+    /** Direct in-mempool parents and children. Up to three links, enough
+     *  for a transaction in the middle of a chain or a parent with two
+     *  children, are stored inline without a separate allocation. */
+    typedef prevector<3, const CTxMemPoolEntry*> Links;
+
+    /** Links and package state of an entry with in-mempool parents or
+     *  children. Entries without either do not allocate one, as their
+     *  descendant and ancestor state is just their own size, fee and sigops. */
+    struct Relatives
+    {
+        // Information about descendants of this transaction that are in the
+        // mempool; if we remove this transaction we must remove all of these
+        // descendants as well.
+        uint64_t nSizeWithDescendants;   //!< size of descendant transactions
+        CAmount nModFeesWithDescendants; //!< ... and total fees (all including us)
+
+        // Analogous statistics for ancestor transactions
+        uint64_t nSizeWithAncestors;
+        CAmount nModFeesWithAncestors;
+        int64_t nSigOpCostWithAncestors;
+
+        uint32_t nCountWithDescendants;  //!< number of descendant transactions
+        uint32_t nCountWithAncestors;
+
+        Links links;       //!< The parents, followed by the children
+        uint32_t nParents; //!< Number of parents at the front of links
+    };
+
 private:
+    // Fields are ordered by size to avoid padding. Quantities that are bounded
+    // by consensus or by the number of transactions in the mempool are stored
+    // in 32 bits.
     const CTransactionRef tx;
     const CAmount nFee;             //!< Cached to avoid expensive parent-transaction lookups
-    const size_t nTxWeight;         //!< ... and avoid recomputing tx weight (also used for GetTxSize())
-    const size_t nUsageSize;        //!< ... and total memory usage
     const int64_t nTime;            //!< Local time when entering the mempool
-    const unsigned int entryHeight; //!< Chain height when entering the mempool
-    const bool spendsCoinbase;      //!< keep track of transactions that spend a coinbase
-    const int64_t sigOpCost;        //!< Total sigop cost
     int64_t feeDelta;          //!< Used for determining the priority of the transaction for mining in a block
     LockPoints lockPoints;     //!< Track the height and time at which tx was final
 
-    // Information about descendants of this transaction that are in the
-    // mempool; if we remove this transaction we must remove all of these
-    // descendants as well.
-    uint64_t nCountWithDescendants;  //!< number of descendant transactions
-    uint64_t nSizeWithDescendants;   //!< ... and size
-    CAmount nModFeesWithDescendants; //!< ... and total fees (all including us)
+    // Created by CTxMemPool::UpdateLinks() when the first parent or child is
+    // linked, and kept until the entry leaves the mempool.
+    mutable std::unique_ptr<Relatives> m_relatives;
 
-    // Analogous statistics for ancestor transactions
-    uint64_t nCountWithAncestors;
-    uint64_t nSizeWithAncestors;
-    CAmount nModFeesWithAncestors;
-    int64_t nSigOpCostWithAncestors;
+    const uint32_t nTxWeight;       //!< ... and avoid recomputing tx weight (also used for GetTxSize())
+    const uint32_t nUsageSize;      //!< ... and total memory usage
+    const unsigned int entryHeight; //!< Chain height when entering the mempool
+    const int32_t sigOpCost;        //!< Total sigop cost
+    const bool spendsCoinbase;      //!< keep track of transactions that spend a coinbase
+
+    Relatives& GetRelatives() const;
+    /** Memory used by m_relatives, accounted by CTxMemPool as links. */
+    size_t RelativesUsage() const;
+
+    friend class CTxMemPool;
 
 public:
     CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFee,
                     int64_t _nTime, unsigned int _entryHeight,
                     bool spendsCoinbase,
                     int64_t nSigOpsCost, LockPoints lp);
+    CTxMemPoolEntry(const CTxMemPoolEntry& other);
 
     const CTransaction& GetTx() const { return *this->tx; }
     CTransactionRef GetSharedTx() const { return this->tx; }
@@ -119,18 +152,18 @@ public:
     // Update the LockPoints after a reorg
     void UpdateLockPoints(const LockPoints& lp);
 
-    uint64_t GetCountWithDescendants() const { return nCountWithDescendants; }
-    uint64_t GetSizeWithDescendants() const { return nSizeWithDescendants; }
-    CAmount GetModFeesWithDescendants() const { return nModFeesWithDescendants; }
+    uint64_t GetCountWithDescendants() const { return m_relatives ? m_relatives->nCountWithDescendants : 1; }
+    uint64_t GetSizeWithDescendants() const { return m_relatives ? m_relatives->nSizeWithDescendants : GetTxSize(); }
+    CAmount GetModFeesWithDescendants() const { return m_relatives ? m_relatives->nModFeesWithDescendants : GetModifiedFee(); }
 
     bool GetSpendsCoinbase() const { return spendsCoinbase; }
 
-    uint64_t GetCountWithAncestors() const { return nCountWithAncestors; }
-    uint64_t GetSizeWithAncestors() const { return nSizeWithAncestors; }
-    CAmount GetModFeesWithAncestors() const { return nModFeesWithAncestors; }
-    int64_t GetSigOpCostWithAncestors() const { return nSigOpCostWithAncestors; }
+    uint64_t GetCountWithAncestors() const { return m_relatives ? m_relatives->nCountWithAncestors : 1; }
+    uint64_t GetSizeWithAncestors() const { return m_relatives ? m_relatives->nSizeWithAncestors : GetTxSize(); }
+    CAmount GetModFeesWithAncestors() const { return m_relatives ? m_relatives->nModFeesWithAncestors : GetModifiedFee(); }
+    int64_t GetSigOpCostWithAncestors() const { return m_relatives ? m_relatives->nSigOpCostWithAncestors : sigOpCost; }
 
-    mutable size_t vTxHashesIdx; //!< Index in mempool's vTxHashes
+    mutable uint64_t m_epoch{0}; //!< Last traversal epoch of the mempool in which this entry was visited
 };
 
 // Helpers for modifying CTxMemPool::mapTx, which is a boost multi_index.
@@ -341,6 +374,42 @@ struct TxMempoolInfo
     int64_t nFeeDelta;
 };
 
+/**
+ * Snapshot of what CTxMemPool::CompareDepthAndScore orders by, so that many
+ * transactions can be sorted for relay without taking the mempool lock for
+ * every comparison.
+ */
+struct TxRelayInfo
+{
+    TxMempoolInfo info;
+
+    /** Number of in-mempool ancestors, including the transaction itself. */
+    uint64_t nCountWithAncestors;
+
+    /** Fee (without prioritisation, see CompareTxMemPoolEntryByScore) and size. */
+    CAmount nFee;
+    size_t nTxSize;
+};
+
+/** Same order as CTxMemPool::CompareDepthAndScore: fewest ancestors first,
+ *  then highest feerate. */
+class CompareTxRelayInfo
+{
+public:
+    bool operator()(const TxRelayInfo& a, const TxRelayInfo& b) const
+    {
+        if (a.nCountWithAncestors != b.nCountWithAncestors) {
+            return a.nCountWithAncestors < b.nCountWithAncestors;
+        }
+        double f1 = (double)a.nFee * b.nTxSize;
+        double f2 = (double)b.nFee * a.nTxSize;
+        if (f1 == f2) {
+            return b.info.tx->GetHash() < a.info.tx->GetHash();
+        }
+        return f1 > f2;
+    }
+};
+
 /** Reason why a transaction was removed from the mempool,
  * this is passed to the notification signal.
  */
@@ -395,7 +464,7 @@ public:
  *
  * In order for the feerate sort to remain correct, we must update transactions
  * in the mempool when new descendants arrive.  To facilitate this, we track
- * the set of in-mempool direct parents and direct children in mapLinks.  Within
+ * the set of in-mempool direct parents and direct children in each entry.  Within
  * each CTxMemPoolEntry, we track the size and fees of all descendants.
  *
  * Usually when a new transaction is added to the mempool, it has no in-mempool
@@ -428,7 +497,7 @@ public:
  * state, to account for in-mempool, out-of-block descendants for all the
  * in-block transactions by calling UpdateTransactionsFromBlock().  Note that
  * until this is called, the mempool state is not consistent, and in particular
- * mapLinks may not be correct (and therefore functions like
+ * the entries' parent and child links may not be correct (and therefore functions like
  * CalculateMemPoolAncestors() and CalculateDescendants() that rely
  * on them to walk the mempool are not generally safe to use).
  *
@@ -449,6 +518,7 @@ private:
 
     uint64_t totalTxSize;      //!< sum of all mempool tx's virtual sizes. Differs from serialized tx size since witness data is discounted. Defined in BIP 141.
     uint64_t cachedInnerUsage; //!< sum of dynamic memory usage of all the map elements (NOT the maps themselves)
+    uint64_t cachedLinksUsage; //!< part of cachedInnerUsage spent on the Relatives of entries
 
     mutable int64_t lastRollingFeeUpdate;
     mutable bool blockSinceLastRollingFeeBump;
@@ -519,7 +589,6 @@ public:
     indexed_transaction_set mapTx GUARDED_BY(cs);
 
     using txiter = indexed_transaction_set::nth_index<0>::type::const_iterator;
-    std::vector<std::pair<uint256, txiter>> vTxHashes GUARDED_BY(cs); //!< All tx witness hashes/entries in mapTx, in random order
 
     struct CompareIteratorByHash {
         bool operator()(const txiter &a, const txiter &b) const {
@@ -528,20 +597,62 @@ public:
     };
     typedef std::set<txiter, CompareIteratorByHash> setEntries;
 
-    const setEntries & GetMemPoolParents(txiter entry) const EXCLUSIVE_LOCKS_REQUIRED(cs);
-    const setEntries & GetMemPoolChildren(txiter entry) const EXCLUSIVE_LOCKS_REQUIRED(cs);
+    /** Range over the direct in-mempool parents or children of an entry. */
+    class LinkRange
+    {
+    public:
+        class const_iterator
+        {
+            const CTxMemPool* m_pool;
+            CTxMemPoolEntry::Links::const_iterator m_it;
+        public:
+            typedef std::forward_iterator_tag iterator_category;
+            typedef txiter value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef const txiter* pointer;
+            typedef txiter reference;
+
+            const_iterator(const CTxMemPool* pool, CTxMemPoolEntry::Links::const_iterator it) : m_pool(pool), m_it(it) {}
+            // Only dereferenced while cs is held, see GetMemPoolParents().
+            txiter operator*() const NO_THREAD_SAFETY_ANALYSIS { return m_pool->mapTx.iterator_to(**m_it); }
+            const_iterator& operator++() { ++m_it; return *this; }
+            bool operator==(const const_iterator& other) const { return m_it == other.m_it; }
+            bool operator!=(const const_iterator& other) const { return m_it != other.m_it; }
+        };
+
+        LinkRange(const CTxMemPool& pool, CTxMemPoolEntry::Links::const_iterator begin, CTxMemPoolEntry::Links::const_iterator end) : m_pool(pool), m_begin(begin), m_end(end) {}
+        const_iterator begin() const { return const_iterator(&m_pool, m_begin); }
+        const_iterator end() const { return const_iterator(&m_pool, m_end); }
+        size_t size() const { return m_end - m_begin; }
+        bool empty() const { return m_begin == m_end; }
+
+    private:
+        const CTxMemPool& m_pool;
+        const CTxMemPoolEntry::Links::const_iterator m_begin;
+        const CTxMemPoolEntry::Links::const_iterator m_end;
+    };
+
+    LinkRange GetMemPoolParents(txiter entry) const EXCLUSIVE_LOCKS_REQUIRED(cs);
+    LinkRange GetMemPoolChildren(txiter entry) const EXCLUSIVE_LOCKS_REQUIRED(cs);
     uint64_t CalculateDescendantMaximum(txiter entry) const EXCLUSIVE_LOCKS_REQUIRED(cs);
-private:
-    typedef std::map<txiter, setEntries, CompareIteratorByHash> cacheMap;
 
-    struct TxLinks {
-        setEntries parents;
-        setEntries children;
+    /** Dynamic memory usage of the mempool, broken down by what it is used for. */
+    struct MemoryUsage
+    {
+        size_t entries{0};      //!< mapTx, including the entries themselves
+        size_t transactions{0}; //!< The transactions referenced by the entries
+        size_t links{0};        //!< Parent and child links and package state of entries with relatives
+        size_t spends{0};       //!< mapNextTx
+        size_t deltas{0};       //!< mapDeltas
+
+        size_t Total() const { return entries + transactions + links + spends + deltas; }
     };
+    MemoryUsage GetMemoryUsage() const;
 
-    typedef std::map<txiter, TxLinks, CompareIteratorByHash> txlinksMap;
-    txlinksMap mapLinks;
+private:
+    typedef std::map<txiter, setEntries, CompareIteratorByHash> cacheMap;
 
+    void UpdateLinks(txiter entry, txiter other, bool parent, bool add);
     void UpdateParent(txiter entry, txiter parent, bool add);
     void UpdateChild(txiter entry, txiter child, bool add);
 
@@ -693,6 +804,9 @@ public:
     CTransactionRef get(const uint256& hash) const;
     TxMempoolInfo info(const uint256& hash) const;
     std::vector<TxMempoolInfo> infoAll() const;
+    /** Look up relay ordering information for all of hashes under a single
+     *  lock. Transactions not in the mempool get an entry with a null tx. */
+    std::vector<TxRelayInfo> relayInfo(const std::vector<uint256>& hashes) const;
 
     size_t DynamicMemoryUsage() const;
 
@@ -736,6 +850,35 @@ private:
      *  removal.
      */
     void removeUnchecked(txiter entry, MemPoolRemovalReason reason = MemPoolRemovalReason::UNKNOWN) EXCLUSIVE_LOCKS_REQUIRED(cs);
+
+    /** Current traversal epoch, see EpochGuard. */
+    mutable uint64_t m_epoch GUARDED_BY(cs){0};
+    mutable bool m_has_epoch_guard GUARDED_BY(cs){false};
+
+    /**
+     * Starts a fresh traversal epoch for as long as it is in scope. Within an
+     * epoch, visited() marks entries instead of collecting them in a
+     * setEntries, so graph walks do not allocate per visited entry.
+     * Epochs can not be nested.
+     */
+    class EpochGuard
+    {
+        const CTxMemPool& pool;
+    public:
+        explicit EpochGuard(const CTxMemPool& in);
+        ~EpochGuard();
+        EpochGuard(const EpochGuard&) = delete;
+        EpochGuard& operator=(const EpochGuard&) = delete;
+    };
+
+    /** Mark it as visited in the current epoch. Returns whether it had already been visited. */
+    bool visited(txiter it) const EXCLUSIVE_LOCKS_REQUIRED(cs)
+    {
+        assert(m_has_epoch_guard);
+        const bool ret = it->m_epoch >= m_epoch;
+        it->m_epoch = std::max(it->m_epoch, m_epoch);
+        return ret;
+    }
 };
 
 /**
@@ -808,6 +951,9 @@ struct DisconnectedBlockTransactions {
 
     indexed_disconnected_transactions queuedTx;
     uint64_t cachedInnerUsage = 0;
+    // Script verification flags that the scripts of all blocks the queued
+    // transactions came from were verified with.
+    unsigned int nScriptVerifiedFlags = ~0U;
 
     // Estimate the overhead of queuedTx to be 6 pointers + an allocation, as
     // no exact formula for boost::multi_index_contained is implemented.
@@ -847,6 +993,7 @@ struct DisconnectedBlockTransactions {
     void clear()
     {
         cachedInnerUsage = 0;
+        nScriptVerifiedFlags = ~0U;
         queuedTx.clear();
     }
 };
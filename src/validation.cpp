@@ -18,8 +18,10 @@
 #include <flatfile.h>
 #include <hash.h>
 #include <index/txindex.h>
+#include <mempooljournal.h>
 #include <policy/fees.h>
 #include <policy/policy.h>
+#include <policy/rbf.h>
 #include <policy/settings.h>
 #include <pow.h>
 #include <primitives/block.h>
@@ -46,9 +48,11 @@
 #include <validationinterface.h>
 #include <warnings.h>
 
+#include <cmath>
 #include <future>
 #include <sstream>
 #include <string>
+#include <unordered_map>
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/thread.hpp>
@@ -328,56 +332,82 @@ static bool IsCurrentForFeeEstimation() EXCLUSIVE_LOCKS_REQUIRED(cs_main)
     return true;
 }
 
-/* Make mempool consistent after a reorg, by re-adding or recursively erasing
- * disconnected block transactions from the mempool, and also removing any
- * other transactions from the mempool that are no longer valid given the new
- * tip/height.
- *
- * Note: we assume that disconnectpool only contains transactions that are NOT
- * confirmed in the current chain nor already in the mempool (otherwise,
- * in-mempool descendants of such transactions would be removed).
- *
- * Passing fAddToMempool=false will skip trying to add the transactions back,
- * and instead just erase from the mempool as needed.
+static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+
+namespace {
+/** Exponentially decaying rate of mempool acceptances. */
+Mutex g_accept_rate_mutex;
+double g_accept_rate GUARDED_BY(g_accept_rate_mutex) = 0.0;
+int64_t g_accept_rate_time GUARDED_BY(g_accept_rate_mutex) = 0;
+} // namespace
+
+/** Time constant of the smoothed mempool acceptance rate, in seconds */
+static constexpr double ACCEPT_RATE_WINDOW = 60.0;
+
+static void RecordMempoolAccept(int64_t now_micros)
+{
+    LOCK(g_accept_rate_mutex);
+    g_accept_rate = g_accept_rate * std::exp(-(now_micros - g_accept_rate_time) * MICRO / ACCEPT_RATE_WINDOW) + 1.0 / ACCEPT_RATE_WINDOW;
+    g_accept_rate_time = now_micros;
+}
+
+double GetMempoolAcceptRate()
+{
+    LOCK(g_accept_rate_mutex);
+    if (g_accept_rate_time == 0) return 0.0;
+    return g_accept_rate * std::exp(-(GetTimeMicros() - g_accept_rate_time) * MICRO / ACCEPT_RATE_WINDOW);
+}
+
+/**
+ * Context-free checks of a mempool candidate. They need neither the chain nor
+ * the mempool, so they are done before taking the mempool lock.
  */
+static bool PreCheckTransaction(const CTransaction& tx, CValidationState& state)
+{
+    if (!CheckTransaction(tx, state))
+        return false; // state filled in by CheckTransaction
 
-static void UpdateMempoolForReorg(DisconnectedBlockTransactions& disconnectpool, bool fAddToMempool) EXCLUSIVE_LOCKS_REQUIRED(cs_main, ::mempool.cs)
+    // Coinbase is only valid in a block, not as a loose transaction
+    if (tx.IsCoinBase())
+        return state.Invalid(ValidationInvalidReason::CONSENSUS, false, REJECT_INVALID, "coinbase");
+
+    // Rather not work on nonstandard transactions (unless -testnet/-regtest)
+    std::string reason;
+    if (fRequireStandard && !IsStandardTx(tx, reason))
+        return state.Invalid(ValidationInvalidReason::TX_NOT_STANDARD, false, REJECT_NONSTANDARD, reason);
+
+    // Do not work on transactions that are too small.
+    // A transaction with 1 segwit input and 1 P2WPHK output has non-witness size of 82 bytes.
+    // Transactions smaller than this are not relayed to reduce unnecessary malloc overhead.
+    if (::GetSerializeSize(tx, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS) < MIN_STANDARD_TX_NONWITNESS_SIZE)
+        return state.Invalid(ValidationInvalidReason::TX_NOT_STANDARD, false, REJECT_NONSTANDARD, "tx-size-small");
+
+    return true;
+}
+
+/**
+ * Verify the input scripts of a mempool candidate, spreading the inputs over
+ * the script check threads. The coins are all in view already, so this does
+ * not touch the mempool. If verification fails, the inputs are checked again
+ * serially so that state describes the first failing input exactly as a
+ * serial check would.
+ */
+static bool CheckInputsParallel(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& view, unsigned int flags, PrecomputedTransactionData& txdata) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
-    AssertLockHeld(cs_main);
-    std::vector<uint256> vHashUpdate;
-    // disconnectpool's insertion_order index sorts the entries from
-    // oldest to newest, but the oldest entry will be the last tx from the
-    // latest mined block that was disconnected.
-    // Iterate disconnectpool in reverse, so that we add transactions
-    // back to the mempool starting with the earliest transaction that had
-    // been previously seen in a block.
-    auto it = disconnectpool.queuedTx.get<insertion_order>().rbegin();
-    while (it != disconnectpool.queuedTx.get<insertion_order>().rend()) {
-        // ignore validation errors in resurrected transactions
-        CValidationState stateDummy;
-        if (!fAddToMempool || (*it)->IsCoinBase() ||
-            !AcceptToMemoryPool(mempool, stateDummy, *it, nullptr /* pfMissingInputs */,
-                nullptr /* plTxnReplaced */, true /* bypass_limits */, 0 /* nAbsurdFee */)) {
-            // If the transaction doesn't make it in to the mempool, remove any
-            // transactions that depend on it (which would now be orphans).
-            mempool.removeRecursive(**it, MemPoolRemovalReason::REORG);
-        } else if (mempool.exists((*it)->GetHash())) {
-            vHashUpdate.push_back((*it)->GetHash());
-        }
-        ++it;
+    if (!nScriptCheckThreads || tx.vin.size() < 2) {
+        return CheckInputs(tx, state, view, true, flags, true, false, txdata);
     }
-    disconnectpool.queuedTx.clear();
-    // AcceptToMemoryPool/addUnchecked all assume that new mempool entries have
-    // no in-mempool children, which is generally not true when adding
-    // previously-confirmed transactions back to the mempool.
-    // UpdateTransactionsFromBlock finds descendants of any transactions in
-    // the disconnectpool that were added back and cleans up the mempool state.
-    mempool.UpdateTransactionsFromBlock(vHashUpdate);
 
-    // We also need to remove any now-immature transactions
-    mempool.removeForReorg(pcoinsTip.get(), ::ChainActive().Tip()->nHeight + 1, STANDARD_LOCKTIME_VERIFY_FLAGS);
-    // Re-limit mempool size, in case we added any transactions
-    LimitMempoolSize(mempool, gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, gArgs.GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
+    std::vector<CScriptCheck> vChecks;
+    if (!CheckInputs(tx, state, view, true, flags, true, false, txdata, &vChecks)) {
+        return false;
+    }
+    CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+    control.Add(vChecks);
+    if (control.Wait()) {
+        return true;
+    }
+    return CheckInputs(tx, state, view, true, flags, true, false, txdata);
 }
 
 // Used to avoid mempool polluting consensus critical paths if CCoinsViewMempool
@@ -386,30 +416,31 @@ static bool CheckInputsFromMempoolAndCache(const CTransaction& tx, CValidationSt
 {
     AssertLockHeld(cs_main);
 
-    // pool.cs should be locked already, but go ahead and re-take the lock here
-    // to enforce that mempool doesn't change between when we check the view
-    // and when we actually call through to CheckInputs
-    LOCK(pool.cs);
-
     assert(!tx.IsCoinBase());
-    for (const CTxIn& txin : tx.vin) {
-        const Coin& coin = view.AccessCoin(txin.prevout);
-
-        // At this point we haven't actually checked if the coins are all
-        // available (or shouldn't assume we have, since CheckInputs does).
-        // So we just return failure if the inputs are not available here,
-        // and then only have to check equivalence for available inputs.
-        if (coin.IsSpent()) return false;
-
-        const CTransactionRef& txFrom = pool.get(txin.prevout.hash);
-        if (txFrom) {
-            assert(txFrom->GetHash() == txin.prevout.hash);
-            assert(txFrom->vout.size() > txin.prevout.n);
-            assert(txFrom->vout[txin.prevout.n] == coin.out);
-        } else {
-            const Coin& coinFromDisk = pcoinsTip->AccessCoin(txin.prevout);
-            assert(!coinFromDisk.IsSpent());
-            assert(coinFromDisk.out == coin.out);
+    {
+        // The mempool only changes under cs_main, so it cannot change between
+        // when we check the view and when we actually call through to
+        // CheckInputs, which runs without pool.cs.
+        LOCK(pool.cs);
+        for (const CTxIn& txin : tx.vin) {
+            const Coin& coin = view.AccessCoin(txin.prevout);
+
+            // At this point we haven't actually checked if the coins are all
+            // available (or shouldn't assume we have, since CheckInputs does).
+            // So we just return failure if the inputs are not available here,
+            // and then only have to check equivalence for available inputs.
+            if (coin.IsSpent()) return false;
+
+            const CTransactionRef& txFrom = pool.get(txin.prevout.hash);
+            if (txFrom) {
+                assert(txFrom->GetHash() == txin.prevout.hash);
+                assert(txFrom->vout.size() > txin.prevout.n);
+                assert(txFrom->vout[txin.prevout.n] == coin.out);
+            } else {
+                const Coin& coinFromDisk = pcoinsTip->AccessCoin(txin.prevout);
+                assert(!coinFromDisk.IsSpent());
+                assert(coinFromDisk.out == coin.out);
+            }
         }
     }
 
@@ -422,34 +453,24 @@ static bool CheckInputsFromMempoolAndCache(const CTransaction& tx, CValidationSt
  *                                for mempool acceptance. This allows the caller to optionally
  *                                remove the cache additions if the associated transaction ends
  *                                up being rejected by the mempool.
+ * @param[in]  scripts_verified   Skip verifying the scripts, because the transaction was verified
+ *                                with at least the policy and current block script flags before.
  */
-static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool& pool, CValidationState& state, const CTransactionRef& ptx, bool* pfMissingInputs, int64_t nAcceptTime, std::list<CTransactionRef>* plTxnReplaced, bool bypass_limits, const CAmount& nAbsurdFee, std::vector<COutPoint>& coins_to_uncache, bool test_accept) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool& pool, CValidationState& state, const CTransactionRef& ptx, bool* pfMissingInputs, int64_t nAcceptTime, std::list<CTransactionRef>* plTxnReplaced, bool bypass_limits, const CAmount& nAbsurdFee, std::vector<COutPoint>& coins_to_uncache, bool test_accept, bool scripts_verified = false) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
     const CTransaction& tx = *ptx;
     const uint256 hash = tx.GetHash();
     AssertLockHeld(cs_main);
-    LOCK(pool.cs); // mempool "read lock" (held through GetMainSignals().TransactionAddedToMempool())
     if (pfMissingInputs) {
         *pfMissingInputs = false;
     }
 
-    if (!CheckTransaction(tx, state))
-        return false; // state filled in by CheckTransaction
-
-    // Coinbase is only valid in a block, not as a loose transaction
-    if (tx.IsCoinBase())
-        return state.Invalid(ValidationInvalidReason::CONSENSUS, false, REJECT_INVALID, "coinbase");
+    int64_t nTimeStart = GetTimeMicros();
 
-    // Rather not work on nonstandard transactions (unless -testnet/-regtest)
-    std::string reason;
-    if (fRequireStandard && !IsStandardTx(tx, reason))
-        return state.Invalid(ValidationInvalidReason::TX_NOT_STANDARD, false, REJECT_NONSTANDARD, reason);
+    if (!PreCheckTransaction(tx, state))
+        return false; // state filled in by PreCheckTransaction
 
-    // Do not work on transactions that are too small.
-    // A transaction with 1 segwit input and 1 P2WPHK output has non-witness size of 82 bytes.
-    // Transactions smaller than this are not relayed to reduce unnecessary malloc overhead.
-    if (::GetSerializeSize(tx, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS) < MIN_STANDARD_TX_NONWITNESS_SIZE)
-        return state.Invalid(ValidationInvalidReason::TX_NOT_STANDARD, false, REJECT_NONSTANDARD, "tx-size-small");
+    WAIT_LOCK(pool.cs, pool_lock); // mempool "read lock" (held through GetMainSignals().TransactionAddedToMempool(), except around the script checks)
 
     // Only accept nLockTime-using transactions that can be mined in the next
     // block; we don't want our mempool filled up with transactions that can't
@@ -672,17 +693,7 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
             // This potentially overestimates the number of actual descendants
             // but we just want to be conservative to avoid doing too much
             // work.
-            if (nConflictingCount <= maxDescendantsToVisit) {
-                // If not too many to replace, then calculate the set of
-                // transactions that would have to be evicted
-                for (CTxMemPool::txiter it : setIterConflicting) {
-                    pool.CalculateDescendants(it, allConflicting);
-                }
-                for (CTxMemPool::txiter it : allConflicting) {
-                    nConflictingFees += it->GetModifiedFee();
-                    nConflictingSize += it->GetTxSize();
-                }
-            } else {
+            if (nConflictingCount > maxDescendantsToVisit) {
                 return state.Invalid(ValidationInvalidReason::TX_MEMPOOL_POLICY, false, REJECT_NONSTANDARD, "too many potential replacements",
                     strprintf("rejecting replacement %s; too many potential replacements (%d > %d)\n",
                         hash.ToString(),
@@ -690,6 +701,13 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
                         maxDescendantsToVisit));
             }
 
+            // If not too many to replace, then determine what would have to
+            // be evicted. The set of evicted transactions itself is only
+            // needed once the replacement is accepted.
+            const ReplacementCost cost = GetReplacementCost(pool, setIterConflicting, allConflicting);
+            nConflictingFees = cost.nModFees;
+            nConflictingSize = cost.nSize;
+
             for (unsigned int j = 0; j < tx.vin.size(); j++) {
                 // We don't want to accept replacements that require low
                 // feerate junk to be mined first. Ideally we'd keep track of
@@ -730,51 +748,68 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
 
         constexpr unsigned int scriptVerifyFlags = STANDARD_SCRIPT_VERIFY_FLAGS;
 
+        int64_t nTimePolicy = GetTimeMicros();
+
         // Check against previous transactions
         // This is done last to help prevent CPU exhaustion denial-of-service attacks.
-        PrecomputedTransactionData txdata(tx);
-        if (!CheckInputs(tx, state, view, true, scriptVerifyFlags, true, false, txdata)) {
-            // SCRIPT_VERIFY_CLEANSTACK requires SCRIPT_VERIFY_WITNESS, so we
-            // need to turn both off, and compare against just turning off CLEANSTACK
-            // to see if the failure is specifically due to witness validation.
-            CValidationState stateDummy; // Want reported failures to be from first CheckInputs
-            if (!tx.HasWitness() && CheckInputs(tx, stateDummy, view, true, scriptVerifyFlags & ~(SCRIPT_VERIFY_WITNESS | SCRIPT_VERIFY_CLEANSTACK), true, false, txdata) &&
-                !CheckInputs(tx, stateDummy, view, true, scriptVerifyFlags & ~SCRIPT_VERIFY_CLEANSTACK, true, false, txdata)) {
-                // Only the witness is missing, so the transaction itself may be fine.
-                state.Invalid(ValidationInvalidReason::TX_WITNESS_MUTATED, false,
-                    state.GetRejectCode(), state.GetRejectReason(), state.GetDebugMessage());
+        if (!scripts_verified) {
+            // Let mempool readers in while the scripts run. Every coin the
+            // checks need is in view already, and the mempool only changes
+            // under cs_main, which we still hold, so the conflicts and
+            // ancestors found above remain valid once pool.cs is retaken.
+            REVERSE_LOCK(pool_lock);
+
+            PrecomputedTransactionData txdata(tx);
+            if (!CheckInputsParallel(tx, state, view, scriptVerifyFlags, txdata)) {
+                // SCRIPT_VERIFY_CLEANSTACK requires SCRIPT_VERIFY_WITNESS, so we
+                // need to turn both off, and compare against just turning off CLEANSTACK
+                // to see if the failure is specifically due to witness validation.
+                CValidationState stateDummy; // Want reported failures to be from first CheckInputs
+                if (!tx.HasWitness() && CheckInputs(tx, stateDummy, view, true, scriptVerifyFlags & ~(SCRIPT_VERIFY_WITNESS | SCRIPT_VERIFY_CLEANSTACK), true, false, txdata) &&
+                    !CheckInputs(tx, stateDummy, view, true, scriptVerifyFlags & ~SCRIPT_VERIFY_CLEANSTACK, true, false, txdata)) {
+                    // Only the witness is missing, so the transaction itself may be fine.
+                    state.Invalid(ValidationInvalidReason::TX_WITNESS_MUTATED, false,
+                        state.GetRejectCode(), state.GetRejectReason(), state.GetDebugMessage());
+                }
+                assert(IsTransactionReason(state.GetReason()));
+                return false; // state filled in by CheckInputs
+            }
+
+            // Check again against the current block tip's script verification
+            // flags to cache our script execution flags. This is, of course,
+            // useless if the next block has different script flags from the
+            // previous one, but because the cache tracks script flags for us it
+            // will auto-invalidate and we'll just have a few blocks of extra
+            // misses on soft-fork activation.
+            //
+            // This is also useful in case of bugs in the standard flags that cause
+            // transactions to pass as valid when they're actually invalid. For
+            // instance the STRICTENC flag was incorrectly allowing certain
+            // CHECKSIG NOT scripts to pass, even though they were invalid.
+            //
+            // There is a similar check in CreateNewBlock() to prevent creating
+            // invalid blocks (using TestBlockValidity), however allowing such
+            // transactions into the mempool can be exploited as a DoS attack.
+            unsigned int currentBlockScriptVerifyFlags = GetBlockScriptFlags(::ChainActive().Tip(), chainparams.GetConsensus());
+            if (!CheckInputsFromMempoolAndCache(tx, state, view, pool, currentBlockScriptVerifyFlags, true, txdata)) {
+                return error("%s: BUG! PLEASE REPORT THIS! CheckInputs failed against latest-block but not STANDARD flags %s, %s",
+                    __func__, hash.ToString(), FormatStateMessage(state));
             }
-            assert(IsTransactionReason(state.GetReason()));
-            return false; // state filled in by CheckInputs
-        }
-
-        // Check again against the current block tip's script verification
-        // flags to cache our script execution flags. This is, of course,
-        // useless if the next block has different script flags from the
-        // previous one, but because the cache tracks script flags for us it
-        // will auto-invalidate and we'll just have a few blocks of extra
-        // misses on soft-fork activation.
-        //
-        // This is also useful in case of bugs in the standard flags that cause
-        // transactions to pass as valid when they're actually invalid. For
-        // instance the STRICTENC flag was incorrectly allowing certain
-        // CHECKSIG NOT scripts to pass, even though they were invalid.
-        //
-        // There is a similar check in CreateNewBlock() to prevent creating
-        // invalid blocks (using TestBlockValidity), however allowing such
-        // transactions into the mempool can be exploited as a DoS attack.
-        unsigned int currentBlockScriptVerifyFlags = GetBlockScriptFlags(::ChainActive().Tip(), chainparams.GetConsensus());
-        if (!CheckInputsFromMempoolAndCache(tx, state, view, pool, currentBlockScriptVerifyFlags, true, txdata)) {
-            return error("%s: BUG! PLEASE REPORT THIS! CheckInputs failed against latest-block but not STANDARD flags %s, %s",
-                __func__, hash.ToString(), FormatStateMessage(state));
         }
 
+        int64_t nTimeScripts = GetTimeMicros();
+
         if (test_accept) {
             // Tx was accepted, but not added
             return true;
         }
 
         // Remove conflicting transactions from the mempool
+        if (fReplacementTransaction) {
+            for (CTxMemPool::txiter it : pool.GetIterSet(setConflicts)) {
+                pool.CalculateDescendants(it, allConflicting);
+            }
+        }
         for (CTxMemPool::txiter it : allConflicting) {
             LogPrint(BCLog::MEMPOOL, "replacing tx %s with %s for %s VC additional fees, %d delta bytes\n",
                 it->GetTx().GetHash().ToString(),
@@ -802,6 +837,11 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
             if (!pool.exists(hash))
                 return state.Invalid(ValidationInvalidReason::TX_MEMPOOL_POLICY, false, REJECT_INSUFFICIENTFEE, "mempool full");
         }
+
+        int64_t nTimeEnd = GetTimeMicros();
+        RecordMempoolAccept(nTimeEnd);
+        LogPrint(BCLog::BENCH, "AcceptToMemoryPool: %s checks %.2fms, %u txins %.2fms, insert %.2fms (%.2f tx/s)\n", hash.ToString(),
+            MILLI * (nTimePolicy - nTimeStart), (unsigned)tx.vin.size(), MILLI * (nTimeScripts - nTimePolicy), MILLI * (nTimeEnd - nTimeScripts), GetMempoolAcceptRate());
     }
 
     GetMainSignals().TransactionAddedToMempool(ptx);
@@ -835,6 +875,84 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
     return AcceptToMemoryPoolWithTime(chainparams, pool, state, tx, pfMissingInputs, GetTime(), plTxnReplaced, bypass_limits, nAbsurdFee, test_accept);
 }
 
+/* Make mempool consistent after a reorg, by re-adding or recursively erasing
+ * disconnected block transactions from the mempool, and also removing any
+ * other transactions from the mempool that are no longer valid given the new
+ * tip/height.
+ *
+ * Note: we assume that disconnectpool only contains transactions that are NOT
+ * confirmed in the current chain nor already in the mempool (otherwise,
+ * in-mempool descendants of such transactions would be removed).
+ *
+ * Passing fAddToMempool=false will skip trying to add the transactions back,
+ * and instead just erase from the mempool as needed.
+ *
+ * Transactions are re-accepted in one pass, flushing the coins cache only
+ * once. Scripts are not verified again if the scripts of all disconnected
+ * blocks were verified with the policy flags and every flag the current tip
+ * requires, which is the case when all their transactions came from the
+ * mempool (see CChainState::RecordScriptVerifiedFlags).
+ */
+static void UpdateMempoolForReorg(DisconnectedBlockTransactions& disconnectpool, bool fAddToMempool) EXCLUSIVE_LOCKS_REQUIRED(cs_main, ::mempool.cs)
+{
+    AssertLockHeld(cs_main);
+    const CChainParams& chainparams = Params();
+    const unsigned int required_flags = STANDARD_SCRIPT_VERIFY_FLAGS | GetBlockScriptFlags(::ChainActive().Tip(), chainparams.GetConsensus());
+    const bool scripts_verified = (required_flags & ~disconnectpool.nScriptVerifiedFlags) == 0;
+    const int64_t nAcceptTime = GetTime();
+    int64_t nTimeStart = GetTimeMicros();
+    unsigned int nAccepted = 0;
+    std::vector<uint256> vHashUpdate;
+    std::vector<COutPoint> coins_to_uncache;
+    // disconnectpool's insertion_order index sorts the entries from
+    // oldest to newest, but the oldest entry will be the last tx from the
+    // latest mined block that was disconnected.
+    // Iterate disconnectpool in reverse, so that we add transactions
+    // back to the mempool starting with the earliest transaction that had
+    // been previously seen in a block.
+    auto it = disconnectpool.queuedTx.get<insertion_order>().rbegin();
+    while (it != disconnectpool.queuedTx.get<insertion_order>().rend()) {
+        // ignore validation errors in resurrected transactions
+        CValidationState stateDummy;
+        coins_to_uncache.clear();
+        if (!fAddToMempool || (*it)->IsCoinBase() ||
+            !AcceptToMemoryPoolWorker(chainparams, mempool, stateDummy, *it, nullptr /* pfMissingInputs */, nAcceptTime,
+                nullptr /* plTxnReplaced */, true /* bypass_limits */, 0 /* nAbsurdFee */, coins_to_uncache,
+                false /* test_accept */, scripts_verified)) {
+            for (const COutPoint& outpoint : coins_to_uncache) {
+                pcoinsTip->Uncache(outpoint);
+            }
+            // If the transaction doesn't make it in to the mempool, remove any
+            // transactions that depend on it (which would now be orphans).
+            mempool.removeRecursive(**it, MemPoolRemovalReason::REORG);
+        } else if (mempool.exists((*it)->GetHash())) {
+            vHashUpdate.push_back((*it)->GetHash());
+            ++nAccepted;
+        }
+        ++it;
+    }
+    if (fAddToMempool) {
+        LogPrint(BCLog::BENCH, "- Re-accept %u/%u disconnected txs%s: %.2fms\n", nAccepted, disconnectpool.queuedTx.size(),
+            scripts_verified ? " without script checks" : "", MILLI * (GetTimeMicros() - nTimeStart));
+    }
+    disconnectpool.clear();
+    // AcceptToMemoryPool/addUnchecked all assume that new mempool entries have
+    // no in-mempool children, which is generally not true when adding
+    // previously-confirmed transactions back to the mempool.
+    // UpdateTransactionsFromBlock finds descendants of any transactions in
+    // the disconnectpool that were added back and cleans up the mempool state.
+    mempool.UpdateTransactionsFromBlock(vHashUpdate);
+
+    // We also need to remove any now-immature transactions
+    mempool.removeForReorg(pcoinsTip.get(), ::ChainActive().Tip()->nHeight + 1, STANDARD_LOCKTIME_VERIFY_FLAGS);
+    // Re-limit mempool size, in case we added any transactions
+    LimitMempoolSize(mempool, gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, gArgs.GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
+    // Keep the coins cache within its limits; AcceptToMemoryPool does this
+    // after every transaction
+    CValidationState stateDummy;
+    ::ChainstateActive().FlushStateToDisk(chainparams, stateDummy, FlushStateMode::PERIODIC);
+}
+
 /**
  * Return transaction in txOut, and if it was found inside a block, its hash is placed in hashBlock.
  * If blockIndex is provided, the transaction is fetched from the corresponding block.
@@ -1493,14 +1611,90 @@ static bool WriteUndoDataForBlock(const CBlockUndo& blockundo, CValidationState&
     return true;
 }
 
-static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
-
 void ThreadScriptCheck(int worker_num)
 {
     util::ThreadRename(strprintf("scriptch.%i", worker_num));
     scriptcheckqueue.Thread();
 }
 
+namespace {
+/**
+ * Closure representing the context-free part of checking one header of a
+ * headers batch: computing its hash and checking its proof of work.
+ */
+class CHeaderCheck
+{
+private:
+    const CBlockHeader* m_header;
+    const Consensus::Params* m_params;
+    uint256* m_hash;
+    char* m_valid;
+
+public:
+    CHeaderCheck() : m_header(nullptr), m_params(nullptr), m_hash(nullptr), m_valid(nullptr) {}
+    CHeaderCheck(const CBlockHeader& header, const Consensus::Params& params, uint256& hash, char& valid) :
+        m_header(&header), m_params(&params), m_hash(&hash), m_valid(&valid) {}
+
+    bool operator()()
+    {
+        *m_hash = m_header->GetHash();
+        *m_valid = CheckProofOfWork(*m_hash, m_header->nBits, *m_params);
+        return *m_valid;
+    }
+
+    void swap(CHeaderCheck& check)
+    {
+        std::swap(m_header, check.m_header);
+        std::swap(m_params, check.m_params);
+        std::swap(m_hash, check.m_hash);
+        std::swap(m_valid, check.m_valid);
+    }
+};
+} // namespace
+
+static CCheckQueue<CHeaderCheck> headercheckqueue(64);
+
+void ThreadHeaderCheck(int worker_num)
+{
+    util::ThreadRename(strprintf("headerch.%i", worker_num));
+    headercheckqueue.Thread();
+}
+
+/**
+ * Hash a batch of headers and check their proof of work, in parallel if header
+ * checking threads are running. Does not need cs_main.
+ *
+ * @returns the index of the first header with invalid proof of work, or
+ *          headers.size() if all of them are valid.
+ */
+static size_t CheckBlockHeadersPoW(const std::vector<CBlockHeader>& headers, std::vector<uint256>& hashes, const Consensus::Params& params)
+{
+    hashes.assign(headers.size(), uint256());
+    std::vector<char> valid(headers.size(), 0);
+
+    CCheckQueueControl<CHeaderCheck> control(nScriptCheckThreads ? &headercheckqueue : nullptr);
+    std::vector<CHeaderCheck> vChecks;
+    vChecks.reserve(headers.size());
+    for (size_t i = 0; i < headers.size(); ++i) {
+        vChecks.emplace_back(headers[i], params, hashes[i], valid[i]);
+    }
+    if (!nScriptCheckThreads) {
+        for (CHeaderCheck& check : vChecks) check();
+    } else {
+        control.Add(vChecks);
+        if (control.Wait()) return headers.size();
+    }
+
+    // The queue stops running checks after the first failure, so headers that
+    // are not marked valid may just not have been looked at.
+    for (size_t i = 0; i < headers.size(); ++i) {
+        if (valid[i]) continue;
+        CHeaderCheck check(headers[i], params, hashes[i], valid[i]);
+        if (!check()) return i;
+    }
+    return headers.size();
+}
+
 VersionBitsCache versionVCscache GUARDED_BY(cs_main);
 
 int32_t ComputeBlockVersion(const CBlockIndex* pindexPrev, const Consensus::Params& params)
@@ -1921,6 +2115,8 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
         setDirtyBlockIndex.insert(pindex);
     }
 
+    RecordScriptVerifiedFlags(block, pindex, fScriptChecks ? flags : 0);
+
     assert(pindex->phashBlock);
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
@@ -1936,6 +2132,29 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
     return true;
 }
 
+void CChainState::RecordScriptVerifiedFlags(const CBlock& block, const CBlockIndex* pindex, unsigned int flags)
+{
+    // Transactions that are in the mempool were verified with the policy
+    // flags when they were accepted, which include every consensus flag.
+    // The mempool is keyed by txid, so the witness must match as well: a
+    // block may carry the same transaction with a malleated witness.
+    bool all_in_mempool = true;
+    for (size_t i = 1; i < block.vtx.size() && all_in_mempool; ++i) {
+        CTransactionRef ptx = mempool.get(block.vtx[i]->GetHash());
+        all_in_mempool = ptx && ptx->GetWitnessHash() == block.vtx[i]->GetWitnessHash();
+    }
+    if (all_in_mempool) flags |= STANDARD_SCRIPT_VERIFY_FLAGS;
+
+    for (auto it = m_script_verified_flags.begin(); it != m_script_verified_flags.end();) {
+        if (it->first->nHeight + MAX_SCRIPT_VERIFIED_FLAGS_DEPTH < pindex->nHeight) {
+            it = m_script_verified_flags.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    m_script_verified_flags[pindex] = flags;
+}
+
 bool CChainState::FlushStateToDisk(
     const CChainParams& chainparams,
     CValidationState& state,
@@ -2171,6 +2390,8 @@ bool CChainState::DisconnectTip(CValidationState& state, const CChainParams& cha
         for (auto it = block.vtx.rbegin(); it != block.vtx.rend(); ++it) {
             disconnectpool->addTransaction(*it);
         }
+        auto verified = m_script_verified_flags.find(pindexDelete);
+        disconnectpool->nScriptVerifiedFlags &= verified != m_script_verified_flags.end() ? verified->second : 0;
         while (disconnectpool->DynamicMemoryUsage() > MAX_DISCONNECTED_TX_POOL_SIZE * 1000) {
             // Drop the earliest entry, and remove its children from the mempool.
             auto it = disconnectpool->queuedTx.get<insertion_order>().begin();
@@ -2179,6 +2400,8 @@ bool CChainState::DisconnectTip(CValidationState& state, const CChainParams& cha
         }
     }
 
+    m_script_verified_flags.erase(pindexDelete);
+
     m_chain.SetTip(pindexDelete->pprev);
 
     UpdateTip(pindexDelete->pprev, chainparams);
@@ -2797,23 +3020,25 @@ void ResetBlockFailureFlags(CBlockIndex* pindex)
 }
 
 CBlockIndex* CChainState::AddToBlockIndex(const CBlockHeader& block)
+{
+    return AddToBlockIndex(block, block.GetHash());
+}
+
+CBlockIndex* CChainState::AddToBlockIndex(const CBlockHeader& block, const uint256& hash)
 {
     AssertLockHeld(cs_main);
 
     // Check for duplicate
-    uint256 hash = block.GetHash();
     BlockMap::iterator it = mapBlockIndex.find(hash);
     if (it != mapBlockIndex.end())
         return it->second;
 
     // Construct new block index object
-    CBlockIndex* pindexNew = new CBlockIndex(block);
+    CBlockIndex* pindexNew = mapBlockIndex.emplace_index(hash, block).first->second;
     // We assign the sequence id to blocks only when the full data is available,
     // to avoid miners withholding blocks but broadcasting headers, to get a
     // competitive advantage.
     pindexNew->nSequenceId = 0;
-    BlockMap::iterator mi = mapBlockIndex.insert(std::make_pair(hash, pindexNew)).first;
-    pindexNew->phashBlock = &((*mi).first);
     BlockMap::iterator miPrev = mapBlockIndex.find(block.hashPrevBlock);
     if (miPrev != mapBlockIndex.end()) {
         pindexNew->pprev = (*miPrev).second;
@@ -3237,10 +3462,14 @@ static bool ContextualCheckBlock(const CBlock& block, CValidationState& state, c
 }
 
 bool CChainState::AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex)
+{
+    return AcceptBlockHeader(block, block.GetHash(), true, state, chainparams, ppindex);
+}
+
+bool CChainState::AcceptBlockHeader(const CBlockHeader& block, const uint256& hash, bool fCheckPOW, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex)
 {
     AssertLockHeld(cs_main);
     // Check for duplicate
-    uint256 hash = block.GetHash();
     BlockMap::iterator miSelf = mapBlockIndex.find(hash);
     CBlockIndex* pindex = nullptr;
     if (hash != chainparams.GetConsensus().hashGenesisBlock) {
@@ -3254,7 +3483,7 @@ bool CChainState::AcceptBlockHeader(const CBlockHeader& block, CValidationState&
             return true;
         }
 
-        if (!CheckBlockHeader(block, state, chainparams.GetConsensus()))
+        if (!CheckBlockHeader(block, state, chainparams.GetConsensus(), fCheckPOW))
             return error("%s: Consensus::CheckBlockHeader: %s, %s", __func__, hash.ToString(), FormatStateMessage(state));
 
         // Get prev block index
@@ -3307,7 +3536,7 @@ bool CChainState::AcceptBlockHeader(const CBlockHeader& block, CValidationState&
         }
     }
     if (pindex == nullptr)
-        pindex = AddToBlockIndex(block);
+        pindex = AddToBlockIndex(block, hash);
 
     if (ppindex)
         *ppindex = pindex;
@@ -3321,11 +3550,20 @@ bool CChainState::AcceptBlockHeader(const CBlockHeader& block, CValidationState&
 bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex, CBlockHeader* first_invalid)
 {
     if (first_invalid != nullptr) first_invalid->SetNull();
+
+    // Hash the whole batch and check its proof of work before taking cs_main,
+    // so that only the contextual checks and the block index insertion are
+    // done under the lock.
+    std::vector<uint256> hashes;
+    const size_t first_bad_pow = CheckBlockHeadersPoW(headers, hashes, chainparams.GetConsensus());
     {
         LOCK(cs_main);
-        for (const CBlockHeader& header : headers) {
+        for (size_t i = 0; i < headers.size(); ++i) {
+            const CBlockHeader& header = headers[i];
             CBlockIndex* pindex = nullptr; // Use a temp pindex instead of ppindex to avoid a const_cast
-            if (!::ChainstateActive().AcceptBlockHeader(header, state, chainparams, &pindex)) {
+            // Headers up to the first one with bad proof of work are accepted as usual,
+            // that one is checked again below to produce the rejection.
+            if (!::ChainstateActive().AcceptBlockHeader(header, hashes[i], i == first_bad_pow, state, chainparams, &pindex)) {
                 if (first_invalid) *first_invalid = header;
                 return false;
             }
@@ -3469,9 +3707,12 @@ bool ProcessNewBlock(const CChainParams& chainparams, const std::shared_ptr<cons
                 assert(pblock->vtx.size() == 1);
                 assert(pblock->vtx[0]->nAssetNo == 0);
                 //assert(pblock->vtx[0]->vout[0].nValue == MAX_MONEY);
-                ::GetMainWallet()->SetMainAssetAddress(pblock->vtx[0]->vout[0].scriptPubKey);   
-                if (::IsMine(*::GetMainWallet(), pblock->vtx[0]->vout[0].scriptPubKey) == ISMINE_SPENDABLE) {
-                    ::uiInterface.NotifyMainAssetFound();
+                std::shared_ptr<CWallet> main_wallet = ::GetMainWallet();
+                if (main_wallet) {
+                    main_wallet->SetMainAssetAddress(pblock->vtx[0]->vout[0].scriptPubKey);
+                    if (::IsMine(*main_wallet, pblock->vtx[0]->vout[0].scriptPubKey) == ISMINE_SPENDABLE) {
+                        ::uiInterface.NotifyMainAssetFound();
+                    }
                 }
             }
         }
@@ -3709,17 +3950,8 @@ CBlockIndex* CChainState::InsertBlockIndex(const uint256& hash)
     if (hash.IsNull())
         return nullptr;
 
-    // Return existing
-    BlockMap::iterator mi = mapBlockIndex.find(hash);
-    if (mi != mapBlockIndex.end())
-        return (*mi).second;
-
-    // Create new
-    CBlockIndex* pindexNew = new CBlockIndex();
-    mi = mapBlockIndex.insert(std::make_pair(hash, pindexNew)).first;
-    pindexNew->phashBlock = &((*mi).first);
-
-    return pindexNew;
+    // Return existing or create new
+    return mapBlockIndex.emplace_index(hash).first->second;
 }
 
 bool CChainState::LoadBlockIndex(const Consensus::Params& consensus_params, CBlockTreeDB& blocktree)
@@ -4201,6 +4433,7 @@ void CChainState::UnloadBlockIndex()
 {
     nBlockSequenceId = 1;
     m_failed_blocks.clear();
+    m_script_verified_flags.clear();
     setBlockIndexCandidates.clear();
 }
 
@@ -4224,9 +4457,6 @@ void UnloadBlockIndex()
         warningcache[b].clear();
     }
 
-    for (const BlockMap::value_type& entry : mapBlockIndex) {
-        delete entry.second;
-    }
     mapBlockIndex.clear();
     fHavePruned = false;
 
@@ -4621,10 +4851,9 @@ int VersionBitsTipStateSinceHeight(const Consensus::Params& params, Consensus::D
 
 static const uint64_t MEMPOOL_DUMP_VERSION = 1;
 
-bool LoadMempool(CTxMemPool& pool)
+/** Read mempool.dat, as written by DumpMempool(). */
+static bool ReadMempoolDump(std::vector<PersistedMempoolTx>& txs, std::map<uint256, CAmount>& deltas)
 {
-    const CChainParams& chainparams = Params();
-    int64_t nExpiryTimeout = gArgs.GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60;
     FILE* filestr = fsbridge::fopen(GetDataDir() / "mempool.dat", "rb");
     CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
     if (file.IsNull()) {
@@ -4632,12 +4861,6 @@ bool LoadMempool(CTxMemPool& pool)
         return false;
     }
 
-    int64_t count = 0;
-    int64_t expired = 0;
-    int64_t failed = 0;
-    int64_t already_there = 0;
-    int64_t nNow = GetTime();
-
     try {
         uint64_t version;
         file >> version;
@@ -4647,54 +4870,141 @@ bool LoadMempool(CTxMemPool& pool)
         uint64_t num;
         file >> num;
         while (num--) {
-            CTransactionRef tx;
-            int64_t nTime;
-            int64_t nFeeDelta;
-            file >> tx;
-            file >> nTime;
-            file >> nFeeDelta;
-
-            CAmount amountdelta = nFeeDelta;
-            if (amountdelta) {
-                pool.PrioritiseTransaction(tx->GetHash(), amountdelta);
-            }
-            CValidationState state;
-            if (nTime + nExpiryTimeout > nNow) {
-                LOCK(cs_main);
-                AcceptToMemoryPoolWithTime(chainparams, pool, state, tx, nullptr /* pfMissingInputs */, nTime,
-                    nullptr /* plTxnReplaced */, false /* bypass_limits */, 0 /* nAbsurdFee */,
-                    false /* test_accept */);
-                if (state.IsValid()) {
-                    ++count;
-                } else {
-                    // mempool may contain the transaction already, e.g. from
-                    // wallet(s) having loaded it while we were processing
-                    // mempool transactions; consider these as valid, instead of
-                    // failed, but mark them as 'already there'
-                    if (pool.exists(tx->GetHash())) {
-                        ++already_there;
-                    } else {
-                        ++failed;
-                    }
-                }
-            } else {
-                ++expired;
-            }
+            PersistedMempoolTx entry;
+            file >> entry.tx;
+            file >> entry.nTime;
+            file >> entry.nFeeDelta;
+            txs.push_back(std::move(entry));
             if (ShutdownRequested())
                 return false;
         }
-        std::map<uint256, CAmount> mapDeltas;
-        file >> mapDeltas;
-
-        for (const auto& i : mapDeltas) {
-            pool.PrioritiseTransaction(i.first, i.second);
-        }
+        file >> deltas;
     } catch (const std::exception& e) {
         LogPrintf("Failed to deserialize mempool data on disk: %s. Continuing anyway.\n", e.what());
         return false;
     }
+    return true;
+}
+
+/**
+ * Verify the scripts of transactions about to be added back to the mempool on
+ * the script check threads, storing valid signatures in the signature cache,
+ * so that the serial AcceptToMemoryPool calls that follow mostly hit the
+ * cache. Inputs may spend the chain tip or earlier transactions in txs.
+ * Failures are ignored here; AcceptToMemoryPool reports them.
+ */
+static void PrevalidateMempoolTransactions(const std::vector<PersistedMempoolTx>& txs)
+{
+    if (!nScriptCheckThreads || txs.empty()) return;
+
+    std::unordered_map<uint256, const CTransaction*, SaltedTxidHasher> in_list;
+    for (const PersistedMempoolTx& entry : txs) {
+        in_list.emplace(entry.tx->GetHash(), entry.tx.get());
+    }
+
+    // Checks keep a pointer into txdata, so it must not reallocate.
+    std::vector<PrecomputedTransactionData> txdata;
+    txdata.reserve(txs.size());
+    std::vector<CScriptCheck> checks;
+    std::vector<CTxOut> spent;
+    {
+        LOCK(cs_main);
+        const CCoinsViewCache& view = *pcoinsTip;
+        for (const PersistedMempoolTx& entry : txs) {
+            const CTransaction& tx = *entry.tx;
+            if (tx.IsCoinBase()) continue;
+            spent.clear();
+            for (const CTxIn& txin : tx.vin) {
+                auto it = in_list.find(txin.prevout.hash);
+                if (it != in_list.end()) {
+                    if (txin.prevout.n >= it->second->vout.size()) break;
+                    spent.push_back(it->second->vout[txin.prevout.n]);
+                } else {
+                    const Coin& coin = view.AccessCoin(txin.prevout);
+                    if (coin.IsSpent()) break;
+                    spent.push_back(coin.out);
+                }
+            }
+            if (spent.size() != tx.vin.size()) continue;
+            txdata.emplace_back(tx);
+            for (unsigned int i = 0; i < tx.vin.size(); i++) {
+                checks.emplace_back(spent[i], tx, i, STANDARD_SCRIPT_VERIFY_FLAGS, true /* cacheStore */, &txdata.back());
+            }
+        }
+    }
+
+    int64_t start = GetTimeMicros();
+    CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+    control.Add(checks);
+    control.Wait();
+    LogPrint(BCLog::BENCH, "Pre-validated %u mempool transactions in %.2fms\n", txdata.size(), MILLI * (GetTimeMicros() - start));
+}
+
+bool LoadMempool(CTxMemPool& pool)
+{
+    const CChainParams& chainparams = Params();
+    int64_t nExpiryTimeout = gArgs.GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60;
+
+    std::vector<PersistedMempoolTx> txs;
+    std::map<uint256, CAmount> mapDeltas;
+    // A journal exists only while journaling is enabled and until mempool.dat
+    // is written without it (see DumpMempool), so it is at least as recent as
+    // mempool.dat, and is the only record of the mempool after an unclean
+    // shutdown.
+    const bool from_journal = g_mempool_journal && MempoolJournal::Read(GetDataDir() / MEMPOOL_JOURNAL_FILENAME, txs, mapDeltas);
+    if (!from_journal) {
+        txs.clear();
+        mapDeltas.clear();
+        if (!ReadMempoolDump(txs, mapDeltas)) {
+            return false;
+        }
+    }
+
+    int64_t count = 0;
+    int64_t expired = 0;
+    int64_t failed = 0;
+    int64_t already_there = 0;
+    int64_t nNow = GetTime();
+
+    PrevalidateMempoolTransactions(txs);
+
+    for (const PersistedMempoolTx& entry : txs) {
+        const CTransactionRef& tx = entry.tx;
+        CAmount amountdelta = entry.nFeeDelta;
+        if (amountdelta) {
+            pool.PrioritiseTransaction(tx->GetHash(), amountdelta);
+        }
+        CValidationState state;
+        if (entry.nTime + nExpiryTimeout > nNow) {
+            LOCK(cs_main);
+            AcceptToMemoryPoolWithTime(chainparams, pool, state, tx, nullptr /* pfMissingInputs */, entry.nTime,
+                nullptr /* plTxnReplaced */, false /* bypass_limits */, 0 /* nAbsurdFee */,
+                false /* test_accept */);
+            if (state.IsValid()) {
+                ++count;
+            } else {
+                // mempool may contain the transaction already, e.g. from
+                // wallet(s) having loaded it while we were processing
+                // mempool transactions; consider these as valid, instead of
+                // failed, but mark them as 'already there'
+                if (pool.exists(tx->GetHash())) {
+                    ++already_there;
+                } else {
+                    ++failed;
+                }
+            }
+        } else {
+            ++expired;
+        }
+        if (ShutdownRequested())
+            return false;
+    }
 
-    LogPrintf("Imported mempool transactions from disk: %i succeeded, %i failed, %i expired, %i already there\n", count, failed, expired, already_there);
+    for (const auto& i : mapDeltas) {
+        pool.PrioritiseTransaction(i.first, i.second);
+    }
+
+    LogPrintf("Imported mempool transactions from %s: %i succeeded, %i failed, %i expired, %i already there\n", from_journal ? MEMPOOL_JOURNAL_FILENAME : "mempool.dat", count, failed, expired, already_there);
     return true;
 }
 
@@ -4742,6 +5052,13 @@ bool DumpMempool(const CTxMemPool& pool)
             throw std::runtime_error("FileCommit failed");
         file.fclose();
         RenameOver(GetDataDir() / "mempool.dat.new", GetDataDir() / "mempool.dat");
+        if (g_mempool_journal) {
+            g_mempool_journal->Flush();
+        } else {
+            // A journal that is not kept up to date is now older than
+            // mempool.dat, and must not be loaded in its place.
+            fs::remove(GetDataDir() / MEMPOOL_JOURNAL_FILENAME);
+        }
         int64_t last = GetTimeMicros();
         LogPrintf("Dumped mempool: %gs to copy, %gs to dump\n", (mid - start) * MICRO, (last - mid) * MICRO);
     } catch (const std::exception& e) {
@@ -4781,9 +5098,6 @@ public:
     ~CMainCleanup()
     {
         // block headers
-        BlockMap::iterator it1 = mapBlockIndex.begin();
-        for (; it1 != mapBlockIndex.end(); it1++)
-            delete (*it1).second;
         mapBlockIndex.clear();
     }
 };
@@ -9,10 +9,13 @@
 #include <vector>
 
 #include <consensus/validation.h>
+#include <index/blockfilterindex.h>
 #include <interfaces/chain.h>
 #include <policy/policy.h>
 #include <rpc/server.h>
+#include <script/interpreter.h>
 #include <test/setup_common.h>
+#include <util/time.h>
 #include <validation.h>
 #include <wallet/coincontrol.h>
 #include <wallet/test/wallet_test_fixture.h>
@@ -46,7 +49,7 @@ BOOST_FIXTURE_TEST_CASE(scan_for_wallet_transactions, TestChain100Setup)
 
     // Verify ScanForWalletTransactions accommodates a null start block.
     {
-        CWallet wallet(chain.get(), WalletLocation(), WalletDatabase::CreateDummy());
+        CWallet wallet(chain.get(), WalletLocation(), WalletDatabase::CreateDummy(), 0);
         AddKey(wallet, coinbaseKey);
         WalletRescanReserver reserver(&wallet);
         reserver.reserve();
@@ -61,7 +64,7 @@ BOOST_FIXTURE_TEST_CASE(scan_for_wallet_transactions, TestChain100Setup)
     // Verify ScanForWalletTransactions picks up transactions in both the old
     // and new block files.
     {
-        CWallet wallet(chain.get(), WalletLocation(), WalletDatabase::CreateDummy());
+        CWallet wallet(chain.get(), WalletLocation(), WalletDatabase::CreateDummy(), 0);
         AddKey(wallet, coinbaseKey);
         WalletRescanReserver reserver(&wallet);
         reserver.reserve();
@@ -80,7 +83,7 @@ BOOST_FIXTURE_TEST_CASE(scan_for_wallet_transactions, TestChain100Setup)
     // Verify ScanForWalletTransactions only picks transactions in the new block
     // file.
     {
-        CWallet wallet(chain.get(), WalletLocation(), WalletDatabase::CreateDummy());
+        CWallet wallet(chain.get(), WalletLocation(), WalletDatabase::CreateDummy(), 0);
         AddKey(wallet, coinbaseKey);
         WalletRescanReserver reserver(&wallet);
         reserver.reserve();
@@ -98,7 +101,7 @@ BOOST_FIXTURE_TEST_CASE(scan_for_wallet_transactions, TestChain100Setup)
 
     // Verify ScanForWalletTransactions scans no blocks.
     {
-        CWallet wallet(chain.get(), WalletLocation(), WalletDatabase::CreateDummy());
+        CWallet wallet(chain.get(), WalletLocation(), WalletDatabase::CreateDummy(), 0);
         AddKey(wallet, coinbaseKey);
         WalletRescanReserver reserver(&wallet);
         reserver.reserve();
@@ -131,7 +134,7 @@ BOOST_FIXTURE_TEST_CASE(importmulti_rescan, TestChain100Setup)
     // before the missing block, and success for a key whose creation time is
     // after.
     {
-        std::shared_ptr<CWallet> wallet = std::make_shared<CWallet>(chain.get(), WalletLocation(), WalletDatabase::CreateDummy());
+        std::shared_ptr<CWallet> wallet = std::make_shared<CWallet>(chain.get(), WalletLocation(), WalletDatabase::CreateDummy(), 0);
         AddWallet(wallet);
         UniValue keys;
         keys.setArray();
@@ -194,7 +197,7 @@ BOOST_FIXTURE_TEST_CASE(importwallet_rescan, TestChain100Setup)
 
     // Import key into wallet and call dumpwallet to create backup file.
     {
-        std::shared_ptr<CWallet> wallet = std::make_shared<CWallet>(chain.get(), WalletLocation(), WalletDatabase::CreateDummy());
+        std::shared_ptr<CWallet> wallet = std::make_shared<CWallet>(chain.get(), WalletLocation(), WalletDatabase::CreateDummy(), 0);
         LOCK(wallet->cs_wallet);
         wallet->mapKeyMetadata[coinbaseKey.GetPubKey().GetID()].nCreateTime = KEY_TIME;
         wallet->AddKeyPubKey(coinbaseKey, coinbaseKey.GetPubKey());
@@ -210,7 +213,7 @@ BOOST_FIXTURE_TEST_CASE(importwallet_rescan, TestChain100Setup)
     // Call importwallet RPC and verify all blocks with timestamps >= BLOCK_TIME
     // were scanned, and no prior blocks were scanned.
     {
-        std::shared_ptr<CWallet> wallet = std::make_shared<CWallet>(chain.get(), WalletLocation(), WalletDatabase::CreateDummy());
+        std::shared_ptr<CWallet> wallet = std::make_shared<CWallet>(chain.get(), WalletLocation(), WalletDatabase::CreateDummy(), 0);
 
         JSONRPCRequest request;
         request.params.setArray();
@@ -232,6 +235,149 @@ BOOST_FIXTURE_TEST_CASE(importwallet_rescan, TestChain100Setup)
     SetMockTime(0);
 }
 
+// Check that rescans look for the scripts of keys and watch-only scripts in
+// block filters.
+BOOST_AUTO_TEST_CASE(scan_filter_elements)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    AddKey(m_wallet, key);
+    CKey watch_key;
+    watch_key.MakeNewKey(true);
+    const CScript watch_script = GetScriptForDestination(PKHash(watch_key.GetPubKey()));
+    {
+        LOCK(m_wallet.cs_wallet);
+        BOOST_CHECK(m_wallet.AddWatchOnly(watch_script, 0 /* nCreateTime */));
+    }
+
+    GCSFilter::ElementSet elements;
+    BOOST_CHECK(m_wallet.GetScanFilterElements(elements));
+    const auto has_script = [&elements](const CScript& script) {
+        return elements.count(GCSFilter::Element(script.begin(), script.end())) > 0;
+    };
+    const CScript p2wpkh = GetScriptForDestination(WitnessV0KeyHash(key.GetPubKey().GetID()));
+    BOOST_CHECK(has_script(GetScriptForRawPubKey(key.GetPubKey())));
+    BOOST_CHECK(has_script(GetScriptForDestination(PKHash(key.GetPubKey()))));
+    BOOST_CHECK(has_script(p2wpkh));
+    BOOST_CHECK(has_script(GetScriptForDestination(ScriptHash(p2wpkh))));
+    BOOST_CHECK(has_script(watch_script));
+    BOOST_CHECK(has_script(GetScriptForDestination(ScriptHash(watch_script))));
+
+    CKey other_key;
+    other_key.MakeNewKey(true);
+    BOOST_CHECK(!has_script(GetScriptForDestination(PKHash(other_key.GetPubKey()))));
+
+    // Bare multisig outputs are only ours if watched, and then held as they
+    // are, also when the 1-of-1 probe of the wallet's first key is watched.
+    const CScript bare_multisig = GetScriptForMultisig(2, {key.GetPubKey(), watch_key.GetPubKey(), other_key.GetPubKey()});
+    {
+        LOCK(m_wallet.cs_wallet);
+        BOOST_CHECK(m_wallet.AddWatchOnly(bare_multisig, 0 /* nCreateTime */));
+        BOOST_CHECK(m_wallet.AddWatchOnly(GetScriptForMultisig(1, {key.GetPubKey()}), 0 /* nCreateTime */));
+    }
+    elements.clear();
+    BOOST_CHECK(m_wallet.GetScanFilterElements(elements));
+    BOOST_CHECK(has_script(bare_multisig));
+    BOOST_CHECK(!has_script(GetScriptForMultisig(1, {key.GetPubKey(), other_key.GetPubKey()})));
+
+    // Block filters do not hold OP_RETURN and empty output scripts, so a
+    // wallet watching them cannot skip blocks.
+    for (const CScript& script : {CScript() << OP_RETURN << std::vector<unsigned char>(4, 1), CScript()}) {
+        auto chain = interfaces::MakeChain();
+        CWallet wallet(chain.get(), WalletLocation(), WalletDatabase::CreateMock(), 0);
+        AddKey(wallet, key);
+        {
+            LOCK(wallet.cs_wallet);
+            BOOST_CHECK(wallet.AddWatchOnly(script, 0 /* nCreateTime */));
+        }
+        elements.clear();
+        BOOST_CHECK(!wallet.GetScanFilterElements(elements));
+    }
+}
+
+// Check that a rescan skipping blocks by their filters finds the same
+// transactions as one reading every block, including payments to watch-only
+// scripts that block filters do not hold.
+BOOST_FIXTURE_TEST_CASE(scan_filtered_rescan, TestChain100Setup)
+{
+    const CScript coinbase_script = GetScriptForRawPubKey(coinbaseKey.GetPubKey());
+    CTransactionRef prev_tx = IssueMainCoins();
+
+    CKey key;
+    key.MakeNewKey(true);
+    const std::vector<CScript> watch_scripts{CScript() << OP_RETURN << std::vector<unsigned char>(4, 1), CScript()};
+
+    // Pay the wallet's key, then each watch-only script from coins the wallet
+    // does not own, with blocks that do not involve the wallet in between.
+    std::vector<CScript> payments{GetScriptForDestination(PKHash(key.GetPubKey()))};
+    payments.insert(payments.end(), watch_scripts.begin(), watch_scripts.end());
+    std::vector<uint256> wallet_txs;
+    for (const CScript& payment : payments) {
+        CMutableTransaction tx;
+        tx.nVersion = 1;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(prev_tx->GetHash(), 0);
+        tx.vout.resize(2);
+        tx.vout[0].nValue = prev_tx->vout[0].nValue - 2 * COIN;
+        tx.vout[0].scriptPubKey = coinbase_script;
+        tx.vout[1].nValue = payment.empty() || payment[0] != OP_RETURN ? COIN : 0;
+        tx.vout[1].scriptPubKey = payment;
+        std::vector<unsigned char> sig;
+        uint256 hash = SignatureHash(coinbase_script, tx, 0, SIGHASH_ALL, 0, SigVersion::BASE);
+        BOOST_REQUIRE(coinbaseKey.Sign(hash, sig));
+        sig.push_back((unsigned char)SIGHASH_ALL);
+        tx.vin[0].scriptSig = CScript() << sig;
+        CreateAndProcessBlock({tx}, coinbase_script);
+        CreateAndProcessBlock({}, coinbase_script);
+        prev_tx = MakeTransactionRef(tx);
+        wallet_txs.push_back(tx.GetHash());
+    }
+
+    auto chain = interfaces::MakeChain();
+    const auto scan = [&chain, &key, &watch_scripts]() {
+        CWallet wallet(chain.get(), WalletLocation(), WalletDatabase::CreateMock(), 0);
+        AddKey(wallet, key);
+        {
+            LOCK(wallet.cs_wallet);
+            for (const CScript& script : watch_scripts) {
+                BOOST_CHECK(wallet.AddWatchOnly(script, 0 /* nCreateTime */));
+            }
+        }
+        WalletRescanReserver reserver(&wallet);
+        reserver.reserve();
+        const uint256 genesis_hash = WITH_LOCK(cs_main, return ::ChainActive().Genesis()->GetBlockHash());
+        CWallet::ScanResult result = wallet.ScanForWalletTransactions(genesis_hash, {} /* stop_block */, reserver, false /* update */);
+        BOOST_CHECK_EQUAL(result.status, CWallet::ScanResult::SUCCESS);
+        LOCK(wallet.cs_wallet);
+        std::set<uint256> txs;
+        for (const auto& entry : wallet.mapWallet) {
+            txs.insert(entry.first);
+        }
+        return txs;
+    };
+
+    // Without the block filter index every block is read.
+    const std::set<uint256> full_scan_txs = scan();
+    for (const uint256& txid : wallet_txs) {
+        BOOST_CHECK(full_scan_txs.count(txid));
+    }
+
+    BOOST_REQUIRE(InitBlockFilterIndex(BlockFilterType::BASIC, 1 << 20, true, false));
+    BlockFilterIndex* filter_index = GetBlockFilterIndex(BlockFilterType::BASIC);
+    filter_index->Start();
+    constexpr int64_t timeout_ms = 10 * 1000;
+    int64_t time_start = GetTimeMillis();
+    while (!filter_index->BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        MilliSleep(100);
+    }
+
+    BOOST_CHECK(scan() == full_scan_txs);
+
+    filter_index->Stop();
+    DestroyAllBlockFilterIndexes();
+}
+
 // Check that GetImmatureCredit() returns a newly calculated value instead of
 // the cached value after a MarkDirty() call.
 //
@@ -242,7 +388,7 @@ BOOST_FIXTURE_TEST_CASE(coin_mark_dirty_immature_credit, TestChain100Setup)
 {
     auto chain = interfaces::MakeChain();
 
-    CWallet wallet(chain.get(), WalletLocation(), WalletDatabase::CreateDummy());
+    CWallet wallet(chain.get(), WalletLocation(), WalletDatabase::CreateDummy(), 0);
     CWalletTx wtx(&wallet, m_coinbase_txns.back());
 
     auto locked_chain = chain->lock();
@@ -254,13 +400,13 @@ BOOST_FIXTURE_TEST_CASE(coin_mark_dirty_immature_credit, TestChain100Setup)
 
     // Call GetImmatureCredit() once before adding the key to the wallet to
     // cache the current immature credit amount, which is 0.
-    BOOST_CHECK_EQUAL(wtx.GetImmatureCredit(*locked_chain), 0);
+    BOOST_CHECK_EQUAL(wtx.GetImmatureCredit(*locked_chain, &wallet), 0);
 
     // Invalidate the cached value, add the key, and make sure a new immature
     // credit amount is calculated.
     wtx.MarkDirty();
     wallet.AddKeyPubKey(coinbaseKey, coinbaseKey.GetPubKey());
-    BOOST_CHECK_EQUAL(wtx.GetImmatureCredit(*locked_chain), 50*COIN);
+    BOOST_CHECK_EQUAL(wtx.GetImmatureCredit(*locked_chain, &wallet), 50*COIN);
 }
 
 static int64_t AddTx(CWallet& wallet, uint32_t lockTime, int64_t mockTime, int64_t blockTime)
@@ -272,12 +418,10 @@ static int64_t AddTx(CWallet& wallet, uint32_t lockTime, int64_t mockTime, int64
     if (blockTime > 0) {
         auto locked_chain = wallet.chain().lock();
         LockAssertion lock(::cs_main);
-        auto inserted = mapBlockIndex.emplace(GetRandHash(), new CBlockIndex);
+        auto inserted = mapBlockIndex.emplace_index(GetRandHash());
         assert(inserted.second);
-        const uint256& hash = inserted.first->first;
         block = inserted.first->second;
         block->nTime = blockTime;
-        block->phashBlock = &hash;
     }
 
     CWalletTx wtx(&wallet, MakeTransactionRef(tx));
@@ -340,7 +484,7 @@ public:
     ListCoinsTestingSetup()
     {
         CreateAndProcessBlock({}, GetScriptForRawPubKey(coinbaseKey.GetPubKey()));
-        wallet = MakeUnique<CWallet>(m_chain.get(), WalletLocation(), WalletDatabase::CreateMock());
+        wallet = MakeUnique<CWallet>(m_chain.get(), WalletLocation(), WalletDatabase::CreateMock(), 0);
         bool firstRun;
         wallet->LoadWallet(firstRun);
         AddKey(*wallet, coinbaseKey);
@@ -460,7 +604,7 @@ BOOST_FIXTURE_TEST_CASE(ListCoins, ListCoinsTestingSetup)
 BOOST_FIXTURE_TEST_CASE(wallet_disableprivkeys, TestChain100Setup)
 {
     auto chain = interfaces::MakeChain();
-    std::shared_ptr<CWallet> wallet = std::make_shared<CWallet>(chain.get(), WalletLocation(), WalletDatabase::CreateDummy());
+    std::shared_ptr<CWallet> wallet = std::make_shared<CWallet>(chain.get(), WalletLocation(), WalletDatabase::CreateDummy(), 0);
     wallet->SetMinVersion(FEATURE_LATEST);
     wallet->SetWalletFlag(WALLET_FLAG_DISABLE_PRIVATE_KEYS);
     BOOST_CHECK(!wallet->TopUpKeyPool(1000));
@@ -47,6 +47,9 @@ const std::map<uint64_t, std::string> WALLET_FLAG_CAVEATS{
 
 static const size_t OUTPUT_GROUP_MAX_ENTRIES = 10;
 
+//! Number of block filters a rescan matches at once
+static const int SCAN_FILTER_BATCH_SIZE = 1000;
+
 static CCriticalSection cs_wallets;
 static std::vector<std::shared_ptr<CWallet>> vpwallets GUARDED_BY(cs_wallets);
 
@@ -2294,11 +2297,108 @@ int64_t CWallet::RescanFromTime(int64_t startTime, const WalletRescanReserver& r
     return startTime;
 }
 
+/**
+ * Number of keys and scripts of the scanning wallet and of the main and asset
+ * wallets, which changes when any of them gets a new key or script.
+ */
+static size_t CountScanFilterKeys(const CWallet& scanning_wallet)
+{
+    size_t count = WITH_LOCK(scanning_wallet.cs_wallet, return scanning_wallet.mapKeyMetadata.size() + scanning_wallet.m_script_metadata.size());
+    for (const std::shared_ptr<CWallet>& wallet : GetAssetWallets()) {
+        LOCK(wallet->cs_wallet);
+        count += wallet->mapKeyMetadata.size() + wallet->m_script_metadata.size();
+    }
+    return count;
+}
+
+/**
+ * Add the scan filter elements of the scanning wallet and of the main and
+ * asset wallets. Returns false if any of them cannot be scanned by filter.
+ */
+static bool GetAllScanFilterElements(const CWallet& scanning_wallet, GCSFilter::ElementSet& elements)
+{
+    bool filterable = scanning_wallet.GetScanFilterElements(elements);
+    for (const std::shared_ptr<CWallet>& wallet : GetAssetWallets()) {
+        filterable = wallet->GetScanFilterElements(elements) && filterable;
+    }
+    return filterable;
+}
+
+bool CWallet::GetScanFilterElements(GCSFilter::ElementSet& elements) const
+{
+    bool filterable = true;
+    const auto add_script = [&elements](const CScript& script) {
+        elements.emplace(script.begin(), script.end());
+    };
+    const auto add_pubkey = [&add_script](const CPubKey& pubkey) {
+        add_script(GetScriptForRawPubKey(pubkey));
+        add_script(GetScriptForDestination(PKHash(pubkey)));
+        if (pubkey.IsCompressed()) {
+            const CScript witness_script = GetScriptForDestination(WitnessV0KeyHash(pubkey.GetID()));
+            add_script(witness_script);
+            add_script(GetScriptForDestination(ScriptHash(witness_script)));
+        }
+    };
+    const auto add_redeem_script = [&add_script](const CScript& script) {
+        add_script(script);
+        add_script(GetScriptForDestination(ScriptHash(script)));
+        const CScript witness_script = GetScriptForDestination(WitnessV0ScriptHash(script));
+        add_script(witness_script);
+        add_script(GetScriptForDestination(ScriptHash(witness_script)));
+    };
+
+    const std::set<CKeyID> keys = GetKeys();
+    for (const CKeyID& keyid : keys) {
+        CPubKey pubkey;
+        if (GetPubKey(keyid, pubkey)) {
+            add_pubkey(pubkey);
+        }
+    }
+    for (const CScriptID& scriptid : GetCScripts()) {
+        CScript script;
+        if (GetCScript(scriptid, script)) {
+            add_redeem_script(script);
+        }
+    }
+    {
+        LOCK(cs_KeyStore);
+        // Watched scripts, including bare multisig scripts of any m-of-n, are
+        // held by the filters of the blocks paying to them as they are.
+        for (const CScript& script : setWatchOnly) {
+            // Block filters leave out empty and OP_RETURN output scripts.
+            if (script.empty() || script[0] == OP_RETURN) {
+                filterable = false;
+            }
+            add_redeem_script(script);
+        }
+        for (const auto& entry : mapWatchKeys) {
+            add_pubkey(entry.second);
+        }
+    }
+
+    // IsMine takes bare multisig outputs as ours only if they are watched.
+    // If it also took those of the wallet's keys, their combinations could
+    // not be listed, so every block would have to be read. Probe a script
+    // that is not watched, so that watching it does not hide the rule.
+    CPubKey pubkey;
+    if (!keys.empty() && GetPubKey(*keys.begin(), pubkey)) {
+        const CScript multisig = GetScriptForMultisig(1, {pubkey});
+        if (!HaveWatchOnly(multisig) && ::IsMine(*this, multisig) != ISMINE_NO) {
+            filterable = false;
+        }
+    }
+    return filterable;
+}
+
 /**
  * Scan the block chain (starting in start_block) for transactions
  * from or to us. If fUpdate is true, found transactions that already
  * exist in the wallet will be updated.
  *
+ * If the basic block filter index is enabled, blocks whose filters show that
+ * they do not pay to or spend from the keys and scripts of the wallets are
+ * not read.
+ *
  * @param[in] start_block Scan starting block. If block is not on the active
  *                        chain, the scan will return SUCCESS immediately.
  * @param[in] stop_block  Scan ending block. If block is not on the active
@@ -2344,6 +2444,17 @@ CWallet::ScanResult CWallet::ScanForWalletTransactions(const uint256& start_bloc
         progress_end = chain().guessVerificationProgress(stop_block.IsNull() ? tip_hash : stop_block);
     }
     double progress_current = progress_begin;
+
+    // With -blockfilterindex, only the blocks whose filters match the scripts
+    // of this wallet and of the main and asset wallets are read. Wallets
+    // without any keys or scripts, or with scripts that block filters do not
+    // hold, read every block, as before.
+    GCSFilter::ElementSet filter_elements;
+    bool use_filters = GetAllScanFilterElements(*this, filter_elements) && !filter_elements.empty();
+    size_t filter_keys = CountScanFilterKeys(*this);
+    int filter_start = 0;
+    std::vector<std::pair<uint256, bool>> filter_matches;
+
     while (block_height && !fAbortRescan && !chain().shutdownRequested()) {
         m_scanning_progress = (progress_current - progress_begin) / (progress_end - progress_begin);
         if (*block_height % 100 == 0 && progress_end - progress_begin > 0.0) {
@@ -2354,8 +2465,44 @@ CWallet::ScanResult CWallet::ScanForWalletTransactions(const uint256& start_bloc
             WalletLogPrintf("Still rescanning. At block %d. Progress=%f\n", *block_height, progress_current);
         }
 
+        bool skip_block = false;
+        if (use_filters) {
+            const size_t scan_keys = CountScanFilterKeys(*this);
+            if (scan_keys != filter_keys) {
+                // Keys were added, e.g. when the scan topped up the keypool,
+                // so match the filters again with the new set.
+                filter_keys = scan_keys;
+                filter_elements.clear();
+                use_filters = GetAllScanFilterElements(*this, filter_elements);
+                filter_matches.clear();
+            }
+        }
+        if (use_filters) {
+            if (*block_height < filter_start || *block_height >= filter_start + (int)filter_matches.size()) {
+                Optional<int> stop_height;
+                {
+                    auto locked_chain = chain().lock();
+                    if (!stop_block.IsNull()) stop_height = locked_chain->getBlockHeight(stop_block);
+                    if (!stop_height) stop_height = locked_chain->getHeight();
+                }
+                filter_start = *block_height;
+                const int filter_stop = std::max(filter_start, std::min(filter_start + SCAN_FILTER_BATCH_SIZE - 1, stop_height.get_value_or(filter_start)));
+                if (!chain().findBlockFilterMatches(filter_start, filter_stop, filter_elements, filter_matches)) {
+                    // The filters are not available (yet), read the blocks
+                    // of this batch.
+                    filter_matches.assign(filter_stop - filter_start + 1, std::make_pair(uint256(), true));
+                }
+            }
+            const std::pair<uint256, bool>& match = filter_matches[*block_height - filter_start];
+            skip_block = match.first == block_hash && !match.second;
+        }
+
         CBlock block;
-        if (chain().findBlock(block_hash, &block) && !block.IsNull()) {
+        if (skip_block) {
+            // The filter of the block shows it does not involve the wallet.
+            result.last_scanned_block = block_hash;
+            result.last_scanned_height = *block_height;
+        } else if (chain().findBlock(block_hash, &block) && !block.IsNull()) {
             auto locked_chain = chain().lock();
             LOCK(cs_wallet);
             if (!locked_chain->getBlockHeight(block_hash)) {
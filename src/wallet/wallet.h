@@ -1183,6 +1183,11 @@ public:
         uint256 last_failed_block;
     };
     ScanResult ScanForWalletTransactions(const uint256& first_block, const uint256& last_block, const WalletRescanReserver& reserver, bool fUpdate);
+    //! Add the scriptPubKeys of the keys, scripts and watch-only scripts of
+    //! this wallet, which the block filter of a block involving the wallet holds.
+    //! Returns false if the wallet has scripts that block filters do not hold,
+    //! so that a rescan must read every block.
+    bool GetScanFilterElements(GCSFilter::ElementSet& elements) const;
     void TransactionRemovedFromMempool(const CTransactionRef& ptx) override;
     void ReacceptWalletTransactions(interfaces::Chain::Lock& locked_chain) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
     void ResendWalletTransactions();